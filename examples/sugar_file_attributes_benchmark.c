@@ -0,0 +1,149 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <sugar-ext.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <gio/gio.h>
+
+/*
+ * Compares the thread pool and io_uring paths of the directory loader
+ * and the write queue on a Journal-like directory:
+ *
+ *   sugar_file_attributes_benchmark [DIRECTORY] [N_ENTRIES]
+ *
+ * The entries are created in a fresh subdirectory of DIRECTORY, the
+ * temporary directory by default, so point it at a tmpfs or an ext4
+ * image mount to compare file systems. Every figure is the best of a
+ * few rounds with a warm cache.
+ */
+#define DEFAULT_ENTRIES 10000
+#define ROUNDS 5
+
+typedef struct {
+    GMainLoop *loop;
+    guint n_loaded;
+} LoadContext;
+
+static void on_batch(const gchar * const *names, SugarFileAttributes * const *attributes,
+                     guint n_entries, gpointer user_data) {
+    LoadContext *context = user_data;
+    context->n_loaded += n_entries;
+}
+
+static void on_loaded(GObject *source, GAsyncResult *result, gpointer user_data) {
+    LoadContext *context = user_data;
+    GError *error = NULL;
+
+    if (!sugar_file_attributes_load_directory_finish(result, &error)) {
+        printf("Loading failed: %s\n", error->message);
+        g_error_free(error);
+    }
+    g_main_loop_quit(context->loop);
+}
+
+static gdouble time_load(GFile *directory, guint n_entries) {
+    gdouble best = G_MAXDOUBLE;
+
+    for (guint round = 0; round < ROUNDS; round++) {
+        LoadContext context = { g_main_loop_new(NULL, FALSE), 0 };
+        gint64 start = g_get_monotonic_time();
+
+        sugar_file_attributes_load_directory_async(directory, on_batch, &context, NULL, on_loaded, &context);
+        g_main_loop_run(context.loop);
+        best = MIN(best, (g_get_monotonic_time() - start) / (gdouble) G_USEC_PER_SEC);
+
+        if (context.n_loaded != n_entries)
+            printf("Loaded %u of %u entries\n", context.n_loaded, n_entries);
+        g_main_loop_unref(context.loop);
+    }
+
+    return best;
+}
+
+static gdouble time_flush(GPtrArray *files) {
+    gdouble best = G_MAXDOUBLE;
+
+    sugar_file_attributes_set_write_delay(60000);
+
+    for (guint round = 0; round < ROUNDS; round++) {
+        gint64 start;
+
+        // Queuing only records the values, the flush does the writing
+        for (guint i = 0; i < files->len; i++) {
+            gchar *title = g_strdup_printf("Entry %u, round %u", i, round);
+            sugar_file_attributes_set_title(g_ptr_array_index(files, i), title);
+            g_free(title);
+        }
+
+        start = g_get_monotonic_time();
+        if (!sugar_file_attributes_flush(NULL))
+            printf("Some queued writes failed\n");
+        best = MIN(best, (g_get_monotonic_time() - start) / (gdouble) G_USEC_PER_SEC);
+    }
+
+    sugar_file_attributes_set_write_delay(0);
+    return best;
+}
+
+int main(int argc, char *argv[]) {
+    const gchar *parent = argc > 1 ? argv[1] : g_get_tmp_dir();
+    guint n_entries = argc > 2 ? (guint) strtoul(argv[2], NULL, 10) : DEFAULT_ENTRIES;
+    gchar *template = g_build_filename(parent, "sugar-benchmark-XXXXXX", NULL);
+    GPtrArray *files = g_ptr_array_new_with_free_func(g_object_unref);
+    GFile *directory;
+
+    if (!g_mkdtemp(template)) {
+        printf("Could not create a directory in %s\n", parent);
+        g_free(template);
+        return 1;
+    }
+
+    printf("Sugar File Attributes Benchmark\n");
+    printf("===============================\n");
+    printf("Creating %u entries in %s...\n", n_entries, template);
+
+    for (guint i = 0; i < n_entries; i++) {
+        gchar *name = g_strdup_printf("entry-%06u", i);
+        gchar *path = g_build_filename(template, name, NULL);
+        GFile *file = g_file_new_for_path(path);
+        SugarFileAttributes *attrs = sugar_file_attributes_new();
+
+        g_file_set_contents(path, "", 0, NULL);
+        sugar_file_attributes_set_string(attrs, SUGAR_FILE_ATTRIBUTE_TITLE, name);
+        sugar_file_attributes_set_string(attrs, SUGAR_FILE_ATTRIBUTE_ACTIVITY, "org.laptop.WriteActivity");
+        sugar_file_attributes_set_string(attrs, SUGAR_FILE_ATTRIBUTE_TAGS, "benchmark,journal");
+        sugar_file_attributes_save_to_file(attrs, file, NULL);
+
+        g_ptr_array_add(files, file);
+        sugar_file_attributes_free(attrs);
+        g_free(path);
+        g_free(name);
+    }
+
+    directory = g_file_new_for_path(template);
+
+    sugar_file_attributes_set_io_uring(TRUE);
+    if (!sugar_file_attributes_get_io_uring())
+        printf("io_uring is not available, both rows use the thread pool.\n");
+
+    printf("\n%-12s %14s %14s\n", "Backend", "Load (ent/s)", "Flush (ent/s)");
+    for (guint use_io_uring = 0; use_io_uring < 2; use_io_uring++) {
+        gdouble load;
+        gdouble flush;
+
+        sugar_file_attributes_set_io_uring(use_io_uring);
+        load = time_load(directory, n_entries);
+        flush = time_flush(files);
+        printf("%-12s %14.0f %14.0f\n", use_io_uring ? "io_uring" : "thread pool",
+               n_entries / load, n_entries / flush);
+    }
+
+    for (guint i = 0; i < files->len; i++)
+        g_file_delete(g_ptr_array_index(files, i), NULL, NULL);
+    g_file_delete(directory, NULL, NULL);
+
+    g_object_unref(directory);
+    g_ptr_array_unref(files);
+    g_free(template);
+    return 0;
+}
@@ -0,0 +1,624 @@
+/*
+ * Copyright (C) 2025 MostlyK
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include "sugar-attribute-index.h"
+#include "sugar-file-attributes-private.h"
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+/*
+ * The index file is a local cache in native byte order:
+ *
+ *   IndexHeader | IndexRecord[n_records] | guint32 buckets[n_buckets] | heap
+ *
+ * Records have a fixed size and refer to NUL-terminated strings in the
+ * heap by offset, 0 meaning NULL. Buckets hold record number + 1 of the
+ * first record whose (device, inode) hashes there, and records chain on
+ * through @next. Opening only maps the file and checks the header, so
+ * listing the Journal costs no per-file system calls.
+ *
+ * Updates stat every file and reuse records whose ctime is unchanged;
+ * as in the attribute cache, records whose ctime was within one
+ * timestamp tick of the previous scan are read again. Sidecar saves
+ * leave the file's ctime alone, so every entry of a directory whose
+ * sidecar changed since the previous scan is read again as well.
+ * Directories with a blob store and a changed entry get their unused
+ * blobs swept.
+ */
+#define INDEX_MAGIC "SGAIDX01"
+#define TIMESTAMP_GRANULARITY_USEC 10000
+
+typedef struct {
+    gchar magic[8];
+    guint32 n_records;
+    guint32 n_buckets;
+    guint32 heap_size;
+    guint32 reserved;
+    gint64 scanned_at;
+} IndexHeader;
+
+typedef struct {
+    guint64 device;
+    guint64 inode;
+    gint64 ctime_sec;
+    gint64 ctime_nsec;
+    gint64 creation_time;
+    gint64 modification_time;
+    guint32 path;
+    guint32 title;
+    guint32 description;
+    guint32 tags;
+    guint32 activity;
+    guint32 preview_path;
+    guint32 next;
+    guint32 unloaded;
+} IndexRecord;
+
+struct _SugarAttributeIndex {
+    GObject parent_instance;
+
+    gchar *filename;
+    GMappedFile *mapped;
+    const IndexHeader *header;
+    const IndexRecord *records;
+    const guint32 *buckets;
+    const gchar *heap;
+};
+
+struct _SugarAttributeIndexClass {
+    GObjectClass parent_class;
+};
+
+G_DEFINE_TYPE(SugarAttributeIndex, sugar_attribute_index, G_TYPE_OBJECT)
+
+typedef struct {
+    struct stat st;
+    gchar *path;
+    SugarFileAttributes *attrs;
+} ScanEntry;
+
+typedef struct {
+    SugarAttributeIndex *index;
+    GArray *entries;
+    GByteArray *scratch;
+    gint64 scanned_at;
+    dev_t skip_device;
+    ino_t skip_inode;
+    gboolean changed;
+} ScanState;
+
+static guint32
+inode_hash(guint64 device, guint64 inode)
+{
+    guint64 value = inode ^ (device << 32);
+
+    return (guint32) (value ^ (value >> 32));
+}
+
+static const gchar*
+heap_string(SugarAttributeIndex *self, guint32 offset)
+{
+    if (offset == 0 || offset >= self->header->heap_size) return NULL;
+    return self->heap + offset;
+}
+
+static void
+unmap_index(SugarAttributeIndex *self)
+{
+    g_clear_pointer(&self->mapped, g_mapped_file_unref);
+    self->header = NULL;
+    self->records = NULL;
+    self->buckets = NULL;
+    self->heap = NULL;
+}
+
+static gboolean
+map_index(SugarAttributeIndex *self, GError **error)
+{
+    GError *local_error = NULL;
+    const IndexHeader *header;
+    const gchar *data;
+    guint64 expected;
+    gsize length;
+
+    unmap_index(self);
+
+    self->mapped = g_mapped_file_new(self->filename, FALSE, &local_error);
+    if (!self->mapped) {
+        // A missing index is an empty one
+        if (g_error_matches(local_error, G_FILE_ERROR, G_FILE_ERROR_NOENT)) {
+            g_error_free(local_error);
+            return TRUE;
+        }
+        g_propagate_error(error, local_error);
+        return FALSE;
+    }
+
+    data = g_mapped_file_get_contents(self->mapped);
+    length = g_mapped_file_get_length(self->mapped);
+    header = (const IndexHeader *) data;
+
+    // A damaged or foreign index is ignored and rewritten by the next update
+    if (length < sizeof(IndexHeader) || memcmp(header->magic, INDEX_MAGIC, sizeof(header->magic)) != 0)
+        goto invalid;
+
+    expected = sizeof(IndexHeader) + (guint64) header->n_records * sizeof(IndexRecord)
+               + (guint64) header->n_buckets * sizeof(guint32) + header->heap_size;
+    if (expected != length || header->heap_size == 0 || header->n_buckets == 0
+        || (header->n_buckets & (header->n_buckets - 1)) != 0)
+        goto invalid;
+
+    self->header = header;
+    self->records = (const IndexRecord *) (data + sizeof(IndexHeader));
+    self->buckets = (const guint32 *) (self->records + header->n_records);
+    self->heap = (const gchar *) (self->buckets + header->n_buckets);
+
+    // Every heap offset is then a terminated string
+    if (self->heap[header->heap_size - 1] != '\0')
+        goto invalid;
+
+    return TRUE;
+
+invalid:
+    unmap_index(self);
+    return TRUE;
+}
+
+static SugarFileAttributes*
+record_to_attributes(SugarAttributeIndex *self, const IndexRecord *record)
+{
+    SugarFileAttributes *attrs = sugar_file_attributes_new();
+
+    attrs->title = g_strdup(heap_string(self, record->title));
+    attrs->description = g_strdup(heap_string(self, record->description));
+    _sugar_file_attributes_assign_string(attrs, G_STRUCT_OFFSET(SugarFileAttributes, tags),
+                                         heap_string(self, record->tags));
+    _sugar_file_attributes_assign_string(attrs, G_STRUCT_OFFSET(SugarFileAttributes, activity),
+                                         heap_string(self, record->activity));
+    attrs->preview_path = g_strdup(heap_string(self, record->preview_path));
+    attrs->creation_time = record->creation_time;
+    attrs->modification_time = record->modification_time;
+    attrs->unloaded = record->unloaded;
+
+    return attrs;
+}
+
+// Whether @st changed since the previous scan, or too close to it to tell
+static gboolean
+changed_since_scan(SugarAttributeIndex *self, const struct stat *st)
+{
+    gint64 ctime_usec = (gint64) st->st_ctim.tv_sec * G_USEC_PER_SEC + st->st_ctim.tv_nsec / 1000;
+
+    return !self->header || self->header->scanned_at - ctime_usec < TIMESTAMP_GRANULARITY_USEC;
+}
+
+static gboolean
+record_is_current(SugarAttributeIndex *self, const IndexRecord *record, const struct stat *st)
+{
+    return record->ctime_sec == st->st_ctim.tv_sec
+           && record->ctime_nsec == st->st_ctim.tv_nsec
+           && !changed_since_scan(self, st);
+}
+
+/*
+ * Returns whether the attributes had to be read from the file, which
+ * @reread forces.
+ */
+static gboolean
+scan_file(ScanState *scan, gint dirfd, const gchar *name, gchar *path, const struct stat *st, gboolean reread)
+{
+    SugarAttributeIndex *self = scan->index;
+    ScanEntry entry = { *st, path, NULL };
+    gint position;
+
+    position = sugar_attribute_index_lookup(self, st->st_dev, st->st_ino);
+    if (!reread && position >= 0 && record_is_current(self, &self->records[position], st)) {
+        entry.attrs = record_to_attributes(self, &self->records[position]);
+        if (g_strcmp0(heap_string(self, self->records[position].path), path) != 0)
+            scan->changed = TRUE;
+    } else {
+        reread = TRUE;
+        entry.attrs = sugar_file_attributes_new();
+        if (!sugar_file_attributes_load_at_full(entry.attrs, dirfd, name, scan->scratch, NULL)) {
+            sugar_file_attributes_free(entry.attrs);
+            g_free(path);
+            return TRUE;
+        }
+        scan->changed = TRUE;
+    }
+
+    g_array_append_val(scan->entries, entry);
+    return reread;
+}
+
+static gboolean
+scan_directory(ScanState *scan, gint dirfd, const gchar *prefix, GError **error)
+{
+    struct dirent *entry;
+    struct stat st;
+    gboolean has_blobs = FALSE;
+    gboolean reread = FALSE;
+    gboolean sidecar_changed;
+    DIR *dir;
+    gint fd;
+
+    fd = dup(dirfd);
+    dir = fd >= 0 ? fdopendir(fd) : NULL;
+    if (!dir) {
+        int saved_errno = errno;
+        if (fd >= 0) close(fd);
+        g_set_error(error, G_IO_ERROR, g_io_error_from_errno(saved_errno),
+                   "Could not read directory: %s", g_strerror(saved_errno));
+        return FALSE;
+    }
+
+    // A sidecar save changes the sidecar, not the entry it is for
+    sidecar_changed = fstatat(dirfd, SUGAR_SIDECAR_NAME, &st, 0) == 0 &&
+                      changed_since_scan(scan->index, &st);
+
+    while ((entry = readdir(dir)) != NULL) {
+        gchar *path;
+
+        if (strcmp(entry->d_name, SUGAR_BLOBS_NAME) == 0)
+            has_blobs = TRUE;
+        if (entry->d_name[0] == '.')
+            continue;
+        if (fstatat(dirfd, entry->d_name, &st, 0) != 0)
+            continue;
+        if (st.st_dev == scan->skip_device && st.st_ino == scan->skip_inode)
+            continue;
+
+        path = prefix ? g_build_filename(prefix, entry->d_name, NULL) : g_strdup(entry->d_name);
+
+        if (S_ISREG(st.st_mode)) {
+            // Ownership of path moves to the scan entry
+            reread |= scan_file(scan, dirfd, entry->d_name, path, &st, sidecar_changed);
+            continue;
+        }
+
+        // Symbolic links to directories are not followed, to avoid loops
+        if (S_ISDIR(st.st_mode)) {
+            gint subdirfd = openat(dirfd, entry->d_name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+            if (subdirfd >= 0) {
+                scan_directory(scan, subdirfd, path, NULL);
+                close(subdirfd);
+            }
+        }
+        g_free(path);
+    }
+
+    closedir(dir);
+
+    // Blobs only fall out of use when a record changes
+    if (has_blobs && reread)
+        _sugar_file_attributes_blob_sweep(dirfd);
+
+    return TRUE;
+}
+
+static gint
+compare_scan_entries(gconstpointer a, gconstpointer b)
+{
+    return strcmp(((const ScanEntry *) a)->path, ((const ScanEntry *) b)->path);
+}
+
+static void
+clear_scan_entry(gpointer data)
+{
+    ScanEntry *entry = data;
+
+    g_free(entry->path);
+    sugar_file_attributes_free(entry->attrs);
+}
+
+static guint32
+heap_add(GByteArray *heap, GHashTable *offsets, const gchar *value)
+{
+    gpointer offset;
+
+    if (!value) return 0;
+
+    // Activities, tags and previews repeat across entries
+    if (g_hash_table_lookup_extended(offsets, value, NULL, &offset))
+        return GPOINTER_TO_UINT(offset);
+
+    offset = GUINT_TO_POINTER(heap->len);
+    g_byte_array_append(heap, (const guint8 *) value, strlen(value) + 1);
+    g_hash_table_insert(offsets, (gpointer) value, offset);
+    return GPOINTER_TO_UINT(offset);
+}
+
+static gboolean
+write_index(SugarAttributeIndex *self, GArray *entries, gint64 scanned_at, GError **error)
+{
+    IndexHeader header = { INDEX_MAGIC, 0, 1, 0, 0, scanned_at };
+    GHashTable *offsets = g_hash_table_new(g_str_hash, g_str_equal);
+    GByteArray *heap = g_byte_array_new();
+    IndexRecord *records;
+    guint32 *buckets;
+    GByteArray *out;
+    gboolean result;
+    guint i;
+
+    while (header.n_buckets < entries->len)
+        header.n_buckets <<= 1;
+    header.n_records = entries->len;
+
+    records = g_new0(IndexRecord, entries->len);
+    buckets = g_new0(guint32, header.n_buckets);
+
+    // Offset 0 is reserved for NULL
+    g_byte_array_append(heap, (const guint8 *) "", 1);
+
+    for (i = 0; i < entries->len; i++) {
+        ScanEntry *entry = &g_array_index(entries, ScanEntry, i);
+        IndexRecord *record = &records[i];
+        guint32 bucket;
+
+        record->device = entry->st.st_dev;
+        record->inode = entry->st.st_ino;
+        record->ctime_sec = entry->st.st_ctim.tv_sec;
+        record->ctime_nsec = entry->st.st_ctim.tv_nsec;
+        record->creation_time = entry->attrs->creation_time;
+        record->modification_time = entry->attrs->modification_time;
+        record->path = heap_add(heap, offsets, entry->path);
+        record->title = heap_add(heap, offsets, entry->attrs->title);
+        record->description = heap_add(heap, offsets, entry->attrs->description);
+        record->tags = heap_add(heap, offsets, entry->attrs->tags);
+        record->activity = heap_add(heap, offsets, entry->attrs->activity);
+        record->preview_path = heap_add(heap, offsets, entry->attrs->preview_path);
+        record->unloaded = entry->attrs->unloaded;
+
+        bucket = inode_hash(record->device, record->inode) & (header.n_buckets - 1);
+        record->next = buckets[bucket];
+        buckets[bucket] = i + 1;
+    }
+    header.heap_size = heap->len;
+
+    out = g_byte_array_sized_new(sizeof(header) + entries->len * sizeof(IndexRecord)
+                                 + header.n_buckets * sizeof(guint32) + heap->len);
+    g_byte_array_append(out, (const guint8 *) &header, sizeof(header));
+    g_byte_array_append(out, (const guint8 *) records, entries->len * sizeof(IndexRecord));
+    g_byte_array_append(out, (const guint8 *) buckets, header.n_buckets * sizeof(guint32));
+    g_byte_array_append(out, heap->data, heap->len);
+
+    // The old mapping stays valid; readers never see a partial file
+    result = g_file_set_contents(self->filename, (const gchar *) out->data, out->len, error);
+
+    g_byte_array_unref(out);
+    g_byte_array_unref(heap);
+    g_hash_table_unref(offsets);
+    g_free(buckets);
+    g_free(records);
+    return result;
+}
+
+static void
+sugar_attribute_index_finalize(GObject *object)
+{
+    SugarAttributeIndex *self = SUGAR_ATTRIBUTE_INDEX(object);
+
+    unmap_index(self);
+    g_free(self->filename);
+
+    G_OBJECT_CLASS(sugar_attribute_index_parent_class)->finalize(object);
+}
+
+static void
+sugar_attribute_index_class_init(SugarAttributeIndexClass *index_class)
+{
+    GObjectClass *gobject_class = G_OBJECT_CLASS(index_class);
+
+    gobject_class->finalize = sugar_attribute_index_finalize;
+}
+
+static void
+sugar_attribute_index_init(SugarAttributeIndex *self)
+{
+}
+
+/**
+ * sugar_attribute_index_new:
+ * @filename: Path of the index file
+ * @error: Return location for error
+ *
+ * Opens the attribute index stored in @filename by mapping it into
+ * memory. A missing or damaged file gives an empty index, which
+ * sugar_attribute_index_update() fills.
+ *
+ * Returns: (transfer full) (nullable): A new #SugarAttributeIndex or %NULL on error
+ */
+SugarAttributeIndex*
+sugar_attribute_index_new(const gchar *filename, GError **error)
+{
+    SugarAttributeIndex *self;
+
+    g_return_val_if_fail(filename != NULL, NULL);
+
+    self = g_object_new(SUGAR_TYPE_ATTRIBUTE_INDEX, NULL);
+    self->filename = g_strdup(filename);
+
+    if (!map_index(self, error)) {
+        g_object_unref(self);
+        return NULL;
+    }
+
+    return self;
+}
+
+/**
+ * sugar_attribute_index_update:
+ * @index: A #SugarAttributeIndex
+ * @root: The directory tree to index
+ * @error: Return location for error
+ *
+ * Brings the index in line with the regular files below @root. Only
+ * files whose ctime changed since the last update have their attributes
+ * read; the index file is rewritten atomically, and only if something
+ * changed. Entries whose name starts with a dot are skipped. Long
+ * descriptions that no file of a changed directory refers to anymore
+ * are removed from its blob store.
+ *
+ * Paths and attributes previously obtained from @index must not be used
+ * after this call.
+ *
+ * Returns: %TRUE on success, %FALSE on error
+ */
+gboolean
+sugar_attribute_index_update(SugarAttributeIndex *index, GFile *root, GError **error)
+{
+    ScanState scan = { index, NULL, NULL, 0, 0, 0, FALSE };
+    struct stat st;
+    gboolean result;
+    gchar *path;
+    gint dirfd;
+
+    g_return_val_if_fail(SUGAR_IS_ATTRIBUTE_INDEX(index), FALSE);
+    g_return_val_if_fail(G_IS_FILE(root), FALSE);
+
+    path = g_file_get_path(root);
+    if (!path) {
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+                   "Directory is not on a local file system");
+        return FALSE;
+    }
+
+    dirfd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dirfd < 0) {
+        int saved_errno = errno;
+        g_set_error(error, G_IO_ERROR, g_io_error_from_errno(saved_errno),
+                   "Could not open %s: %s", path, g_strerror(saved_errno));
+        g_free(path);
+        return FALSE;
+    }
+    g_free(path);
+
+    // The index may live inside the tree it describes
+    if (stat(index->filename, &st) == 0) {
+        scan.skip_device = st.st_dev;
+        scan.skip_inode = st.st_ino;
+    }
+
+    scan.entries = g_array_new(FALSE, FALSE, sizeof(ScanEntry));
+    g_array_set_clear_func(scan.entries, clear_scan_entry);
+    scan.scratch = g_byte_array_new();
+    scan.scanned_at = g_get_real_time();
+
+    result = scan_directory(&scan, dirfd, NULL, error);
+    close(dirfd);
+
+    if (result && (scan.changed || scan.entries->len != sugar_attribute_index_get_n_entries(index))) {
+        g_array_sort(scan.entries, compare_scan_entries);
+        result = write_index(index, scan.entries, scan.scanned_at, error) && map_index(index, error);
+    }
+
+    g_byte_array_unref(scan.scratch);
+    g_array_unref(scan.entries);
+    return result;
+}
+
+/**
+ * sugar_attribute_index_get_n_entries:
+ * @index: A #SugarAttributeIndex
+ *
+ * Gets the number of files in the index.
+ *
+ * Returns: The number of entries
+ */
+guint
+sugar_attribute_index_get_n_entries(SugarAttributeIndex *index)
+{
+    g_return_val_if_fail(SUGAR_IS_ATTRIBUTE_INDEX(index), 0);
+
+    return index->header ? index->header->n_records : 0;
+}
+
+/**
+ * sugar_attribute_index_get_path:
+ * @index: A #SugarAttributeIndex
+ * @position: Position of the entry
+ *
+ * Gets the path of an entry relative to the indexed directory. Entries
+ * are sorted by path.
+ *
+ * Returns: (transfer none): The path, valid until the next update
+ */
+const gchar*
+sugar_attribute_index_get_path(SugarAttributeIndex *index, guint position)
+{
+    g_return_val_if_fail(SUGAR_IS_ATTRIBUTE_INDEX(index), NULL);
+    g_return_val_if_fail(position < sugar_attribute_index_get_n_entries(index), NULL);
+
+    return heap_string(index, index->records[position].path);
+}
+
+/**
+ * sugar_attribute_index_get_attributes:
+ * @index: A #SugarAttributeIndex
+ * @position: Position of the entry
+ *
+ * Gets the attributes of an entry as they were at the last update.
+ *
+ * Returns: (transfer full): A new #SugarFileAttributes
+ */
+SugarFileAttributes*
+sugar_attribute_index_get_attributes(SugarAttributeIndex *index, guint position)
+{
+    g_return_val_if_fail(SUGAR_IS_ATTRIBUTE_INDEX(index), NULL);
+    g_return_val_if_fail(position < sugar_attribute_index_get_n_entries(index), NULL);
+
+    return record_to_attributes(index, &index->records[position]);
+}
+
+/**
+ * sugar_attribute_index_lookup:
+ * @index: A #SugarAttributeIndex
+ * @device: Device number of the file, as in st_dev
+ * @inode: Inode number of the file, as in st_ino
+ *
+ * Finds the entry of a file by its inode.
+ *
+ * Returns: The position of the entry, or -1 if the file is not indexed
+ */
+gint
+sugar_attribute_index_lookup(SugarAttributeIndex *index, guint64 device, guint64 inode)
+{
+    guint32 next, steps;
+
+    g_return_val_if_fail(SUGAR_IS_ATTRIBUTE_INDEX(index), -1);
+
+    if (!index->header || index->header->n_records == 0)
+        return -1;
+
+    next = index->buckets[inode_hash(device, inode) & (index->header->n_buckets - 1)];
+
+    // The step limit keeps a damaged chain from looping
+    for (steps = 0; next != 0 && next <= index->header->n_records && steps < index->header->n_records; steps++) {
+        const IndexRecord *record = &index->records[next - 1];
+        if (record->device == device && record->inode == inode)
+            return next - 1;
+        next = record->next;
+    }
+
+    return -1;
+}
@@ -0,0 +1,53 @@
+/*
+ * Copyright (C) 2025 MostlyK
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __SUGAR_ATTRIBUTE_INDEX_H__
+#define __SUGAR_ATTRIBUTE_INDEX_H__
+
+#include <glib-object.h>
+#include <gio/gio.h>
+#include "sugar-file-attributes.h"
+
+G_BEGIN_DECLS
+
+typedef struct _SugarAttributeIndex SugarAttributeIndex;
+typedef struct _SugarAttributeIndexClass SugarAttributeIndexClass;
+
+#define SUGAR_TYPE_ATTRIBUTE_INDEX            (sugar_attribute_index_get_type())
+#define SUGAR_ATTRIBUTE_INDEX(object)         (G_TYPE_CHECK_INSTANCE_CAST((object), SUGAR_TYPE_ATTRIBUTE_INDEX, SugarAttributeIndex))
+#define SUGAR_IS_ATTRIBUTE_INDEX(object)      (G_TYPE_CHECK_INSTANCE_TYPE((object), SUGAR_TYPE_ATTRIBUTE_INDEX))
+
+GType                sugar_attribute_index_get_type       (void);
+SugarAttributeIndex *sugar_attribute_index_new            (const gchar         *filename,
+                                                           GError             **error);
+gboolean             sugar_attribute_index_update         (SugarAttributeIndex *index,
+                                                           GFile               *root,
+                                                           GError             **error);
+guint                sugar_attribute_index_get_n_entries  (SugarAttributeIndex *index);
+const gchar         *sugar_attribute_index_get_path       (SugarAttributeIndex *index,
+                                                           guint                position);
+SugarFileAttributes *sugar_attribute_index_get_attributes (SugarAttributeIndex *index,
+                                                           guint                position);
+gint                 sugar_attribute_index_lookup         (SugarAttributeIndex *index,
+                                                           guint64              device,
+                                                           guint64              inode);
+
+G_END_DECLS
+
+#endif /* __SUGAR_ATTRIBUTE_INDEX_H__ */
@@ -0,0 +1,449 @@
+/*
+ * Copyright (C) 2025 MostlyK
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include "sugar-attribute-monitor.h"
+#include "sugar-file-attributes-private.h"
+#include <glib-unix.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+
+/*
+ * Watches one directory with inotify. Setting an extended attribute
+ * raises IN_ATTRIB on the entry, so attribute edits by other processes
+ * show up like creations, removals, renames and finished writes.
+ *
+ * Events only record the entry name. Once no event has arrived for the
+ * delay, or at the latest a few delays after the first one so a steady
+ * stream is still reported, the recorded entries are reloaded on a
+ * worker thread and handed out in one signal. Entries that can no
+ * longer be loaded are reported as removed, so a burst that creates
+ * and deletes a file comes out as just the removal.
+ *
+ * Sidecar updates and queue overflows do not say which entries
+ * changed; they make the next reload cover the whole directory.
+ */
+#define DEFAULT_DELAY 200
+#define MAX_DELAY_FACTOR 5
+#define WATCH_EVENTS (IN_ATTRIB | IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | \
+                      IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR)
+
+enum {
+    ATTRIBUTES_CHANGED,
+    N_SIGNALS
+};
+
+static guint signals[N_SIGNALS];
+
+typedef struct {
+    gboolean rescan;
+    GPtrArray *names;
+    GPtrArray *attributes;
+} Reload;
+
+struct _SugarAttributeMonitor {
+    GObject parent_instance;
+
+    GFile *directory;
+    gint dirfd;
+    gint inotify_fd;
+    GMainContext *context;
+    GSource *inotify_source;
+    GSource *timeout_source;
+
+    GHashTable *pending;
+    gboolean rescan;
+    gboolean reloading;
+    gint64 first_event;
+    gint64 last_event;
+    guint delay;
+};
+
+struct _SugarAttributeMonitorClass {
+    GObjectClass parent_class;
+};
+
+G_DEFINE_TYPE(SugarAttributeMonitor, sugar_attribute_monitor, G_TYPE_OBJECT)
+
+static gboolean on_timeout(gpointer user_data);
+
+static void
+reload_free(Reload *reload)
+{
+    g_ptr_array_unref(reload->names);
+    if (reload->attributes) g_ptr_array_unref(reload->attributes);
+    g_free(reload);
+}
+
+static void
+start_timer(SugarAttributeMonitor *self, guint delay_ms)
+{
+    self->timeout_source = g_timeout_source_new(delay_ms);
+    g_source_set_callback(self->timeout_source, on_timeout, self, NULL);
+    g_source_attach(self->timeout_source, self->context);
+}
+
+// Notes an event; the reload waits for the events to settle
+static void
+schedule_reload(SugarAttributeMonitor *self)
+{
+    gint64 now = g_get_monotonic_time();
+
+    if (!self->timeout_source && !self->reloading) {
+        self->first_event = now;
+        start_timer(self, self->delay);
+    }
+
+    self->last_event = now;
+}
+
+static void
+reload_thread(GTask *task, gpointer source, gpointer task_data, GCancellable *cancellable)
+{
+    SugarAttributeMonitor *self = source;
+    Reload *reload = task_data;
+    GByteArray *scratch = g_byte_array_new();
+
+    if (reload->rescan) {
+        GHashTable *seen = g_hash_table_new(g_str_hash, g_str_equal);
+        GPtrArray *names;
+        gint fd = -1;
+
+        for (guint i = 0; i < reload->names->len; i++)
+            g_hash_table_add(seen, reload->names->pdata[i]);
+
+        names = _sugar_file_attributes_read_directory(self->directory, &fd, NULL);
+        if (fd >= 0) close(fd);
+
+        for (guint i = 0; names && i < names->len; i++) {
+            if (!g_hash_table_contains(seen, names->pdata[i]))
+                g_ptr_array_add(reload->names, g_strdup(names->pdata[i]));
+        }
+
+        if (names) g_ptr_array_unref(names);
+        g_hash_table_unref(seen);
+    }
+
+    reload->attributes = g_ptr_array_new_full(reload->names->len, (GDestroyNotify) sugar_file_attributes_free);
+
+    for (guint i = 0; i < reload->names->len; i++) {
+        SugarFileAttributes *attrs = sugar_file_attributes_new();
+
+        if (!sugar_file_attributes_load_at_full(attrs, self->dirfd, reload->names->pdata[i], scratch, NULL))
+            g_clear_pointer(&attrs, sugar_file_attributes_free);
+
+        g_ptr_array_add(reload->attributes, attrs);
+    }
+
+    g_byte_array_unref(scratch);
+    g_task_return_boolean(task, TRUE);
+}
+
+static void
+reload_done(GObject *source, GAsyncResult *result, gpointer user_data)
+{
+    SugarAttributeMonitor *self = SUGAR_ATTRIBUTE_MONITOR(source);
+    Reload *reload = g_task_get_task_data(G_TASK(result));
+
+    self->reloading = FALSE;
+
+    if (reload->names->len > 0) {
+        g_ptr_array_add(reload->names, NULL);
+        g_signal_emit(self, signals[ATTRIBUTES_CHANGED], 0, reload->names->pdata, reload->attributes);
+    }
+
+    // Events that arrived during the reload
+    if (g_hash_table_size(self->pending) > 0 || self->rescan) {
+        self->first_event = g_get_monotonic_time();
+        start_timer(self, self->delay);
+    }
+}
+
+static void
+start_reload(SugarAttributeMonitor *self)
+{
+    Reload *reload = g_new0(Reload, 1);
+    GHashTableIter iter;
+    gpointer name;
+    GTask *task;
+
+    reload->rescan = self->rescan;
+    reload->names = g_ptr_array_new_full(g_hash_table_size(self->pending) + 1, g_free);
+
+    g_hash_table_iter_init(&iter, self->pending);
+    while (g_hash_table_iter_next(&iter, &name, NULL)) {
+        g_hash_table_iter_steal(&iter);
+        g_ptr_array_add(reload->names, name);
+    }
+
+    self->rescan = FALSE;
+    self->reloading = TRUE;
+
+    task = g_task_new(self, NULL, reload_done, NULL);
+    g_task_set_source_tag(task, start_reload);
+    g_task_set_task_data(task, reload, (GDestroyNotify) reload_free);
+    g_task_run_in_thread(task, reload_thread);
+    g_object_unref(task);
+}
+
+static gboolean
+on_timeout(gpointer user_data)
+{
+    SugarAttributeMonitor *self = user_data;
+    gint64 now = g_get_monotonic_time();
+    gint64 quiet = self->last_event + (gint64) self->delay * 1000;
+    gint64 deadline = self->first_event + (gint64) self->delay * MAX_DELAY_FACTOR * 1000;
+
+    g_clear_pointer(&self->timeout_source, g_source_unref);
+
+    // Still busy, wait for a quiet moment unless the burst has gone on too long
+    if (now < quiet && now < deadline) {
+        start_timer(self, (guint) ((MIN(quiet, deadline) - now + 999) / 1000));
+        return G_SOURCE_REMOVE;
+    }
+
+    start_reload(self);
+    return G_SOURCE_REMOVE;
+}
+
+static void
+stop_watching(SugarAttributeMonitor *self)
+{
+    if (self->inotify_source) {
+        g_source_destroy(self->inotify_source);
+        g_clear_pointer(&self->inotify_source, g_source_unref);
+    }
+}
+
+static void
+handle_event(SugarAttributeMonitor *self, const struct inotify_event *event)
+{
+    // The directory itself went away
+    if (event->mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED)) {
+        stop_watching(self);
+        return;
+    }
+
+    if (event->mask & IN_Q_OVERFLOW) {
+        self->rescan = TRUE;
+    } else if (event->len == 0 || (event->mask & IN_ISDIR)) {
+        return;
+    } else if (strcmp(event->name, SUGAR_SIDECAR_NAME) == 0) {
+        self->rescan = TRUE;
+    } else if (event->name[0] == '.') {
+        return;
+    } else if (!g_hash_table_contains(self->pending, event->name)) {
+        g_hash_table_add(self->pending, g_strdup(event->name));
+    }
+
+    schedule_reload(self);
+}
+
+static gboolean
+on_inotify(gint fd, GIOCondition condition, gpointer user_data)
+{
+    SugarAttributeMonitor *self = user_data;
+    union {
+        struct inotify_event event;
+        gchar bytes[4096];
+    } buffer;
+
+    while (self->inotify_source) {
+        ssize_t length = read(fd, buffer.bytes, sizeof(buffer.bytes));
+
+        if (length < 0 && errno == EINTR) continue;
+        if (length <= 0) break;
+
+        for (ssize_t offset = 0; offset < length && self->inotify_source; ) {
+            const struct inotify_event *event = (const struct inotify_event *) (buffer.bytes + offset);
+
+            handle_event(self, event);
+            offset += sizeof(struct inotify_event) + event->len;
+        }
+    }
+
+    return self->inotify_source ? G_SOURCE_CONTINUE : G_SOURCE_REMOVE;
+}
+
+static void
+sugar_attribute_monitor_dispose(GObject *object)
+{
+    SugarAttributeMonitor *self = SUGAR_ATTRIBUTE_MONITOR(object);
+
+    stop_watching(self);
+
+    if (self->timeout_source) {
+        g_source_destroy(self->timeout_source);
+        g_clear_pointer(&self->timeout_source, g_source_unref);
+    }
+
+    G_OBJECT_CLASS(sugar_attribute_monitor_parent_class)->dispose(object);
+}
+
+static void
+sugar_attribute_monitor_finalize(GObject *object)
+{
+    SugarAttributeMonitor *self = SUGAR_ATTRIBUTE_MONITOR(object);
+
+    if (self->inotify_fd >= 0) close(self->inotify_fd);
+    if (self->dirfd >= 0) close(self->dirfd);
+    g_hash_table_unref(self->pending);
+    g_clear_pointer(&self->context, g_main_context_unref);
+    g_clear_object(&self->directory);
+
+    G_OBJECT_CLASS(sugar_attribute_monitor_parent_class)->finalize(object);
+}
+
+static void
+sugar_attribute_monitor_class_init(SugarAttributeMonitorClass *monitor_class)
+{
+    GObjectClass *gobject_class = G_OBJECT_CLASS(monitor_class);
+
+    gobject_class->dispose = sugar_attribute_monitor_dispose;
+    gobject_class->finalize = sugar_attribute_monitor_finalize;
+
+    /**
+     * SugarAttributeMonitor::attributes-changed:
+     * @monitor: The monitor
+     * @names: (array zero-terminated=1): Names of the changed entries
+     * @attributes: (element-type SugarFileAttributes): The new attributes of each entry, %NULL for removed ones
+     *
+     * Emitted with the entries of the directory whose attributes changed,
+     * were created or were removed since the last emission.
+     */
+    signals[ATTRIBUTES_CHANGED] =
+        g_signal_new("attributes-changed",
+                     G_OBJECT_CLASS_TYPE(gobject_class),
+                     G_SIGNAL_RUN_LAST,
+                     0,
+                     NULL, NULL,
+                     NULL,
+                     G_TYPE_NONE, 2, G_TYPE_STRV, G_TYPE_PTR_ARRAY);
+}
+
+static void
+sugar_attribute_monitor_init(SugarAttributeMonitor *self)
+{
+    self->dirfd = -1;
+    self->inotify_fd = -1;
+    self->pending = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    self->delay = DEFAULT_DELAY;
+}
+
+/**
+ * sugar_attribute_monitor_new:
+ * @directory: A #GFile for a local directory
+ * @error: Return location for error
+ *
+ * Starts watching the entries of @directory for attribute changes made
+ * by any process, including this one. Changes are reported with the
+ * #SugarAttributeMonitor::attributes-changed signal on the
+ * thread-default main context of the caller. Hidden entries and
+ * subdirectories are not reported.
+ *
+ * Returns: (transfer full) (nullable): A new #SugarAttributeMonitor, or %NULL on error
+ */
+SugarAttributeMonitor*
+sugar_attribute_monitor_new(GFile *directory, GError **error)
+{
+    SugarAttributeMonitor *self;
+    gchar *path;
+
+    g_return_val_if_fail(G_IS_FILE(directory), NULL);
+
+    path = g_file_get_path(directory);
+    if (!path) {
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+                    "Directory is not on a local file system");
+        return NULL;
+    }
+
+    self = g_object_new(SUGAR_TYPE_ATTRIBUTE_MONITOR, NULL);
+    self->directory = g_object_ref(directory);
+    self->context = g_main_context_ref_thread_default();
+    self->dirfd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    self->inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+
+    if (self->dirfd < 0 || self->inotify_fd < 0 || inotify_add_watch(self->inotify_fd, path, WATCH_EVENTS) < 0) {
+        int saved_errno = errno;
+        g_set_error(error, G_IO_ERROR, g_io_error_from_errno(saved_errno),
+                    "Could not watch %s: %s", path, g_strerror(saved_errno));
+        g_object_unref(self);
+        g_free(path);
+        return NULL;
+    }
+
+    self->inotify_source = g_unix_fd_source_new(self->inotify_fd, G_IO_IN);
+    g_source_set_callback(self->inotify_source, (GSourceFunc) (void (*)(void)) on_inotify, self, NULL);
+    g_source_attach(self->inotify_source, self->context);
+
+    g_free(path);
+    return self;
+}
+
+/**
+ * sugar_attribute_monitor_get_directory:
+ * @monitor: A #SugarAttributeMonitor
+ *
+ * Gets the directory watched by @monitor.
+ *
+ * Returns: (transfer none): The directory
+ */
+GFile*
+sugar_attribute_monitor_get_directory(SugarAttributeMonitor *monitor)
+{
+    g_return_val_if_fail(SUGAR_IS_ATTRIBUTE_MONITOR(monitor), NULL);
+
+    return monitor->directory;
+}
+
+/**
+ * sugar_attribute_monitor_set_delay:
+ * @monitor: A #SugarAttributeMonitor
+ * @delay_ms: How long events must settle, in milliseconds
+ *
+ * Sets how long the monitor waits after the last event of a burst
+ * before reloading the changed entries. A burst that keeps going is
+ * still reported every few delays. The default is 200 milliseconds.
+ */
+void
+sugar_attribute_monitor_set_delay(SugarAttributeMonitor *monitor, guint delay_ms)
+{
+    g_return_if_fail(SUGAR_IS_ATTRIBUTE_MONITOR(monitor));
+
+    monitor->delay = delay_ms;
+}
+
+/**
+ * sugar_attribute_monitor_get_delay:
+ * @monitor: A #SugarAttributeMonitor
+ *
+ * Gets the delay set with sugar_attribute_monitor_set_delay().
+ *
+ * Returns: The delay in milliseconds
+ */
+guint
+sugar_attribute_monitor_get_delay(SugarAttributeMonitor *monitor)
+{
+    g_return_val_if_fail(SUGAR_IS_ATTRIBUTE_MONITOR(monitor), 0);
+
+    return monitor->delay;
+}
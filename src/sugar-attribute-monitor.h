@@ -0,0 +1,44 @@
+/*
+ * Copyright (C) 2025 MostlyK
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __SUGAR_ATTRIBUTE_MONITOR_H__
+#define __SUGAR_ATTRIBUTE_MONITOR_H__
+
+#include <gio/gio.h>
+
+G_BEGIN_DECLS
+
+typedef struct _SugarAttributeMonitor SugarAttributeMonitor;
+typedef struct _SugarAttributeMonitorClass SugarAttributeMonitorClass;
+
+#define SUGAR_TYPE_ATTRIBUTE_MONITOR            (sugar_attribute_monitor_get_type())
+#define SUGAR_ATTRIBUTE_MONITOR(object)         (G_TYPE_CHECK_INSTANCE_CAST((object), SUGAR_TYPE_ATTRIBUTE_MONITOR, SugarAttributeMonitor))
+#define SUGAR_IS_ATTRIBUTE_MONITOR(object)      (G_TYPE_CHECK_INSTANCE_TYPE((object), SUGAR_TYPE_ATTRIBUTE_MONITOR))
+
+GType                  sugar_attribute_monitor_get_type      (void);
+SugarAttributeMonitor *sugar_attribute_monitor_new           (GFile                 *directory,
+                                                              GError               **error);
+GFile                 *sugar_attribute_monitor_get_directory (SugarAttributeMonitor *monitor);
+void                   sugar_attribute_monitor_set_delay     (SugarAttributeMonitor *monitor,
+                                                              guint                  delay_ms);
+guint                  sugar_attribute_monitor_get_delay     (SugarAttributeMonitor *monitor);
+
+G_END_DECLS
+
+#endif /* __SUGAR_ATTRIBUTE_MONITOR_H__ */
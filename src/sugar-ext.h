@@ -22,7 +22,16 @@
 
 #include <gtk/gtk.h>
 #include "sugar-grid.h"
+#include "sugar-grid-layout-manager.h"
 #include "sugar-file-attributes.h"
+#include "sugar-file-attributes-list-model.h"
+#include "sugar-file-attributes-sort-model.h"
+#include "sugar-attribute-index.h"
+#include "sugar-search-index.h"
+#include "sugar-title-index.h"
+#include "sugar-tag-index.h"
+#include "sugar-preview-store.h"
+#include "sugar-attribute-monitor.h"
 #include "controllers/sugar-event-controllers.h"
 
 G_BEGIN_DECLS
@@ -0,0 +1,888 @@
+/*
+ * Copyright (C) 2025 MostlyK
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include "sugar-file-attributes-private.h"
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+/*
+ * The asynchronous variants run the blocking calls on a small shared
+ * thread pool. Attribute I/O is bound by the storage device, so more
+ * threads would only queue up in the kernel.
+ *
+ * Operations on the same file are kept in order by giving every file a
+ * lane: a queue of pending tasks of which at most one is handed to the
+ * pool at a time. When the running task finishes, the worker pushes the
+ * lane back if more tasks are waiting, so a busy file cannot starve the
+ * others. A lane only exists while it has pending work.
+ */
+#define MAX_WORKERS 4
+
+/*
+ * Directory loads split the entries into chunks that the loader threads
+ * claim one at a time from a shared counter, so a thread that hits slow
+ * entries simply claims fewer chunks. The first chunk is small so the
+ * first batch reaches the main loop within a frame.
+ */
+#define MAX_DIRECTORY_WORKERS 8
+#define FIRST_CHUNK_SIZE 16
+#define CHUNK_SIZE 128
+
+typedef struct {
+    gchar *key;
+    GQueue tasks;
+} FileLane;
+
+typedef struct {
+    GTaskThreadFunc func;
+    GFile *file;
+    SugarFileAttributes *attrs;
+    gchar *value;
+    gchar **tags;
+    gchar *(*get_string)(GFile *file);
+    gboolean (*set_string)(GFile *file, const gchar *value);
+} AttributesTaskData;
+
+static GMutex lanes_lock;
+static GHashTable *lanes;
+static GThreadPool *pool;
+
+static void
+attributes_task_data_free(AttributesTaskData *data)
+{
+    g_object_unref(data->file);
+    sugar_file_attributes_free(data->attrs);
+    g_free(data->value);
+    g_strfreev(data->tags);
+    g_free(data);
+}
+
+static gchar*
+get_lane_key(GFile *file)
+{
+    gchar *key = g_file_get_path(file);
+
+    if (!key) key = g_file_get_uri(file);
+    return key;
+}
+
+static void
+run_lane(gpointer item, gpointer user_data)
+{
+    FileLane *lane = item;
+    GTask *task;
+    AttributesTaskData *data;
+
+    g_mutex_lock(&lanes_lock);
+    task = g_queue_pop_head(&lane->tasks);
+    g_mutex_unlock(&lanes_lock);
+
+    data = g_task_get_task_data(task);
+    if (!g_task_return_error_if_cancelled(task))
+        data->func(task, NULL, data, g_task_get_cancellable(task));
+    g_object_unref(task);
+
+    g_mutex_lock(&lanes_lock);
+    if (g_queue_is_empty(&lane->tasks)) {
+        g_hash_table_remove(lanes, lane->key);
+        g_free(lane->key);
+        g_free(lane);
+    } else {
+        g_thread_pool_push(pool, lane, NULL);
+    }
+    g_mutex_unlock(&lanes_lock);
+}
+
+static void
+queue_task(GTask *task)
+{
+    AttributesTaskData *data = g_task_get_task_data(task);
+    gchar *key = get_lane_key(data->file);
+    FileLane *lane;
+
+    g_mutex_lock(&lanes_lock);
+
+    if (!pool) {
+        lanes = g_hash_table_new(g_str_hash, g_str_equal);
+        pool = g_thread_pool_new(run_lane, NULL, MAX_WORKERS, FALSE, NULL);
+    }
+
+    lane = g_hash_table_lookup(lanes, key);
+    if (lane) {
+        // Already queued or running, the worker picks this up in order
+        g_queue_push_tail(&lane->tasks, task);
+        g_free(key);
+    } else {
+        lane = g_new0(FileLane, 1);
+        lane->key = key;
+        g_queue_init(&lane->tasks);
+        g_queue_push_tail(&lane->tasks, task);
+        g_hash_table_insert(lanes, lane->key, lane);
+        g_thread_pool_push(pool, lane, NULL);
+    }
+
+    g_mutex_unlock(&lanes_lock);
+}
+
+static GTask*
+create_task(GFile               *file,
+            GTaskThreadFunc      func,
+            gpointer             source_tag,
+            GCancellable        *cancellable,
+            GAsyncReadyCallback  callback,
+            gpointer             user_data)
+{
+    GTask *task = g_task_new(NULL, cancellable, callback, user_data);
+    AttributesTaskData *data = g_new0(AttributesTaskData, 1);
+
+    data->func = func;
+    data->file = g_object_ref(file);
+
+    g_task_set_source_tag(task, source_tag);
+    g_task_set_task_data(task, data, (GDestroyNotify) attributes_task_data_free);
+    return task;
+}
+
+static void
+get_from_file_thread(GTask *task, gpointer source, gpointer task_data, GCancellable *cancellable)
+{
+    AttributesTaskData *data = task_data;
+    GError *error = NULL;
+    SugarFileAttributes *attrs = sugar_file_attributes_get_from_file(data->file, &error);
+
+    if (attrs)
+        g_task_return_pointer(task, attrs, (GDestroyNotify) sugar_file_attributes_free);
+    else
+        g_task_return_error(task, error);
+}
+
+static void
+save_to_file_thread(GTask *task, gpointer source, gpointer task_data, GCancellable *cancellable)
+{
+    AttributesTaskData *data = task_data;
+    GError *error = NULL;
+
+    if (sugar_file_attributes_save_to_file(data->attrs, data->file, &error))
+        g_task_return_boolean(task, TRUE);
+    else
+        g_task_return_error(task, error);
+}
+
+static void
+get_string_thread(GTask *task, gpointer source, gpointer task_data, GCancellable *cancellable)
+{
+    AttributesTaskData *data = task_data;
+
+    g_task_return_pointer(task, data->get_string(data->file), g_free);
+}
+
+static void
+set_string_thread(GTask *task, gpointer source, gpointer task_data, GCancellable *cancellable)
+{
+    AttributesTaskData *data = task_data;
+
+    if (data->set_string(data->file, data->value))
+        g_task_return_boolean(task, TRUE);
+    else
+        g_task_return_new_error(task, G_IO_ERROR, G_IO_ERROR_FAILED,
+                                "Failed to write extended attributes");
+}
+
+static void
+get_tags_thread(GTask *task, gpointer source, gpointer task_data, GCancellable *cancellable)
+{
+    AttributesTaskData *data = task_data;
+
+    g_task_return_pointer(task, sugar_file_attributes_get_tags(data->file), (GDestroyNotify) g_strfreev);
+}
+
+static void
+set_tags_thread(GTask *task, gpointer source, gpointer task_data, GCancellable *cancellable)
+{
+    AttributesTaskData *data = task_data;
+
+    if (sugar_file_attributes_set_tags(data->file, (const gchar * const *) data->tags))
+        g_task_return_boolean(task, TRUE);
+    else
+        g_task_return_new_error(task, G_IO_ERROR, G_IO_ERROR_FAILED,
+                                "Failed to write extended attributes");
+}
+
+static void
+get_string_async(GFile               *file,
+                 gchar             *(*get_string)(GFile *file),
+                 gpointer             source_tag,
+                 GCancellable        *cancellable,
+                 GAsyncReadyCallback  callback,
+                 gpointer             user_data)
+{
+    GTask *task = create_task(file, get_string_thread, source_tag, cancellable, callback, user_data);
+    AttributesTaskData *data = g_task_get_task_data(task);
+
+    data->get_string = get_string;
+    queue_task(task);
+}
+
+static void
+set_string_async(GFile               *file,
+                 const gchar         *value,
+                 gboolean           (*set_string)(GFile *file, const gchar *value),
+                 gpointer             source_tag,
+                 GCancellable        *cancellable,
+                 GAsyncReadyCallback  callback,
+                 gpointer             user_data)
+{
+    GTask *task = create_task(file, set_string_thread, source_tag, cancellable, callback, user_data);
+    AttributesTaskData *data = g_task_get_task_data(task);
+
+    data->set_string = set_string;
+    data->value = g_strdup(value);
+    queue_task(task);
+}
+
+/**
+ * sugar_file_attributes_get_from_file_async:
+ * @file: A #GFile
+ * @cancellable: (nullable): A #GCancellable
+ * @callback: Function to call when the attributes are read
+ * @user_data: Data for @callback
+ *
+ * Reads Sugar file attributes from the given file without blocking.
+ * Operations on the same file complete in the order they were started.
+ * If @cancellable is cancelled before the read starts, it fails with
+ * %G_IO_ERROR_CANCELLED.
+ */
+void
+sugar_file_attributes_get_from_file_async(GFile               *file,
+                                          GCancellable        *cancellable,
+                                          GAsyncReadyCallback  callback,
+                                          gpointer             user_data)
+{
+    g_return_if_fail(G_IS_FILE(file));
+
+    queue_task(create_task(file, get_from_file_thread, sugar_file_attributes_get_from_file_async,
+                           cancellable, callback, user_data));
+}
+
+/**
+ * sugar_file_attributes_get_from_file_finish:
+ * @result: A #GAsyncResult
+ * @error: Return location for error
+ *
+ * Finishes an operation started with
+ * sugar_file_attributes_get_from_file_async().
+ *
+ * Returns: (transfer full): A #SugarFileAttributes or %NULL on error
+ */
+SugarFileAttributes*
+sugar_file_attributes_get_from_file_finish(GAsyncResult *result, GError **error)
+{
+    g_return_val_if_fail(g_task_is_valid(result, NULL), NULL);
+    g_return_val_if_fail(g_task_get_source_tag(G_TASK(result)) == sugar_file_attributes_get_from_file_async, NULL);
+
+    return g_task_propagate_pointer(G_TASK(result), error);
+}
+
+/**
+ * sugar_file_attributes_save_to_file_async:
+ * @attrs: A #SugarFileAttributes
+ * @file: A #GFile
+ * @cancellable: (nullable): A #GCancellable
+ * @callback: Function to call when the attributes are written
+ * @user_data: Data for @callback
+ *
+ * Saves Sugar file attributes to the given file without blocking.
+ * @attrs is copied, so the caller may change or free it right away;
+ * unlike sugar_file_attributes_save_to_file() it is left unchanged: its
+ * modification time is not updated and its dirty fields stay marked, so
+ * a later save of the same record writes them again. Writes to the
+ * same file are never reordered. If @cancellable is cancelled before
+ * the write starts, nothing is written and it fails with
+ * %G_IO_ERROR_CANCELLED.
+ */
+void
+sugar_file_attributes_save_to_file_async(SugarFileAttributes *attrs,
+                                         GFile               *file,
+                                         GCancellable        *cancellable,
+                                         GAsyncReadyCallback  callback,
+                                         gpointer             user_data)
+{
+    GTask *task;
+    AttributesTaskData *data;
+
+    g_return_if_fail(attrs != NULL);
+    g_return_if_fail(G_IS_FILE(file));
+
+    task = create_task(file, save_to_file_thread, sugar_file_attributes_save_to_file_async,
+                       cancellable, callback, user_data);
+    data = g_task_get_task_data(task);
+    data->attrs = g_boxed_copy(sugar_file_attributes_get_type(), attrs);
+    queue_task(task);
+}
+
+/**
+ * sugar_file_attributes_save_to_file_finish:
+ * @result: A #GAsyncResult
+ * @error: Return location for error
+ *
+ * Finishes an operation started with
+ * sugar_file_attributes_save_to_file_async().
+ *
+ * Returns: %TRUE on success, %FALSE on error
+ */
+gboolean
+sugar_file_attributes_save_to_file_finish(GAsyncResult *result, GError **error)
+{
+    g_return_val_if_fail(g_task_is_valid(result, NULL), FALSE);
+    g_return_val_if_fail(g_task_get_source_tag(G_TASK(result)) == sugar_file_attributes_save_to_file_async, FALSE);
+
+    return g_task_propagate_boolean(G_TASK(result), error);
+}
+
+/**
+ * sugar_file_attributes_get_title_async:
+ * @file: A #GFile
+ * @cancellable: (nullable): A #GCancellable
+ * @callback: Function to call when the title is read
+ * @user_data: Data for @callback
+ *
+ * Gets the title attribute for a file without blocking.
+ */
+void
+sugar_file_attributes_get_title_async(GFile               *file,
+                                      GCancellable        *cancellable,
+                                      GAsyncReadyCallback  callback,
+                                      gpointer             user_data)
+{
+    g_return_if_fail(G_IS_FILE(file));
+
+    get_string_async(file, sugar_file_attributes_get_title, sugar_file_attributes_get_title_async,
+                     cancellable, callback, user_data);
+}
+
+/**
+ * sugar_file_attributes_get_title_finish:
+ * @result: A #GAsyncResult
+ * @error: Return location for error
+ *
+ * Finishes an operation started with sugar_file_attributes_get_title_async().
+ *
+ * Returns: (transfer full): The title string or %NULL
+ */
+gchar*
+sugar_file_attributes_get_title_finish(GAsyncResult *result, GError **error)
+{
+    g_return_val_if_fail(g_task_is_valid(result, NULL), NULL);
+    g_return_val_if_fail(g_task_get_source_tag(G_TASK(result)) == sugar_file_attributes_get_title_async, NULL);
+
+    return g_task_propagate_pointer(G_TASK(result), error);
+}
+
+/**
+ * sugar_file_attributes_set_title_async:
+ * @file: A #GFile
+ * @title: The title to set
+ * @cancellable: (nullable): A #GCancellable
+ * @callback: Function to call when the title is written
+ * @user_data: Data for @callback
+ *
+ * Sets the title attribute for a file without blocking.
+ */
+void
+sugar_file_attributes_set_title_async(GFile               *file,
+                                      const gchar         *title,
+                                      GCancellable        *cancellable,
+                                      GAsyncReadyCallback  callback,
+                                      gpointer             user_data)
+{
+    g_return_if_fail(G_IS_FILE(file));
+
+    set_string_async(file, title, sugar_file_attributes_set_title, sugar_file_attributes_set_title_async,
+                     cancellable, callback, user_data);
+}
+
+/**
+ * sugar_file_attributes_set_title_finish:
+ * @result: A #GAsyncResult
+ * @error: Return location for error
+ *
+ * Finishes an operation started with sugar_file_attributes_set_title_async().
+ *
+ * Returns: %TRUE on success, %FALSE on error
+ */
+gboolean
+sugar_file_attributes_set_title_finish(GAsyncResult *result, GError **error)
+{
+    g_return_val_if_fail(g_task_is_valid(result, NULL), FALSE);
+    g_return_val_if_fail(g_task_get_source_tag(G_TASK(result)) == sugar_file_attributes_set_title_async, FALSE);
+
+    return g_task_propagate_boolean(G_TASK(result), error);
+}
+
+/**
+ * sugar_file_attributes_get_description_async:
+ * @file: A #GFile
+ * @cancellable: (nullable): A #GCancellable
+ * @callback: Function to call when the description is read
+ * @user_data: Data for @callback
+ *
+ * Gets the description attribute for a file without blocking.
+ */
+void
+sugar_file_attributes_get_description_async(GFile               *file,
+                                            GCancellable        *cancellable,
+                                            GAsyncReadyCallback  callback,
+                                            gpointer             user_data)
+{
+    g_return_if_fail(G_IS_FILE(file));
+
+    get_string_async(file, sugar_file_attributes_get_description, sugar_file_attributes_get_description_async,
+                     cancellable, callback, user_data);
+}
+
+/**
+ * sugar_file_attributes_get_description_finish:
+ * @result: A #GAsyncResult
+ * @error: Return location for error
+ *
+ * Finishes an operation started with
+ * sugar_file_attributes_get_description_async().
+ *
+ * Returns: (transfer full): The description string or %NULL
+ */
+gchar*
+sugar_file_attributes_get_description_finish(GAsyncResult *result, GError **error)
+{
+    g_return_val_if_fail(g_task_is_valid(result, NULL), NULL);
+    g_return_val_if_fail(g_task_get_source_tag(G_TASK(result)) == sugar_file_attributes_get_description_async, NULL);
+
+    return g_task_propagate_pointer(G_TASK(result), error);
+}
+
+/**
+ * sugar_file_attributes_set_description_async:
+ * @file: A #GFile
+ * @description: The description to set
+ * @cancellable: (nullable): A #GCancellable
+ * @callback: Function to call when the description is written
+ * @user_data: Data for @callback
+ *
+ * Sets the description attribute for a file without blocking.
+ */
+void
+sugar_file_attributes_set_description_async(GFile               *file,
+                                            const gchar         *description,
+                                            GCancellable        *cancellable,
+                                            GAsyncReadyCallback  callback,
+                                            gpointer             user_data)
+{
+    g_return_if_fail(G_IS_FILE(file));
+
+    set_string_async(file, description, sugar_file_attributes_set_description,
+                     sugar_file_attributes_set_description_async, cancellable, callback, user_data);
+}
+
+/**
+ * sugar_file_attributes_set_description_finish:
+ * @result: A #GAsyncResult
+ * @error: Return location for error
+ *
+ * Finishes an operation started with
+ * sugar_file_attributes_set_description_async().
+ *
+ * Returns: %TRUE on success, %FALSE on error
+ */
+gboolean
+sugar_file_attributes_set_description_finish(GAsyncResult *result, GError **error)
+{
+    g_return_val_if_fail(g_task_is_valid(result, NULL), FALSE);
+    g_return_val_if_fail(g_task_get_source_tag(G_TASK(result)) == sugar_file_attributes_set_description_async, FALSE);
+
+    return g_task_propagate_boolean(G_TASK(result), error);
+}
+
+/**
+ * sugar_file_attributes_get_tags_async:
+ * @file: A #GFile
+ * @cancellable: (nullable): A #GCancellable
+ * @callback: Function to call when the tags are read
+ * @user_data: Data for @callback
+ *
+ * Gets the tags for a file without blocking.
+ */
+void
+sugar_file_attributes_get_tags_async(GFile               *file,
+                                     GCancellable        *cancellable,
+                                     GAsyncReadyCallback  callback,
+                                     gpointer             user_data)
+{
+    g_return_if_fail(G_IS_FILE(file));
+
+    queue_task(create_task(file, get_tags_thread, sugar_file_attributes_get_tags_async,
+                           cancellable, callback, user_data));
+}
+
+/**
+ * sugar_file_attributes_get_tags_finish:
+ * @result: A #GAsyncResult
+ * @error: Return location for error
+ *
+ * Finishes an operation started with sugar_file_attributes_get_tags_async().
+ *
+ * Returns: (transfer full) (array zero-terminated=1): Array of tag strings or %NULL
+ */
+gchar**
+sugar_file_attributes_get_tags_finish(GAsyncResult *result, GError **error)
+{
+    g_return_val_if_fail(g_task_is_valid(result, NULL), NULL);
+    g_return_val_if_fail(g_task_get_source_tag(G_TASK(result)) == sugar_file_attributes_get_tags_async, NULL);
+
+    return g_task_propagate_pointer(G_TASK(result), error);
+}
+
+/**
+ * sugar_file_attributes_set_tags_async:
+ * @file: A #GFile
+ * @tags: (array zero-terminated=1): Array of tag strings
+ * @cancellable: (nullable): A #GCancellable
+ * @callback: Function to call when the tags are written
+ * @user_data: Data for @callback
+ *
+ * Sets the tags for a file without blocking.
+ */
+void
+sugar_file_attributes_set_tags_async(GFile               *file,
+                                     const gchar * const *tags,
+                                     GCancellable        *cancellable,
+                                     GAsyncReadyCallback  callback,
+                                     gpointer             user_data)
+{
+    GTask *task;
+    AttributesTaskData *data;
+
+    g_return_if_fail(G_IS_FILE(file));
+
+    task = create_task(file, set_tags_thread, sugar_file_attributes_set_tags_async,
+                       cancellable, callback, user_data);
+    data = g_task_get_task_data(task);
+    data->tags = g_strdupv((gchar **) tags);
+    queue_task(task);
+}
+
+/**
+ * sugar_file_attributes_set_tags_finish:
+ * @result: A #GAsyncResult
+ * @error: Return location for error
+ *
+ * Finishes an operation started with sugar_file_attributes_set_tags_async().
+ *
+ * Returns: %TRUE on success, %FALSE on error
+ */
+gboolean
+sugar_file_attributes_set_tags_finish(GAsyncResult *result, GError **error)
+{
+    g_return_val_if_fail(g_task_is_valid(result, NULL), FALSE);
+    g_return_val_if_fail(g_task_get_source_tag(G_TASK(result)) == sugar_file_attributes_set_tags_async, FALSE);
+
+    return g_task_propagate_boolean(G_TASK(result), error);
+}
+
+typedef struct {
+    gint dirfd;
+    gchar *path;
+    GPtrArray *names;
+    guint n_chunks;
+    gint next_chunk;
+    SugarFileAttributesLoadFunc load_func;
+    gpointer load_data;
+} DirectoryLoad;
+
+typedef struct {
+    GTask *task;
+    GPtrArray *names;
+    GPtrArray *attributes;
+} DirectoryBatch;
+
+static void
+directory_load_free(DirectoryLoad *load)
+{
+    if (load->dirfd >= 0) close(load->dirfd);
+    g_free(load->path);
+    if (load->names) g_ptr_array_unref(load->names);
+    g_free(load);
+}
+
+static void
+directory_batch_free(DirectoryBatch *batch)
+{
+    g_object_unref(batch->task);
+    g_ptr_array_unref(batch->names);
+    g_ptr_array_unref(batch->attributes);
+    g_free(batch);
+}
+
+static gboolean
+deliver_batch(gpointer user_data)
+{
+    DirectoryBatch *batch = user_data;
+    DirectoryLoad *load = g_task_get_task_data(batch->task);
+
+    // Nothing reaches the caller once the load is cancelled
+    if (!g_cancellable_is_cancelled(g_task_get_cancellable(batch->task))) {
+        load->load_func((const gchar * const *) batch->names->pdata,
+                        (SugarFileAttributes * const *) batch->attributes->pdata,
+                        batch->names->len, load->load_data);
+    }
+
+    return G_SOURCE_REMOVE;
+}
+
+/*
+ * Tells whether a directory entry is a subdirectory. Some FUSE and NFS
+ * setups and older XFS report DT_UNKNOWN, so those are stat()ed.
+ */
+static gboolean
+is_directory(gint dirfd, const struct dirent *entry)
+{
+    struct stat st;
+
+    if (entry->d_type != DT_UNKNOWN)
+        return entry->d_type == DT_DIR;
+
+    return fstatat(dirfd, entry->d_name, &st, 0) == 0 && S_ISDIR(st.st_mode);
+}
+
+/*
+ * Lists the entries of @directory that hold Journal objects, skipping
+ * hidden entries and subdirectories, and returns an open descriptor for
+ * it in @dirfd to load them with.
+ */
+GPtrArray*
+_sugar_file_attributes_read_directory(GFile *directory, gint *dirfd, GError **error)
+{
+    gchar *path = g_file_get_path(directory);
+    GPtrArray *names;
+    struct dirent *entry;
+    DIR *dir;
+    gint fd;
+
+    if (!path) {
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+                   "Directory is not on a local file system");
+        return NULL;
+    }
+
+    *dirfd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    fd = *dirfd >= 0 ? dup(*dirfd) : -1;
+    dir = fd >= 0 ? fdopendir(fd) : NULL;
+
+    if (!dir) {
+        int saved_errno = errno;
+        if (fd >= 0) close(fd);
+        g_set_error(error, G_IO_ERROR, g_io_error_from_errno(saved_errno),
+                   "Could not open %s: %s", path, g_strerror(saved_errno));
+        g_free(path);
+        return NULL;
+    }
+
+    // readdir() reads the entries in large getdents64() blocks
+    names = g_ptr_array_new_with_free_func(g_free);
+    while ((entry = readdir(dir)) != NULL) {
+        if (entry->d_name[0] == '.' || is_directory(*dirfd, entry))
+            continue;
+        g_ptr_array_add(names, g_strdup(entry->d_name));
+    }
+
+    closedir(dir);
+    g_free(path);
+    return names;
+}
+
+static gboolean
+read_directory(DirectoryLoad *load, GFile *directory, GError **error)
+{
+    load->names = _sugar_file_attributes_read_directory(directory, &load->dirfd, error);
+    if (!load->names)
+        return FALSE;
+
+    load->path = g_file_get_path(directory);
+
+    if (load->names->len <= FIRST_CHUNK_SIZE)
+        load->n_chunks = load->names->len > 0 ? 1 : 0;
+    else
+        load->n_chunks = 1 + (load->names->len - FIRST_CHUNK_SIZE + CHUNK_SIZE - 1) / CHUNK_SIZE;
+
+    return TRUE;
+}
+
+static gpointer
+load_directory_worker(gpointer user_data)
+{
+    GTask *task = user_data;
+    DirectoryLoad *load = g_task_get_task_data(task);
+    GCancellable *cancellable = g_task_get_cancellable(task);
+    GByteArray *scratch = g_byte_array_new();
+    guint chunk;
+
+    while ((chunk = (guint) g_atomic_int_add(&load->next_chunk, 1)) < load->n_chunks) {
+        guint start = chunk == 0 ? 0 : FIRST_CHUNK_SIZE + (chunk - 1) * CHUNK_SIZE;
+        guint end = MIN(chunk == 0 ? FIRST_CHUNK_SIZE : start + CHUNK_SIZE, load->names->len);
+        DirectoryBatch *batch;
+        SugarFileAttributes **attributes;
+        gboolean *loaded;
+        guint i;
+
+        if (g_cancellable_is_cancelled(cancellable))
+            break;
+
+        batch = g_new0(DirectoryBatch, 1);
+        batch->task = g_object_ref(task);
+        batch->names = g_ptr_array_new_full(end - start, g_free);
+        batch->attributes = g_ptr_array_new_full(end - start, (GDestroyNotify) sugar_file_attributes_free);
+
+        // The whole chunk is loaded together, so io_uring can batch it
+        attributes = g_new(SugarFileAttributes *, end - start);
+        loaded = g_new(gboolean, end - start);
+        for (i = start; i < end; i++)
+            attributes[i - start] = sugar_file_attributes_new();
+
+        _sugar_file_attributes_load_many_at(load->dirfd, load->path, (const gchar * const *) load->names->pdata + start,
+                                            end - start, attributes, loaded, scratch);
+
+        for (i = start; i < end; i++) {
+            // Entries removed since the directory was read are skipped
+            if (!loaded[i - start]) {
+                sugar_file_attributes_free(attributes[i - start]);
+                continue;
+            }
+
+            g_ptr_array_add(batch->names, g_strdup(g_ptr_array_index(load->names, i)));
+            g_ptr_array_add(batch->attributes, attributes[i - start]);
+        }
+
+        g_free(attributes);
+        g_free(loaded);
+
+        if (batch->names->len > 0) {
+            g_main_context_invoke_full(g_task_get_context(task), G_PRIORITY_DEFAULT,
+                                       deliver_batch, batch, (GDestroyNotify) directory_batch_free);
+        } else {
+            directory_batch_free(batch);
+        }
+    }
+
+    g_byte_array_unref(scratch);
+    return NULL;
+}
+
+static void
+load_directory_thread(GTask *task, gpointer source, gpointer task_data, GCancellable *cancellable)
+{
+    DirectoryLoad *load = task_data;
+    GFile *directory = g_object_get_data(G_OBJECT(task), "directory");
+    GPtrArray *threads;
+    GError *error = NULL;
+    guint n_workers;
+    guint i;
+
+    if (!read_directory(load, directory, &error)) {
+        g_task_return_error(task, error);
+        return;
+    }
+
+    n_workers = MIN(MIN(g_get_num_processors(), MAX_DIRECTORY_WORKERS), load->n_chunks);
+    threads = g_ptr_array_new();
+
+    // This thread loads chunks too, the others only join in on large directories
+    for (i = 1; i < n_workers; i++)
+        g_ptr_array_add(threads, g_thread_new("sugar-attrs-load", load_directory_worker, task));
+    load_directory_worker(task);
+
+    for (i = 0; i < threads->len; i++)
+        g_thread_join(g_ptr_array_index(threads, i));
+    g_ptr_array_unref(threads);
+
+    // Batches were queued before this, so the caller sees them all first
+    if (!g_task_return_error_if_cancelled(task))
+        g_task_return_boolean(task, TRUE);
+}
+
+/**
+ * sugar_file_attributes_load_directory_async:
+ * @directory: A #GFile for a local directory
+ * @load_func: Function called with each batch of results
+ * @load_data: Data for @load_func
+ * @cancellable: (nullable): A #GCancellable
+ * @callback: Function to call when every entry has been loaded
+ * @user_data: Data for @callback
+ *
+ * Loads the Sugar file attributes of every entry in @directory on
+ * several threads. Results are handed to @load_func in batches on the
+ * thread-default main context of the caller as they become available,
+ * in no particular order; the arrays are only valid during the call.
+ * Hidden entries and subdirectories are skipped. @callback runs after
+ * the last batch, and @load_data must stay valid until then.
+ */
+void
+sugar_file_attributes_load_directory_async(GFile                       *directory,
+                                           SugarFileAttributesLoadFunc  load_func,
+                                           gpointer                     load_data,
+                                           GCancellable                *cancellable,
+                                           GAsyncReadyCallback          callback,
+                                           gpointer                     user_data)
+{
+    GTask *task;
+    DirectoryLoad *load;
+
+    g_return_if_fail(G_IS_FILE(directory));
+    g_return_if_fail(load_func != NULL);
+
+    load = g_new0(DirectoryLoad, 1);
+    load->dirfd = -1;
+    load->load_func = load_func;
+    load->load_data = load_data;
+
+    task = g_task_new(NULL, cancellable, callback, user_data);
+    g_task_set_source_tag(task, sugar_file_attributes_load_directory_async);
+    g_task_set_task_data(task, load, (GDestroyNotify) directory_load_free);
+    g_object_set_data_full(G_OBJECT(task), "directory", g_object_ref(directory), g_object_unref);
+    g_task_run_in_thread(task, load_directory_thread);
+    g_object_unref(task);
+}
+
+/**
+ * sugar_file_attributes_load_directory_finish:
+ * @result: A #GAsyncResult
+ * @error: Return location for error
+ *
+ * Finishes an operation started with
+ * sugar_file_attributes_load_directory_async().
+ *
+ * Returns: %TRUE on success, %FALSE on error
+ */
+gboolean
+sugar_file_attributes_load_directory_finish(GAsyncResult *result, GError **error)
+{
+    g_return_val_if_fail(g_task_is_valid(result, NULL), FALSE);
+    g_return_val_if_fail(g_task_get_source_tag(G_TASK(result)) == sugar_file_attributes_load_directory_async, FALSE);
+
+    return g_task_propagate_boolean(G_TASK(result), error);
+}
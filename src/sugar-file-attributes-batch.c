@@ -0,0 +1,178 @@
+/*
+ * Copyright (C) 2025 MostlyK
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include "sugar-file-attributes-private.h"
+#include <string.h>
+
+/*
+ * Records live in fixed-size blocks so they never move once handed out,
+ * and their strings are bump-allocated from a GStringChunk. Loading a
+ * page of entries then costs a few block allocations instead of several
+ * per record, and freeing it is one call per block.
+ */
+#define BLOCK_RECORDS 256
+#define STRING_CHUNK_SIZE (16 * 1024)
+
+struct _SugarFileAttributesBatch {
+    GPtrArray *blocks;
+    GStringChunk *strings;
+    guint n_records;
+};
+
+// Returns the next free record, only counted once filled in
+static SugarFileAttributes*
+next_record(SugarFileAttributesBatch *batch)
+{
+    SugarFileAttributes *record;
+
+    if (batch->n_records == batch->blocks->len * BLOCK_RECORDS)
+        g_ptr_array_add(batch->blocks, g_new(SugarFileAttributes, BLOCK_RECORDS));
+
+    record = (SugarFileAttributes *) batch->blocks->pdata[batch->n_records / BLOCK_RECORDS] +
+             batch->n_records % BLOCK_RECORDS;
+    memset(record, 0, sizeof(*record));
+    return record;
+}
+
+/**
+ * sugar_file_attributes_batch_new:
+ *
+ * Creates an empty batch of attribute records. A batch owns its records
+ * and their strings and releases them all at once, which suits loading
+ * a page of Journal entries. It is not thread safe.
+ *
+ * Returns: (transfer full): A new #SugarFileAttributesBatch. Free with sugar_file_attributes_batch_free().
+ */
+SugarFileAttributesBatch*
+sugar_file_attributes_batch_new(void)
+{
+    SugarFileAttributesBatch *batch = g_new0(SugarFileAttributesBatch, 1);
+
+    batch->blocks = g_ptr_array_new_with_free_func(g_free);
+    batch->strings = g_string_chunk_new(STRING_CHUNK_SIZE);
+    return batch;
+}
+
+/**
+ * sugar_file_attributes_batch_free:
+ * @batch: A #SugarFileAttributesBatch
+ *
+ * Frees a batch together with all of its records.
+ */
+void
+sugar_file_attributes_batch_free(SugarFileAttributesBatch *batch)
+{
+    if (!batch) return;
+
+    g_ptr_array_unref(batch->blocks);
+    g_string_chunk_free(batch->strings);
+    g_free(batch);
+}
+
+/**
+ * sugar_file_attributes_batch_load_at:
+ * @batch: A #SugarFileAttributesBatch
+ * @dirfd: A directory file descriptor, or %AT_FDCWD
+ * @name: Name of the file relative to @dirfd
+ * @scratch: (nullable): A reusable buffer, see sugar_file_attributes_load_at_full()
+ * @error: Return location for error
+ *
+ * Loads the attributes of a file into a new record at the end of
+ * @batch. Nothing is added on error.
+ *
+ * Returns: %TRUE on success, %FALSE on error
+ */
+gboolean
+sugar_file_attributes_batch_load_at(SugarFileAttributesBatch *batch, gint dirfd, const gchar *name,
+                                    GByteArray *scratch, GError **error)
+{
+    g_return_val_if_fail(batch != NULL, FALSE);
+    g_return_val_if_fail(name != NULL, FALSE);
+
+    if (!_sugar_file_attributes_load_at_arena(next_record(batch), dirfd, name, scratch, batch->strings, error))
+        return FALSE;
+
+    batch->n_records++;
+    return TRUE;
+}
+
+/**
+ * sugar_file_attributes_batch_add:
+ * @batch: A #SugarFileAttributesBatch
+ * @attrs: A #SugarFileAttributes
+ *
+ * Appends a copy of @attrs to @batch.
+ *
+ * Returns: (transfer none): The new record, owned by @batch
+ */
+const SugarFileAttributes*
+sugar_file_attributes_batch_add(SugarFileAttributesBatch *batch, const SugarFileAttributes *attrs)
+{
+    SugarFileAttributes *record;
+
+    g_return_val_if_fail(batch != NULL, NULL);
+    g_return_val_if_fail(attrs != NULL, NULL);
+
+    record = next_record(batch);
+    *record = *attrs;
+    record->title = attrs->title ? g_string_chunk_insert(batch->strings, attrs->title) : NULL;
+    record->description = attrs->description ? g_string_chunk_insert(batch->strings, attrs->description) : NULL;
+    record->tags = attrs->tags ? g_string_chunk_insert(batch->strings, attrs->tags) : NULL;
+    record->activity = attrs->activity ? g_string_chunk_insert(batch->strings, attrs->activity) : NULL;
+    record->preview_path = attrs->preview_path ? g_string_chunk_insert(batch->strings, attrs->preview_path) : NULL;
+    memset(record->snapshot, 0, sizeof(record->snapshot));
+
+    batch->n_records++;
+    return record;
+}
+
+/**
+ * sugar_file_attributes_batch_get_length:
+ * @batch: A #SugarFileAttributesBatch
+ *
+ * Gets the number of records in @batch.
+ *
+ * Returns: The number of records
+ */
+guint
+sugar_file_attributes_batch_get_length(SugarFileAttributesBatch *batch)
+{
+    g_return_val_if_fail(batch != NULL, 0);
+
+    return batch->n_records;
+}
+
+/**
+ * sugar_file_attributes_batch_get:
+ * @batch: A #SugarFileAttributesBatch
+ * @index: Position of the record, in the order records were added
+ *
+ * Gets a record of @batch. Records stay at the same address until the
+ * batch is freed and must not be freed or modified by the caller.
+ *
+ * Returns: (transfer none): The record at @index
+ */
+const SugarFileAttributes*
+sugar_file_attributes_batch_get(SugarFileAttributesBatch *batch, guint index)
+{
+    g_return_val_if_fail(batch != NULL, NULL);
+    g_return_val_if_fail(index < batch->n_records, NULL);
+
+    return (SugarFileAttributes *) batch->blocks->pdata[index / BLOCK_RECORDS] + index % BLOCK_RECORDS;
+}
@@ -0,0 +1,312 @@
+/*
+ * Copyright (C) 2025 MostlyK
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include "sugar-file-attributes-private.h"
+
+/*
+ * Process-wide cache of loaded attributes, keyed by inode so hard links
+ * and different paths to the same file share one entry. An entry is
+ * only served while the file's ctime is unchanged; every xattr write
+ * updates ctime, so changes made by other processes are noticed with a
+ * single stat().
+ *
+ * Timestamps are only as fine as the file system clock tick. An entry
+ * read within one tick of its ctime could miss a later write landing in
+ * the same tick, so such entries are never served; the next read loads
+ * the file again and stores a trustworthy copy.
+ */
+#define DEFAULT_MAX_ENTRIES 512
+#define TIMESTAMP_GRANULARITY_USEC 10000
+
+typedef struct {
+    dev_t dev;
+    ino_t ino;
+} CacheKey;
+
+typedef struct {
+    CacheKey key;
+    struct timespec ctime;
+    gboolean racy;
+    SugarFileAttributes *attrs;
+    GList link;
+} CacheEntry;
+
+static GMutex cache_lock;
+static GHashTable *entries;
+static GQueue lru = G_QUEUE_INIT;
+static guint max_entries = DEFAULT_MAX_ENTRIES;
+static guint64 hits;
+static guint64 misses;
+
+static guint
+cache_key_hash(gconstpointer key)
+{
+    const CacheKey *k = key;
+    guint64 value = (guint64) k->ino ^ ((guint64) k->dev << 32);
+
+    return (guint) (value ^ (value >> 32));
+}
+
+static gboolean
+cache_key_equal(gconstpointer a, gconstpointer b)
+{
+    const CacheKey *ka = a;
+    const CacheKey *kb = b;
+
+    return ka->dev == kb->dev && ka->ino == kb->ino;
+}
+
+static gboolean
+is_racy(const struct timespec *ctime)
+{
+    gint64 ctime_usec = (gint64) ctime->tv_sec * G_USEC_PER_SEC + ctime->tv_nsec / 1000;
+
+    return g_get_real_time() - ctime_usec < TIMESTAMP_GRANULARITY_USEC;
+}
+
+static gboolean
+same_ctime(const CacheEntry *entry, const struct stat *st)
+{
+    return entry->ctime.tv_sec == st->st_ctim.tv_sec && entry->ctime.tv_nsec == st->st_ctim.tv_nsec;
+}
+
+static CacheEntry*
+find_entry(const struct stat *st)
+{
+    CacheKey key = { st->st_dev, st->st_ino };
+
+    if (!entries) return NULL;
+    return g_hash_table_lookup(entries, &key);
+}
+
+static void
+remove_entry(CacheEntry *entry)
+{
+    g_queue_unlink(&lru, &entry->link);
+    g_hash_table_remove(entries, &entry->key);
+    sugar_file_attributes_free(entry->attrs);
+    g_free(entry);
+}
+
+static void
+touch_entry(CacheEntry *entry)
+{
+    g_queue_unlink(&lru, &entry->link);
+    g_queue_push_head_link(&lru, &entry->link);
+}
+
+static void
+trim_entries(void)
+{
+    while (lru.length > max_entries)
+        remove_entry(g_queue_peek_tail_link(&lru)->data);
+}
+
+// Returns the entry for @st if it can be served; call with the lock held
+static CacheEntry*
+lookup_entry(const struct stat *st)
+{
+    CacheEntry *entry = find_entry(st);
+
+    if (entry && !entry->racy && same_ctime(entry, st)) {
+        touch_entry(entry);
+        hits++;
+        return entry;
+    }
+
+    if (entry) remove_entry(entry);
+    misses++;
+    return NULL;
+}
+
+/*
+ * Copies the fields in @mask of the cached attributes of the file
+ * described by @st into @attrs. Returns %FALSE, leaving @attrs alone,
+ * if there is no entry that is still valid.
+ */
+gboolean
+_sugar_file_attributes_cache_load(const struct stat *st, SugarFileAttributes *attrs, SugarFileAttributeMask mask)
+{
+    CacheEntry *entry;
+
+    g_mutex_lock(&cache_lock);
+
+    entry = lookup_entry(st);
+    if (entry)
+        _sugar_file_attributes_copy_fields(attrs, entry->attrs, mask);
+
+    g_mutex_unlock(&cache_lock);
+    return entry != NULL;
+}
+
+/*
+ * Stores a copy of @attrs, which must have been read or written after
+ * @st was taken.
+ */
+void
+_sugar_file_attributes_cache_store(const struct stat *st, const SugarFileAttributes *attrs)
+{
+    CacheEntry *entry;
+
+    g_mutex_lock(&cache_lock);
+
+    if (max_entries == 0) {
+        g_mutex_unlock(&cache_lock);
+        return;
+    }
+
+    if (!entries)
+        entries = g_hash_table_new(cache_key_hash, cache_key_equal);
+
+    entry = find_entry(st);
+    if (entry) {
+        sugar_file_attributes_free(entry->attrs);
+        touch_entry(entry);
+    } else {
+        entry = g_new0(CacheEntry, 1);
+        entry->key.dev = st->st_dev;
+        entry->key.ino = st->st_ino;
+        entry->link.data = entry;
+        g_hash_table_insert(entries, &entry->key, entry);
+        g_queue_push_head_link(&lru, &entry->link);
+    }
+
+    entry->attrs = g_boxed_copy(sugar_file_attributes_get_type(), (gpointer) attrs);
+    entry->ctime = st->st_ctim;
+    entry->racy = is_racy(&st->st_ctim);
+    trim_entries();
+
+    g_mutex_unlock(&cache_lock);
+}
+
+/*
+ * Applies a single-field write to the cached entry. @before is the
+ * file state the entry must match, @after the state after the write;
+ * an entry that was already stale is dropped instead.
+ */
+void
+_sugar_file_attributes_cache_update_string(const struct stat *before,
+                                           const struct stat *after,
+                                           glong              field_offset,
+                                           const gchar       *value)
+{
+    CacheEntry *entry;
+
+    g_mutex_lock(&cache_lock);
+
+    entry = find_entry(before);
+    if (entry && (entry->racy || !same_ctime(entry, before))) {
+        remove_entry(entry);
+    } else if (entry) {
+        _sugar_file_attributes_assign_string(entry->attrs, field_offset, value);
+        entry->ctime = after->st_ctim;
+        entry->racy = is_racy(&after->st_ctim);
+        touch_entry(entry);
+    }
+
+    g_mutex_unlock(&cache_lock);
+}
+
+void
+_sugar_file_attributes_cache_invalidate(const struct stat *st)
+{
+    CacheEntry *entry;
+
+    g_mutex_lock(&cache_lock);
+
+    entry = find_entry(st);
+    if (entry) remove_entry(entry);
+
+    g_mutex_unlock(&cache_lock);
+}
+
+/**
+ * sugar_file_attributes_cache_set_max_entries:
+ * @n_entries: Maximum number of files to keep, 0 disables the cache
+ *
+ * Sets how many files the process-wide attribute cache holds. When it
+ * is full, the least recently used entry is dropped.
+ */
+void
+sugar_file_attributes_cache_set_max_entries(guint n_entries)
+{
+    g_mutex_lock(&cache_lock);
+
+    max_entries = n_entries;
+    if (entries) trim_entries();
+
+    g_mutex_unlock(&cache_lock);
+}
+
+/**
+ * sugar_file_attributes_cache_get_max_entries:
+ *
+ * Gets the capacity of the process-wide attribute cache.
+ *
+ * Returns: The maximum number of cached files
+ */
+guint
+sugar_file_attributes_cache_get_max_entries(void)
+{
+    guint result;
+
+    g_mutex_lock(&cache_lock);
+    result = max_entries;
+    g_mutex_unlock(&cache_lock);
+
+    return result;
+}
+
+/**
+ * sugar_file_attributes_cache_get_stats:
+ * @n_hits: (out) (optional): Return location for the number of cache hits
+ * @n_misses: (out) (optional): Return location for the number of cache misses
+ *
+ * Gets the counters of the process-wide attribute cache since the
+ * last call to sugar_file_attributes_cache_clear().
+ */
+void
+sugar_file_attributes_cache_get_stats(guint64 *n_hits, guint64 *n_misses)
+{
+    g_mutex_lock(&cache_lock);
+
+    if (n_hits) *n_hits = hits;
+    if (n_misses) *n_misses = misses;
+
+    g_mutex_unlock(&cache_lock);
+}
+
+/**
+ * sugar_file_attributes_cache_clear:
+ *
+ * Drops every entry of the process-wide attribute cache and resets its
+ * counters.
+ */
+void
+sugar_file_attributes_cache_clear(void)
+{
+    g_mutex_lock(&cache_lock);
+
+    while (!g_queue_is_empty(&lru))
+        remove_entry(g_queue_peek_head_link(&lru)->data);
+    hits = 0;
+    misses = 0;
+
+    g_mutex_unlock(&cache_lock);
+}
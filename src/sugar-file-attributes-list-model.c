@@ -0,0 +1,624 @@
+/*
+ * Copyright (C) 2025 MostlyK
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include "sugar-file-attributes-list-model.h"
+#include "sugar-file-attributes-private.h"
+#include <string.h>
+#include <unistd.h>
+
+/*
+ * A list model over the entries of a Journal directory that only loads
+ * what is looked at. The entry names are read once up front, which is
+ * all a list view needs for its scrollbar; the attributes of a position
+ * are loaded when the view asks for its item.
+ *
+ * Each request also starts loading the next few positions in the
+ * direction the view is scrolling on a worker thread, so rows are
+ * usually loaded before they are shown. Loaded items are kept in a tree
+ * ordered by position, and once there are more than the limit the ones
+ * farthest from the last request are dropped.
+ */
+#define DEFAULT_PREFETCH 32
+#define DEFAULT_MAX_LOADED 256
+
+struct _SugarFileAttributesItem {
+    GObject parent_instance;
+
+    GFile *directory;
+    gchar *name;
+    GFile *file;
+    SugarFileAttributes *attributes;
+};
+
+struct _SugarFileAttributesItemClass {
+    GObjectClass parent_class;
+};
+
+enum {
+    ITEM_PROP_0,
+    ITEM_PROP_NAME,
+    ITEM_PROP_FILE,
+    ITEM_PROP_ATTRIBUTES,
+    N_ITEM_PROPS
+};
+
+static GParamSpec *item_props[N_ITEM_PROPS];
+
+G_DEFINE_TYPE(SugarFileAttributesItem, sugar_file_attributes_item, G_TYPE_OBJECT)
+
+typedef struct {
+    guint position;
+    GArray *positions;
+    GPtrArray *names;
+    GPtrArray *attributes;
+} Prefetch;
+
+struct _SugarFileAttributesListModel {
+    GObject parent_instance;
+
+    GFile *directory;
+    gint dirfd;
+    GPtrArray *names;
+    GByteArray *scratch;
+
+    GTree *loaded;
+    guint prefetch;
+    guint max_loaded;
+    guint last_position;
+    gint direction;
+    GCancellable *prefetch_cancellable;
+};
+
+struct _SugarFileAttributesListModelClass {
+    GObjectClass parent_class;
+};
+
+static void sugar_file_attributes_list_model_iface_init(GListModelInterface *iface);
+
+G_DEFINE_TYPE_WITH_CODE(SugarFileAttributesListModel, sugar_file_attributes_list_model, G_TYPE_OBJECT,
+                        G_IMPLEMENT_INTERFACE(G_TYPE_LIST_MODEL, sugar_file_attributes_list_model_iface_init))
+
+static void
+sugar_file_attributes_item_get_property(GObject *object, guint prop_id, GValue *value, GParamSpec *pspec)
+{
+    SugarFileAttributesItem *self = SUGAR_FILE_ATTRIBUTES_ITEM(object);
+
+    switch (prop_id) {
+    case ITEM_PROP_NAME:
+        g_value_set_string(value, self->name);
+        break;
+    case ITEM_PROP_FILE:
+        g_value_set_object(value, sugar_file_attributes_item_get_file(self));
+        break;
+    case ITEM_PROP_ATTRIBUTES:
+        g_value_set_boxed(value, self->attributes);
+        break;
+    default:
+        G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+        break;
+    }
+}
+
+static void
+sugar_file_attributes_item_finalize(GObject *object)
+{
+    SugarFileAttributesItem *self = SUGAR_FILE_ATTRIBUTES_ITEM(object);
+
+    g_object_unref(self->directory);
+    g_clear_object(&self->file);
+    g_free(self->name);
+    sugar_file_attributes_free(self->attributes);
+
+    G_OBJECT_CLASS(sugar_file_attributes_item_parent_class)->finalize(object);
+}
+
+static void
+sugar_file_attributes_item_class_init(SugarFileAttributesItemClass *item_class)
+{
+    GObjectClass *gobject_class = G_OBJECT_CLASS(item_class);
+
+    gobject_class->get_property = sugar_file_attributes_item_get_property;
+    gobject_class->finalize = sugar_file_attributes_item_finalize;
+
+    item_props[ITEM_PROP_NAME] =
+        g_param_spec_string("name", "Name", "Name of the entry in its directory",
+                            NULL, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS);
+    item_props[ITEM_PROP_FILE] =
+        g_param_spec_object("file", "File", "The entry",
+                            G_TYPE_FILE, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS);
+    item_props[ITEM_PROP_ATTRIBUTES] =
+        g_param_spec_boxed("attributes", "Attributes", "Sugar file attributes of the entry",
+                           sugar_file_attributes_get_type(), G_PARAM_READABLE | G_PARAM_STATIC_STRINGS);
+
+    g_object_class_install_properties(gobject_class, N_ITEM_PROPS, item_props);
+}
+
+static void
+sugar_file_attributes_item_init(SugarFileAttributesItem *self)
+{
+}
+
+SugarFileAttributesItem*
+_sugar_file_attributes_item_new(GFile *directory, const gchar *name, SugarFileAttributes *attributes)
+{
+    SugarFileAttributesItem *item = g_object_new(SUGAR_TYPE_FILE_ATTRIBUTES_ITEM, NULL);
+
+    item->directory = g_object_ref(directory);
+    item->name = g_strdup(name);
+    item->attributes = attributes;
+    return item;
+}
+
+/**
+ * sugar_file_attributes_item_get_name:
+ * @item: A #SugarFileAttributesItem
+ *
+ * Gets the name of the entry relative to the directory of its model.
+ *
+ * Returns: (transfer none): The entry name
+ */
+const gchar*
+sugar_file_attributes_item_get_name(SugarFileAttributesItem *item)
+{
+    g_return_val_if_fail(SUGAR_IS_FILE_ATTRIBUTES_ITEM(item), NULL);
+
+    return item->name;
+}
+
+/**
+ * sugar_file_attributes_item_get_file:
+ * @item: A #SugarFileAttributesItem
+ *
+ * Gets the entry as a #GFile.
+ *
+ * Returns: (transfer none): The entry
+ */
+GFile*
+sugar_file_attributes_item_get_file(SugarFileAttributesItem *item)
+{
+    g_return_val_if_fail(SUGAR_IS_FILE_ATTRIBUTES_ITEM(item), NULL);
+
+    // Most rows are never activated, so the GFile is made on first use
+    if (!item->file)
+        item->file = g_file_get_child(item->directory, item->name);
+
+    return item->file;
+}
+
+/**
+ * sugar_file_attributes_item_get_attributes:
+ * @item: A #SugarFileAttributesItem
+ *
+ * Gets the attributes of the entry as they were when it was loaded.
+ * Entries that could not be read have empty attributes.
+ *
+ * Returns: (transfer none): The attributes
+ */
+const SugarFileAttributes*
+sugar_file_attributes_item_get_attributes(SugarFileAttributesItem *item)
+{
+    g_return_val_if_fail(SUGAR_IS_FILE_ATTRIBUTES_ITEM(item), NULL);
+
+    return item->attributes;
+}
+
+static gint
+compare_positions(gconstpointer a, gconstpointer b, gpointer user_data)
+{
+    guint pa = GPOINTER_TO_UINT(a);
+    guint pb = GPOINTER_TO_UINT(b);
+
+    return pa < pb ? -1 : pa > pb ? 1 : 0;
+}
+
+static guint
+distance(guint a, guint b)
+{
+    return a > b ? a - b : b - a;
+}
+
+// Drops the items farthest from the last request, those behind it first
+static void
+evict_items(SugarFileAttributesListModel *self)
+{
+    while ((guint) g_tree_nnodes(self->loaded) > self->max_loaded) {
+        guint first = GPOINTER_TO_UINT(g_tree_node_key(g_tree_node_first(self->loaded)));
+        guint last = GPOINTER_TO_UINT(g_tree_node_key(g_tree_node_last(self->loaded)));
+        guint to_first = distance(first, self->last_position);
+        guint to_last = distance(last, self->last_position);
+        gboolean drop_first = to_first > to_last || (to_first == to_last && self->direction >= 0);
+
+        g_tree_remove(self->loaded, GUINT_TO_POINTER(drop_first ? first : last));
+    }
+}
+
+static SugarFileAttributesItem*
+add_item(SugarFileAttributesListModel *self, guint position, SugarFileAttributes *attributes)
+{
+    SugarFileAttributesItem *item = _sugar_file_attributes_item_new(self->directory,
+                                                                    self->names->pdata[position],
+                                                                    attributes);
+
+    g_tree_insert(self->loaded, GUINT_TO_POINTER(position), item);
+    return item;
+}
+
+static void
+prefetch_free(Prefetch *prefetch)
+{
+    g_array_unref(prefetch->positions);
+    g_ptr_array_unref(prefetch->names);
+    g_ptr_array_unref(prefetch->attributes);
+    g_free(prefetch);
+}
+
+static void
+prefetch_thread(GTask *task, gpointer source, gpointer task_data, GCancellable *cancellable)
+{
+    SugarFileAttributesListModel *self = source;
+    Prefetch *prefetch = task_data;
+    GByteArray *scratch = g_byte_array_new();
+
+    for (guint i = 0; i < prefetch->names->len && !g_cancellable_is_cancelled(cancellable); i++) {
+        SugarFileAttributes *attrs = sugar_file_attributes_new();
+
+        sugar_file_attributes_load_at_full(attrs, self->dirfd, prefetch->names->pdata[i], scratch, NULL);
+        g_ptr_array_add(prefetch->attributes, attrs);
+    }
+
+    g_byte_array_unref(scratch);
+    g_task_return_boolean(task, TRUE);
+}
+
+static void schedule_prefetch(SugarFileAttributesListModel *self);
+
+static void
+prefetch_done(GObject *source, GAsyncResult *result, gpointer user_data)
+{
+    SugarFileAttributesListModel *self = SUGAR_FILE_ATTRIBUTES_LIST_MODEL(source);
+    Prefetch *prefetch = g_task_get_task_data(G_TASK(result));
+
+    g_clear_object(&self->prefetch_cancellable);
+
+    // Whatever was loaded before a cancellation is still good
+    for (guint i = 0; i < prefetch->attributes->len; i++) {
+        guint position = g_array_index(prefetch->positions, guint, i);
+
+        if (g_tree_lookup(self->loaded, GUINT_TO_POINTER(position)))
+            continue;
+        add_item(self, position, g_steal_pointer(&prefetch->attributes->pdata[i]));
+    }
+    evict_items(self);
+
+    // The view moved on while this batch was loading
+    if (self->last_position != prefetch->position)
+        schedule_prefetch(self);
+}
+
+static void
+schedule_prefetch(SugarFileAttributesListModel *self)
+{
+    // Keep the window within half the limit so prefetched items are not evicted right away
+    guint n = MIN(self->prefetch, self->max_loaded / 2);
+    guint start;
+    guint end;
+    Prefetch *prefetch;
+    GTask *task;
+
+    if (n == 0 || self->prefetch_cancellable)
+        return;
+
+    if (self->direction >= 0) {
+        start = self->last_position + 1;
+        end = MIN(start + n, self->names->len);
+    } else {
+        end = self->last_position;
+        start = end > n ? end - n : 0;
+    }
+
+    prefetch = g_new0(Prefetch, 1);
+    prefetch->position = self->last_position;
+    prefetch->positions = g_array_new(FALSE, FALSE, sizeof(guint));
+    prefetch->names = g_ptr_array_new();
+    prefetch->attributes = g_ptr_array_new_with_free_func((GDestroyNotify) sugar_file_attributes_free);
+
+    // Nearest first, so a fast scroll gets the rows it reaches first
+    for (guint i = 0; start + i < end; i++) {
+        guint position = self->direction >= 0 ? start + i : end - 1 - i;
+
+        if (g_tree_lookup(self->loaded, GUINT_TO_POINTER(position)))
+            continue;
+        g_array_append_val(prefetch->positions, position);
+        g_ptr_array_add(prefetch->names, self->names->pdata[position]);
+    }
+
+    if (prefetch->positions->len == 0) {
+        prefetch_free(prefetch);
+        return;
+    }
+
+    self->prefetch_cancellable = g_cancellable_new();
+    task = g_task_new(self, self->prefetch_cancellable, prefetch_done, NULL);
+    g_task_set_source_tag(task, schedule_prefetch);
+    g_task_set_task_data(task, prefetch, (GDestroyNotify) prefetch_free);
+    g_task_run_in_thread(task, prefetch_thread);
+    g_object_unref(task);
+}
+
+static GType
+sugar_file_attributes_list_model_get_item_type(GListModel *list)
+{
+    return SUGAR_TYPE_FILE_ATTRIBUTES_ITEM;
+}
+
+static guint
+sugar_file_attributes_list_model_get_n_items(GListModel *list)
+{
+    return SUGAR_FILE_ATTRIBUTES_LIST_MODEL(list)->names->len;
+}
+
+static gpointer
+sugar_file_attributes_list_model_get_item(GListModel *list, guint position)
+{
+    SugarFileAttributesListModel *self = SUGAR_FILE_ATTRIBUTES_LIST_MODEL(list);
+    SugarFileAttributesItem *item;
+    gint direction = self->direction;
+
+    if (position >= self->names->len)
+        return NULL;
+
+    if (position != self->last_position)
+        direction = position > self->last_position ? 1 : -1;
+
+    // A prefetch running the other way is of no use anymore
+    if (direction != self->direction && self->prefetch_cancellable)
+        g_cancellable_cancel(self->prefetch_cancellable);
+
+    self->direction = direction;
+    self->last_position = position;
+
+    item = g_tree_lookup(self->loaded, GUINT_TO_POINTER(position));
+    if (!item) {
+        SugarFileAttributes *attrs = sugar_file_attributes_new();
+
+        // Entries removed since the directory was read keep empty attributes
+        sugar_file_attributes_load_at_full(attrs, self->dirfd, self->names->pdata[position],
+                                           self->scratch, NULL);
+        item = add_item(self, position, attrs);
+    }
+    g_object_ref(item);
+
+    evict_items(self);
+    schedule_prefetch(self);
+    return item;
+}
+
+static void
+sugar_file_attributes_list_model_iface_init(GListModelInterface *iface)
+{
+    iface->get_item_type = sugar_file_attributes_list_model_get_item_type;
+    iface->get_n_items = sugar_file_attributes_list_model_get_n_items;
+    iface->get_item = sugar_file_attributes_list_model_get_item;
+}
+
+static void
+sugar_file_attributes_list_model_dispose(GObject *object)
+{
+    SugarFileAttributesListModel *self = SUGAR_FILE_ATTRIBUTES_LIST_MODEL(object);
+
+    if (self->prefetch_cancellable)
+        g_cancellable_cancel(self->prefetch_cancellable);
+
+    G_OBJECT_CLASS(sugar_file_attributes_list_model_parent_class)->dispose(object);
+}
+
+static void
+sugar_file_attributes_list_model_finalize(GObject *object)
+{
+    SugarFileAttributesListModel *self = SUGAR_FILE_ATTRIBUTES_LIST_MODEL(object);
+
+    // A running prefetch holds a reference, so it has finished by now
+    g_clear_object(&self->prefetch_cancellable);
+    g_tree_unref(self->loaded);
+    if (self->names) g_ptr_array_unref(self->names);
+    g_byte_array_unref(self->scratch);
+    if (self->dirfd >= 0) close(self->dirfd);
+    g_clear_object(&self->directory);
+
+    G_OBJECT_CLASS(sugar_file_attributes_list_model_parent_class)->finalize(object);
+}
+
+static void
+sugar_file_attributes_list_model_class_init(SugarFileAttributesListModelClass *model_class)
+{
+    GObjectClass *gobject_class = G_OBJECT_CLASS(model_class);
+
+    gobject_class->dispose = sugar_file_attributes_list_model_dispose;
+    gobject_class->finalize = sugar_file_attributes_list_model_finalize;
+}
+
+static void
+sugar_file_attributes_list_model_init(SugarFileAttributesListModel *self)
+{
+    self->dirfd = -1;
+    self->scratch = g_byte_array_new();
+    self->loaded = g_tree_new_full(compare_positions, NULL, NULL, g_object_unref);
+    self->prefetch = DEFAULT_PREFETCH;
+    self->max_loaded = DEFAULT_MAX_LOADED;
+}
+
+static gint
+compare_names(gconstpointer a, gconstpointer b)
+{
+    return strcmp(*(const gchar * const *) a, *(const gchar * const *) b);
+}
+
+/**
+ * sugar_file_attributes_list_model_new:
+ * @directory: A #GFile for a local directory
+ * @error: Return location for error
+ *
+ * Creates a #GListModel of #SugarFileAttributesItem for the entries of
+ * @directory, in name order, skipping hidden entries and
+ * subdirectories. Only the names are read here; attributes are loaded
+ * as items are requested, so this is meant to back a #GtkListView or
+ * #GtkGridView. The model is a snapshot and does not follow later
+ * changes to the directory.
+ *
+ * Returns: (transfer full) (nullable): A new #SugarFileAttributesListModel, or %NULL on error
+ */
+SugarFileAttributesListModel*
+sugar_file_attributes_list_model_new(GFile *directory, GError **error)
+{
+    SugarFileAttributesListModel *self;
+
+    g_return_val_if_fail(G_IS_FILE(directory), NULL);
+
+    self = g_object_new(SUGAR_TYPE_FILE_ATTRIBUTES_LIST_MODEL, NULL);
+    self->directory = g_object_ref(directory);
+    self->names = _sugar_file_attributes_read_directory(directory, &self->dirfd, error);
+
+    if (!self->names) {
+        g_object_unref(self);
+        return NULL;
+    }
+
+    g_ptr_array_sort(self->names, compare_names);
+    return self;
+}
+
+/**
+ * sugar_file_attributes_list_model_get_directory:
+ * @model: A #SugarFileAttributesListModel
+ *
+ * Gets the directory listed by @model.
+ *
+ * Returns: (transfer none): The directory
+ */
+GFile*
+sugar_file_attributes_list_model_get_directory(SugarFileAttributesListModel *model)
+{
+    g_return_val_if_fail(SUGAR_IS_FILE_ATTRIBUTES_LIST_MODEL(model), NULL);
+
+    return model->directory;
+}
+
+/**
+ * sugar_file_attributes_list_model_get_name:
+ * @model: A #SugarFileAttributesListModel
+ * @position: Position of the entry
+ *
+ * Gets the name of the entry at @position without loading it.
+ *
+ * Returns: (transfer none) (nullable): The entry name, or %NULL if @position is out of range
+ */
+const gchar*
+sugar_file_attributes_list_model_get_name(SugarFileAttributesListModel *model, guint position)
+{
+    g_return_val_if_fail(SUGAR_IS_FILE_ATTRIBUTES_LIST_MODEL(model), NULL);
+
+    return position < model->names->len ? model->names->pdata[position] : NULL;
+}
+
+/**
+ * sugar_file_attributes_list_model_set_prefetch:
+ * @model: A #SugarFileAttributesListModel
+ * @n_items: Number of items to load ahead, or 0
+ *
+ * Sets how many items past the last requested one are loaded in the
+ * background, in the direction the view is scrolling. At most half of
+ * the loaded item limit is prefetched. The default is 32.
+ */
+void
+sugar_file_attributes_list_model_set_prefetch(SugarFileAttributesListModel *model, guint n_items)
+{
+    g_return_if_fail(SUGAR_IS_FILE_ATTRIBUTES_LIST_MODEL(model));
+
+    model->prefetch = n_items;
+}
+
+/**
+ * sugar_file_attributes_list_model_get_prefetch:
+ * @model: A #SugarFileAttributesListModel
+ *
+ * Gets the value set with sugar_file_attributes_list_model_set_prefetch().
+ *
+ * Returns: The number of items loaded ahead
+ */
+guint
+sugar_file_attributes_list_model_get_prefetch(SugarFileAttributesListModel *model)
+{
+    g_return_val_if_fail(SUGAR_IS_FILE_ATTRIBUTES_LIST_MODEL(model), 0);
+
+    return model->prefetch;
+}
+
+/**
+ * sugar_file_attributes_list_model_set_max_loaded:
+ * @model: A #SugarFileAttributesListModel
+ * @n_items: Number of items to keep loaded, at least 1
+ *
+ * Sets how many items the model keeps loaded; beyond that, those
+ * farthest from the last requested position are dropped and loaded
+ * again if requested. Items still referenced elsewhere, such as by
+ * visible rows, stay alive regardless. The default is 256, several
+ * screenfuls of rows.
+ */
+void
+sugar_file_attributes_list_model_set_max_loaded(SugarFileAttributesListModel *model, guint n_items)
+{
+    g_return_if_fail(SUGAR_IS_FILE_ATTRIBUTES_LIST_MODEL(model));
+    g_return_if_fail(n_items > 0);
+
+    model->max_loaded = n_items;
+    evict_items(model);
+}
+
+/**
+ * sugar_file_attributes_list_model_get_max_loaded:
+ * @model: A #SugarFileAttributesListModel
+ *
+ * Gets the value set with sugar_file_attributes_list_model_set_max_loaded().
+ *
+ * Returns: The number of items kept loaded
+ */
+guint
+sugar_file_attributes_list_model_get_max_loaded(SugarFileAttributesListModel *model)
+{
+    g_return_val_if_fail(SUGAR_IS_FILE_ATTRIBUTES_LIST_MODEL(model), 0);
+
+    return model->max_loaded;
+}
+
+/**
+ * sugar_file_attributes_list_model_get_n_loaded:
+ * @model: A #SugarFileAttributesListModel
+ *
+ * Gets how many items the model currently holds loaded, including
+ * prefetched ones.
+ *
+ * Returns: The number of loaded items
+ */
+guint
+sugar_file_attributes_list_model_get_n_loaded(SugarFileAttributesListModel *model)
+{
+    g_return_val_if_fail(SUGAR_IS_FILE_ATTRIBUTES_LIST_MODEL(model), 0);
+
+    return g_tree_nnodes(model->loaded);
+}
@@ -0,0 +1,62 @@
+/*
+ * Copyright (C) 2025 MostlyK
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __SUGAR_FILE_ATTRIBUTES_LIST_MODEL_H__
+#define __SUGAR_FILE_ATTRIBUTES_LIST_MODEL_H__
+
+#include <gio/gio.h>
+#include "sugar-file-attributes.h"
+
+G_BEGIN_DECLS
+
+typedef struct _SugarFileAttributesItem SugarFileAttributesItem;
+typedef struct _SugarFileAttributesItemClass SugarFileAttributesItemClass;
+typedef struct _SugarFileAttributesListModel SugarFileAttributesListModel;
+typedef struct _SugarFileAttributesListModelClass SugarFileAttributesListModelClass;
+
+#define SUGAR_TYPE_FILE_ATTRIBUTES_ITEM             (sugar_file_attributes_item_get_type())
+#define SUGAR_FILE_ATTRIBUTES_ITEM(object)          (G_TYPE_CHECK_INSTANCE_CAST((object), SUGAR_TYPE_FILE_ATTRIBUTES_ITEM, SugarFileAttributesItem))
+#define SUGAR_IS_FILE_ATTRIBUTES_ITEM(object)       (G_TYPE_CHECK_INSTANCE_TYPE((object), SUGAR_TYPE_FILE_ATTRIBUTES_ITEM))
+
+#define SUGAR_TYPE_FILE_ATTRIBUTES_LIST_MODEL       (sugar_file_attributes_list_model_get_type())
+#define SUGAR_FILE_ATTRIBUTES_LIST_MODEL(object)    (G_TYPE_CHECK_INSTANCE_CAST((object), SUGAR_TYPE_FILE_ATTRIBUTES_LIST_MODEL, SugarFileAttributesListModel))
+#define SUGAR_IS_FILE_ATTRIBUTES_LIST_MODEL(object) (G_TYPE_CHECK_INSTANCE_TYPE((object), SUGAR_TYPE_FILE_ATTRIBUTES_LIST_MODEL))
+
+GType                          sugar_file_attributes_item_get_type              (void);
+const gchar                   *sugar_file_attributes_item_get_name              (SugarFileAttributesItem      *item);
+GFile                         *sugar_file_attributes_item_get_file              (SugarFileAttributesItem      *item);
+const SugarFileAttributes     *sugar_file_attributes_item_get_attributes        (SugarFileAttributesItem      *item);
+
+GType                          sugar_file_attributes_list_model_get_type        (void);
+SugarFileAttributesListModel  *sugar_file_attributes_list_model_new             (GFile                        *directory,
+                                                                                 GError                      **error);
+GFile                         *sugar_file_attributes_list_model_get_directory   (SugarFileAttributesListModel *model);
+const gchar                   *sugar_file_attributes_list_model_get_name        (SugarFileAttributesListModel *model,
+                                                                                 guint                         position);
+void                           sugar_file_attributes_list_model_set_prefetch    (SugarFileAttributesListModel *model,
+                                                                                 guint                         n_items);
+guint                          sugar_file_attributes_list_model_get_prefetch    (SugarFileAttributesListModel *model);
+void                           sugar_file_attributes_list_model_set_max_loaded  (SugarFileAttributesListModel *model,
+                                                                                 guint                         n_items);
+guint                          sugar_file_attributes_list_model_get_max_loaded  (SugarFileAttributesListModel *model);
+guint                          sugar_file_attributes_list_model_get_n_loaded    (SugarFileAttributesListModel *model);
+
+G_END_DECLS
+
+#endif /* __SUGAR_FILE_ATTRIBUTES_LIST_MODEL_H__ */
@@ -0,0 +1,181 @@
+/*
+ * Copyright (C) 2025 MostlyK
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __SUGAR_FILE_ATTRIBUTES_PRIVATE_H__
+#define __SUGAR_FILE_ATTRIBUTES_PRIVATE_H__
+
+#include <sys/stat.h>
+#include "sugar-file-attributes.h"
+#include "sugar-file-attributes-list-model.h"
+
+G_BEGIN_DECLS
+
+/* Fields written by a library call, passed to write hooks */
+typedef enum {
+    SUGAR_WRITE_TITLE       = 1 << 0,
+    SUGAR_WRITE_DESCRIPTION = 1 << 1,
+    SUGAR_WRITE_TAGS        = 1 << 2,
+    SUGAR_WRITE_ACTIVITY    = 1 << 3,
+    SUGAR_WRITE_ALL         = 0xff,
+} SugarWriteFields;
+
+/*
+ * Called after a successful write with the new values of @fields; the
+ * other members of @attrs are unspecified. Hooks run in the writing
+ * thread, possibly in several threads at once, and must not add or
+ * remove hooks. They should not do file I/O either, as they delay the
+ * write that triggered them.
+ */
+typedef void (*SugarWriteHook) (const gchar               *path,
+                                const SugarFileAttributes *attrs,
+                                SugarWriteFields           fields,
+                                gpointer                   user_data);
+
+guint                _sugar_file_attributes_add_write_hook      (SugarWriteHook hook, gpointer user_data);
+void                 _sugar_file_attributes_remove_write_hook   (guint id);
+
+/* Replaces a string member, interning it when enabled */
+void                 _sugar_file_attributes_assign_string       (SugarFileAttributes *attrs,
+                                                                 glong field_offset,
+                                                                 const gchar *value);
+
+/* Copies the fields in @mask from @src to @dest */
+void                 _sugar_file_attributes_copy_fields         (SugarFileAttributes *dest,
+                                                                 const SugarFileAttributes *src,
+                                                                 SugarFileAttributeMask mask);
+
+/* Loads into a record whose strings are copied into @arena */
+gboolean             _sugar_file_attributes_load_at_arena       (SugarFileAttributes *attrs,
+                                                                 gint dirfd,
+                                                                 const gchar *name,
+                                                                 GByteArray *scratch,
+                                                                 GStringChunk *arena,
+                                                                 GError **error);
+
+/* Lists the Journal entries of @directory, see sugar-file-attributes-async.c */
+GPtrArray*           _sugar_file_attributes_read_directory      (GFile *directory,
+                                                                 gint *dirfd,
+                                                                 GError **error);
+
+/* Makes an item owning @attributes, see sugar-file-attributes-list-model.c */
+SugarFileAttributesItem* _sugar_file_attributes_item_new         (GFile *directory,
+                                                                 const gchar *name,
+                                                                 SugarFileAttributes *attributes);
+
+/* Saves to @path without going through the write queue */
+gboolean             _sugar_file_attributes_save_path           (const gchar *path,
+                                                                 SugarFileAttributes *attrs,
+                                                                 SugarFileAttributesSaveFlags flags,
+                                                                 GError **error);
+
+/* Write queue, see sugar-file-attributes-queue.c */
+gboolean             _sugar_file_attributes_queue_write         (const gchar *path,
+                                                                 SugarFileAttributeMask field,
+                                                                 const gchar *value);
+void                 _sugar_file_attributes_queue_apply         (const struct stat *st,
+                                                                 SugarFileAttributes *attrs,
+                                                                 SugarFileAttributeMask mask);
+gboolean             _sugar_file_attributes_queue_flush_file    (const struct stat *st,
+                                                                 GError **error);
+
+/* Sidecar store, see sugar-file-attributes-sidecar.c */
+#define SUGAR_SIDECAR_NAME ".sugar-metadata"
+
+GBytes*              _sugar_file_attributes_sidecar_lookup      (gint dirfd,
+                                                                 const gchar *path);
+gboolean             _sugar_file_attributes_sidecar_store       (gint dirfd,
+                                                                 const gchar *path,
+                                                                 const guint8 *record,
+                                                                 gsize size);
+
+/* Blob store for long values, see sugar-file-attributes-sidecar.c */
+#define SUGAR_BLOBS_NAME ".sugar-blobs"
+#define SUGAR_BLOB_DIGEST_LENGTH 64
+
+gchar*               _sugar_file_attributes_blob_store          (gint dirfd,
+                                                                 const gchar *path,
+                                                                 const gchar *value,
+                                                                 gsize length);
+gchar*               _sugar_file_attributes_blob_load           (gint dirfd,
+                                                                 const gchar *path,
+                                                                 const gchar *digest);
+void                 _sugar_file_attributes_blob_sweep          (gint dirfd);
+gboolean             _sugar_file_attributes_collect_blobs       (gint dirfd,
+                                                                 const gchar *name,
+                                                                 GHashTable *digests);
+
+/* Loads entries of a directory together, as the directory loader does */
+void                 _sugar_file_attributes_load_many_at        (gint dirfd,
+                                                                 const gchar *dir_path,
+                                                                 const gchar * const *names,
+                                                                 guint n_names,
+                                                                 SugarFileAttributes * const *attributes,
+                                                                 gboolean *loaded,
+                                                                 GByteArray *scratch);
+
+/* Saves many files together, as the write queue does */
+gboolean             _sugar_file_attributes_save_paths          (const gchar * const *paths,
+                                                                 SugarFileAttributes * const *attributes,
+                                                                 guint n_paths,
+                                                                 GError **error);
+
+/* io_uring batches, see sugar-file-attributes-uring.c */
+typedef struct _SugarUring SugarUring;
+struct statx;
+
+SugarUring*          _sugar_uring_get                           (void);
+gboolean             _sugar_uring_wait                          (SugarUring *ring);
+void                 _sugar_uring_statx                         (SugarUring *ring,
+                                                                 gint dirfd,
+                                                                 const gchar *path,
+                                                                 gint flags,
+                                                                 guint mask,
+                                                                 struct statx *buffer,
+                                                                 gint *result);
+void                 _sugar_uring_getxattr                      (SugarUring *ring,
+                                                                 const gchar *path,
+                                                                 const gchar *name,
+                                                                 gpointer value,
+                                                                 gsize size,
+                                                                 gint *result);
+void                 _sugar_uring_setxattr                      (SugarUring *ring,
+                                                                 const gchar *path,
+                                                                 const gchar *name,
+                                                                 gconstpointer value,
+                                                                 gsize size,
+                                                                 gint *result);
+
+/* Metadata cache, see sugar-file-attributes-cache.c */
+gboolean             _sugar_file_attributes_cache_load          (const struct stat *st,
+                                                                 SugarFileAttributes *attrs,
+                                                                 SugarFileAttributeMask mask);
+void                 _sugar_file_attributes_cache_store         (const struct stat *st,
+                                                                 const SugarFileAttributes *attrs);
+void                 _sugar_file_attributes_cache_update_string (const struct stat *before,
+                                                                 const struct stat *after,
+                                                                 glong field_offset,
+                                                                 const gchar *value);
+void                 _sugar_file_attributes_cache_invalidate    (const struct stat *st);
+
+/* Text folding shared by the text indexes, see sugar-search-index.c */
+gchar*               _sugar_text_fold                           (const gchar *text);
+
+G_END_DECLS
+
+#endif /* __SUGAR_FILE_ATTRIBUTES_PRIVATE_H__ */
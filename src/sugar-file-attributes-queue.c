@@ -0,0 +1,353 @@
+/*
+ * Copyright (C) 2025 MostlyK
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include "sugar-file-attributes-private.h"
+
+/*
+ * Write-behind queue for the single-field setters. With a write delay
+ * set, sugar_file_attributes_set_title() and friends only record the
+ * new value; values for the same inode are merged into one pending
+ * record whose dirty mask holds the changed fields, and the record is
+ * written with a single dirty-field save when the queue is flushed.
+ *
+ * Flushing happens from a low-priority timeout on the default main
+ * context, so it waits for the loop to be idle, or on an explicit
+ * sugar_file_attributes_flush(). Reads overlay the pending values, and
+ * full saves flush the file's pending record first so they land last.
+ *
+ * The lock is not held while records are written, since the write
+ * hooks may load attributes themselves. A record being written moves
+ * from the pending table to the in-flight one, which reads overlay as
+ * well, and a second flush of the same file waits for the first.
+ */
+typedef struct {
+    dev_t dev;
+    ino_t ino;
+} QueueKey;
+
+typedef struct {
+    QueueKey key;
+    gchar *path;
+    SugarFileAttributes *values;
+} QueueEntry;
+
+static GMutex queue_lock;
+static GCond in_flight_done;
+static GHashTable *pending;
+static GHashTable *in_flight;
+static guint write_delay;
+static guint flush_source;
+
+static guint
+queue_key_hash(gconstpointer key)
+{
+    const QueueKey *k = key;
+    guint64 value = (guint64) k->ino ^ ((guint64) k->dev << 32);
+
+    return (guint) (value ^ (value >> 32));
+}
+
+static gboolean
+queue_key_equal(gconstpointer a, gconstpointer b)
+{
+    const QueueKey *ka = a;
+    const QueueKey *kb = b;
+
+    return ka->dev == kb->dev && ka->ino == kb->ino;
+}
+
+static void
+queue_entry_free(QueueEntry *entry)
+{
+    g_free(entry->path);
+    sugar_file_attributes_free(entry->values);
+    g_free(entry);
+}
+
+// Moves @entry from the pending to the in-flight table; call with the lock held
+static void
+start_entry(QueueEntry *entry)
+{
+    if (!in_flight)
+        in_flight = g_hash_table_new(queue_key_hash, queue_key_equal);
+
+    g_hash_table_steal(pending, &entry->key);
+    g_hash_table_insert(in_flight, &entry->key, entry);
+}
+
+// Drops the @n_entries written entries and wakes flushes waiting for them
+static void
+finish_entries(QueueEntry **entries, guint n_entries)
+{
+    guint i;
+
+    g_mutex_lock(&queue_lock);
+    for (i = 0; i < n_entries; i++) {
+        g_hash_table_remove(in_flight, &entries[i]->key);
+        queue_entry_free(entries[i]);
+    }
+    g_cond_broadcast(&in_flight_done);
+    g_mutex_unlock(&queue_lock);
+}
+
+// Waits until no pending record is being written by another flush; call with the lock held
+static void
+wait_for_in_flight(void)
+{
+    GHashTableIter iter;
+    gpointer key;
+
+    if (!in_flight || !pending)
+        return;
+
+    g_hash_table_iter_init(&iter, pending);
+    while (g_hash_table_iter_next(&iter, &key, NULL)) {
+        if (g_hash_table_contains(in_flight, key)) {
+            g_cond_wait(&in_flight_done, &queue_lock);
+            g_hash_table_iter_init(&iter, pending);
+        }
+    }
+}
+
+// Writes every pending record in one go, so they can share io_uring batches
+static gboolean
+flush_all(GError **error)
+{
+    GHashTableIter iter;
+    gpointer value;
+    QueueEntry **entries;
+    const gchar **paths;
+    SugarFileAttributes **values;
+    guint n_entries, i;
+    gboolean result;
+
+    g_mutex_lock(&queue_lock);
+
+    if (flush_source) {
+        g_source_remove(flush_source);
+        flush_source = 0;
+    }
+
+    wait_for_in_flight();
+
+    n_entries = pending ? g_hash_table_size(pending) : 0;
+    if (n_entries == 0) {
+        g_mutex_unlock(&queue_lock);
+        return TRUE;
+    }
+
+    entries = g_new(QueueEntry *, n_entries);
+    paths = g_new(const gchar *, n_entries);
+    values = g_new(SugarFileAttributes *, n_entries);
+
+    i = 0;
+    g_hash_table_iter_init(&iter, pending);
+    while (g_hash_table_iter_next(&iter, NULL, &value))
+        entries[i++] = value;
+
+    for (i = 0; i < n_entries; i++) {
+        start_entry(entries[i]);
+        paths[i] = entries[i]->path;
+        values[i] = entries[i]->values;
+    }
+
+    g_mutex_unlock(&queue_lock);
+
+    // Every file is tried, the first error is kept
+    result = _sugar_file_attributes_save_paths(paths, values, n_entries, error);
+
+    finish_entries(entries, n_entries);
+    g_free(values);
+    g_free(paths);
+    g_free(entries);
+    return result;
+}
+
+static gboolean
+on_flush_timeout(gpointer user_data)
+{
+    GError *error = NULL;
+
+    g_mutex_lock(&queue_lock);
+    flush_source = 0;
+    g_mutex_unlock(&queue_lock);
+
+    if (!flush_all(&error)) {
+        g_warning("Could not write queued file attributes: %s", error->message);
+        g_error_free(error);
+    }
+
+    return G_SOURCE_REMOVE;
+}
+
+/*
+ * Queues @value for string field @field of the file at @path. Returns
+ * %FALSE if writes are not delayed or the file cannot be found, in
+ * which case the caller writes it directly.
+ */
+gboolean
+_sugar_file_attributes_queue_write(const gchar *path, SugarFileAttributeMask field, const gchar *value)
+{
+    struct stat st;
+    QueueKey key;
+    QueueEntry *entry;
+
+    if (!g_atomic_int_get(&write_delay) || stat(path, &st) != 0)
+        return FALSE;
+
+    key.dev = st.st_dev;
+    key.ino = st.st_ino;
+
+    g_mutex_lock(&queue_lock);
+
+    if (!write_delay) {
+        g_mutex_unlock(&queue_lock);
+        return FALSE;
+    }
+
+    if (!pending)
+        pending = g_hash_table_new(queue_key_hash, queue_key_equal);
+
+    entry = g_hash_table_lookup(pending, &key);
+    if (!entry) {
+        entry = g_new0(QueueEntry, 1);
+        entry->key = key;
+        entry->path = g_strdup(path);
+        entry->values = g_new0(SugarFileAttributes, 1);
+        g_hash_table_insert(pending, &entry->key, entry);
+    }
+    sugar_file_attributes_set_string(entry->values, field, value);
+
+    // Measured from the first pending change, so a steady stream of edits still gets written
+    if (!flush_source) {
+        flush_source = g_timeout_add_full(G_PRIORITY_DEFAULT_IDLE, write_delay,
+                                          on_flush_timeout, NULL, NULL);
+    }
+
+    g_mutex_unlock(&queue_lock);
+    return TRUE;
+}
+
+/*
+ * Overlays the pending values among the fields in @mask on @attrs,
+ * which were just loaded from the file described by @st. Values still
+ * being written count too, as the file may not have them yet.
+ */
+void
+_sugar_file_attributes_queue_apply(const struct stat *st, SugarFileAttributes *attrs, SugarFileAttributeMask mask)
+{
+    QueueKey key = { st->st_dev, st->st_ino };
+    QueueEntry *entry;
+
+    g_mutex_lock(&queue_lock);
+
+    entry = in_flight ? g_hash_table_lookup(in_flight, &key) : NULL;
+    if (entry)
+        _sugar_file_attributes_copy_fields(attrs, entry->values, entry->values->dirty & mask);
+
+    entry = pending ? g_hash_table_lookup(pending, &key) : NULL;
+    if (entry)
+        _sugar_file_attributes_copy_fields(attrs, entry->values, entry->values->dirty & mask);
+
+    g_mutex_unlock(&queue_lock);
+}
+
+// Writes the pending values of the file described by @st, if any
+gboolean
+_sugar_file_attributes_queue_flush_file(const struct stat *st, GError **error)
+{
+    QueueKey key = { st->st_dev, st->st_ino };
+    QueueEntry *entry;
+    gboolean result;
+
+    g_mutex_lock(&queue_lock);
+
+    // An earlier flush of this file must land first
+    while (in_flight && g_hash_table_contains(in_flight, &key))
+        g_cond_wait(&in_flight_done, &queue_lock);
+
+    entry = pending ? g_hash_table_lookup(pending, &key) : NULL;
+    if (!entry) {
+        g_mutex_unlock(&queue_lock);
+        return TRUE;
+    }
+
+    start_entry(entry);
+    g_mutex_unlock(&queue_lock);
+
+    result = _sugar_file_attributes_save_path(entry->path, entry->values,
+                                              SUGAR_FILE_ATTRIBUTES_SAVE_DEFAULT, error);
+
+    finish_entries(&entry, 1);
+    return result;
+}
+
+/**
+ * sugar_file_attributes_set_write_delay:
+ * @delay_ms: How long to hold back writes, in milliseconds, or 0
+ *
+ * Makes sugar_file_attributes_set_title(),
+ * sugar_file_attributes_set_description() and
+ * sugar_file_attributes_set_tags() queue their values instead of
+ * writing them at once. Changes to the same file are merged and written
+ * together, at most @delay_ms after the first one, once the default
+ * main context is idle; applications without a running main loop must
+ * call sugar_file_attributes_flush() themselves.
+ *
+ * Reads in this process see queued values immediately. A delay of 0,
+ * the default, writes pending values and turns queueing off.
+ */
+void
+sugar_file_attributes_set_write_delay(guint delay_ms)
+{
+    g_mutex_lock(&queue_lock);
+    g_atomic_int_set(&write_delay, delay_ms);
+    g_mutex_unlock(&queue_lock);
+
+    if (delay_ms == 0)
+        sugar_file_attributes_flush(NULL);
+}
+
+/**
+ * sugar_file_attributes_get_write_delay:
+ *
+ * Gets the delay set with sugar_file_attributes_set_write_delay().
+ *
+ * Returns: The delay in milliseconds, 0 if writes are not queued
+ */
+guint
+sugar_file_attributes_get_write_delay(void)
+{
+    return g_atomic_int_get(&write_delay);
+}
+
+/**
+ * sugar_file_attributes_flush:
+ * @error: Return location for error
+ *
+ * Writes every queued change now. Call this before the files may be
+ * read by other processes, for example when closing the Journal.
+ *
+ * Returns: %TRUE on success, %FALSE if some change could not be written
+ */
+gboolean
+sugar_file_attributes_flush(GError **error)
+{
+    return flush_all(error);
+}
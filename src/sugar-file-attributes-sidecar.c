@@ -0,0 +1,610 @@
+/*
+ * Copyright (C) 2025 MostlyK
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include "sugar-file-attributes-private.h"
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+/*
+ * Sidecar store for file systems without user xattrs, such as FAT
+ * formatted USB sticks. Each directory gets one SIDECAR_NAME file
+ * holding the packed records of its entries as an append-only log,
+ * all integers little endian:
+ *
+ *   0  "SGS" magic and a version byte
+ *   4  records: name length (uint32), record length (uint32), the
+ *      entry name and the packed record
+ *
+ * The last record of a name wins. The log is mapped and parsed once
+ * into a table that serves every entry of the directory until the file
+ * changes, so listing a directory costs one read of the sidecar rather
+ * than a lookup per entry. Saves append a single record with one
+ * write(); once most of the log is superseded records or entries that
+ * no longer exist, it is rewritten and atomically replaced.
+ */
+#define SIDECAR_NAME SUGAR_SIDECAR_NAME
+#define SIDECAR_MAGIC "SGS"
+#define SIDECAR_VERSION 1
+#define SIDECAR_HEADER_SIZE 4
+#define RECORD_HEADER_SIZE 8
+#define COMPACT_MIN_SIZE (64 * 1024)
+#define MAX_DIRECTORIES 16
+
+typedef struct {
+    dev_t dev;
+    ino_t ino;
+} DirKey;
+
+typedef struct {
+    DirKey key;
+    GHashTable *records;
+    gsize live_size;
+
+    // State of the sidecar file that records matches, ino 0 if it did not exist
+    ino_t file_ino;
+    goffset file_size;
+    struct timespec file_mtime;
+} SidecarDir;
+
+static GMutex sidecar_lock;
+static GHashTable *directories;
+
+static guint
+dir_key_hash(gconstpointer key)
+{
+    const DirKey *k = key;
+    guint64 value = (guint64) k->ino ^ ((guint64) k->dev << 32);
+
+    return (guint) (value ^ (value >> 32));
+}
+
+static gboolean
+dir_key_equal(gconstpointer a, gconstpointer b)
+{
+    const DirKey *ka = a;
+    const DirKey *kb = b;
+
+    return ka->dev == kb->dev && ka->ino == kb->ino;
+}
+
+static void
+sidecar_dir_free(SidecarDir *dir)
+{
+    g_hash_table_unref(dir->records);
+    g_free(dir);
+}
+
+static gsize
+record_size(const gchar *name, GBytes *value)
+{
+    return RECORD_HEADER_SIZE + strlen(name) + g_bytes_get_size(value);
+}
+
+static void
+set_record(SidecarDir *dir, const gchar *name, GBytes *value)
+{
+    GBytes *old = g_hash_table_lookup(dir->records, name);
+
+    if (old)
+        dir->live_size -= record_size(name, old);
+    dir->live_size += record_size(name, value);
+    g_hash_table_insert(dir->records, g_strdup(name), value);
+}
+
+static guint32
+read_uint32(const guint8 *data)
+{
+    guint32 le;
+    memcpy(&le, data, sizeof(le));
+    return GUINT32_FROM_LE(le);
+}
+
+static gboolean
+same_file(const SidecarDir *dir, const struct stat *st)
+{
+    return dir->file_ino == st->st_ino && dir->file_size == st->st_size &&
+           dir->file_mtime.tv_sec == st->st_mtim.tv_sec && dir->file_mtime.tv_nsec == st->st_mtim.tv_nsec;
+}
+
+/*
+ * Reloads the table from the sidecar file described by @st, or empties
+ * it if @st is %NULL. Values point into the mapping, which stays alive
+ * as long as any of them does. A record cut short by a crash in the
+ * middle of an append ends the log.
+ */
+static void
+parse_sidecar(SidecarDir *dir, gint dirfd, const struct stat *st)
+{
+    GMappedFile *map;
+    gint fd;
+    GBytes *bytes;
+    const guint8 *data;
+    gsize size;
+    gsize offset = SIDECAR_HEADER_SIZE;
+
+    g_hash_table_remove_all(dir->records);
+    dir->live_size = 0;
+    dir->file_ino = st ? st->st_ino : 0;
+    dir->file_size = st ? st->st_size : 0;
+    dir->file_mtime = st ? st->st_mtim : (struct timespec) { 0, 0 };
+
+    if (!st) return;
+
+    fd = openat(dirfd, SIDECAR_NAME, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return;
+
+    map = g_mapped_file_new_from_fd(fd, FALSE, NULL);
+    close(fd);
+    if (!map) return;
+
+    bytes = g_mapped_file_get_bytes(map);
+    g_mapped_file_unref(map);
+    data = g_bytes_get_data(bytes, &size);
+
+    if (size < SIDECAR_HEADER_SIZE || memcmp(data, SIDECAR_MAGIC, 3) != 0 || data[3] != SIDECAR_VERSION) {
+        g_bytes_unref(bytes);
+        return;
+    }
+
+    while (size - offset >= RECORD_HEADER_SIZE) {
+        guint32 name_length = read_uint32(data + offset);
+        guint32 value_length = read_uint32(data + offset + 4);
+        gchar *name;
+
+        if (size - offset - RECORD_HEADER_SIZE < (guint64) name_length + value_length)
+            break;
+
+        offset += RECORD_HEADER_SIZE;
+        name = g_strndup((const gchar *) data + offset, name_length);
+        set_record(dir, name, g_bytes_new_from_bytes(bytes, offset + name_length, value_length));
+        g_free(name);
+        offset += (gsize) name_length + value_length;
+    }
+
+    g_bytes_unref(bytes);
+}
+
+// Returns the up-to-date table of the directory @dirfd; call with the lock held
+static SidecarDir*
+get_directory(gint dirfd)
+{
+    struct stat st;
+    DirKey key;
+    SidecarDir *dir;
+
+    if (fstat(dirfd, &st) != 0)
+        return NULL;
+
+    key.dev = st.st_dev;
+    key.ino = st.st_ino;
+
+    if (!directories) {
+        directories = g_hash_table_new_full(dir_key_hash, dir_key_equal, NULL,
+                                            (GDestroyNotify) sidecar_dir_free);
+    }
+
+    dir = g_hash_table_lookup(directories, &key);
+    if (!dir) {
+        // Scans move from directory to directory, so any old one can go
+        if (g_hash_table_size(directories) >= MAX_DIRECTORIES)
+            g_hash_table_remove_all(directories);
+
+        dir = g_new0(SidecarDir, 1);
+        dir->key = key;
+        dir->records = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, (GDestroyNotify) g_bytes_unref);
+        // Forces the first parse below
+        dir->file_size = -1;
+        g_hash_table_insert(directories, &dir->key, dir);
+    }
+
+    if (fstatat(dirfd, SIDECAR_NAME, &st, 0) != 0)
+        parse_sidecar(dir, dirfd, NULL);
+    else if (!same_file(dir, &st))
+        parse_sidecar(dir, dirfd, &st);
+
+    return dir;
+}
+
+static gboolean
+write_all(gint fd, const guint8 *data, gsize size)
+{
+    gsize done = 0;
+
+    while (done < size) {
+        ssize_t n = write(fd, data + done, size - done);
+
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) return FALSE;
+        done += n;
+    }
+
+    return TRUE;
+}
+
+static void
+append_record(GByteArray *log, const gchar *name, const guint8 *value, gsize value_length)
+{
+    guint32 lengths[2] = { GUINT32_TO_LE(strlen(name)), GUINT32_TO_LE(value_length) };
+
+    g_byte_array_append(log, (const guint8 *) lengths, sizeof(lengths));
+    g_byte_array_append(log, (const guint8 *) name, strlen(name));
+    g_byte_array_append(log, value, value_length);
+}
+
+static void
+append_header(GByteArray *log)
+{
+    guint8 header[SIDECAR_HEADER_SIZE] = { 'S', 'G', 'S', SIDECAR_VERSION };
+
+    g_byte_array_append(log, header, sizeof(header));
+}
+
+/*
+ * Rewrites the log with the latest record of each entry that still
+ * exists, then renames it over the old one. A save racing with the
+ * rename from another process can be lost, like a concurrent save of
+ * the same file with xattrs would be.
+ */
+static void
+compact_sidecar(SidecarDir *dir, gint dirfd)
+{
+    GByteArray *log = g_byte_array_sized_new(dir->live_size + SIDECAR_HEADER_SIZE);
+    gchar *temp_name = g_strdup_printf("%s.%d", SIDECAR_NAME, (gint) getpid());
+    GHashTableIter iter;
+    gpointer name, value;
+    struct stat st;
+    gint fd;
+
+    append_header(log);
+
+    g_hash_table_iter_init(&iter, dir->records);
+    while (g_hash_table_iter_next(&iter, &name, &value)) {
+        gsize size;
+        const guint8 *data = g_bytes_get_data(value, &size);
+
+        if (fstatat(dirfd, name, &st, AT_SYMLINK_NOFOLLOW) == 0)
+            append_record(log, name, data, size);
+    }
+
+    fd = openat(dirfd, temp_name, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd >= 0 && write_all(fd, log->data, log->len) && fsync(fd) == 0 &&
+        renameat(dirfd, temp_name, dirfd, SIDECAR_NAME) == 0) {
+        if (fstat(fd, &st) == 0)
+            parse_sidecar(dir, dirfd, &st);
+    } else if (fd >= 0) {
+        unlinkat(dirfd, temp_name, 0);
+    }
+
+    if (fd >= 0) close(fd);
+    g_byte_array_unref(log);
+    g_free(temp_name);
+}
+
+/*
+ * Opens the directory of @path, relative to @dirfd, and sets @name to
+ * the entry's name within it.
+ */
+static gint
+open_directory(gint dirfd, const gchar *path, gchar **name)
+{
+    gchar *dir_path = g_path_get_dirname(path);
+    gint fd = openat(dirfd, dir_path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+
+    *name = g_path_get_basename(path);
+    g_free(dir_path);
+    return fd;
+}
+
+/*
+ * Returns the packed record stored for the file at @path, relative to
+ * @dirfd, or %NULL if its directory's sidecar has none.
+ */
+GBytes*
+_sugar_file_attributes_sidecar_lookup(gint dirfd, const gchar *path)
+{
+    gchar *name;
+    gint fd = open_directory(dirfd, path, &name);
+    SidecarDir *dir;
+    GBytes *record = NULL;
+
+    if (fd >= 0) {
+        g_mutex_lock(&sidecar_lock);
+
+        dir = get_directory(fd);
+        if (dir) {
+            record = g_hash_table_lookup(dir->records, name);
+            if (record) g_bytes_ref(record);
+        }
+
+        g_mutex_unlock(&sidecar_lock);
+        close(fd);
+    }
+
+    g_free(name);
+    return record;
+}
+
+/*
+ * Appends @record as the new packed record of the file at @path,
+ * relative to @dirfd, to its directory's sidecar. Returns %FALSE if it
+ * could not be written.
+ */
+gboolean
+_sugar_file_attributes_sidecar_store(gint dirfd, const gchar *path, const guint8 *record, gsize size)
+{
+    gchar *name;
+    gint dir_fd = open_directory(dirfd, path, &name);
+    GByteArray *log = g_byte_array_sized_new(RECORD_HEADER_SIZE + strlen(name) + size + SIDECAR_HEADER_SIZE);
+    gboolean result = FALSE;
+    SidecarDir *dir;
+    struct stat st;
+    gint fd = -1;
+
+    if (dir_fd < 0) goto out;
+
+    g_mutex_lock(&sidecar_lock);
+
+    dir = get_directory(dir_fd);
+    if (!dir) goto unlock;
+
+    fd = openat(dir_fd, SIDECAR_NAME, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0 || fstat(fd, &st) != 0) goto unlock;
+
+    if (st.st_size == 0)
+        append_header(log);
+    append_record(log, name, record, size);
+
+    // O_APPEND and one write() per record keep appends from other processes apart
+    if (!write_all(fd, log->data, log->len)) goto unlock;
+    result = TRUE;
+
+    // Keep the table unless someone else appended since it was parsed
+    if (fstat(fd, &st) == 0 && (dir->file_ino == 0 || dir->file_ino == st.st_ino) &&
+        dir->file_size + (goffset) log->len == st.st_size) {
+        set_record(dir, name, g_bytes_new(record, size));
+        dir->file_ino = st.st_ino;
+        dir->file_size = st.st_size;
+        dir->file_mtime = st.st_mtim;
+
+        if (st.st_size > COMPACT_MIN_SIZE && (gsize) st.st_size > 2 * dir->live_size)
+            compact_sidecar(dir, dir_fd);
+    } else {
+        dir->file_size = -1;
+    }
+
+unlock:
+    g_mutex_unlock(&sidecar_lock);
+
+out:
+    if (fd >= 0) close(fd);
+    if (dir_fd >= 0) close(dir_fd);
+    g_byte_array_unref(log);
+    g_free(name);
+    return result;
+}
+
+/*
+ * Blob store for values too long for an xattr record, see
+ * pack_attributes(). Each directory gets a BLOBS_NAME subdirectory with
+ * one file per distinct value, named after the SHA-256 digest of its
+ * contents, which is all a record keeps. Equal values are stored once,
+ * and a blob is complete once renamed into place, so it is never
+ * rewritten. Blobs are shared between entries and stay behind when the
+ * records referring to them change, until _sugar_file_attributes_blob_sweep()
+ * reads every record of the directory and removes the unused ones.
+ */
+#define BLOBS_NAME SUGAR_BLOBS_NAME
+#define DIGEST_LENGTH SUGAR_BLOB_DIGEST_LENGTH
+
+/* A save stores its blob before the record, so new blobs are never swept */
+#define BLOB_SWEEP_AGE_USEC G_TIME_SPAN_HOUR
+
+static gint blob_serial;
+
+// Digests come from records on disk and end up in a path, so take no chances
+static gboolean
+is_digest(const gchar *digest)
+{
+    for (guint i = 0; i < DIGEST_LENGTH; i++) {
+        if (!g_ascii_isxdigit(digest[i]) || g_ascii_isupper(digest[i]))
+            return FALSE;
+    }
+
+    return digest[DIGEST_LENGTH] == '\0';
+}
+
+/*
+ * Stores @length bytes of @value in the blob store of the directory of
+ * @path, relative to @dirfd. Returns the digest referring to it, or
+ * %NULL if it could not be written.
+ */
+gchar*
+_sugar_file_attributes_blob_store(gint dirfd, const gchar *path, const gchar *value, gsize length)
+{
+    gchar *name;
+    gint dir_fd = open_directory(dirfd, path, &name);
+    gchar *digest = g_compute_checksum_for_string(G_CHECKSUM_SHA256, value, length);
+    gchar *blob_name = g_build_filename(BLOBS_NAME, digest, NULL);
+    gchar *temp_name = NULL;
+    gboolean stored = FALSE;
+    struct stat st;
+    gint fd;
+
+    if (dir_fd < 0) goto out;
+
+    // Reusing a blob makes it new again, so a sweep running meanwhile keeps it
+    if (fstatat(dir_fd, blob_name, &st, 0) == 0) {
+        stored = utimensat(dir_fd, blob_name, NULL, 0) == 0;
+        goto out;
+    }
+
+    if (mkdirat(dir_fd, BLOBS_NAME, 0755) != 0 && errno != EEXIST)
+        goto out;
+
+    // Threads storing the same value each write their own temporary file
+    temp_name = g_strdup_printf("%s.%d.%d", blob_name, (gint) getpid(), g_atomic_int_add(&blob_serial, 1));
+    fd = openat(dir_fd, temp_name, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+    if (fd < 0) goto out;
+
+    // The record is written next and must not refer to a blob lost in a crash
+    stored = write_all(fd, (const guint8 *) value, length) && fsync(fd) == 0;
+    close(fd);
+
+    stored = stored && renameat(dir_fd, temp_name, dir_fd, blob_name) == 0;
+    if (!stored)
+        unlinkat(dir_fd, temp_name, 0);
+
+out:
+    if (dir_fd >= 0) close(dir_fd);
+    g_free(temp_name);
+    g_free(blob_name);
+    g_free(name);
+
+    if (!stored) {
+        g_free(digest);
+        return NULL;
+    }
+    return digest;
+}
+
+/*
+ * Returns the value stored under @digest in the blob store of the
+ * directory of @path, relative to @dirfd, or %NULL if there is no such
+ * blob or its contents do not match the digest.
+ */
+gchar*
+_sugar_file_attributes_blob_load(gint dirfd, const gchar *path, const gchar *digest)
+{
+    gchar *name;
+    gchar *blob_name;
+    gchar *value = NULL;
+    GMappedFile *map = NULL;
+    gint dir_fd;
+    gint fd;
+
+    if (!is_digest(digest)) return NULL;
+
+    dir_fd = open_directory(dirfd, path, &name);
+    blob_name = g_build_filename(BLOBS_NAME, digest, NULL);
+
+    fd = dir_fd >= 0 ? openat(dir_fd, blob_name, O_RDONLY | O_CLOEXEC) : -1;
+    if (fd >= 0) {
+        map = g_mapped_file_new_from_fd(fd, FALSE, NULL);
+        close(fd);
+    }
+
+    if (map) {
+        const gchar *contents = g_mapped_file_get_contents(map);
+        gsize length = g_mapped_file_get_length(map);
+        gchar *actual = g_compute_checksum_for_string(G_CHECKSUM_SHA256, contents ? contents : "", length);
+
+        if (strcmp(actual, digest) == 0)
+            value = g_strndup(contents, length);
+
+        g_free(actual);
+        g_mapped_file_unref(map);
+    }
+
+    if (dir_fd >= 0) close(dir_fd);
+    g_free(blob_name);
+    g_free(name);
+    return value;
+}
+
+// Collects the digests referred to by every entry of @dirfd; %FALSE if one could not be read
+static gboolean
+collect_directory_blobs(gint dirfd, GHashTable *digests)
+{
+    struct dirent *entry;
+    struct stat st;
+    gboolean result = TRUE;
+    gint fd = dup(dirfd);
+    DIR *dir = fd >= 0 ? fdopendir(fd) : NULL;
+
+    if (!dir) {
+        if (fd >= 0) close(fd);
+        return FALSE;
+    }
+
+    // The duplicate shares its offset with @dirfd, which callers may have read through
+    rewinddir(dir);
+
+    // Hidden entries count too, only the store's own files are skipped
+    while (result && (entry = readdir(dir)) != NULL) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0 ||
+            strcmp(entry->d_name, BLOBS_NAME) == 0 || strcmp(entry->d_name, SIDECAR_NAME) == 0)
+            continue;
+        if (fstatat(dirfd, entry->d_name, &st, AT_SYMLINK_NOFOLLOW) != 0 ||
+            !(S_ISREG(st.st_mode) || S_ISDIR(st.st_mode)))
+            continue;
+
+        result = _sugar_file_attributes_collect_blobs(dirfd, entry->d_name, digests);
+    }
+
+    closedir(dir);
+    return result;
+}
+
+/*
+ * Removes the blobs of the directory @dirfd that no record of its
+ * entries refers to anymore. Nothing is removed if some entry could not
+ * be read.
+ */
+void
+_sugar_file_attributes_blob_sweep(gint dirfd)
+{
+    GHashTable *digests;
+    struct dirent *entry;
+    struct stat st;
+    gint64 now = g_get_real_time();
+    gint blobs_fd;
+    gint fd;
+    DIR *dir;
+
+    blobs_fd = openat(dirfd, BLOBS_NAME, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (blobs_fd < 0)
+        return;
+
+    digests = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    fd = collect_directory_blobs(dirfd, digests) ? dup(blobs_fd) : -1;
+    dir = fd >= 0 ? fdopendir(fd) : NULL;
+    if (!dir && fd >= 0)
+        close(fd);
+
+    while (dir && (entry = readdir(dir)) != NULL) {
+        gint64 mtime;
+
+        // Temporary files of stores in progress are not digests
+        if (!is_digest(entry->d_name) || g_hash_table_contains(digests, entry->d_name))
+            continue;
+        if (fstatat(blobs_fd, entry->d_name, &st, AT_SYMLINK_NOFOLLOW) != 0)
+            continue;
+
+        mtime = (gint64) st.st_mtim.tv_sec * G_USEC_PER_SEC + st.st_mtim.tv_nsec / 1000;
+        if (now - mtime >= BLOB_SWEEP_AGE_USEC)
+            unlinkat(blobs_fd, entry->d_name, 0);
+    }
+
+    if (dir) closedir(dir);
+    close(blobs_fd);
+    g_hash_table_unref(digests);
+}
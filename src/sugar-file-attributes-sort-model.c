@@ -0,0 +1,685 @@
+/*
+ * Copyright (C) 2025 MostlyK
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include "sugar-file-attributes-sort-model.h"
+#include "sugar-file-attributes-private.h"
+#include <string.h>
+
+/*
+ * A sorted and filtered list model over attributes the caller already
+ * loaded, for the Journal's sortable columns. Entries are kept in one
+ * array in sort order and the shown ones in a second; names break ties,
+ * so the order is total and an entry can be found by binary search on
+ * its own keys.
+ *
+ * Text is compared through collation keys computed once per entry, so
+ * sorting is a strcmp() per comparison instead of a g_utf8_collate().
+ * Large sets are sorted in chunks on several threads, which also compute
+ * the keys, and the chunks are merged.
+ *
+ * A changed entry is taken out at its old position and inserted at its
+ * new one, so an update costs two binary searches and is reported as
+ * the one or two rows that moved. Large batches and re-sorts apply
+ * everything first and report the span between the first and the last
+ * row that differ.
+ */
+#define PARALLEL_SORT_THRESHOLD 16384
+#define MAX_SORT_THREADS 8
+#define MIN_BATCH_RESORT 32
+#define BATCH_RESORT_DIVISOR 16
+#define NO_POSITION G_MAXUINT
+
+typedef struct {
+    gchar *name;
+    SugarFileAttributesItem *item;
+    gchar *collate_key;
+    gboolean visible;
+    gboolean changed;
+} Entry;
+
+typedef struct {
+    SugarFileAttributesSortModel *model;
+    GPtrArray *entries;
+    gboolean update_keys;
+} SortChunk;
+
+struct _SugarFileAttributesSortModel {
+    GObject parent_instance;
+
+    GFile *directory;
+    GHashTable *entries;
+    GPtrArray *sorted;
+    GPtrArray *visible;
+
+    SugarFileAttributesSortKey sort_key;
+    gboolean descending;
+
+    SugarFileAttributesFilterFunc filter_func;
+    gpointer filter_data;
+    GDestroyNotify filter_destroy;
+};
+
+struct _SugarFileAttributesSortModelClass {
+    GObjectClass parent_class;
+};
+
+static void sugar_file_attributes_sort_model_iface_init(GListModelInterface *iface);
+
+G_DEFINE_TYPE_WITH_CODE(SugarFileAttributesSortModel, sugar_file_attributes_sort_model, G_TYPE_OBJECT,
+                        G_IMPLEMENT_INTERFACE(G_TYPE_LIST_MODEL, sugar_file_attributes_sort_model_iface_init))
+
+static void
+entry_free(Entry *entry)
+{
+    g_free(entry->name);
+    g_clear_object(&entry->item);
+    g_free(entry->collate_key);
+    g_free(entry);
+}
+
+static const SugarFileAttributes*
+entry_attributes(const Entry *entry)
+{
+    return sugar_file_attributes_item_get_attributes(entry->item);
+}
+
+static void
+update_collate_key(SugarFileAttributesSortModel *self, Entry *entry)
+{
+    const SugarFileAttributes *attrs = entry_attributes(entry);
+    const gchar *text = NULL;
+
+    g_clear_pointer(&entry->collate_key, g_free);
+
+    if (self->sort_key == SUGAR_FILE_ATTRIBUTES_SORT_TITLE)
+        text = attrs->title;
+    else if (self->sort_key == SUGAR_FILE_ATTRIBUTES_SORT_ACTIVITY)
+        text = attrs->activity;
+    else
+        return;
+
+    entry->collate_key = g_utf8_collate_key(text ? text : "", -1);
+}
+
+static gint
+compare_times(gint64 a, gint64 b)
+{
+    return a < b ? -1 : a > b ? 1 : 0;
+}
+
+static gint
+compare_entries(const Entry *a, const Entry *b, SugarFileAttributesSortModel *self)
+{
+    gint result = 0;
+
+    switch (self->sort_key) {
+    case SUGAR_FILE_ATTRIBUTES_SORT_MODIFICATION_TIME:
+        result = compare_times(entry_attributes(a)->modification_time, entry_attributes(b)->modification_time);
+        break;
+    case SUGAR_FILE_ATTRIBUTES_SORT_CREATION_TIME:
+        result = compare_times(entry_attributes(a)->creation_time, entry_attributes(b)->creation_time);
+        break;
+    case SUGAR_FILE_ATTRIBUTES_SORT_TITLE:
+    case SUGAR_FILE_ATTRIBUTES_SORT_ACTIVITY:
+        result = strcmp(a->collate_key, b->collate_key);
+        break;
+    }
+
+    if (self->descending)
+        result = -result;
+
+    // Names keep the order total, which the binary searches rely on
+    return result != 0 ? result : strcmp(a->name, b->name);
+}
+
+static gint
+compare_entry_pointers(gconstpointer a, gconstpointer b, gpointer user_data)
+{
+    return compare_entries(*(Entry * const *) a, *(Entry * const *) b, user_data);
+}
+
+// Returns the position of the first entry of @array not before @entry
+static guint
+lower_bound(SugarFileAttributesSortModel *self, GPtrArray *array, const Entry *entry)
+{
+    guint low = 0;
+    guint high = array->len;
+
+    while (low < high) {
+        guint middle = low + (high - low) / 2;
+
+        if (compare_entries(array->pdata[middle], entry, self) < 0)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+
+    return low;
+}
+
+static gpointer
+sort_chunk(gpointer user_data)
+{
+    SortChunk *chunk = user_data;
+
+    if (chunk->update_keys) {
+        for (guint i = 0; i < chunk->entries->len; i++)
+            update_collate_key(chunk->model, chunk->entries->pdata[i]);
+    }
+
+    g_ptr_array_sort_with_data(chunk->entries, compare_entry_pointers, chunk->model);
+    return NULL;
+}
+
+// Sorts every entry, recomputing the collation keys first if @update_keys
+static void
+sort_entries(SugarFileAttributesSortModel *self, gboolean update_keys)
+{
+    guint n = self->sorted->len;
+    guint n_chunks = MIN(MIN(g_get_num_processors(), MAX_SORT_THREADS), n / (PARALLEL_SORT_THRESHOLD / 2));
+    SortChunk chunks[MAX_SORT_THREADS];
+    GThread *threads[MAX_SORT_THREADS];
+    guint heads[MAX_SORT_THREADS] = { 0 };
+
+    if (n < PARALLEL_SORT_THRESHOLD || n_chunks < 2) {
+        SortChunk chunk = { self, self->sorted, update_keys };
+        sort_chunk(&chunk);
+        return;
+    }
+
+    for (guint c = 0; c < n_chunks; c++) {
+        guint start = (guint) ((guint64) n * c / n_chunks);
+        guint end = (guint) ((guint64) n * (c + 1) / n_chunks);
+
+        chunks[c].model = self;
+        chunks[c].update_keys = update_keys;
+        chunks[c].entries = g_ptr_array_sized_new(end - start);
+        for (guint i = start; i < end; i++)
+            g_ptr_array_add(chunks[c].entries, self->sorted->pdata[i]);
+    }
+
+    // This thread sorts the first chunk itself
+    for (guint c = 1; c < n_chunks; c++)
+        threads[c] = g_thread_new("sugar-sort", sort_chunk, &chunks[c]);
+    sort_chunk(&chunks[0]);
+    for (guint c = 1; c < n_chunks; c++)
+        g_thread_join(threads[c]);
+
+    // With at most a handful of chunks a scan for the smallest head beats a heap
+    for (guint i = 0; i < n; i++) {
+        gint best = -1;
+
+        for (guint c = 0; c < n_chunks; c++) {
+            if (heads[c] == chunks[c].entries->len)
+                continue;
+            if (best < 0 || compare_entries(chunks[c].entries->pdata[heads[c]],
+                                            chunks[best].entries->pdata[heads[best]], self) < 0)
+                best = c;
+        }
+
+        self->sorted->pdata[i] = chunks[best].entries->pdata[heads[best]++];
+    }
+
+    for (guint c = 0; c < n_chunks; c++)
+        g_ptr_array_unref(chunks[c].entries);
+}
+
+static gboolean
+entry_passes_filter(SugarFileAttributesSortModel *self, Entry *entry)
+{
+    if (!self->filter_func)
+        return TRUE;
+
+    return self->filter_func(entry->name, entry_attributes(entry), self->filter_data);
+}
+
+// Gives @entry a new item holding a copy of @attrs
+static void
+set_entry_attributes(SugarFileAttributesSortModel *self, Entry *entry, const SugarFileAttributes *attrs)
+{
+    g_clear_object(&entry->item);
+    entry->item = _sugar_file_attributes_item_new(self->directory, entry->name,
+                                                  g_boxed_copy(sugar_file_attributes_get_type(), attrs));
+    update_collate_key(self, entry);
+    entry->visible = entry_passes_filter(self, entry);
+}
+
+static void
+rebuild_visible(SugarFileAttributesSortModel *self)
+{
+    g_ptr_array_set_size(self->visible, 0);
+
+    for (guint i = 0; i < self->sorted->len; i++) {
+        Entry *entry = self->sorted->pdata[i];
+
+        if (entry->visible)
+            g_ptr_array_add(self->visible, entry);
+    }
+}
+
+/*
+ * Reports the change from @old to the current visible entries as the
+ * single span between the first and the last row that differ.
+ */
+static void
+emit_changes(SugarFileAttributesSortModel *self, GPtrArray *old)
+{
+    GPtrArray *new = self->visible;
+    guint prefix = 0;
+    guint suffix = 0;
+
+    while (prefix < old->len && prefix < new->len && old->pdata[prefix] == new->pdata[prefix] &&
+           !((Entry *) new->pdata[prefix])->changed)
+        prefix++;
+
+    while (suffix < old->len - prefix && suffix < new->len - prefix &&
+           old->pdata[old->len - 1 - suffix] == new->pdata[new->len - 1 - suffix] &&
+           !((Entry *) new->pdata[new->len - 1 - suffix])->changed)
+        suffix++;
+
+    if (old->len - prefix - suffix > 0 || new->len - prefix - suffix > 0) {
+        g_list_model_items_changed(G_LIST_MODEL(self), prefix,
+                                   old->len - prefix - suffix, new->len - prefix - suffix);
+    }
+}
+
+// Re-sorts and re-filters everything, keeping the old rows to report the difference
+static void
+resort(SugarFileAttributesSortModel *self, gboolean update_keys)
+{
+    GPtrArray *old = g_ptr_array_copy(self->visible, NULL, NULL);
+
+    sort_entries(self, update_keys);
+    rebuild_visible(self);
+    emit_changes(self, old);
+
+    g_ptr_array_unref(old);
+}
+
+// Takes @entry out of both arrays, returning its visible position or NO_POSITION
+static guint
+unlink_entry(SugarFileAttributesSortModel *self, Entry *entry)
+{
+    guint position = NO_POSITION;
+
+    g_ptr_array_remove_index(self->sorted, lower_bound(self, self->sorted, entry));
+
+    if (entry->visible) {
+        position = lower_bound(self, self->visible, entry);
+        g_ptr_array_remove_index(self->visible, position);
+    }
+
+    return position;
+}
+
+static void
+update_entry(SugarFileAttributesSortModel *self, const gchar *name, const SugarFileAttributes *attrs)
+{
+    Entry *entry = g_hash_table_lookup(self->entries, name);
+    guint old_position = NO_POSITION;
+    guint new_position = NO_POSITION;
+
+    if (entry) {
+        old_position = unlink_entry(self, entry);
+    } else {
+        entry = g_new0(Entry, 1);
+        entry->name = g_strdup(name);
+        g_hash_table_insert(self->entries, entry->name, entry);
+    }
+
+    set_entry_attributes(self, entry, attrs);
+    g_ptr_array_insert(self->sorted, lower_bound(self, self->sorted, entry), entry);
+
+    if (entry->visible)
+        new_position = lower_bound(self, self->visible, entry);
+
+    // An entry that stays in place is reported as one changed row
+    if (old_position != NO_POSITION && old_position == new_position) {
+        g_ptr_array_insert(self->visible, new_position, entry);
+        g_list_model_items_changed(G_LIST_MODEL(self), new_position, 1, 1);
+        return;
+    }
+
+    if (old_position != NO_POSITION)
+        g_list_model_items_changed(G_LIST_MODEL(self), old_position, 1, 0);
+
+    if (new_position != NO_POSITION) {
+        g_ptr_array_insert(self->visible, new_position, entry);
+        g_list_model_items_changed(G_LIST_MODEL(self), new_position, 0, 1);
+    }
+}
+
+static GType
+sugar_file_attributes_sort_model_get_item_type(GListModel *list)
+{
+    return SUGAR_TYPE_FILE_ATTRIBUTES_ITEM;
+}
+
+static guint
+sugar_file_attributes_sort_model_get_n_items(GListModel *list)
+{
+    return SUGAR_FILE_ATTRIBUTES_SORT_MODEL(list)->visible->len;
+}
+
+static gpointer
+sugar_file_attributes_sort_model_get_item(GListModel *list, guint position)
+{
+    SugarFileAttributesSortModel *self = SUGAR_FILE_ATTRIBUTES_SORT_MODEL(list);
+
+    if (position >= self->visible->len)
+        return NULL;
+
+    return g_object_ref(((Entry *) self->visible->pdata[position])->item);
+}
+
+static void
+sugar_file_attributes_sort_model_iface_init(GListModelInterface *iface)
+{
+    iface->get_item_type = sugar_file_attributes_sort_model_get_item_type;
+    iface->get_n_items = sugar_file_attributes_sort_model_get_n_items;
+    iface->get_item = sugar_file_attributes_sort_model_get_item;
+}
+
+static void
+sugar_file_attributes_sort_model_finalize(GObject *object)
+{
+    SugarFileAttributesSortModel *self = SUGAR_FILE_ATTRIBUTES_SORT_MODEL(object);
+
+    if (self->filter_destroy)
+        self->filter_destroy(self->filter_data);
+
+    g_ptr_array_unref(self->visible);
+    g_ptr_array_unref(self->sorted);
+    g_hash_table_unref(self->entries);
+    g_clear_object(&self->directory);
+
+    G_OBJECT_CLASS(sugar_file_attributes_sort_model_parent_class)->finalize(object);
+}
+
+static void
+sugar_file_attributes_sort_model_class_init(SugarFileAttributesSortModelClass *model_class)
+{
+    GObjectClass *gobject_class = G_OBJECT_CLASS(model_class);
+
+    gobject_class->finalize = sugar_file_attributes_sort_model_finalize;
+}
+
+static void
+sugar_file_attributes_sort_model_init(SugarFileAttributesSortModel *self)
+{
+    self->entries = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, (GDestroyNotify) entry_free);
+    self->sorted = g_ptr_array_new();
+    self->visible = g_ptr_array_new();
+    self->sort_key = SUGAR_FILE_ATTRIBUTES_SORT_MODIFICATION_TIME;
+    self->descending = TRUE;
+}
+
+/**
+ * sugar_file_attributes_sort_model_new:
+ * @directory: The directory the entries are in
+ *
+ * Creates an empty sorted #GListModel of #SugarFileAttributesItem for
+ * entries of @directory. Fill it with
+ * sugar_file_attributes_sort_model_update_many(), for example from the
+ * batches of sugar_file_attributes_load_directory_async(). It starts
+ * sorted by modification time, newest first.
+ *
+ * Returns: (transfer full): A new #SugarFileAttributesSortModel
+ */
+SugarFileAttributesSortModel*
+sugar_file_attributes_sort_model_new(GFile *directory)
+{
+    SugarFileAttributesSortModel *self;
+
+    g_return_val_if_fail(G_IS_FILE(directory), NULL);
+
+    self = g_object_new(SUGAR_TYPE_FILE_ATTRIBUTES_SORT_MODEL, NULL);
+    self->directory = g_object_ref(directory);
+    return self;
+}
+
+/**
+ * sugar_file_attributes_sort_model_update:
+ * @model: A #SugarFileAttributesSortModel
+ * @name: Name of the entry in the directory
+ * @attrs: The attributes of the entry
+ *
+ * Adds an entry or replaces its attributes, moving it to its place in
+ * the sort order. Only the rows that moved are reported as changed.
+ */
+void
+sugar_file_attributes_sort_model_update(SugarFileAttributesSortModel *model,
+                                        const gchar                  *name,
+                                        const SugarFileAttributes    *attrs)
+{
+    g_return_if_fail(SUGAR_IS_FILE_ATTRIBUTES_SORT_MODEL(model));
+    g_return_if_fail(name != NULL);
+    g_return_if_fail(attrs != NULL);
+
+    update_entry(model, name, attrs);
+}
+
+/**
+ * sugar_file_attributes_sort_model_update_many:
+ * @model: A #SugarFileAttributesSortModel
+ * @names: (array length=n_entries): Names of the entries in the directory
+ * @attributes: (array length=n_entries): The attributes of each entry
+ * @n_entries: Number of entries
+ *
+ * Adds or replaces many entries at once. Small batches are placed one
+ * by one like sugar_file_attributes_sort_model_update(); larger ones
+ * are applied together with a single sort and reported as one change.
+ */
+void
+sugar_file_attributes_sort_model_update_many(SugarFileAttributesSortModel *model,
+                                             const gchar * const          *names,
+                                             SugarFileAttributes * const  *attributes,
+                                             guint                         n_entries)
+{
+    GPtrArray *old;
+
+    g_return_if_fail(SUGAR_IS_FILE_ATTRIBUTES_SORT_MODEL(model));
+    g_return_if_fail(names != NULL || n_entries == 0);
+    g_return_if_fail(attributes != NULL || n_entries == 0);
+
+    if (n_entries < MIN_BATCH_RESORT || n_entries < model->sorted->len / BATCH_RESORT_DIVISOR) {
+        for (guint i = 0; i < n_entries; i++)
+            update_entry(model, names[i], attributes[i]);
+        return;
+    }
+
+    old = g_ptr_array_copy(model->visible, NULL, NULL);
+
+    for (guint i = 0; i < n_entries; i++) {
+        Entry *entry = g_hash_table_lookup(model->entries, names[i]);
+
+        if (!entry) {
+            entry = g_new0(Entry, 1);
+            entry->name = g_strdup(names[i]);
+            g_hash_table_insert(model->entries, entry->name, entry);
+            g_ptr_array_add(model->sorted, entry);
+        }
+
+        set_entry_attributes(model, entry, attributes[i]);
+        entry->changed = TRUE;
+    }
+
+    sort_entries(model, FALSE);
+    rebuild_visible(model);
+    emit_changes(model, old);
+
+    for (guint i = 0; i < n_entries; i++)
+        ((Entry *) g_hash_table_lookup(model->entries, names[i]))->changed = FALSE;
+
+    g_ptr_array_unref(old);
+}
+
+/**
+ * sugar_file_attributes_sort_model_remove:
+ * @model: A #SugarFileAttributesSortModel
+ * @name: Name of the entry in the directory
+ *
+ * Removes an entry, if it is in the model.
+ */
+void
+sugar_file_attributes_sort_model_remove(SugarFileAttributesSortModel *model, const gchar *name)
+{
+    Entry *entry;
+    guint position;
+
+    g_return_if_fail(SUGAR_IS_FILE_ATTRIBUTES_SORT_MODEL(model));
+    g_return_if_fail(name != NULL);
+
+    entry = g_hash_table_lookup(model->entries, name);
+    if (!entry) return;
+
+    position = unlink_entry(model, entry);
+    g_hash_table_remove(model->entries, name);
+
+    if (position != NO_POSITION)
+        g_list_model_items_changed(G_LIST_MODEL(model), position, 1, 0);
+}
+
+/**
+ * sugar_file_attributes_sort_model_get_n_entries:
+ * @model: A #SugarFileAttributesSortModel
+ *
+ * Gets the number of entries in the model, including those hidden by
+ * the filter.
+ *
+ * Returns: The number of entries
+ */
+guint
+sugar_file_attributes_sort_model_get_n_entries(SugarFileAttributesSortModel *model)
+{
+    g_return_val_if_fail(SUGAR_IS_FILE_ATTRIBUTES_SORT_MODEL(model), 0);
+
+    return model->sorted->len;
+}
+
+/**
+ * sugar_file_attributes_sort_model_set_sort:
+ * @model: A #SugarFileAttributesSortModel
+ * @key: The field to sort by
+ * @descending: Whether to sort from the largest value down
+ *
+ * Changes the sort order. Entries with equal values are ordered by
+ * name.
+ */
+void
+sugar_file_attributes_sort_model_set_sort(SugarFileAttributesSortModel *model,
+                                          SugarFileAttributesSortKey    key,
+                                          gboolean                      descending)
+{
+    gboolean update_keys;
+
+    g_return_if_fail(SUGAR_IS_FILE_ATTRIBUTES_SORT_MODEL(model));
+
+    if (model->sort_key == key && model->descending == !!descending)
+        return;
+
+    update_keys = model->sort_key != key;
+    model->sort_key = key;
+    model->descending = !!descending;
+    resort(model, update_keys);
+}
+
+/**
+ * sugar_file_attributes_sort_model_get_sort_key:
+ * @model: A #SugarFileAttributesSortModel
+ *
+ * Gets the field the model is sorted by.
+ *
+ * Returns: The sort field
+ */
+SugarFileAttributesSortKey
+sugar_file_attributes_sort_model_get_sort_key(SugarFileAttributesSortModel *model)
+{
+    g_return_val_if_fail(SUGAR_IS_FILE_ATTRIBUTES_SORT_MODEL(model), SUGAR_FILE_ATTRIBUTES_SORT_MODIFICATION_TIME);
+
+    return model->sort_key;
+}
+
+/**
+ * sugar_file_attributes_sort_model_get_descending:
+ * @model: A #SugarFileAttributesSortModel
+ *
+ * Gets whether the model is sorted from the largest value down.
+ *
+ * Returns: %TRUE if the order is descending
+ */
+gboolean
+sugar_file_attributes_sort_model_get_descending(SugarFileAttributesSortModel *model)
+{
+    g_return_val_if_fail(SUGAR_IS_FILE_ATTRIBUTES_SORT_MODEL(model), FALSE);
+
+    return model->descending;
+}
+
+/**
+ * sugar_file_attributes_sort_model_set_filter_func:
+ * @model: A #SugarFileAttributesSortModel
+ * @filter_func: (nullable): Function deciding which entries are shown, or %NULL to show all
+ * @user_data: Data for @filter_func
+ * @destroy: (nullable): Function to free @user_data
+ *
+ * Sets the filter of the model and applies it to every entry.
+ */
+void
+sugar_file_attributes_sort_model_set_filter_func(SugarFileAttributesSortModel  *model,
+                                                 SugarFileAttributesFilterFunc  filter_func,
+                                                 gpointer                       user_data,
+                                                 GDestroyNotify                 destroy)
+{
+    g_return_if_fail(SUGAR_IS_FILE_ATTRIBUTES_SORT_MODEL(model));
+
+    if (model->filter_destroy)
+        model->filter_destroy(model->filter_data);
+
+    model->filter_func = filter_func;
+    model->filter_data = user_data;
+    model->filter_destroy = destroy;
+    sugar_file_attributes_sort_model_refilter(model);
+}
+
+/**
+ * sugar_file_attributes_sort_model_refilter:
+ * @model: A #SugarFileAttributesSortModel
+ *
+ * Runs the filter on every entry again, for filters whose outcome
+ * depends on more than the entry, such as a search query.
+ */
+void
+sugar_file_attributes_sort_model_refilter(SugarFileAttributesSortModel *model)
+{
+    GPtrArray *old;
+
+    g_return_if_fail(SUGAR_IS_FILE_ATTRIBUTES_SORT_MODEL(model));
+
+    old = g_ptr_array_copy(model->visible, NULL, NULL);
+
+    for (guint i = 0; i < model->sorted->len; i++) {
+        Entry *entry = model->sorted->pdata[i];
+        entry->visible = entry_passes_filter(model, entry);
+    }
+
+    rebuild_visible(model);
+    emit_changes(model, old);
+    g_ptr_array_unref(old);
+}
@@ -0,0 +1,91 @@
+/*
+ * Copyright (C) 2025 MostlyK
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __SUGAR_FILE_ATTRIBUTES_SORT_MODEL_H__
+#define __SUGAR_FILE_ATTRIBUTES_SORT_MODEL_H__
+
+#include <gio/gio.h>
+#include "sugar-file-attributes.h"
+#include "sugar-file-attributes-list-model.h"
+
+G_BEGIN_DECLS
+
+/**
+ * SugarFileAttributesSortKey:
+ * @SUGAR_FILE_ATTRIBUTES_SORT_MODIFICATION_TIME: Sort by @modification_time
+ * @SUGAR_FILE_ATTRIBUTES_SORT_CREATION_TIME: Sort by @creation_time
+ * @SUGAR_FILE_ATTRIBUTES_SORT_TITLE: Sort by @title, in the collation order of the locale
+ * @SUGAR_FILE_ATTRIBUTES_SORT_ACTIVITY: Sort by @activity
+ *
+ * Selects the field a #SugarFileAttributesSortModel is ordered by.
+ */
+typedef enum {
+    SUGAR_FILE_ATTRIBUTES_SORT_MODIFICATION_TIME,
+    SUGAR_FILE_ATTRIBUTES_SORT_CREATION_TIME,
+    SUGAR_FILE_ATTRIBUTES_SORT_TITLE,
+    SUGAR_FILE_ATTRIBUTES_SORT_ACTIVITY,
+} SugarFileAttributesSortKey;
+
+/**
+ * SugarFileAttributesFilterFunc:
+ * @name: Name of the entry
+ * @attrs: The attributes of the entry
+ * @user_data: Data passed to sugar_file_attributes_sort_model_set_filter_func()
+ *
+ * Decides whether an entry is shown by a #SugarFileAttributesSortModel.
+ *
+ * Returns: %TRUE to show the entry
+ */
+typedef gboolean (*SugarFileAttributesFilterFunc) (const gchar               *name,
+                                                   const SugarFileAttributes *attrs,
+                                                   gpointer                   user_data);
+
+typedef struct _SugarFileAttributesSortModel SugarFileAttributesSortModel;
+typedef struct _SugarFileAttributesSortModelClass SugarFileAttributesSortModelClass;
+
+#define SUGAR_TYPE_FILE_ATTRIBUTES_SORT_MODEL       (sugar_file_attributes_sort_model_get_type())
+#define SUGAR_FILE_ATTRIBUTES_SORT_MODEL(object)    (G_TYPE_CHECK_INSTANCE_CAST((object), SUGAR_TYPE_FILE_ATTRIBUTES_SORT_MODEL, SugarFileAttributesSortModel))
+#define SUGAR_IS_FILE_ATTRIBUTES_SORT_MODEL(object) (G_TYPE_CHECK_INSTANCE_TYPE((object), SUGAR_TYPE_FILE_ATTRIBUTES_SORT_MODEL))
+
+GType                          sugar_file_attributes_sort_model_get_type        (void);
+SugarFileAttributesSortModel  *sugar_file_attributes_sort_model_new             (GFile                         *directory);
+void                           sugar_file_attributes_sort_model_update          (SugarFileAttributesSortModel  *model,
+                                                                                 const gchar                   *name,
+                                                                                 const SugarFileAttributes     *attrs);
+void                           sugar_file_attributes_sort_model_update_many     (SugarFileAttributesSortModel  *model,
+                                                                                 const gchar * const           *names,
+                                                                                 SugarFileAttributes * const   *attributes,
+                                                                                 guint                          n_entries);
+void                           sugar_file_attributes_sort_model_remove          (SugarFileAttributesSortModel  *model,
+                                                                                 const gchar                   *name);
+guint                          sugar_file_attributes_sort_model_get_n_entries   (SugarFileAttributesSortModel  *model);
+void                           sugar_file_attributes_sort_model_set_sort        (SugarFileAttributesSortModel  *model,
+                                                                                 SugarFileAttributesSortKey     key,
+                                                                                 gboolean                       descending);
+SugarFileAttributesSortKey     sugar_file_attributes_sort_model_get_sort_key    (SugarFileAttributesSortModel  *model);
+gboolean                       sugar_file_attributes_sort_model_get_descending  (SugarFileAttributesSortModel  *model);
+void                           sugar_file_attributes_sort_model_set_filter_func (SugarFileAttributesSortModel  *model,
+                                                                                 SugarFileAttributesFilterFunc  filter_func,
+                                                                                 gpointer                       user_data,
+                                                                                 GDestroyNotify                 destroy);
+void                           sugar_file_attributes_sort_model_refilter        (SugarFileAttributesSortModel  *model);
+
+G_END_DECLS
+
+#endif /* __SUGAR_FILE_ATTRIBUTES_SORT_MODEL_H__ */
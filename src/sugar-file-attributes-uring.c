@@ -0,0 +1,354 @@
+/*
+ * Copyright (C) 2025 MostlyK
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/* For struct statx */
+#define _GNU_SOURCE
+
+#include "config.h"
+#include "sugar-file-attributes-private.h"
+
+#ifdef HAVE_IO_URING
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+/*
+ * Batched metadata I/O through io_uring, used by the directory loader
+ * and the write queue. Callers queue statx(), getxattr() and setxattr()
+ * operations whose results land in an int each, then wait for all of
+ * them: a full ring of operations costs one io_uring_enter() instead of
+ * one blocking syscall each, and the kernel runs them side by side.
+ *
+ * Each thread gets its own ring on first use, freed when it exits. A
+ * full ring is completed before more operations are queued, so the
+ * completion queue, twice the size, can never overflow.
+ *
+ * The xattr operations need Linux 5.19. Kernels without them, and
+ * sandboxes that block io_uring, are detected once at run time, after
+ * which callers take their usual one-syscall-per-operation path.
+ *
+ * The kernel always hands these operations to its io-wq worker threads,
+ * which costs more than the syscalls it saves while the metadata is
+ * cached, so batching is opt-in.
+ */
+#define RING_ENTRIES 256
+
+static gint use_io_uring;
+
+#ifdef HAVE_IO_URING
+
+struct _SugarUring {
+    gint fd;
+    guint entries;
+    guint queued;
+    gboolean broken;
+
+    guint *sq_head;
+    guint *sq_tail;
+    guint *sq_mask;
+    guint *sq_array;
+    struct io_uring_sqe *sqes;
+
+    guint *cq_head;
+    guint *cq_tail;
+    guint *cq_mask;
+    struct io_uring_cqe *cqes;
+
+    gpointer sq_ring;
+    gsize sq_ring_size;
+    gpointer cq_ring;
+    gsize cq_ring_size;
+    gsize sqes_size;
+};
+
+static void
+ring_free(SugarUring *ring)
+{
+    if (ring->sqes) munmap(ring->sqes, ring->sqes_size);
+    if (ring->cq_ring) munmap(ring->cq_ring, ring->cq_ring_size);
+    if (ring->sq_ring) munmap(ring->sq_ring, ring->sq_ring_size);
+    close(ring->fd);
+    g_free(ring);
+}
+
+static GPrivate thread_ring = G_PRIVATE_INIT((GDestroyNotify) ring_free);
+
+static gpointer
+map_ring(gint fd, gsize size, off_t offset)
+{
+    gpointer map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, offset);
+
+    return map == MAP_FAILED ? NULL : map;
+}
+
+static SugarUring*
+ring_new(void)
+{
+    struct io_uring_params params;
+    SugarUring *ring;
+    gint fd;
+
+    memset(&params, 0, sizeof(params));
+    fd = (gint) syscall(__NR_io_uring_setup, RING_ENTRIES, &params);
+    if (fd < 0) return NULL;
+
+    ring = g_new0(SugarUring, 1);
+    ring->fd = fd;
+    ring->entries = params.sq_entries;
+    ring->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(guint);
+    ring->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+
+    ring->sq_ring = map_ring(fd, ring->sq_ring_size, IORING_OFF_SQ_RING);
+    ring->cq_ring = map_ring(fd, ring->cq_ring_size, IORING_OFF_CQ_RING);
+    ring->sqes = map_ring(fd, ring->sqes_size, IORING_OFF_SQES);
+
+    if (!ring->sq_ring || !ring->cq_ring || !ring->sqes) {
+        ring_free(ring);
+        return NULL;
+    }
+
+    ring->sq_head = G_STRUCT_MEMBER_P(ring->sq_ring, params.sq_off.head);
+    ring->sq_tail = G_STRUCT_MEMBER_P(ring->sq_ring, params.sq_off.tail);
+    ring->sq_mask = G_STRUCT_MEMBER_P(ring->sq_ring, params.sq_off.ring_mask);
+    ring->sq_array = G_STRUCT_MEMBER_P(ring->sq_ring, params.sq_off.array);
+    ring->cq_head = G_STRUCT_MEMBER_P(ring->cq_ring, params.cq_off.head);
+    ring->cq_tail = G_STRUCT_MEMBER_P(ring->cq_ring, params.cq_off.tail);
+    ring->cq_mask = G_STRUCT_MEMBER_P(ring->cq_ring, params.cq_off.ring_mask);
+    ring->cqes = G_STRUCT_MEMBER_P(ring->cq_ring, params.cq_off.cqes);
+    return ring;
+}
+
+static gboolean
+ops_supported(SugarUring *ring)
+{
+    static const guint8 needed[] = { IORING_OP_STATX, IORING_OP_GETXATTR, IORING_OP_SETXATTR };
+    struct io_uring_probe *probe = g_malloc0(sizeof(*probe) + 256 * sizeof(struct io_uring_probe_op));
+    gboolean supported = syscall(__NR_io_uring_register, ring->fd, IORING_REGISTER_PROBE, probe, 256) == 0;
+
+    for (guint i = 0; supported && i < G_N_ELEMENTS(needed); i++)
+        supported = needed[i] <= probe->last_op && (probe->ops[needed[i]].flags & IO_URING_OP_SUPPORTED);
+
+    g_free(probe);
+    return supported;
+}
+
+static gboolean
+io_uring_available(void)
+{
+    static gsize available = 0;
+
+    if (g_once_init_enter(&available)) {
+        SugarUring *ring = ring_new();
+        gboolean supported = ring && ops_supported(ring);
+
+        if (ring) ring_free(ring);
+        g_once_init_leave(&available, supported ? 2 : 1);
+    }
+
+    return available == 2;
+}
+
+/*
+ * Returns the calling thread's ring, or %NULL when io_uring is turned
+ * off or unavailable.
+ */
+SugarUring*
+_sugar_uring_get(void)
+{
+    SugarUring *ring;
+
+    if (!g_atomic_int_get(&use_io_uring) || !io_uring_available())
+        return NULL;
+
+    ring = g_private_get(&thread_ring);
+    if (!ring) {
+        // Locked memory limits of older kernels can still refuse a ring
+        ring = ring_new();
+        if (!ring) return NULL;
+        g_private_set(&thread_ring, ring);
+    }
+
+    return ring->broken ? NULL : ring;
+}
+
+/*
+ * Submits the queued operations and waits for all of them. Returns
+ * %FALSE if the ring failed, in which case results that did not arrive
+ * are left at -ECANCELED and the thread stops using io_uring.
+ */
+gboolean
+_sugar_uring_wait(SugarUring *ring)
+{
+    guint n_submitted = ring->queued;
+    guint n_done = 0;
+
+    if (ring->broken) return FALSE;
+
+    __atomic_store_n(ring->sq_tail, *ring->sq_tail + ring->queued, __ATOMIC_RELEASE);
+    ring->queued = 0;
+
+    for (;;) {
+        guint head = *ring->cq_head;
+        guint tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+        guint unsubmitted;
+
+        for (; head != tail; head++) {
+            const struct io_uring_cqe *cqe = &ring->cqes[head & *ring->cq_mask];
+            *(gint *) (guintptr) cqe->user_data = cqe->res;
+            n_done++;
+        }
+        __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+
+        if (n_done == n_submitted)
+            return TRUE;
+
+        // The kernel stops submitting at an error and leaves the rest in the ring
+        unsubmitted = *ring->sq_tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+        if (syscall(__NR_io_uring_enter, ring->fd, unsubmitted, n_submitted - n_done,
+                    IORING_ENTER_GETEVENTS, NULL, 0) < 0 &&
+            errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+            ring->broken = TRUE;
+            return FALSE;
+        }
+    }
+}
+
+static struct io_uring_sqe*
+get_sqe(SugarUring *ring, gint *result)
+{
+    struct io_uring_sqe *sqe;
+    guint index;
+
+    *result = -ECANCELED;
+
+    if (ring->queued == ring->entries && !_sugar_uring_wait(ring))
+        return NULL;
+
+    index = (*ring->sq_tail + ring->queued) & *ring->sq_mask;
+    sqe = &ring->sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->user_data = (guint64) (guintptr) result;
+    ring->sq_array[index] = index;
+    ring->queued++;
+    return sqe;
+}
+
+/*
+ * Queue statx(), getxattr() and setxattr() calls. @result receives the
+ * return value, or minus the errno, once _sugar_uring_wait() returns;
+ * every pointer passed must stay valid until then.
+ */
+void
+_sugar_uring_statx(SugarUring *ring, gint dirfd, const gchar *path, gint flags, guint mask,
+                   struct statx *buffer, gint *result)
+{
+    struct io_uring_sqe *sqe = get_sqe(ring, result);
+
+    if (!sqe) return;
+
+    sqe->opcode = IORING_OP_STATX;
+    sqe->fd = dirfd;
+    sqe->addr = (guint64) (guintptr) path;
+    sqe->len = mask;
+    sqe->off = (guint64) (guintptr) buffer;
+    sqe->statx_flags = flags;
+}
+
+void
+_sugar_uring_getxattr(SugarUring *ring, const gchar *path, const gchar *name, gpointer value, gsize size,
+                      gint *result)
+{
+    struct io_uring_sqe *sqe = get_sqe(ring, result);
+
+    if (!sqe) return;
+
+    sqe->opcode = IORING_OP_GETXATTR;
+    sqe->addr = (guint64) (guintptr) name;
+    sqe->addr2 = (guint64) (guintptr) value;
+    sqe->addr3 = (guint64) (guintptr) path;
+    sqe->len = size;
+}
+
+void
+_sugar_uring_setxattr(SugarUring *ring, const gchar *path, const gchar *name, gconstpointer value, gsize size,
+                      gint *result)
+{
+    struct io_uring_sqe *sqe = get_sqe(ring, result);
+
+    if (!sqe) return;
+
+    sqe->opcode = IORING_OP_SETXATTR;
+    sqe->addr = (guint64) (guintptr) name;
+    sqe->addr2 = (guint64) (guintptr) value;
+    sqe->addr3 = (guint64) (guintptr) path;
+    sqe->len = size;
+}
+
+#else /* HAVE_IO_URING */
+
+SugarUring*
+_sugar_uring_get(void)
+{
+    return NULL;
+}
+
+#endif /* HAVE_IO_URING */
+
+/**
+ * sugar_file_attributes_set_io_uring:
+ * @enabled: Whether to batch metadata I/O through io_uring
+ *
+ * Sets whether sugar_file_attributes_load_directory_async() and the
+ * write queue submit their metadata reads and writes in batches through
+ * io_uring. Batching pays off where storage latency dominates, such as
+ * SD cards, and costs time on cached metadata, so it is disabled by
+ * default; examples/sugar_file_attributes_benchmark.c compares both.
+ * Enabling it has no effect where the library was built without
+ * io_uring or the kernel does not support the needed operations; the
+ * thread pool path is used then.
+ */
+void
+sugar_file_attributes_set_io_uring(gboolean enabled)
+{
+    g_atomic_int_set(&use_io_uring, enabled ? TRUE : FALSE);
+}
+
+/**
+ * sugar_file_attributes_get_io_uring:
+ *
+ * Tells whether metadata I/O is batched through io_uring, which needs
+ * it to be enabled with sugar_file_attributes_set_io_uring() and
+ * supported by the library and the running kernel.
+ *
+ * Returns: %TRUE if io_uring is in use
+ */
+gboolean
+sugar_file_attributes_get_io_uring(void)
+{
+#ifdef HAVE_IO_URING
+    return g_atomic_int_get(&use_io_uring) && io_uring_available();
+#else
+    return FALSE;
+#endif
+}
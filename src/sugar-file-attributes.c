@@ -17,8 +17,18 @@
  * Boston, MA 02111-1307, USA.
  */
 
+/* For statx() */
+#define _GNU_SOURCE
+
+#include "config.h"
 #include "sugar-file-attributes.h"
+#include "sugar-file-attributes-private.h"
+#include <errno.h>
+#include <fcntl.h>
 #include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
 #include <sys/xattr.h>
 
 #define SUGAR_XATTR_PREFIX "user.sugar."
@@ -29,6 +39,227 @@
 #define SUGAR_XATTR_CREATION_TIME SUGAR_XATTR_PREFIX "creation_time"
 #define SUGAR_XATTR_MODIFICATION_TIME SUGAR_XATTR_PREFIX "modification_time"
 #define SUGAR_XATTR_PREVIEW_PATH SUGAR_XATTR_PREFIX "preview_path"
+#define SUGAR_XATTR_META SUGAR_XATTR_PREFIX "meta"
+
+/*
+ * Packed record stored under SUGAR_XATTR_META, all integers little endian:
+ *
+ *   0  "SGM" magic and a version byte
+ *   4  mask of the string fields present, in string_fields order
+ *   5  mask of the present strings stored out of line, version 2 only
+ *   6  2 reserved bytes
+ *   8  creation_time (int64)
+ *  16  modification_time (int64)
+ *  24  for each present string: length (uint32) followed by the bytes
+ *
+ * Readers try the record first and fall back to the per-key attributes,
+ * so files written by older versions keep working.
+ *
+ * Long descriptions are stored out of line in the blob store of the
+ * file's directory, see sugar-file-attributes-sidecar.c, and the record
+ * holds the hex SHA-256 digest naming the blob instead. Only records
+ * with such references are written as version 2, which older readers
+ * skip for the per-key attributes. Those keep the full value where the
+ * file system allows, so copies that carry the xattrs but not the blob
+ * store lose nothing either.
+ */
+#define META_MAGIC "SGM"
+#define META_VERSION 1
+#define META_VERSION_OVERFLOW 2
+#define META_HEADER_SIZE 24
+
+/*
+ * Descriptions longer than this are stored out of line, which keeps
+ * records within XATTR_SCRATCH_SIZE and clear of the xattr size limits
+ * of file systems, and lets scans skip reading them.
+ */
+#define OVERFLOW_FIELDS SUGAR_FILE_ATTRIBUTE_DESCRIPTION
+#define OVERFLOW_THRESHOLD 512
+
+/* Most records fit here, so reading one is a single getxattr() */
+#define XATTR_SCRATCH_SIZE 1024
+
+enum {
+    FIELD_TITLE,
+    FIELD_DESCRIPTION,
+    FIELD_TAGS,
+    FIELD_ACTIVITY,
+    FIELD_PREVIEW_PATH,
+};
+
+static const struct {
+    const gchar *xattr;
+    gsize offset;
+} string_fields[] = {
+    { SUGAR_XATTR_TITLE, G_STRUCT_OFFSET(SugarFileAttributes, title) },
+    { SUGAR_XATTR_DESCRIPTION, G_STRUCT_OFFSET(SugarFileAttributes, description) },
+    { SUGAR_XATTR_TAGS, G_STRUCT_OFFSET(SugarFileAttributes, tags) },
+    { SUGAR_XATTR_ACTIVITY, G_STRUCT_OFFSET(SugarFileAttributes, activity) },
+    { SUGAR_XATTR_PREVIEW_PATH, G_STRUCT_OFFSET(SugarFileAttributes, preview_path) },
+};
+
+#define N_STRING_FIELDS G_N_ELEMENTS(string_fields)
+#define STRING_FIELD(attrs, i) (*(gchar **) G_STRUCT_MEMBER_P((attrs), string_fields[i].offset))
+
+/* Bit i of a SugarFileAttributeMask selects string_fields[i] */
+G_STATIC_ASSERT(SUGAR_FILE_ATTRIBUTE_PREVIEW_PATH == 1 << FIELD_PREVIEW_PATH);
+G_STATIC_ASSERT(SUGAR_FILE_ATTRIBUTE_CREATION_TIME == 1 << N_STRING_FIELDS);
+G_STATIC_ASSERT(G_N_ELEMENTS(((SugarFileAttributes *) NULL)->snapshot) == N_STRING_FIELDS);
+
+/* Saves report the fields they wrote to the write hooks as is */
+G_STATIC_ASSERT((guint) SUGAR_WRITE_TITLE == SUGAR_FILE_ATTRIBUTE_TITLE);
+G_STATIC_ASSERT((guint) SUGAR_WRITE_DESCRIPTION == SUGAR_FILE_ATTRIBUTE_DESCRIPTION);
+G_STATIC_ASSERT((guint) SUGAR_WRITE_TAGS == SUGAR_FILE_ATTRIBUTE_TAGS);
+G_STATIC_ASSERT((guint) SUGAR_WRITE_ACTIVITY == SUGAR_FILE_ATTRIBUTE_ACTIVITY);
+
+/*
+ * Activity ids and tags come from small vocabularies, so with interning
+ * enabled the loaders and sugar_file_attributes_copy() share one copy of
+ * each value. The pool maps each interned string to its number of users;
+ * a field holds an interned string exactly when the pool's key for its
+ * contents is that same pointer, so sugar_file_attributes_free() can
+ * tell them apart from strings the caller allocated.
+ */
+static GMutex intern_lock;
+static GHashTable *intern_pool;
+static gint interning_enabled;
+
+static gboolean
+field_is_interned(gsize offset)
+{
+    return offset == G_STRUCT_OFFSET(SugarFileAttributes, tags) ||
+           offset == G_STRUCT_OFFSET(SugarFileAttributes, activity);
+}
+
+/*
+ * Returns the pooled string with the contents of @value, adding it if
+ * needed. With @take, @value is owned by the pool afterwards, so
+ * loaded strings are not copied again.
+ */
+static gchar*
+intern_string(gchar *value, gboolean take)
+{
+    gpointer key, refs;
+
+    g_mutex_lock(&intern_lock);
+
+    if (!intern_pool)
+        intern_pool = g_hash_table_new(g_str_hash, g_str_equal);
+
+    if (g_hash_table_lookup_extended(intern_pool, value, &key, &refs)) {
+        g_hash_table_insert(intern_pool, key, GUINT_TO_POINTER(GPOINTER_TO_UINT(refs) + 1));
+        if (take)
+            g_free(value);
+        value = key;
+    } else {
+        if (!take)
+            value = g_strdup(value);
+        g_hash_table_insert(intern_pool, value, GUINT_TO_POINTER(1));
+    }
+
+    g_mutex_unlock(&intern_lock);
+    return value;
+}
+
+static void
+release_string(gchar *value)
+{
+    gpointer key, refs;
+
+    if (!value) return;
+
+    g_mutex_lock(&intern_lock);
+
+    if (intern_pool && g_hash_table_lookup_extended(intern_pool, value, &key, &refs) && key == value) {
+        if (GPOINTER_TO_UINT(refs) > 1) {
+            g_hash_table_insert(intern_pool, key, GUINT_TO_POINTER(GPOINTER_TO_UINT(refs) - 1));
+            value = NULL;
+        } else {
+            g_hash_table_remove(intern_pool, key);
+        }
+    }
+
+    g_mutex_unlock(&intern_lock);
+    g_free(value);
+}
+
+// Replaces the string at @offset in @attrs, taking @value
+static void
+store_string(SugarFileAttributes *attrs, gsize offset, gchar *value)
+{
+    gchar **field = G_STRUCT_MEMBER_P(attrs, offset);
+
+    release_string(*field);
+
+    if (value && field_is_interned(offset) && g_atomic_int_get(&interning_enabled))
+        value = intern_string(value, TRUE);
+    *field = value;
+}
+
+void
+_sugar_file_attributes_assign_string(SugarFileAttributes *attrs, glong field_offset, const gchar *value)
+{
+    gchar **field = G_STRUCT_MEMBER_P(attrs, field_offset);
+
+    if (value && field_is_interned(field_offset) && g_atomic_int_get(&interning_enabled)) {
+        gchar *interned = intern_string((gchar *) value, FALSE);
+        release_string(*field);
+        *field = interned;
+    } else {
+        store_string(attrs, field_offset, g_strdup(value));
+    }
+}
+
+void
+_sugar_file_attributes_copy_fields(SugarFileAttributes       *dest,
+                                   const SugarFileAttributes *src,
+                                   SugarFileAttributeMask     mask)
+{
+    for (guint i = 0; i < N_STRING_FIELDS; i++) {
+        if (mask & (1u << i))
+            _sugar_file_attributes_assign_string(dest, string_fields[i].offset, STRING_FIELD(src, i));
+    }
+
+    if (mask & SUGAR_FILE_ATTRIBUTE_CREATION_TIME)
+        dest->creation_time = src->creation_time;
+    if (mask & SUGAR_FILE_ATTRIBUTE_MODIFICATION_TIME)
+        dest->modification_time = src->modification_time;
+
+    dest->unloaded = (dest->unloaded & ~mask) | (src->unloaded & mask);
+}
+
+/**
+ * sugar_file_attributes_set_interning:
+ * @enabled: Whether to intern activity ids and tags
+ *
+ * Makes the loaders and sugar_file_attributes_copy() share a single copy
+ * of each distinct @activity and @tags value, which saves memory when
+ * many records are held at once. Equal interned values are then the same
+ * pointer.
+ *
+ * While a record holds interned strings, those two fields must be
+ * treated as read-only and released only by sugar_file_attributes_free().
+ * Interning is disabled by default.
+ */
+void
+sugar_file_attributes_set_interning(gboolean enabled)
+{
+    g_atomic_int_set(&interning_enabled, enabled ? 1 : 0);
+}
+
+/**
+ * sugar_file_attributes_get_interning:
+ *
+ * Gets whether activity ids and tags are interned, see
+ * sugar_file_attributes_set_interning().
+ *
+ * Returns: %TRUE if interning is enabled
+ */
+gboolean
+sugar_file_attributes_get_interning(void)
+{
+    return g_atomic_int_get(&interning_enabled);
+}
 
 /**
  * sugar_file_attributes_new:
@@ -44,184 +275,1553 @@ sugar_file_attributes_new(void)
     
     attrs->creation_time = g_get_real_time();
     attrs->modification_time = attrs->creation_time;
+    attrs->snapshot_creation_time = attrs->creation_time;
     
     return attrs;
 }
 
 /**
- * sugar_file_attributes_free:
+ * sugar_file_attributes_free:
+ * @attrs: A #SugarFileAttributes
+ *
+ * Frees a #SugarFileAttributes structure.
+ */
+void
+sugar_file_attributes_free(SugarFileAttributes *attrs)
+{
+    if (!attrs) return;
+    
+    g_free(attrs->title);
+    g_free(attrs->description);
+    release_string(attrs->tags);
+    release_string(attrs->activity);
+    g_free(attrs->preview_path);
+    for (guint i = 0; i < G_N_ELEMENTS(attrs->snapshot); i++)
+        g_free(attrs->snapshot[i]);
+    g_free(attrs);
+}
+
+static gint
+string_field_index(SugarFileAttributeMask field)
+{
+    for (guint i = 0; i < N_STRING_FIELDS; i++) {
+        if (field == 1u << i)
+            return i;
+    }
+    return -1;
+}
+
+/**
+ * sugar_file_attributes_set_string:
+ * @attrs: A #SugarFileAttributes
+ * @field: A single string field, such as %SUGAR_FILE_ATTRIBUTE_TITLE
+ * @value: (nullable): The new value
+ *
+ * Sets a string field and marks it dirty, so the next save writes it
+ * without rewriting the unchanged fields.
+ */
+void
+sugar_file_attributes_set_string(SugarFileAttributes *attrs, SugarFileAttributeMask field, const gchar *value)
+{
+    gint index = string_field_index(field);
+
+    g_return_if_fail(attrs != NULL);
+    g_return_if_fail(index >= 0);
+
+    _sugar_file_attributes_assign_string(attrs, string_fields[index].offset, value);
+    attrs->dirty |= field;
+    attrs->unloaded &= ~field;
+}
+
+/**
+ * sugar_file_attributes_set_time:
+ * @attrs: A #SugarFileAttributes
+ * @field: %SUGAR_FILE_ATTRIBUTE_CREATION_TIME or %SUGAR_FILE_ATTRIBUTE_MODIFICATION_TIME
+ * @value: The new time, in microseconds since the epoch
+ *
+ * Sets a time field and marks it dirty. Saving always sets the
+ * modification time to the current time.
+ */
+void
+sugar_file_attributes_set_time(SugarFileAttributes *attrs, SugarFileAttributeMask field, gint64 value)
+{
+    g_return_if_fail(attrs != NULL);
+    g_return_if_fail(field == SUGAR_FILE_ATTRIBUTE_CREATION_TIME ||
+                     field == SUGAR_FILE_ATTRIBUTE_MODIFICATION_TIME);
+
+    if (field == SUGAR_FILE_ATTRIBUTE_CREATION_TIME)
+        attrs->creation_time = value;
+    else
+        attrs->modification_time = value;
+    attrs->dirty |= field;
+}
+
+/*
+ * Every xattr helper works on a target that is either a path or an open
+ * file descriptor, so the GFile API and the fd/dirfd-relative API share
+ * the same reading and writing code. @name, relative to @dirfd, locates
+ * the file's sidecar record and is %NULL for a bare descriptor.
+ */
+typedef struct {
+    const gchar *path;
+    gint fd;
+    gint dirfd;
+    const gchar *name;
+} XattrTarget;
+
+#define PATH_TARGET(p) { (p), -1, AT_FDCWD, (p) }
+#define FD_TARGET(f) { NULL, (f), -1, NULL }
+#define AT_TARGET(f, d, n) { NULL, (f), (d), (n) }
+
+static ssize_t
+target_getxattr(const XattrTarget *target, const gchar *name, void *value, gsize size)
+{
+    if (target->path)
+        return getxattr(target->path, name, value, size);
+    return fgetxattr(target->fd, name, value, size);
+}
+
+static gint
+target_setxattr(const XattrTarget *target, const gchar *name, const void *value, gsize size)
+{
+    if (target->path)
+        return setxattr(target->path, name, value, size, 0);
+    return fsetxattr(target->fd, name, value, size, 0);
+}
+
+static gint
+target_removexattr(const XattrTarget *target, const gchar *name)
+{
+    if (target->path)
+        return removexattr(target->path, name);
+    return fremovexattr(target->fd, name);
+}
+
+static ssize_t
+target_listxattr(const XattrTarget *target, gchar *list, gsize size)
+{
+    if (target->path)
+        return listxattr(target->path, list, size);
+    return flistxattr(target->fd, list, size);
+}
+
+/*
+ * Reads an attribute value, or the attribute name list when @name is
+ * %NULL, into @scratch. The array is only used as storage: its length
+ * is the usable capacity and only grows, so a scanner reusing one
+ * buffer stops allocating once it has seen its largest value. The size
+ * is probed again only when the read fails with ERANGE.
+ */
+static ssize_t
+fetch_xattr(const XattrTarget *target, const gchar *name, GByteArray *scratch)
+{
+    ssize_t result;
+
+    if (scratch->len < XATTR_SCRATCH_SIZE)
+        g_byte_array_set_size(scratch, XATTR_SCRATCH_SIZE);
+
+    for (;;) {
+        ssize_t probe;
+
+        if (name)
+            result = target_getxattr(target, name, scratch->data, scratch->len);
+        else
+            result = target_listxattr(target, (gchar *) scratch->data, scratch->len);
+
+        if (result >= 0 || errno != ERANGE)
+            return result;
+
+        probe = name ? target_getxattr(target, name, NULL, 0) : target_listxattr(target, NULL, 0);
+        if (probe < 0)
+            return probe;
+
+        // The value may grow between the probe and the read, keep some slack
+        g_byte_array_set_size(scratch, MAX((gsize) probe + XATTR_SCRATCH_SIZE, scratch->len * 2));
+    }
+}
+
+/*
+ * Sets string field @field of @attrs to a copy of @length bytes at
+ * @value, or to %NULL. Records of a #SugarFileAttributesBatch pass
+ * their @arena and get the copy from it; others own their strings.
+ */
+static void
+load_string(SugarFileAttributes *attrs, guint field, const guint8 *value, gsize length, GStringChunk *arena)
+{
+    if (!arena)
+        store_string(attrs, string_fields[field].offset, value ? g_strndup((const gchar *) value, length) : NULL);
+    else
+        STRING_FIELD(attrs, field) = value ? g_string_chunk_insert_len(arena, (const gchar *) value, length) : NULL;
+}
+
+static gint64
+parse_int64(const guint8 *data, gsize size)
+{
+    gchar str[32];
+
+    if (size == 0 || size >= sizeof(str)) return 0;
+
+    memcpy(str, data, size);
+    str[size] = '\0';
+    return g_ascii_strtoll(str, NULL, 10);
+}
+
+static gint64
+get_xattr_int64(const XattrTarget *target, const gchar *name)
+{
+    guint8 str[32];
+    ssize_t size = target_getxattr(target, name, str, sizeof(str));
+
+    if (size <= 0) return 0;
+    return parse_int64(str, size);
+}
+
+/*
+ * Tells whether the file system of a path target lacks user xattrs, in
+ * which case its metadata is kept in the directory's sidecar file, see
+ * sugar-file-attributes-sidecar.c. Only asked once a write has failed.
+ */
+static gboolean
+xattrs_unsupported(const XattrTarget *target)
+{
+    return target->name && target_getxattr(target, SUGAR_XATTR_META, NULL, 0) < 0 && errno == ENOTSUP;
+}
+
+static gboolean
+set_xattr_string(const XattrTarget *target, const gchar *name, const gchar *value)
+{
+    if (!value) {
+        // Only a file system without xattrs counts as a failure to remove
+        return target_removexattr(target, name) == 0 || errno != ENOTSUP;
+    }
+    
+    return target_setxattr(target, name, value, strlen(value)) == 0;
+}
+
+static gboolean
+set_xattr_int64(const XattrTarget *target, const gchar *name, gint64 value)
+{
+    gchar *str = g_strdup_printf("%" G_GINT64_FORMAT, value);
+    gboolean result = set_xattr_string(target, name, str);
+    g_free(str);
+    return result;
+}
+
+static void
+append_uint32(GByteArray *record, guint32 value)
+{
+    guint32 le = GUINT32_TO_LE(value);
+    g_byte_array_append(record, (const guint8 *) &le, sizeof(le));
+}
+
+static void
+append_int64(GByteArray *record, gint64 value)
+{
+    gint64 le = GINT64_TO_LE(value);
+    g_byte_array_append(record, (const guint8 *) &le, sizeof(le));
+}
+
+// Tells whether string field @field of @attrs is to be stored out of line
+static gboolean
+overflows(const SugarFileAttributes *attrs, guint field)
+{
+    const gchar *value = STRING_FIELD(attrs, field);
+
+    return (OVERFLOW_FIELDS & (1u << field)) && !(attrs->unloaded & (1u << field)) &&
+           value && strlen(value) > OVERFLOW_THRESHOLD;
+}
+
+/*
+ * Packs @attrs into a record. Long values go to the blob store of the
+ * directory of @target, and @overflowed, if not %NULL, is set to the
+ * fields stored out of line. Fields in @unloaded hold the digest of a
+ * stored value, as load_attributes() leaves them, and are kept as
+ * references. Values stay inline where there is no directory to store
+ * them in, as for a bare file descriptor or a %NULL @target, or if
+ * the blob cannot be written.
+ */
+static GByteArray*
+pack_attributes(const SugarFileAttributes *attrs, const XattrTarget *target, guint *overflowed)
+{
+    GByteArray *record = g_byte_array_sized_new(128);
+    guint8 header[8] = { 'S', 'G', 'M', META_VERSION, 0, 0, 0, 0 };
+    gchar *digests[N_STRING_FIELDS] = { NULL, };
+    guint i;
+
+    for (i = 0; i < N_STRING_FIELDS; i++) {
+        const gchar *value = STRING_FIELD(attrs, i);
+
+        if (!value) continue;
+        header[4] |= 1 << i;
+
+        if (overflows(attrs, i) && target && target->name)
+            digests[i] = _sugar_file_attributes_blob_store(target->dirfd, target->name, value, strlen(value));
+        if (digests[i] || (attrs->unloaded & (1u << i)))
+            header[5] |= 1 << i;
+    }
+
+    if (header[5])
+        header[3] = META_VERSION_OVERFLOW;
+    if (overflowed)
+        *overflowed = header[5];
+
+    g_byte_array_append(record, header, sizeof(header));
+    append_int64(record, attrs->creation_time);
+    append_int64(record, attrs->modification_time);
+
+    for (i = 0; i < N_STRING_FIELDS; i++) {
+        const gchar *value = digests[i] ? digests[i] : STRING_FIELD(attrs, i);
+        gsize length;
+
+        if (!value) continue;
+
+        length = strlen(value);
+        append_uint32(record, length);
+        g_byte_array_append(record, (const guint8 *) value, length);
+        g_free(digests[i]);
+    }
+
+    return record;
+}
+
+static gint64
+read_int64(const guint8 *data)
+{
+    gint64 le;
+    memcpy(&le, data, sizeof(le));
+    return GINT64_FROM_LE(le);
+}
+
+/*
+ * Sets @fields of @attrs from a packed record. Fields stored out of
+ * line get the digest of their value and their bit in @unloaded, see
+ * load_overflow().
+ */
+static gboolean
+unpack_attributes(const guint8 *data, gsize size, SugarFileAttributes *attrs, guint fields, GStringChunk *arena)
+{
+    const guint8 *values[N_STRING_FIELDS] = { NULL, };
+    guint32 lengths[N_STRING_FIELDS] = { 0, };
+    gsize offset = META_HEADER_SIZE;
+    guint8 mask;
+    guint8 overflowed;
+    guint i;
+
+    if (size < META_HEADER_SIZE || memcmp(data, META_MAGIC, 3) != 0)
+        return FALSE;
+
+    // A newer layout is left to the legacy attributes
+    if (data[3] != META_VERSION && data[3] != META_VERSION_OVERFLOW)
+        return FALSE;
+
+    mask = data[4];
+    overflowed = data[3] == META_VERSION_OVERFLOW ? data[5] & mask : 0;
+
+    // Validate everything before touching attrs
+    for (i = 0; i < N_STRING_FIELDS; i++) {
+        guint32 length;
+
+        if (!(mask & (1 << i))) continue;
+        if (size - offset < sizeof(length)) return FALSE;
+
+        memcpy(&length, data + offset, sizeof(length));
+        length = GUINT32_FROM_LE(length);
+        offset += sizeof(length);
+
+        if (size - offset < length) return FALSE;
+        if ((overflowed & (1 << i)) && length != SUGAR_BLOB_DIGEST_LENGTH) return FALSE;
+
+        values[i] = data + offset;
+        lengths[i] = length;
+        offset += length;
+    }
+
+    for (i = 0; i < N_STRING_FIELDS; i++) {
+        if (fields & (1u << i))
+            load_string(attrs, i, values[i], lengths[i], arena);
+    }
+    attrs->unloaded = (attrs->unloaded & ~fields) | (overflowed & fields);
+
+    if (fields & SUGAR_FILE_ATTRIBUTE_CREATION_TIME)
+        attrs->creation_time = read_int64(data + 8);
+    if (fields & SUGAR_FILE_ATTRIBUTE_MODIFICATION_TIME)
+        attrs->modification_time = read_int64(data + 16);
+
+    return TRUE;
+}
+
+static gboolean
+get_packed_attributes(const XattrTarget *target, SugarFileAttributes *attrs, GByteArray *scratch,
+                      guint fields, GStringChunk *arena)
+{
+    ssize_t size = fetch_xattr(target, SUGAR_XATTR_META, scratch);
+
+    if (size < 0) return FALSE;
+    return unpack_attributes(scratch->data, size, attrs, fields, arena);
+}
+
+static gboolean
+load_sidecar(const XattrTarget *target, SugarFileAttributes *attrs, guint fields, GStringChunk *arena)
+{
+    GBytes *record = _sugar_file_attributes_sidecar_lookup(target->dirfd, target->name);
+    gboolean result = FALSE;
+
+    if (record) {
+        gsize size;
+        const guint8 *data = g_bytes_get_data(record, &size);
+
+        result = unpack_attributes(data, size, attrs, fields, arena);
+        g_bytes_unref(record);
+    }
+
+    return result;
+}
+
+static gboolean
+store_sidecar(const XattrTarget *target, const SugarFileAttributes *attrs)
+{
+    GByteArray *record = pack_attributes(attrs, target, NULL);
+    gboolean result = _sugar_file_attributes_sidecar_store(target->dirfd, target->name, record->data, record->len);
+
+    g_byte_array_unref(record);
+    return result;
+}
+
+static gboolean
+set_packed_attributes(const XattrTarget *target, const SugarFileAttributes *attrs, guint *overflowed)
+{
+    GByteArray *record = pack_attributes(attrs, target, overflowed);
+    gboolean result = target_setxattr(target, SUGAR_XATTR_META, record->data, record->len) == 0;
+
+    g_byte_array_unref(record);
+    return result;
+}
+
+static gboolean
+remove_packed_attributes(const XattrTarget *target)
+{
+    return target_removexattr(target, SUGAR_XATTR_META) == 0 || errno == ENODATA;
+}
+
+/*
+ * Applies a single-field update done by the convenience setters to the
+ * packed record, if the file has one, so it does not go stale next to
+ * the per-key attribute written alongside it. @overflowed is set as by
+ * pack_attributes(), or to 0 if there is no record.
+ */
+static gboolean
+update_packed_string(const XattrTarget *target, guint field, const gchar *value, guint *overflowed)
+{
+    SugarFileAttributes *attrs = g_new0(SugarFileAttributes, 1);
+    GByteArray *scratch = g_byte_array_new();
+    gboolean result = TRUE;
+
+    *overflowed = 0;
+
+    if (get_packed_attributes(target, attrs, scratch, SUGAR_FILE_ATTRIBUTE_ALL, NULL)) {
+        store_string(attrs, string_fields[field].offset, g_strdup(value));
+        attrs->unloaded &= ~(1u << field);
+        result = set_packed_attributes(target, attrs, overflowed);
+    }
+
+    g_byte_array_unref(scratch);
+    sugar_file_attributes_free(attrs);
+    return result;
+}
+
+#define PRESENT_CREATION_TIME SUGAR_FILE_ATTRIBUTE_CREATION_TIME
+#define PRESENT_MODIFICATION_TIME SUGAR_FILE_ATTRIBUTE_MODIFICATION_TIME
+
+/*
+ * Lists the attribute names once and returns a bit per per-key field
+ * that exists, so files without Sugar metadata cost a single syscall
+ * instead of one failing read per field.
+ */
+static guint
+list_present_fields(const XattrTarget *target, GByteArray *scratch)
+{
+    const gsize prefix_len = strlen(SUGAR_XATTR_PREFIX);
+    ssize_t size = fetch_xattr(target, NULL, scratch);
+    const gchar *list = (const gchar *) scratch->data;
+    const gchar *name;
+    guint present = 0;
+    guint i;
+
+    if (size <= 0) return 0;
+
+    for (name = list; name < list + size; name += strlen(name) + 1) {
+        if (strncmp(name, SUGAR_XATTR_PREFIX, prefix_len) != 0)
+            continue;
+
+        for (i = 0; i < N_STRING_FIELDS; i++) {
+            if (strcmp(name, string_fields[i].xattr) == 0)
+                present |= 1u << i;
+        }
+        if (strcmp(name, SUGAR_XATTR_CREATION_TIME) == 0)
+            present |= PRESENT_CREATION_TIME;
+        else if (strcmp(name, SUGAR_XATTR_MODIFICATION_TIME) == 0)
+            present |= PRESENT_MODIFICATION_TIME;
+    }
+
+    return present;
+}
+
+static gint64
+fetch_xattr_int64(const XattrTarget *target, const gchar *name, GByteArray *scratch)
+{
+    ssize_t size = fetch_xattr(target, name, scratch);
+
+    if (size <= 0) return 0;
+    return parse_int64(scratch->data, size);
+}
+
+/*
+ * Reads the packed record if there is one, otherwise only the per-key
+ * attributes that are listed on the file. Only @fields, a
+ * #SugarFileAttributeMask, are set. @scratch may be %NULL, in which
+ * case a temporary buffer is used. Strings are copied into @arena
+ * unless it is %NULL, see load_string(). If the file system has no
+ * user xattrs, the record is read from the sidecar instead and
+ * @in_sidecar, if not %NULL, is set. Fields stored out of line are
+ * left as digests, for load_overflow() to deal with.
+ */
+static void
+load_attributes(const XattrTarget *target, SugarFileAttributes *attrs, GByteArray *scratch,
+                guint fields, GStringChunk *arena, gboolean *in_sidecar)
+{
+    GByteArray *owned = NULL;
+    guint present;
+    guint i;
+
+    if (in_sidecar)
+        *in_sidecar = FALSE;
+
+    if (!scratch)
+        scratch = owned = g_byte_array_sized_new(XATTR_SCRATCH_SIZE);
+
+    // Only a failed read may leave ENOTSUP behind
+    errno = 0;
+    if (get_packed_attributes(target, attrs, scratch, fields, arena))
+        goto out;
+
+    if (target->name && errno == ENOTSUP) {
+        if (in_sidecar)
+            *in_sidecar = TRUE;
+        if (load_sidecar(target, attrs, fields, arena))
+            goto out;
+        // Nothing stored yet, every field is cleared below
+        present = 0;
+    } else {
+        // A single missing attribute fails as cheaply as listing them would
+        present = (fields & (fields - 1)) ? list_present_fields(target, scratch) & fields : fields;
+    }
+
+    attrs->unloaded &= ~fields;
+
+    for (i = 0; i < N_STRING_FIELDS; i++) {
+        ssize_t size;
+
+        if (!(fields & (1u << i))) continue;
+        size = (present & (1u << i)) ? fetch_xattr(target, string_fields[i].xattr, scratch) : -1;
+        load_string(attrs, i, size > 0 ? scratch->data : NULL, MAX(size, 0), arena);
+    }
+
+    if (fields & SUGAR_FILE_ATTRIBUTE_CREATION_TIME) {
+        attrs->creation_time = (present & PRESENT_CREATION_TIME) ?
+            fetch_xattr_int64(target, SUGAR_XATTR_CREATION_TIME, scratch) : 0;
+    }
+    if (fields & SUGAR_FILE_ATTRIBUTE_MODIFICATION_TIME) {
+        attrs->modification_time = (present & PRESENT_MODIFICATION_TIME) ?
+            fetch_xattr_int64(target, SUGAR_XATTR_MODIFICATION_TIME, scratch) : 0;
+    }
+
+out:
+    attrs->dirty &= ~fields;
+
+    if (owned)
+        g_byte_array_unref(owned);
+}
+
+/*
+ * Replaces the digests load_attributes() left in the @fields of @attrs
+ * that are stored out of line: with their values from the blob store
+ * if @resolve is set, otherwise with %NULL. A missing blob falls back
+ * to the per-key attribute; a field found in neither is an error. Fields
+ * that are not read keep their bit in @unloaded, so saves leave them
+ * alone and sugar_file_attributes_load_fields() can read them later.
+ */
+static gboolean
+load_overflow(const XattrTarget *target, SugarFileAttributes *attrs, guint fields, GStringChunk *arena,
+              gboolean resolve, GError **error)
+{
+    guint pending = attrs->unloaded & fields;
+    GByteArray *scratch = NULL;
+    gboolean result = TRUE;
+
+    for (guint i = 0; pending && i < N_STRING_FIELDS; i++) {
+        const guint8 *data = NULL;
+        gchar *value = NULL;
+        gsize length = 0;
+
+        if (!(pending & (1u << i))) continue;
+
+        if (resolve && target->name)
+            value = _sugar_file_attributes_blob_load(target->dirfd, target->name, STRING_FIELD(attrs, i));
+
+        if (value) {
+            data = (const guint8 *) value;
+            length = strlen(value);
+        } else if (resolve) {
+            ssize_t size;
+
+            if (!scratch)
+                scratch = g_byte_array_sized_new(XATTR_SCRATCH_SIZE);
+            size = fetch_xattr(target, string_fields[i].xattr, scratch);
+            if (size > 0) {
+                data = scratch->data;
+                length = size;
+            } else if (result) {
+                g_set_error(error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND,
+                           "Blob %s is missing and no %s attribute is left",
+                           STRING_FIELD(attrs, i), string_fields[i].xattr);
+                result = FALSE;
+            }
+        }
+        if (data)
+            attrs->unloaded &= ~(1u << i);
+
+        load_string(attrs, i, data, length, arena);
+        g_free(value);
+    }
+
+    if (scratch)
+        g_byte_array_unref(scratch);
+    return result;
+}
+
+/*
+ * Sidecar counterpart of update_packed_string(). A record created here
+ * gets a creation time, as a first save would give it.
+ */
+static gboolean
+update_sidecar_string(const XattrTarget *target, guint field, const gchar *value)
+{
+    SugarFileAttributes *attrs = g_new0(SugarFileAttributes, 1);
+    gboolean result;
+
+    load_attributes(target, attrs, NULL, SUGAR_FILE_ATTRIBUTE_ALL, NULL, NULL);
+    store_string(attrs, string_fields[field].offset, g_strdup(value));
+    attrs->unloaded &= ~(1u << field);
+    if (attrs->creation_time == 0)
+        attrs->creation_time = g_get_real_time();
+
+    result = store_sidecar(target, attrs);
+    sugar_file_attributes_free(attrs);
+    return result;
+}
+
+/*
+ * Writes the per-key form of string @field. A value the record stores
+ * out of line, as told by @overflowed, is kept there too unless it is
+ * too long for the file system, in which case the stale one is removed
+ * and the blob is the only copy.
+ */
+static gboolean
+set_legacy_string(const XattrTarget *target, guint field, const gchar *value, guint overflowed)
+{
+    if (set_xattr_string(target, string_fields[field].xattr, value))
+        return TRUE;
+
+    if ((overflowed & (1u << field)) && (errno == E2BIG || errno == ENOSPC || errno == ERANGE))
+        return set_xattr_string(target, string_fields[field].xattr, NULL);
+
+    return FALSE;
+}
+
+/*
+ * Writes one string field for the convenience setters: the packed record
+ * and the per-key attribute, or the sidecar record where the file system
+ * has no user xattrs.
+ */
+static gboolean
+set_string_field(const XattrTarget *target, guint field, const gchar *value)
+{
+    guint overflowed;
+
+    if (update_packed_string(target, field, value, &overflowed) &&
+        set_legacy_string(target, field, value, overflowed))
+        return TRUE;
+
+    return xattrs_unsupported(target) && update_sidecar_string(target, field, value);
+}
+
+/*
+ * Gives the file of @target a creation time if it has none, in the
+ * packed record and the per-key attribute alike. A time either form
+ * already holds is kept, the packed one first, as loads prefer it.
+ * Sidecar records get one as they are created.
+ */
+static gboolean
+set_creation_time_field(const XattrTarget *target)
+{
+    SugarFileAttributes *attrs = g_new0(SugarFileAttributes, 1);
+    GByteArray *scratch = g_byte_array_new();
+    gint64 legacy_time = get_xattr_int64(target, SUGAR_XATTR_CREATION_TIME);
+    gint64 creation_time = legacy_time ? legacy_time : g_get_real_time();
+    gboolean result = TRUE;
+
+    if (get_packed_attributes(target, attrs, scratch, SUGAR_FILE_ATTRIBUTE_ALL, NULL)) {
+        if (attrs->creation_time == 0) {
+            attrs->creation_time = creation_time;
+            result = set_packed_attributes(target, attrs, NULL);
+        }
+        creation_time = attrs->creation_time;
+    }
+
+    if (result && creation_time != legacy_time)
+        result = set_xattr_int64(target, SUGAR_XATTR_CREATION_TIME, creation_time);
+
+    g_byte_array_unref(scratch);
+    sugar_file_attributes_free(attrs);
+    return result;
+}
+
+/*
+ * The snapshot holds a copy of each string field and the creation time
+ * as last loaded or saved, so saves can tell the fields assigned
+ * directly from those left alone. A zeroed structure starts out with
+ * every field %NULL.
+ */
+static void
+take_snapshot(SugarFileAttributes *attrs, guint fields)
+{
+    for (guint i = 0; i < N_STRING_FIELDS; i++) {
+        if (!(fields & (1u << i)) || g_strcmp0(attrs->snapshot[i], STRING_FIELD(attrs, i)) == 0)
+            continue;
+        g_free(attrs->snapshot[i]);
+        attrs->snapshot[i] = g_strdup(STRING_FIELD(attrs, i));
+    }
+    if (fields & SUGAR_FILE_ATTRIBUTE_CREATION_TIME)
+        attrs->snapshot_creation_time = attrs->creation_time;
+}
+
+static guint
+changed_since_snapshot(const SugarFileAttributes *attrs)
+{
+    guint changed = 0;
+
+    for (guint i = 0; i < N_STRING_FIELDS; i++) {
+        if (g_strcmp0(STRING_FIELD(attrs, i), attrs->snapshot[i]) != 0)
+            changed |= 1u << i;
+    }
+    if (attrs->creation_time != attrs->snapshot_creation_time)
+        changed |= SUGAR_FILE_ATTRIBUTE_CREATION_TIME;
+
+    return changed;
+}
+
+// Called once @attrs is what the file holds, apart from the fields left on disk
+static void
+mark_saved(SugarFileAttributes *attrs)
+{
+    attrs->dirty = 0;
+    take_snapshot(attrs, SUGAR_FILE_ATTRIBUTE_ALL);
+}
+
+// The dirty and directly assigned fields, or all of them, less those a load left on disk
+static guint
+save_fields(const SugarFileAttributes *attrs)
+{
+    if (!attrs->dirty)
+        return SUGAR_FILE_ATTRIBUTE_ALL & ~attrs->unloaded;
+
+    return (attrs->dirty | changed_since_snapshot(attrs)) & ~attrs->unloaded;
+}
+
+static gboolean
+save_needs_stored(const SugarFileAttributes *attrs, SugarFileAttributesSaveFlags flags)
+{
+    return save_fields(attrs) != SUGAR_FILE_ATTRIBUTE_ALL || (flags & SUGAR_FILE_ATTRIBUTES_SAVE_COMPARE);
+}
+
+/*
+ * Tells whether string @field of @attrs differs from the @stored one.
+ * A value @stored out of line holds its digest, which the value of
+ * @attrs is hashed to compare against.
+ */
+static gboolean
+field_differs(const SugarFileAttributes *attrs, const SugarFileAttributes *stored, guint field)
+{
+    const gchar *value = STRING_FIELD(attrs, field);
+    gchar *digest;
+    gboolean result;
+
+    if (!(stored->unloaded & (1u << field)) || !value)
+        return g_strcmp0(value, STRING_FIELD(stored, field)) != 0;
+
+    digest = g_compute_checksum_for_string(G_CHECKSUM_SHA256, value, -1);
+    result = g_strcmp0(digest, STRING_FIELD(stored, field)) != 0;
+    g_free(digest);
+    return result;
+}
+
+/*
+ * Works out the fields a save of @attrs writes, given the @stored values
+ * whenever save_needs_stored() asks for them, and sets the modification
+ * time. Returns 0 when a compared save finds nothing changed. @record
+ * is set to the full record to pack: @attrs, or @stored with the
+ * written fields merged in.
+ */
+static guint
+plan_save(SugarFileAttributes *attrs, SugarFileAttributes *stored, SugarFileAttributesSaveFlags flags,
+          const SugarFileAttributes **record)
+{
+    guint fields = save_fields(attrs);
+    guint i;
+
+    *record = attrs;
+
+    // A file saved for the first time still gets its creation time
+    if (stored && stored->creation_time == 0)
+        fields |= SUGAR_FILE_ATTRIBUTE_CREATION_TIME;
+
+    if (flags & SUGAR_FILE_ATTRIBUTES_SAVE_COMPARE) {
+        for (i = 0; i < N_STRING_FIELDS; i++) {
+            if (!field_differs(attrs, stored, i))
+                fields &= ~(1u << i);
+        }
+        if (attrs->creation_time == stored->creation_time)
+            fields &= ~SUGAR_FILE_ATTRIBUTE_CREATION_TIME;
+
+        if (!(fields & ~SUGAR_FILE_ATTRIBUTE_MODIFICATION_TIME))
+            return 0;
+    }
+
+    attrs->modification_time = g_get_real_time();
+    fields |= SUGAR_FILE_ATTRIBUTE_MODIFICATION_TIME;
+
+    if (stored && fields != SUGAR_FILE_ATTRIBUTE_ALL) {
+        _sugar_file_attributes_copy_fields(stored, attrs, fields);
+        *record = stored;
+    }
+
+    return fields;
+}
+
+/*
+ * Writes the dirty fields of @attrs, or all of them if none is marked,
+ * plus the modification time. Fields that are not written, including
+ * those in @unloaded, keep their stored values, which are read back to
+ * rebuild the packed record. @written is set to the fields that were
+ * actually written, and @in_sidecar when they went to the sidecar store.
+ */
+static gboolean
+save_attributes(const XattrTarget *target, SugarFileAttributes *attrs, SugarFileAttributesSaveFlags flags,
+                guint *written, gboolean *in_sidecar)
+{
+    SugarFileAttributes *stored = NULL;
+    const SugarFileAttributes *record;
+    guint overflowed = 0;
+    gboolean success;
+    gboolean packed;
+    guint fields;
+    guint i;
+
+    *written = 0;
+    *in_sidecar = FALSE;
+
+    if (save_needs_stored(attrs, flags)) {
+        stored = g_new0(SugarFileAttributes, 1);
+        load_attributes(target, stored, NULL, SUGAR_FILE_ATTRIBUTE_ALL, NULL, NULL);
+    }
+
+    fields = plan_save(attrs, stored, flags, &record);
+    if (!fields) {
+        mark_saved(attrs);
+        sugar_file_attributes_free(stored);
+        return TRUE;
+    }
+
+    if (flags & SUGAR_FILE_ATTRIBUTES_SAVE_PACKED) {
+        packed = set_packed_attributes(target, record, &overflowed);
+    } else {
+        packed = remove_packed_attributes(target);
+    }
+
+    // The packed form is all a sidecar holds, whatever the flags ask for
+    if (!packed && xattrs_unsupported(target)) {
+        *in_sidecar = TRUE;
+        success = store_sidecar(target, record);
+    } else if (flags & SUGAR_FILE_ATTRIBUTES_SAVE_LEGACY) {
+        success = packed;
+        for (i = 0; i < N_STRING_FIELDS; i++) {
+            if (!(fields & (1u << i))) continue;
+            success &= set_legacy_string(target, i, STRING_FIELD(attrs, i), overflowed);
+        }
+        if (fields & SUGAR_FILE_ATTRIBUTE_CREATION_TIME)
+            success &= set_xattr_int64(target, SUGAR_XATTR_CREATION_TIME, attrs->creation_time);
+        success &= set_xattr_int64(target, SUGAR_XATTR_MODIFICATION_TIME, attrs->modification_time);
+    } else {
+        success = packed;
+    }
+
+    if (success) {
+        mark_saved(attrs);
+        *written = fields;
+    }
+
+    sugar_file_attributes_free(stored);
+    return success;
+}
+
+#ifdef HAVE_STATX
+static gint64
+statx_usec(const struct statx_timestamp *ts)
+{
+    return (gint64) ts->tv_sec * G_USEC_PER_SEC + ts->tv_nsec / 1000;
+}
+
+static void
+timespec_from_statx(struct timespec *ts, const struct statx_timestamp *stx_ts)
+{
+    ts->tv_sec = stx_ts->tv_sec;
+    ts->tv_nsec = stx_ts->tv_nsec;
+}
+
+static void
+stat_from_statx(struct stat *st, const struct statx *stx)
+{
+    memset(st, 0, sizeof(*st));
+    st->st_dev = makedev(stx->stx_dev_major, stx->stx_dev_minor);
+    st->st_ino = stx->stx_ino;
+    st->st_mode = stx->stx_mode;
+    st->st_nlink = stx->stx_nlink;
+    st->st_uid = stx->stx_uid;
+    st->st_gid = stx->stx_gid;
+    st->st_rdev = makedev(stx->stx_rdev_major, stx->stx_rdev_minor);
+    st->st_size = stx->stx_size;
+    st->st_blksize = stx->stx_blksize;
+    st->st_blocks = stx->stx_blocks;
+    timespec_from_statx(&st->st_atim, &stx->stx_atime);
+    timespec_from_statx(&st->st_mtim, &stx->stx_mtime);
+    timespec_from_statx(&st->st_ctim, &stx->stx_ctime);
+}
+#endif
+
+static gint64
+timespec_usec(const struct timespec *ts)
+{
+    return (gint64) ts->tv_sec * G_USEC_PER_SEC + ts->tv_nsec / 1000;
+}
+
+/*
+ * fstatat() that also reports the birth time, in microseconds, or 0 if
+ * the file system does not record one. With statx() both come from a
+ * single call; kernels or sandboxes without it get plain fstatat().
+ */
+static gint
+stat_file(gint dirfd, const gchar *path, gint flags, struct stat *st, gint64 *btime)
+{
+#ifdef HAVE_STATX
+    struct statx stx;
+
+    if (statx(dirfd, path, flags | AT_STATX_SYNC_AS_STAT, STATX_BASIC_STATS | STATX_BTIME, &stx) == 0) {
+        stat_from_statx(st, &stx);
+        *btime = (stx.stx_mask & STATX_BTIME) ? statx_usec(&stx.stx_btime) : 0;
+        return 0;
+    }
+
+    // Seccomp filters that predate statx() tend to answer EPERM
+    if (errno != ENOSYS && errno != EPERM)
+        return -1;
+#endif
+
+    *btime = 0;
+    return fstatat(dirfd, path, st, flags);
+}
+
+static gint
+open_at(gint dirfd, const gchar *name, GError **error)
+{
+    // O_NONBLOCK keeps a FIFO in the directory from stalling the scan
+    gint fd = openat(dirfd, name, O_RDONLY | O_CLOEXEC | O_NOCTTY | O_NONBLOCK);
+
+    if (fd < 0) {
+        int saved_errno = errno;
+        g_set_error(error, G_IO_ERROR, g_io_error_from_errno(saved_errno),
+                   "Could not open %s: %s", name, g_strerror(saved_errno));
+    }
+
+    return fd;
+}
+
+/*
+ * Adds the digests of the values that the record of @name, relative
+ * to @dirfd, stores out of line to @digests. Returns %FALSE if the
+ * entry could not be read, so its blobs are not known.
+ */
+gboolean
+_sugar_file_attributes_collect_blobs(gint dirfd, const gchar *name, GHashTable *digests)
+{
+    SugarFileAttributes *attrs;
+    gint fd = open_at(dirfd, name, NULL);
+
+    // Removed since the directory was read
+    if (fd < 0)
+        return errno == ENOENT;
+
+    XattrTarget target = AT_TARGET(fd, dirfd, name);
+    attrs = g_new0(SugarFileAttributes, 1);
+    load_attributes(&target, attrs, NULL, OVERFLOW_FIELDS, NULL, NULL);
+    close(fd);
+
+    for (guint i = 0; i < N_STRING_FIELDS; i++) {
+        if (attrs->unloaded & OVERFLOW_FIELDS & (1u << i))
+            g_hash_table_add(digests, g_strdup(STRING_FIELD(attrs, i)));
+    }
+
+    sugar_file_attributes_free(attrs);
+    return TRUE;
+}
+
+/*
+ * Hooks are called without the lock, since they may load attributes
+ * and so take other locks. Each entry is referenced by the calls that
+ * are about to run it, and removal waits until none of them runs it.
+ */
+typedef struct {
+    guint id;
+    SugarWriteHook hook;
+    gpointer user_data;
+    guint ref_count;
+    guint n_running;
+    gboolean removed;
+} WriteHook;
+
+static GMutex hooks_lock;
+static GCond hooks_idle;
+static GSList *write_hooks;
+static guint last_hook_id;
+
+// Call with the lock held
+static void
+write_hook_unref(WriteHook *entry)
+{
+    if (--entry->ref_count == 0)
+        g_free(entry);
+}
+
+guint
+_sugar_file_attributes_add_write_hook(SugarWriteHook hook, gpointer user_data)
+{
+    WriteHook *entry = g_new0(WriteHook, 1);
+    guint id;
+
+    g_mutex_lock(&hooks_lock);
+    id = entry->id = ++last_hook_id;
+    entry->hook = hook;
+    entry->user_data = user_data;
+    entry->ref_count = 1;
+    write_hooks = g_slist_prepend(write_hooks, entry);
+    g_mutex_unlock(&hooks_lock);
+
+    return id;
+}
+
+void
+_sugar_file_attributes_remove_write_hook(guint id)
+{
+    g_mutex_lock(&hooks_lock);
+    for (GSList *l = write_hooks; l; l = l->next) {
+        WriteHook *entry = l->data;
+        if (entry->id == id) {
+            write_hooks = g_slist_delete_link(write_hooks, l);
+            entry->removed = TRUE;
+            while (entry->n_running > 0)
+                g_cond_wait(&hooks_idle, &hooks_lock);
+            write_hook_unref(entry);
+            break;
+        }
+    }
+    g_mutex_unlock(&hooks_lock);
+}
+
+// A hook removed meanwhile is skipped, so none is called after its removal returns
+static void
+notify_write(const gchar *path, const SugarFileAttributes *attrs, SugarWriteFields fields)
+{
+    GSList *hooks;
+
+    g_mutex_lock(&hooks_lock);
+    hooks = g_slist_copy(write_hooks);
+    for (GSList *l = hooks; l; l = l->next)
+        ((WriteHook *) l->data)->ref_count++;
+    g_mutex_unlock(&hooks_lock);
+
+    for (GSList *l = hooks; l; l = l->next) {
+        WriteHook *entry = l->data;
+        gboolean run;
+
+        g_mutex_lock(&hooks_lock);
+        run = !entry->removed;
+        if (run)
+            entry->n_running++;
+        g_mutex_unlock(&hooks_lock);
+
+        if (run)
+            entry->hook(path, attrs, fields, entry->user_data);
+
+        g_mutex_lock(&hooks_lock);
+        if (run && --entry->n_running == 0)
+            g_cond_broadcast(&hooks_idle);
+        write_hook_unref(entry);
+        g_mutex_unlock(&hooks_lock);
+    }
+
+    g_slist_free(hooks);
+}
+
+/**
+ * sugar_file_attributes_get_from_file:
+ * @file: A #GFile
+ * @error: Return location for error
+ *
+ * Reads Sugar file attributes from the given file.
+ *
+ * Returns: (transfer full): A #SugarFileAttributes or %NULL on error
+ */
+SugarFileAttributes*
+sugar_file_attributes_get_from_file(GFile *file, GError **error)
+{
+    g_return_val_if_fail(G_IS_FILE(file), NULL);
+    
+    SugarFileAttributes *attrs = sugar_file_attributes_new();
+    
+    if (!sugar_file_attributes_load_fields(attrs, file, SUGAR_FILE_ATTRIBUTE_ALL, error)) {
+        sugar_file_attributes_free(attrs);
+        return NULL;
+    }
+    
+    return attrs;
+}
+
+/**
+ * sugar_file_attributes_load_from_file:
+ * @attrs: A #SugarFileAttributes
+ * @file: A #GFile
+ * @error: Return location for error
+ *
+ * Loads Sugar file attributes from the given file into the structure.
+ *
+ * Returns: %TRUE on success, %FALSE on error
+ */
+gboolean
+sugar_file_attributes_load_from_file(SugarFileAttributes *attrs, GFile *file, GError **error)
+{
+    g_return_val_if_fail(attrs != NULL, FALSE);
+    g_return_val_if_fail(G_IS_FILE(file), FALSE);
+    
+    return sugar_file_attributes_load_fields(attrs, file, SUGAR_FILE_ATTRIBUTE_ALL, error);
+}
+
+/**
+ * sugar_file_attributes_load_fields:
+ * @attrs: A #SugarFileAttributes
+ * @file: A #GFile
+ * @mask: The fields to load
+ * @error: Return location for error
+ *
+ * Loads only the fields in @mask from the given file into the
+ * structure; the other fields are left unchanged. Listings that show a
+ * few fields avoid reading and copying the rest, and a missing time is
+ * only looked up from the file system when it was requested.
+ *
+ * A long description whose out-of-line copy is gone, along with its
+ * per-key attribute, fails with %G_IO_ERROR_NOT_FOUND; the other fields
+ * are still loaded, and the description is left out of later saves.
+ *
+ * Returns: %TRUE on success, %FALSE on error
+ */
+gboolean
+sugar_file_attributes_load_fields(SugarFileAttributes    *attrs,
+                                  GFile                  *file,
+                                  SugarFileAttributeMask  mask,
+                                  GError                **error)
+{
+    g_return_val_if_fail(attrs != NULL, FALSE);
+    g_return_val_if_fail(G_IS_FILE(file), FALSE);
+    
+    gchar *path = g_file_get_path(file);
+    if (!path) {
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+                   "File does not support extended attributes");
+        return FALSE;
+    }
+    
+    // Serve repeated reads from the cache while the file is unchanged
+    struct stat st;
+    gint64 btime;
+    gboolean have_stat = stat_file(AT_FDCWD, path, 0, &st, &btime) == 0;
+    if (have_stat && _sugar_file_attributes_cache_load(&st, attrs, mask)) {
+        _sugar_file_attributes_queue_apply(&st, attrs, mask);
+        attrs->dirty &= ~mask;
+        take_snapshot(attrs, mask);
+        g_free(path);
+        return TRUE;
+    }
+    
+    XattrTarget target = PATH_TARGET(path);
+    gboolean in_sidecar;
+    
+    load_attributes(&target, attrs, NULL, mask, NULL, &in_sidecar);
+    // A dangling blob leaves its field unloaded, the others are still set
+    gboolean resolved = load_overflow(&target, attrs, mask, NULL, TRUE, error);
+    
+    // Fallback to file system times if not set, from the stat above
+    if (have_stat && (mask & SUGAR_FILE_ATTRIBUTE_CREATION_TIME) && attrs->creation_time == 0)
+        attrs->creation_time = btime;
+    if (have_stat && (mask & SUGAR_FILE_ATTRIBUTE_MODIFICATION_TIME) && attrs->modification_time == 0)
+        attrs->modification_time = timespec_usec(&st.st_mtim);
+    
+    // Partial loads are not worth caching, and sidecar writes leave ctime alone
+    if (have_stat && mask == SUGAR_FILE_ATTRIBUTE_ALL && !in_sidecar && !attrs->unloaded)
+        _sugar_file_attributes_cache_store(&st, attrs);
+    
+    // The cache holds what is on disk, queued writes are only layered on top
+    if (have_stat) _sugar_file_attributes_queue_apply(&st, attrs, mask);
+    take_snapshot(attrs, mask);
+    
+    g_free(path);
+    return resolved;
+}
+
+// @btime is the birth time from stat_file(), 0 if unknown
+static void
+finish_load(SugarFileAttributes *attrs, const struct stat *st, gint64 btime)
+{
+    // Fallback to file system times if not set, as sugar_file_attributes_load_fields() does
+    if (attrs->creation_time == 0)
+        attrs->creation_time = btime;
+    if (attrs->modification_time == 0)
+        attrs->modification_time = timespec_usec(&st->st_mtim);
+
+    _sugar_file_attributes_queue_apply(st, attrs, SUGAR_FILE_ATTRIBUTE_ALL);
+}
+
+static gboolean
+load_fd(SugarFileAttributes *attrs, const XattrTarget *target, GByteArray *scratch, GStringChunk *arena,
+        GError **error)
+{
+    struct stat st;
+    gint64 btime;
+
+    if (stat_file(target->fd, "", AT_EMPTY_PATH, &st, &btime) != 0) {
+        int saved_errno = errno;
+        g_set_error(error, G_IO_ERROR, g_io_error_from_errno(saved_errno),
+                   "Could not stat file: %s", g_strerror(saved_errno));
+        return FALSE;
+    }
+
+    load_attributes(target, attrs, scratch, SUGAR_FILE_ATTRIBUTE_ALL, arena, NULL);
+    load_overflow(target, attrs, SUGAR_FILE_ATTRIBUTE_ALL, arena, FALSE, NULL);
+    finish_load(attrs, &st, btime);
+    // Records in an arena are read-only and own none of their strings
+    if (!arena)
+        take_snapshot(attrs, SUGAR_FILE_ATTRIBUTE_ALL);
+    return TRUE;
+}
+
+/**
+ * sugar_file_attributes_load_from_fd:
+ * @attrs: A #SugarFileAttributes
+ * @fd: An open file descriptor
+ * @error: Return location for error
+ *
+ * Loads Sugar file attributes from an open file into the structure.
+ * The descriptor is not closed. Unlike the #GFile variant no path is
+ * resolved, so a file renamed while open is still read correctly.
+ * Long descriptions are left unread, see #SugarFileAttributes.
+ *
+ * Returns: %TRUE on success, %FALSE on error
+ */
+gboolean
+sugar_file_attributes_load_from_fd(SugarFileAttributes *attrs, gint fd, GError **error)
+{
+    return sugar_file_attributes_load_from_fd_full(attrs, fd, NULL, error);
+}
+
+/**
+ * sugar_file_attributes_load_from_fd_full:
+ * @attrs: A #SugarFileAttributes
+ * @fd: An open file descriptor
+ * @scratch: (nullable): A buffer reused across calls, or %NULL
+ * @error: Return location for error
+ *
+ * Like sugar_file_attributes_load_from_fd(), but reads the attribute
+ * values into @scratch. Passing the same array for every file of a scan
+ * avoids a heap allocation per attribute; its contents are undefined
+ * afterwards.
+ *
+ * Returns: %TRUE on success, %FALSE on error
+ */
+gboolean
+sugar_file_attributes_load_from_fd_full(SugarFileAttributes *attrs, gint fd, GByteArray *scratch, GError **error)
+{
+    XattrTarget target = FD_TARGET(fd);
+
+    g_return_val_if_fail(attrs != NULL, FALSE);
+    g_return_val_if_fail(fd >= 0, FALSE);
+
+    return load_fd(attrs, &target, scratch, NULL, error);
+}
+
+/**
+ * sugar_file_attributes_load_at:
+ * @attrs: A #SugarFileAttributes
+ * @dirfd: A directory file descriptor
+ * @name: Name of the entry relative to @dirfd
+ * @error: Return location for error
+ *
+ * Loads Sugar file attributes of a directory entry. Scanners can open a
+ * directory once and read many entries without walking the full path
+ * of each one. Long descriptions are left unread, see
+ * #SugarFileAttributes.
+ *
+ * Returns: %TRUE on success, %FALSE on error
+ */
+gboolean
+sugar_file_attributes_load_at(SugarFileAttributes *attrs, gint dirfd, const gchar *name, GError **error)
+{
+    return sugar_file_attributes_load_at_full(attrs, dirfd, name, NULL, error);
+}
+
+/**
+ * sugar_file_attributes_load_at_full:
  * @attrs: A #SugarFileAttributes
+ * @dirfd: A directory file descriptor
+ * @name: Name of the entry relative to @dirfd
+ * @scratch: (nullable): A buffer reused across calls, or %NULL
+ * @error: Return location for error
  *
- * Frees a #SugarFileAttributes structure.
+ * Like sugar_file_attributes_load_at(), reading into @scratch as
+ * described for sugar_file_attributes_load_from_fd_full().
+ *
+ * Returns: %TRUE on success, %FALSE on error
  */
-void
-sugar_file_attributes_free(SugarFileAttributes *attrs)
+gboolean
+sugar_file_attributes_load_at_full(SugarFileAttributes *attrs, gint dirfd, const gchar *name,
+                                   GByteArray *scratch, GError **error)
 {
-    if (!attrs) return;
-    
-    g_free(attrs->title);
-    g_free(attrs->description);
-    g_free(attrs->tags);
-    g_free(attrs->activity);
-    g_free(attrs->preview_path);
-    g_free(attrs);
+    gboolean result;
+    gint fd;
+
+    g_return_val_if_fail(attrs != NULL, FALSE);
+    g_return_val_if_fail(name != NULL, FALSE);
+
+    fd = open_at(dirfd, name, error);
+    if (fd < 0) return FALSE;
+
+    XattrTarget target = AT_TARGET(fd, dirfd, name);
+    result = load_fd(attrs, &target, scratch, NULL, error);
+    close(fd);
+    return result;
 }
 
-static gchar*
-get_xattr_string(const gchar *path, const gchar *name)
+gboolean
+_sugar_file_attributes_load_at_arena(SugarFileAttributes *attrs, gint dirfd, const gchar *name,
+                                     GByteArray *scratch, GStringChunk *arena, GError **error)
 {
-    ssize_t size = getxattr(path, name, NULL, 0);
-    if (size <= 0) return NULL;
-    
-    gchar *buffer = g_malloc(size + 1);
-    ssize_t result = getxattr(path, name, buffer, size);
-    
-    if (result <= 0) {
-        g_free(buffer);
-        return NULL;
-    }
-    
-    buffer[result] = '\0';
-    return buffer;
+    gboolean result;
+    gint fd = open_at(dirfd, name, error);
+
+    if (fd < 0) return FALSE;
+
+    XattrTarget target = AT_TARGET(fd, dirfd, name);
+    result = load_fd(attrs, &target, scratch, arena, error);
+    close(fd);
+    return result;
 }
 
-static gboolean
-set_xattr_string(const gchar *path, const gchar *name, const gchar *value)
+#ifdef HAVE_IO_URING
+typedef struct {
+    gchar *path;
+    struct statx stx;
+    gint stat_result;
+    gint meta_result;
+    guint8 meta[XATTR_SCRATCH_SIZE];
+} LoadSlot;
+
+/*
+ * Stats every entry and reads its packed record in one batch. Entries
+ * whose record is missing, larger than a slot or unreadable, and the
+ * ones with per-key attributes or a sidecar record, are loaded the
+ * usual way afterwards.
+ */
+static void
+load_many_uring(SugarUring *ring, gint dirfd, const gchar *dir_path, const gchar * const *names, guint n_names,
+                SugarFileAttributes * const *attributes, gboolean *loaded, GByteArray *scratch)
 {
-    if (!value) {
-        removexattr(path, name);
-        return TRUE;
+    LoadSlot *slots = g_new(LoadSlot, n_names);
+    gboolean completed;
+    guint i;
+
+    for (i = 0; i < n_names; i++) {
+        LoadSlot *slot = &slots[i];
+
+        slot->path = g_build_filename(dir_path, names[i], NULL);
+        _sugar_uring_statx(ring, dirfd, names[i], AT_STATX_SYNC_AS_STAT, STATX_BASIC_STATS | STATX_BTIME,
+                           &slot->stx, &slot->stat_result);
+        _sugar_uring_getxattr(ring, slot->path, SUGAR_XATTR_META, slot->meta, sizeof(slot->meta),
+                              &slot->meta_result);
     }
-    
-    return setxattr(path, name, value, strlen(value), 0) == 0;
-}
 
-static gint64
-get_xattr_int64(const gchar *path, const gchar *name)
-{
-    gchar *str = get_xattr_string(path, name);
-    if (!str) return 0;
-    
-    gint64 value = g_ascii_strtoll(str, NULL, 10);
-    g_free(str);
-    return value;
+    completed = _sugar_uring_wait(ring);
+
+    for (i = 0; i < n_names; i++) {
+        LoadSlot *slot = &slots[i];
+        SugarFileAttributes *attrs = attributes[i];
+
+        if (completed && slot->stat_result == -ENOENT) {
+            // Removed since the directory was read
+            loaded[i] = FALSE;
+        } else if (completed && slot->stat_result == 0 && slot->meta_result > 0 &&
+                   unpack_attributes(slot->meta, slot->meta_result, attrs, SUGAR_FILE_ATTRIBUTE_ALL, NULL)) {
+            struct stat st;
+
+            stat_from_statx(&st, &slot->stx);
+            load_overflow(NULL, attrs, SUGAR_FILE_ATTRIBUTE_ALL, NULL, FALSE, NULL);
+            attrs->dirty = 0;
+            finish_load(attrs, &st, (slot->stx.stx_mask & STATX_BTIME) ? statx_usec(&slot->stx.stx_btime) : 0);
+            take_snapshot(attrs, SUGAR_FILE_ATTRIBUTE_ALL);
+            loaded[i] = TRUE;
+        } else {
+            loaded[i] = sugar_file_attributes_load_at_full(attrs, dirfd, names[i], scratch, NULL);
+        }
+
+        g_free(slot->path);
+    }
+
+    g_free(slots);
 }
+#endif
 
-static gboolean
-set_xattr_int64(const gchar *path, const gchar *name, gint64 value)
+/*
+ * Loads the entries @names of the directory open as @dirfd into the
+ * records at the same index of @attributes, as
+ * sugar_file_attributes_load_at_full() would one by one, and sets
+ * @loaded for those that could be read. With io_uring and the
+ * directory's @dir_path, the common case of entries with a packed
+ * record costs a share of one batch instead of several syscalls each.
+ */
+void
+_sugar_file_attributes_load_many_at(gint dirfd, const gchar *dir_path, const gchar * const *names, guint n_names,
+                                    SugarFileAttributes * const *attributes, gboolean *loaded, GByteArray *scratch)
 {
-    gchar *str = g_strdup_printf("%" G_GINT64_FORMAT, value);
-    gboolean result = set_xattr_string(path, name, str);
-    g_free(str);
-    return result;
+#ifdef HAVE_IO_URING
+    SugarUring *ring = dir_path ? _sugar_uring_get() : NULL;
+
+    if (ring) {
+        load_many_uring(ring, dirfd, dir_path, names, n_names, attributes, loaded, scratch);
+        return;
+    }
+#endif
+
+    for (guint i = 0; i < n_names; i++)
+        loaded[i] = sugar_file_attributes_load_at_full(attributes[i], dirfd, names[i], scratch, NULL);
 }
 
 /**
- * sugar_file_attributes_get_from_file:
- * @file: A #GFile
- * @error: Return location for error
+ * sugar_file_attributes_get_times_at:
+ * @dirfd: A directory file descriptor, or %AT_FDCWD
+ * @names: (array zero-terminated=1): Names of the entries relative to @dirfd
+ * @creation_times: (out caller-allocates) (array) (optional): Return location for one creation time per name
+ * @modification_times: (out caller-allocates) (array) (optional): Return location for one modification time per name
  *
- * Reads Sugar file attributes from the given file.
+ * Reads the file system times of many directory entries, in
+ * microseconds, with a single statx() per entry. This is the fallback
+ * used when the time attributes are missing, for scanners that want it
+ * for a whole directory of legacy files at once. Times that are not
+ * available, including creation times on file systems that do not
+ * record them, are set to 0.
  *
- * Returns: (transfer full): A #SugarFileAttributes or %NULL on error
+ * Returns: The number of entries that could be read
  */
-SugarFileAttributes*
-sugar_file_attributes_get_from_file(GFile *file, GError **error)
+guint
+sugar_file_attributes_get_times_at(gint                 dirfd,
+                                   const gchar * const *names,
+                                   gint64              *creation_times,
+                                   gint64              *modification_times)
 {
-    g_return_val_if_fail(G_IS_FILE(file), NULL);
-    
-    gchar *path = g_file_get_path(file);
-    if (!path) {
-        g_set_error(error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
-                   "File does not support extended attributes");
-        return NULL;
-    }
-    
-    SugarFileAttributes *attrs = sugar_file_attributes_new();
-    
-    attrs->title = get_xattr_string(path, SUGAR_XATTR_TITLE);
-    attrs->description = get_xattr_string(path, SUGAR_XATTR_DESCRIPTION);
-    attrs->tags = get_xattr_string(path, SUGAR_XATTR_TAGS);
-    attrs->activity = get_xattr_string(path, SUGAR_XATTR_ACTIVITY);
-    attrs->preview_path = get_xattr_string(path, SUGAR_XATTR_PREVIEW_PATH);
-    
-    attrs->creation_time = get_xattr_int64(path, SUGAR_XATTR_CREATION_TIME);
-    attrs->modification_time = get_xattr_int64(path, SUGAR_XATTR_MODIFICATION_TIME);
-    
-    // Fallback to file system times if not set
-    if (attrs->creation_time == 0 || attrs->modification_time == 0) {
-        GFileInfo *info = g_file_query_info(file, 
-                                           G_FILE_ATTRIBUTE_TIME_CREATED ","
-                                           G_FILE_ATTRIBUTE_TIME_MODIFIED,
-                                           G_FILE_QUERY_INFO_NONE, NULL, NULL);
-        if (info) {
-            if (attrs->creation_time == 0) {
-                attrs->creation_time = g_file_info_get_attribute_uint64(info, G_FILE_ATTRIBUTE_TIME_CREATED);
-            }
-            if (attrs->modification_time == 0) {
-                attrs->modification_time = g_file_info_get_attribute_uint64(info, G_FILE_ATTRIBUTE_TIME_MODIFIED);
-            }
-            g_object_unref(info);
-        }
+    guint n_read = 0;
+
+    g_return_val_if_fail(names != NULL, 0);
+
+    for (guint i = 0; names[i]; i++) {
+        struct stat st;
+        gint64 btime;
+        gboolean found = stat_file(dirfd, names[i], 0, &st, &btime) == 0;
+
+        if (creation_times)
+            creation_times[i] = found ? btime : 0;
+        if (modification_times)
+            modification_times[i] = found ? timespec_usec(&st.st_mtim) : 0;
+        if (found)
+            n_read++;
     }
-    
-    g_free(path);
-    return attrs;
+
+    return n_read;
 }
 
 /**
- * sugar_file_attributes_load_from_file:
+ * sugar_file_attributes_save_to_file:
  * @attrs: A #SugarFileAttributes
  * @file: A #GFile
  * @error: Return location for error
  *
- * Loads Sugar file attributes from the given file into the structure.
+ * Saves Sugar file attributes to the given file, in both the packed and
+ * the per-key form.
  *
  * Returns: %TRUE on success, %FALSE on error
  */
 gboolean
-sugar_file_attributes_load_from_file(SugarFileAttributes *attrs, GFile *file, GError **error)
+sugar_file_attributes_save_to_file(SugarFileAttributes *attrs, GFile *file, GError **error)
 {
-    g_return_val_if_fail(attrs != NULL, FALSE);
-    g_return_val_if_fail(G_IS_FILE(file), FALSE);
-    
-    SugarFileAttributes *temp = sugar_file_attributes_get_from_file(file, error);
-    if (!temp) return FALSE;
-    
-    // Copy values
-    g_free(attrs->title);
-    g_free(attrs->description);
-    g_free(attrs->tags);
-    g_free(attrs->activity);
-    g_free(attrs->preview_path);
-    
-    attrs->title = g_strdup(temp->title);
-    attrs->description = g_strdup(temp->description);
-    attrs->tags = g_strdup(temp->tags);
-    attrs->activity = g_strdup(temp->activity);
-    attrs->preview_path = g_strdup(temp->preview_path);
-    attrs->creation_time = temp->creation_time;
-    attrs->modification_time = temp->modification_time;
-    
-    sugar_file_attributes_free(temp);
-    return TRUE;
+    return sugar_file_attributes_save_to_file_full(attrs, file, SUGAR_FILE_ATTRIBUTES_SAVE_DEFAULT, error);
 }
 
 /**
- * sugar_file_attributes_save_to_file:
+ * sugar_file_attributes_save_to_file_full:
  * @attrs: A #SugarFileAttributes
  * @file: A #GFile
+ * @flags: Which forms to write
  * @error: Return location for error
  *
- * Saves Sugar file attributes to the given file.
+ * Saves Sugar file attributes to the given file. With
+ * %SUGAR_FILE_ATTRIBUTES_SAVE_PACKED all fields go into a single
+ * attribute; with %SUGAR_FILE_ATTRIBUTES_SAVE_LEGACY one attribute per
+ * field is written for older readers. When the packed form is not
+ * written, an existing packed record is removed so it cannot go stale.
+ *
+ * On file systems without user extended attributes, such as FAT
+ * formatted USB sticks, the packed record is kept in a hidden
+ * sidecar file in the file's directory instead, whatever @flags say.
+ *
+ * Descriptions longer than 512 bytes written with the packed form go to
+ * a hidden blob store in the file's directory, and the packed record
+ * only refers to the blob. The per-key attribute still holds the full
+ * text, unless it is too long for the file system to store.
  *
  * Returns: %TRUE on success, %FALSE on error
  */
 gboolean
-sugar_file_attributes_save_to_file(SugarFileAttributes *attrs, GFile *file, GError **error)
+sugar_file_attributes_save_to_file_full(SugarFileAttributes           *attrs,
+                                        GFile                         *file,
+                                        SugarFileAttributesSaveFlags   flags,
+                                        GError                       **error)
 {
     g_return_val_if_fail(attrs != NULL, FALSE);
     g_return_val_if_fail(G_IS_FILE(file), FALSE);
+    g_return_val_if_fail(flags & SUGAR_FILE_ATTRIBUTES_SAVE_DEFAULT, FALSE);
     
     gchar *path = g_file_get_path(file);
     if (!path) {
@@ -230,27 +1830,305 @@ sugar_file_attributes_save_to_file(SugarFileAttributes *attrs, GFile *file, GErr
         return FALSE;
     }
     
-    gboolean success = TRUE;
+    // Queued values are older than these, so they must not be written after them
+    struct stat st;
+    gboolean success = stat(path, &st) != 0 || _sugar_file_attributes_queue_flush_file(&st, error);
     
-    attrs->modification_time = g_get_real_time();
+    success = success && _sugar_file_attributes_save_path(path, attrs, flags, error);
     
-    success &= set_xattr_string(path, SUGAR_XATTR_TITLE, attrs->title);
-    success &= set_xattr_string(path, SUGAR_XATTR_DESCRIPTION, attrs->description);
-    success &= set_xattr_string(path, SUGAR_XATTR_TAGS, attrs->tags);
-    success &= set_xattr_string(path, SUGAR_XATTR_ACTIVITY, attrs->activity);
-    success &= set_xattr_string(path, SUGAR_XATTR_PREVIEW_PATH, attrs->preview_path);
-    success &= set_xattr_int64(path, SUGAR_XATTR_CREATION_TIME, attrs->creation_time);
-    success &= set_xattr_int64(path, SUGAR_XATTR_MODIFICATION_TIME, attrs->modification_time);
+    g_free(path);
+    return success;
+}
+
+// Updates the cache and tells the write hooks once @written fields of @path were saved
+static void
+finish_save(const gchar *path, const SugarFileAttributes *attrs, guint written, gboolean in_sidecar)
+{
+    struct stat st;
+
+    // Only a complete record can replace the cached one
+    if (stat(path, &st) == 0) {
+        if (written == SUGAR_FILE_ATTRIBUTE_ALL && !in_sidecar)
+            _sugar_file_attributes_cache_store(&st, attrs);
+        else
+            _sugar_file_attributes_cache_invalidate(&st);
+    }
+    notify_write(path, attrs, written & SUGAR_WRITE_ALL);
+}
+
+gboolean
+_sugar_file_attributes_save_path(const gchar                   *path,
+                                 SugarFileAttributes           *attrs,
+                                 SugarFileAttributesSaveFlags   flags,
+                                 GError                       **error)
+{
+    XattrTarget target = PATH_TARGET(path);
+    guint written;
+    gboolean in_sidecar;
+    gboolean success = save_attributes(&target, attrs, flags, &written, &in_sidecar);
     
     if (!success) {
         g_set_error(error, G_IO_ERROR, G_IO_ERROR_FAILED,
                    "Failed to write extended attributes");
+    } else if (written) {
+        finish_save(path, attrs, written, in_sidecar);
     }
     
-    g_free(path);
     return success;
 }
 
+#ifdef HAVE_IO_URING
+typedef struct {
+    SugarFileAttributes *stored;
+    GByteArray *record;
+    gchar *times[2];
+    gint meta_result;
+    gint results[N_STRING_FIELDS + 3];
+    guint n_results;
+    guint fields;
+    guint8 meta[XATTR_SCRATCH_SIZE];
+} SaveSlot;
+
+/*
+ * Queues the writes of a default save of @attrs, given the packed
+ * record read back in @slot. Saves that need more than setxattr() are
+ * left out, with no record packed: fields being removed or stored out
+ * of line, or no usable packed record, which may mean per-key
+ * attributes or a sidecar.
+ */
+static void
+queue_save(SugarUring *ring, const gchar *path, SugarFileAttributes *attrs, SaveSlot *slot)
+{
+    const SugarFileAttributes *record;
+    guint i;
+
+    if (slot->meta_result <= 0)
+        return;
+
+    slot->stored = g_new0(SugarFileAttributes, 1);
+    if (!unpack_attributes(slot->meta, slot->meta_result, slot->stored, SUGAR_FILE_ATTRIBUTE_ALL, NULL))
+        return;
+
+    slot->fields = plan_save(attrs, slot->stored, SUGAR_FILE_ATTRIBUTES_SAVE_DEFAULT, &record);
+    for (i = 0; i < N_STRING_FIELDS; i++) {
+        if ((slot->fields & (1u << i)) && (!STRING_FIELD(attrs, i) || overflows(attrs, i)))
+            return;
+    }
+
+    slot->record = pack_attributes(record, NULL, NULL);
+    _sugar_uring_setxattr(ring, path, SUGAR_XATTR_META, slot->record->data, slot->record->len,
+                          &slot->results[slot->n_results++]);
+
+    for (i = 0; i < N_STRING_FIELDS; i++) {
+        const gchar *value = STRING_FIELD(attrs, i);
+
+        if (slot->fields & (1u << i)) {
+            _sugar_uring_setxattr(ring, path, string_fields[i].xattr, value, strlen(value),
+                                  &slot->results[slot->n_results++]);
+        }
+    }
+
+    if (slot->fields & SUGAR_FILE_ATTRIBUTE_CREATION_TIME) {
+        slot->times[0] = g_strdup_printf("%" G_GINT64_FORMAT, attrs->creation_time);
+        _sugar_uring_setxattr(ring, path, SUGAR_XATTR_CREATION_TIME, slot->times[0], strlen(slot->times[0]),
+                              &slot->results[slot->n_results++]);
+    }
+
+    slot->times[1] = g_strdup_printf("%" G_GINT64_FORMAT, attrs->modification_time);
+    _sugar_uring_setxattr(ring, path, SUGAR_XATTR_MODIFICATION_TIME, slot->times[1], strlen(slot->times[1]),
+                          &slot->results[slot->n_results++]);
+}
+
+/*
+ * Reads the packed records of every file in one batch, then writes the
+ * new records and per-key attributes in another. Sets @saved for the
+ * files that were written; the others are left for the usual path.
+ */
+static void
+save_paths_uring(SugarUring *ring, const gchar * const *paths, SugarFileAttributes * const *attributes,
+                 guint n_paths, gboolean *saved)
+{
+    SaveSlot *slots = g_new0(SaveSlot, n_paths);
+    gboolean completed;
+    guint i;
+
+    for (i = 0; i < n_paths; i++) {
+        _sugar_uring_getxattr(ring, paths[i], SUGAR_XATTR_META, slots[i].meta, sizeof(slots[i].meta),
+                              &slots[i].meta_result);
+    }
+
+    completed = _sugar_uring_wait(ring);
+    for (i = 0; completed && i < n_paths; i++) {
+        queue_save(ring, paths[i], attributes[i], &slots[i]);
+    }
+
+    completed = completed && _sugar_uring_wait(ring);
+    for (i = 0; i < n_paths; i++) {
+        SaveSlot *slot = &slots[i];
+        gboolean success = completed && slot->record;
+
+        for (guint j = 0; success && j < slot->n_results; j++)
+            success = slot->results[j] == 0;
+
+        if (success) {
+            mark_saved(attributes[i]);
+            finish_save(paths[i], attributes[i], slot->fields, FALSE);
+            saved[i] = TRUE;
+        }
+
+        if (slot->record) g_byte_array_unref(slot->record);
+        sugar_file_attributes_free(slot->stored);
+        g_free(slot->times[0]);
+        g_free(slot->times[1]);
+    }
+
+    g_free(slots);
+}
+#endif
+
+/*
+ * Saves every record of @attributes to the file at the same index of
+ * @paths, as _sugar_file_attributes_save_path() with the default flags
+ * would. With io_uring the common case, an update of files that
+ * already have a packed record, goes out in two batches. Every file is
+ * tried; @error gets the first failure.
+ */
+gboolean
+_sugar_file_attributes_save_paths(const gchar * const *paths, SugarFileAttributes * const *attributes,
+                                  guint n_paths, GError **error)
+{
+    gboolean *saved = g_new0(gboolean, n_paths);
+    gboolean result = TRUE;
+#ifdef HAVE_IO_URING
+    SugarUring *ring = _sugar_uring_get();
+
+    if (ring)
+        save_paths_uring(ring, paths, attributes, n_paths, saved);
+#endif
+
+    for (guint i = 0; i < n_paths; i++) {
+        if (!saved[i]) {
+            result &= _sugar_file_attributes_save_path(paths[i], attributes[i], SUGAR_FILE_ATTRIBUTES_SAVE_DEFAULT,
+                                                       result ? error : NULL);
+        }
+    }
+
+    g_free(saved);
+    return result;
+}
+
+/*
+ * Finds the path of the file @target opened, @st, as the write hooks
+ * know it: the entry name under the directory its descriptor resolves
+ * to, or for a bare descriptor the one /proc gives. Returns %NULL when
+ * no path leads to @st any longer, as for an unlinked file.
+ */
+static gchar*
+target_path(const XattrTarget *target, const struct stat *st)
+{
+    gchar *path = NULL;
+    struct stat path_st;
+
+    if (target->name && (target->dirfd == AT_FDCWD || g_path_is_absolute(target->name))) {
+        path = g_canonicalize_filename(target->name, NULL);
+    } else {
+        gchar *link = g_strdup_printf("/proc/self/fd/%d", target->name ? target->dirfd : target->fd);
+        gchar *resolved = g_file_read_link(link, NULL);
+
+        path = resolved && target->name ? g_build_filename(resolved, target->name, NULL) : g_strdup(resolved);
+        g_free(resolved);
+        g_free(link);
+    }
+
+    if (path && (stat(path, &path_st) != 0 || path_st.st_dev != st->st_dev || path_st.st_ino != st->st_ino))
+        g_clear_pointer(&path, g_free);
+
+    return path;
+}
+
+static gboolean
+save_fd(SugarFileAttributes *attrs, const XattrTarget *target, GError **error)
+{
+    gboolean in_sidecar;
+    gboolean have_stat;
+    guint written;
+    struct stat st;
+
+    have_stat = fstat(target->fd, &st) == 0;
+    if (have_stat && !_sugar_file_attributes_queue_flush_file(&st, error))
+        return FALSE;
+
+    if (!save_attributes(target, attrs, SUGAR_FILE_ATTRIBUTES_SAVE_DEFAULT, &written, &in_sidecar)) {
+        int saved_errno = errno;
+        g_set_error(error, G_IO_ERROR, g_io_error_from_errno(saved_errno),
+                   "Failed to write extended attributes: %s", g_strerror(saved_errno));
+        return FALSE;
+    }
+
+    if (written && have_stat) {
+        gchar *path = target_path(target, &st);
+
+        if (path)
+            finish_save(path, attrs, written, in_sidecar);
+        g_free(path);
+    }
+
+    return TRUE;
+}
+
+/**
+ * sugar_file_attributes_save_to_fd:
+ * @attrs: A #SugarFileAttributes
+ * @fd: An open file descriptor
+ * @error: Return location for error
+ *
+ * Saves Sugar file attributes to an open file, in both the packed and
+ * the per-key form. The descriptor may be read-only; it is not closed.
+ * The indexes learn of the save under the path the descriptor resolves
+ * to, and not at all if its file has none left, such as when unlinked.
+ *
+ * Returns: %TRUE on success, %FALSE on error
+ */
+gboolean
+sugar_file_attributes_save_to_fd(SugarFileAttributes *attrs, gint fd, GError **error)
+{
+    XattrTarget target = FD_TARGET(fd);
+
+    g_return_val_if_fail(attrs != NULL, FALSE);
+    g_return_val_if_fail(fd >= 0, FALSE);
+
+    return save_fd(attrs, &target, error);
+}
+
+/**
+ * sugar_file_attributes_save_at:
+ * @attrs: A #SugarFileAttributes
+ * @dirfd: A directory file descriptor
+ * @name: Name of the entry relative to @dirfd
+ * @error: Return location for error
+ *
+ * Saves Sugar file attributes to a directory entry.
+ *
+ * Returns: %TRUE on success, %FALSE on error
+ */
+gboolean
+sugar_file_attributes_save_at(SugarFileAttributes *attrs, gint dirfd, const gchar *name, GError **error)
+{
+    gboolean result;
+    gint fd;
+
+    g_return_val_if_fail(attrs != NULL, FALSE);
+    g_return_val_if_fail(name != NULL, FALSE);
+
+    fd = open_at(dirfd, name, error);
+    if (fd < 0) return FALSE;
+
+    XattrTarget target = AT_TARGET(fd, dirfd, name);
+    result = save_fd(attrs, &target, error);
+    close(fd);
+    return result;
+}
+
 /**
  * sugar_file_attributes_get_title:
  * @file: A #GFile
@@ -264,10 +2142,12 @@ sugar_file_attributes_get_title(GFile *file)
 {
     g_return_val_if_fail(G_IS_FILE(file), NULL);
     
-    SugarFileAttributes *attrs = sugar_file_attributes_get_from_file(file, NULL);
-    if (!attrs) return NULL;
+    SugarFileAttributes *attrs = g_new0(SugarFileAttributes, 1);
+    gchar *title = NULL;
+    
+    if (sugar_file_attributes_load_fields(attrs, file, SUGAR_FILE_ATTRIBUTE_TITLE, NULL))
+        title = g_steal_pointer(&attrs->title);
     
-    gchar *title = g_strdup(attrs->title);
     sugar_file_attributes_free(attrs);
     return title;
 }
@@ -278,6 +2158,8 @@ sugar_file_attributes_get_title(GFile *file)
  * @title: The title to set
  *
  * Sets the title attribute for a file.
+ * While a write delay is set, the value is queued instead, see
+ * sugar_file_attributes_set_write_delay().
  *
  * Returns: %TRUE on success, %FALSE on error
  */
@@ -289,7 +2171,25 @@ sugar_file_attributes_set_title(GFile *file, const gchar *title)
     gchar *path = g_file_get_path(file);
     if (!path) return FALSE;
     
-    gboolean result = set_xattr_string(path, SUGAR_XATTR_TITLE, title);
+    if (_sugar_file_attributes_queue_write(path, SUGAR_FILE_ATTRIBUTE_TITLE, title)) {
+        g_free(path);
+        return TRUE;
+    }
+    
+    struct stat before, after;
+    gboolean have_stat = stat(path, &before) == 0;
+    
+    XattrTarget target = PATH_TARGET(path);
+    gboolean result = set_string_field(&target, FIELD_TITLE, title);
+    
+    if (have_stat && result && stat(path, &after) == 0) {
+        _sugar_file_attributes_cache_update_string(&before, &after,
+                                                   G_STRUCT_OFFSET(SugarFileAttributes, title), title);
+    }
+    if (result) {
+        SugarFileAttributes written = { .title = (gchar *) title };
+        notify_write(path, &written, SUGAR_WRITE_TITLE);
+    }
     g_free(path);
     return result;
 }
@@ -307,10 +2207,12 @@ sugar_file_attributes_get_description(GFile *file)
 {
     g_return_val_if_fail(G_IS_FILE(file), NULL);
     
-    SugarFileAttributes *attrs = sugar_file_attributes_get_from_file(file, NULL);
-    if (!attrs) return NULL;
+    SugarFileAttributes *attrs = g_new0(SugarFileAttributes, 1);
+    gchar *description = NULL;
+    
+    if (sugar_file_attributes_load_fields(attrs, file, SUGAR_FILE_ATTRIBUTE_DESCRIPTION, NULL))
+        description = g_steal_pointer(&attrs->description);
     
-    gchar *description = g_strdup(attrs->description);
     sugar_file_attributes_free(attrs);
     return description;
 }
@@ -321,6 +2223,8 @@ sugar_file_attributes_get_description(GFile *file)
  * @description: The description to set
  *
  * Sets the description attribute for a file.
+ * While a write delay is set, the value is queued instead, see
+ * sugar_file_attributes_set_write_delay().
  *
  * Returns: %TRUE on success, %FALSE on error
  */
@@ -332,7 +2236,25 @@ sugar_file_attributes_set_description(GFile *file, const gchar *description)
     gchar *path = g_file_get_path(file);
     if (!path) return FALSE;
     
-    gboolean result = set_xattr_string(path, SUGAR_XATTR_DESCRIPTION, description);
+    if (_sugar_file_attributes_queue_write(path, SUGAR_FILE_ATTRIBUTE_DESCRIPTION, description)) {
+        g_free(path);
+        return TRUE;
+    }
+    
+    struct stat before, after;
+    gboolean have_stat = stat(path, &before) == 0;
+    
+    XattrTarget target = PATH_TARGET(path);
+    gboolean result = set_string_field(&target, FIELD_DESCRIPTION, description);
+    
+    if (have_stat && result && stat(path, &after) == 0) {
+        _sugar_file_attributes_cache_update_string(&before, &after,
+                                                   G_STRUCT_OFFSET(SugarFileAttributes, description), description);
+    }
+    if (result) {
+        SugarFileAttributes written = { .description = (gchar *) description };
+        notify_write(path, &written, SUGAR_WRITE_DESCRIPTION);
+    }
     g_free(path);
     return result;
 }
@@ -350,9 +2272,9 @@ sugar_file_attributes_get_tags(GFile *file)
 {
     g_return_val_if_fail(G_IS_FILE(file), NULL);
     
-    SugarFileAttributes *attrs = sugar_file_attributes_get_from_file(file, NULL);
-    if (!attrs || !attrs->tags) {
-        if (attrs) sugar_file_attributes_free(attrs);
+    SugarFileAttributes *attrs = g_new0(SugarFileAttributes, 1);
+    if (!sugar_file_attributes_load_fields(attrs, file, SUGAR_FILE_ATTRIBUTE_TAGS, NULL) || !attrs->tags) {
+        sugar_file_attributes_free(attrs);
         return NULL;
     }
     
@@ -378,6 +2300,8 @@ sugar_file_attributes_get_tags(GFile *file)
  * @tags: NULL-terminated array of tag strings
  *
  * Sets the tags attribute for a file.
+ * While a write delay is set, the value is queued instead, see
+ * sugar_file_attributes_set_write_delay().
  *
  * Returns: %TRUE on success, %FALSE on error
  */
@@ -394,7 +2318,26 @@ sugar_file_attributes_set_tags(GFile *file, const gchar * const *tags)
         tags_str = g_strjoinv(",", (gchar**)tags);
     }
     
-    gboolean result = set_xattr_string(path, SUGAR_XATTR_TAGS, tags_str);
+    if (_sugar_file_attributes_queue_write(path, SUGAR_FILE_ATTRIBUTE_TAGS, tags_str)) {
+        g_free(tags_str);
+        g_free(path);
+        return TRUE;
+    }
+    
+    struct stat before, after;
+    gboolean have_stat = stat(path, &before) == 0;
+    
+    XattrTarget target = PATH_TARGET(path);
+    gboolean result = set_string_field(&target, FIELD_TAGS, tags_str);
+    
+    if (have_stat && result && stat(path, &after) == 0) {
+        _sugar_file_attributes_cache_update_string(&before, &after,
+                                                   G_STRUCT_OFFSET(SugarFileAttributes, tags), tags_str);
+    }
+    if (result) {
+        SugarFileAttributes written = { .tags = (gchar *) tags_str };
+        notify_write(path, &written, SUGAR_WRITE_TAGS);
+    }
     
     g_free(tags_str);
     g_free(path);
@@ -419,13 +2362,17 @@ sugar_file_attributes_mark_as_created_by(GFile *file, const gchar *activity_name
     gchar *path = g_file_get_path(file);
     if (!path) return FALSE;
     
-    gboolean result = set_xattr_string(path, SUGAR_XATTR_ACTIVITY, activity_name);
-    
-    // Also set creation time if not already set
-    if (result && get_xattr_int64(path, SUGAR_XATTR_CREATION_TIME) == 0) {
-        result &= set_xattr_int64(path, SUGAR_XATTR_CREATION_TIME, g_get_real_time());
+    XattrTarget target = PATH_TARGET(path);
+    gboolean result = set_string_field(&target, FIELD_ACTIVITY, activity_name);
+    if (result) {
+        SugarFileAttributes written = { .activity = (gchar *) activity_name };
+        notify_write(path, &written, SUGAR_WRITE_ACTIVITY);
     }
     
+    // Also set creation time if not already set; sidecar records always have one
+    if (result && !xattrs_unsupported(&target))
+        result = set_creation_time_field(&target);
+    
     g_free(path);
     return result;
 }
@@ -437,14 +2384,11 @@ sugar_file_attributes_copy(const SugarFileAttributes *attrs)
 
     SugarFileAttributes *new_attrs = g_new0(SugarFileAttributes, 1);
 
-    new_attrs->title = g_strdup(attrs->title);
-    new_attrs->description = g_strdup(attrs->description);
-    new_attrs->tags = g_strdup(attrs->tags);
-    new_attrs->activity = g_strdup(attrs->activity);
-    new_attrs->preview_path = g_strdup(attrs->preview_path);
-    new_attrs->creation_time = attrs->creation_time;
-    new_attrs->modification_time = attrs->modification_time;
-
+    _sugar_file_attributes_copy_fields(new_attrs, attrs, SUGAR_FILE_ATTRIBUTE_ALL);
+    new_attrs->dirty = attrs->dirty;
+    for (guint i = 0; i < N_STRING_FIELDS; i++)
+        new_attrs->snapshot[i] = g_strdup(attrs->snapshot[i]);
+    new_attrs->snapshot_creation_time = attrs->snapshot_creation_time;
     return new_attrs;
 }
 
@@ -25,6 +25,31 @@
 
 G_BEGIN_DECLS
 
+/**
+ * SugarFileAttributeMask:
+ * @SUGAR_FILE_ATTRIBUTE_TITLE: The @title field
+ * @SUGAR_FILE_ATTRIBUTE_DESCRIPTION: The @description field
+ * @SUGAR_FILE_ATTRIBUTE_TAGS: The @tags field
+ * @SUGAR_FILE_ATTRIBUTE_ACTIVITY: The @activity field
+ * @SUGAR_FILE_ATTRIBUTE_PREVIEW_PATH: The @preview_path field
+ * @SUGAR_FILE_ATTRIBUTE_CREATION_TIME: The @creation_time field
+ * @SUGAR_FILE_ATTRIBUTE_MODIFICATION_TIME: The @modification_time field
+ * @SUGAR_FILE_ATTRIBUTE_ALL: Every field
+ *
+ * Selects fields of a #SugarFileAttributes, for example those read by
+ * sugar_file_attributes_load_fields().
+ */
+typedef enum {
+    SUGAR_FILE_ATTRIBUTE_TITLE = 1 << 0,
+    SUGAR_FILE_ATTRIBUTE_DESCRIPTION = 1 << 1,
+    SUGAR_FILE_ATTRIBUTE_TAGS = 1 << 2,
+    SUGAR_FILE_ATTRIBUTE_ACTIVITY = 1 << 3,
+    SUGAR_FILE_ATTRIBUTE_PREVIEW_PATH = 1 << 4,
+    SUGAR_FILE_ATTRIBUTE_CREATION_TIME = 1 << 5,
+    SUGAR_FILE_ATTRIBUTE_MODIFICATION_TIME = 1 << 6,
+    SUGAR_FILE_ATTRIBUTE_ALL = (1 << 7) - 1,
+} SugarFileAttributeMask;
+
 /**
  * SugarFileAttributes:
  * @title: Display title for the file
@@ -34,8 +59,21 @@ G_BEGIN_DECLS
  * @creation_time: When the file was created (timestamp)
  * @modification_time: When the file was last modified (timestamp)
  * @preview_path: Path to preview/thumbnail image
+ * @dirty: Fields changed with the setters since the last load or save
+ * @unloaded: Fields stored out of line that the last load left unread
  *
  * Extended attributes for Sugar activity files.
+ *
+ * Saving writes the @dirty fields, the fields assigned directly since
+ * the last load or save, and the modification time; with @dirty 0 it
+ * writes every field. Stored values that another writer changed in the
+ * meantime are kept when this copy left them alone.
+ *
+ * Long descriptions are stored out of line. The loaders that take a
+ * directory or file descriptor, which scanners use, leave them %NULL
+ * and set their bit in @unloaded; sugar_file_attributes_load_fields()
+ * reads them. Saves leave @unloaded fields alone unless they are set
+ * with sugar_file_attributes_set_string().
  * @gtype-name SugarFileAttributes
  */
 typedef struct {
@@ -46,20 +84,86 @@ typedef struct {
     gint64 creation_time;
     gint64 modification_time;
     gchar *preview_path;
+    SugarFileAttributeMask dirty;
+    SugarFileAttributeMask unloaded;
+
+    /*< private >*/
+    gchar *snapshot[5];
+    gint64 snapshot_creation_time;
 } SugarFileAttributes;
 
+/**
+ * SugarFileAttributesSaveFlags:
+ * @SUGAR_FILE_ATTRIBUTES_SAVE_PACKED: Write all fields as one packed attribute
+ * @SUGAR_FILE_ATTRIBUTES_SAVE_LEGACY: Write one attribute per field
+ * @SUGAR_FILE_ATTRIBUTES_SAVE_DEFAULT: Write both forms, for migrations
+ * @SUGAR_FILE_ATTRIBUTES_SAVE_COMPARE: Read the stored values first and skip
+ *   those that are unchanged; nothing is written if all of them are
+ *
+ * Selects how sugar_file_attributes_save_to_file_full() writes.
+ */
+typedef enum {
+    SUGAR_FILE_ATTRIBUTES_SAVE_PACKED = 1 << 0,
+    SUGAR_FILE_ATTRIBUTES_SAVE_LEGACY = 1 << 1,
+    SUGAR_FILE_ATTRIBUTES_SAVE_DEFAULT = SUGAR_FILE_ATTRIBUTES_SAVE_PACKED | SUGAR_FILE_ATTRIBUTES_SAVE_LEGACY,
+    SUGAR_FILE_ATTRIBUTES_SAVE_COMPARE = 1 << 2,
+} SugarFileAttributesSaveFlags;
+
+/**
+ * SugarFileAttributesLoadFunc:
+ * @names: (array length=n_entries): Entry names relative to the directory
+ * @attributes: (array length=n_entries): The attributes of each entry
+ * @n_entries: Number of entries in this batch
+ * @user_data: Data passed to sugar_file_attributes_load_directory_async()
+ *
+ * Receives one batch of results from a directory load.
+ */
+typedef void (*SugarFileAttributesLoadFunc) (const gchar * const         *names,
+                                             SugarFileAttributes * const *attributes,
+                                             guint                        n_entries,
+                                             gpointer                     user_data);
+
+/**
+ * SugarFileAttributesBatch:
+ *
+ * An opaque array of attribute records sharing one allocation arena.
+ */
+typedef struct _SugarFileAttributesBatch SugarFileAttributesBatch;
+
 GType sugar_file_attributes_get_type (void);
 
 /* File attributes API */
 SugarFileAttributes* sugar_file_attributes_new              (void);
 void                 sugar_file_attributes_free            (SugarFileAttributes *attrs);
+void                 sugar_file_attributes_set_string      (SugarFileAttributes *attrs, SugarFileAttributeMask field,
+                                                            const gchar *value);
+void                 sugar_file_attributes_set_time        (SugarFileAttributes *attrs, SugarFileAttributeMask field,
+                                                            gint64 value);
 
 /* Reading attributes */
 SugarFileAttributes* sugar_file_attributes_get_from_file   (GFile *file, GError **error);
 gboolean             sugar_file_attributes_load_from_file  (SugarFileAttributes *attrs, GFile *file, GError **error);
+gboolean             sugar_file_attributes_load_fields     (SugarFileAttributes *attrs, GFile *file,
+                                                            SugarFileAttributeMask mask, GError **error);
+gboolean             sugar_file_attributes_load_from_fd    (SugarFileAttributes *attrs, gint fd, GError **error);
+gboolean             sugar_file_attributes_load_at         (SugarFileAttributes *attrs, gint dirfd,
+                                                            const gchar *name, GError **error);
+gboolean             sugar_file_attributes_load_from_fd_full (SugarFileAttributes *attrs, gint fd,
+                                                              GByteArray *scratch, GError **error);
+gboolean             sugar_file_attributes_load_at_full    (SugarFileAttributes *attrs, gint dirfd,
+                                                            const gchar *name, GByteArray *scratch,
+                                                            GError **error);
+guint                sugar_file_attributes_get_times_at    (gint dirfd, const gchar * const *names,
+                                                            gint64 *creation_times,
+                                                            gint64 *modification_times);
 
 /* Writing attributes */
 gboolean             sugar_file_attributes_save_to_file    (SugarFileAttributes *attrs, GFile *file, GError **error);
+gboolean             sugar_file_attributes_save_to_file_full (SugarFileAttributes *attrs, GFile *file,
+                                                              SugarFileAttributesSaveFlags flags, GError **error);
+gboolean             sugar_file_attributes_save_to_fd      (SugarFileAttributes *attrs, gint fd, GError **error);
+gboolean             sugar_file_attributes_save_at         (SugarFileAttributes *attrs, gint dirfd,
+                                                            const gchar *name, GError **error);
 
 /* Convenience functions */
 gchar*               sugar_file_attributes_get_title       (GFile *file);
@@ -69,6 +173,72 @@ gboolean             sugar_file_attributes_set_description (GFile *file, const g
 gchar**              sugar_file_attributes_get_tags        (GFile *file);
 gboolean             sugar_file_attributes_set_tags        (GFile *file, const gchar * const *tags);
 
+/* Asynchronous variants */
+void                 sugar_file_attributes_get_from_file_async    (GFile *file, GCancellable *cancellable,
+                                                                   GAsyncReadyCallback callback, gpointer user_data);
+SugarFileAttributes* sugar_file_attributes_get_from_file_finish   (GAsyncResult *result, GError **error);
+void                 sugar_file_attributes_save_to_file_async     (SugarFileAttributes *attrs, GFile *file,
+                                                                   GCancellable *cancellable,
+                                                                   GAsyncReadyCallback callback, gpointer user_data);
+gboolean             sugar_file_attributes_save_to_file_finish    (GAsyncResult *result, GError **error);
+void                 sugar_file_attributes_get_title_async        (GFile *file, GCancellable *cancellable,
+                                                                   GAsyncReadyCallback callback, gpointer user_data);
+gchar*               sugar_file_attributes_get_title_finish       (GAsyncResult *result, GError **error);
+void                 sugar_file_attributes_set_title_async        (GFile *file, const gchar *title,
+                                                                   GCancellable *cancellable,
+                                                                   GAsyncReadyCallback callback, gpointer user_data);
+gboolean             sugar_file_attributes_set_title_finish       (GAsyncResult *result, GError **error);
+void                 sugar_file_attributes_get_description_async  (GFile *file, GCancellable *cancellable,
+                                                                   GAsyncReadyCallback callback, gpointer user_data);
+gchar*               sugar_file_attributes_get_description_finish (GAsyncResult *result, GError **error);
+void                 sugar_file_attributes_set_description_async  (GFile *file, const gchar *description,
+                                                                   GCancellable *cancellable,
+                                                                   GAsyncReadyCallback callback, gpointer user_data);
+gboolean             sugar_file_attributes_set_description_finish (GAsyncResult *result, GError **error);
+void                 sugar_file_attributes_get_tags_async         (GFile *file, GCancellable *cancellable,
+                                                                   GAsyncReadyCallback callback, gpointer user_data);
+gchar**              sugar_file_attributes_get_tags_finish        (GAsyncResult *result, GError **error);
+void                 sugar_file_attributes_set_tags_async         (GFile *file, const gchar * const *tags,
+                                                                   GCancellable *cancellable,
+                                                                   GAsyncReadyCallback callback, gpointer user_data);
+gboolean             sugar_file_attributes_set_tags_finish        (GAsyncResult *result, GError **error);
+void                 sugar_file_attributes_load_directory_async   (GFile *directory,
+                                                                   SugarFileAttributesLoadFunc load_func,
+                                                                   gpointer load_data,
+                                                                   GCancellable *cancellable,
+                                                                   GAsyncReadyCallback callback, gpointer user_data);
+gboolean             sugar_file_attributes_load_directory_finish  (GAsyncResult *result, GError **error);
+
+/* Batches */
+SugarFileAttributesBatch*  sugar_file_attributes_batch_new        (void);
+void                       sugar_file_attributes_batch_free       (SugarFileAttributesBatch *batch);
+gboolean                   sugar_file_attributes_batch_load_at    (SugarFileAttributesBatch *batch, gint dirfd,
+                                                                   const gchar *name, GByteArray *scratch,
+                                                                   GError **error);
+const SugarFileAttributes* sugar_file_attributes_batch_add        (SugarFileAttributesBatch *batch,
+                                                                   const SugarFileAttributes *attrs);
+guint                      sugar_file_attributes_batch_get_length (SugarFileAttributesBatch *batch);
+const SugarFileAttributes* sugar_file_attributes_batch_get        (SugarFileAttributesBatch *batch, guint index);
+
+/* String interning */
+void                 sugar_file_attributes_set_interning         (gboolean enabled);
+gboolean             sugar_file_attributes_get_interning         (void);
+
+/* Metadata cache */
+void                 sugar_file_attributes_cache_set_max_entries (guint n_entries);
+guint                sugar_file_attributes_cache_get_max_entries (void);
+void                 sugar_file_attributes_cache_get_stats       (guint64 *n_hits, guint64 *n_misses);
+void                 sugar_file_attributes_cache_clear           (void);
+
+/* Delayed writes */
+void                 sugar_file_attributes_set_write_delay       (guint delay_ms);
+guint                sugar_file_attributes_get_write_delay       (void);
+gboolean             sugar_file_attributes_flush                 (GError **error);
+
+/* Batched I/O */
+void                 sugar_file_attributes_set_io_uring          (gboolean enabled);
+gboolean             sugar_file_attributes_get_io_uring          (void);
+
 /* Activity integration */
 gboolean             sugar_file_attributes_mark_as_created_by (GFile *file, const gchar *activity_name);
 
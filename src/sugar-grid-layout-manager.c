@@ -0,0 +1,471 @@
+/*
+ * Copyright (C) 2025 MostlyK
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include "sugar-grid-layout-manager.h"
+#include "sugar-ext.h"
+
+/*
+ * Children are placed on a #SugarGrid whose cells are
+ * sugar_get_grid_cell_size() pixels wide. Each child remembers its
+ * placement in its #SugarGridLayoutChild, and the occupied cells carry
+ * weight on the grid. An allocation only searches the grid for children
+ * that are new, changed size, were explicitly moved, or fell outside the
+ * grid after a shrink; every other child keeps its cell and is
+ * re-allocated at the same geometry, which GTK short-circuits. Resizing
+ * keeps the overlapping weights with sugar_grid_resize().
+ */
+
+struct _SugarGridLayoutChild {
+    GtkLayoutChild parent_instance;
+
+    GdkRectangle cell;
+    gint requested_column;
+    gint requested_row;
+    guint placed : 1;
+    guint needs_placement : 1;
+};
+
+struct _SugarGridLayoutChildClass {
+    GtkLayoutChildClass parent_class;
+};
+
+struct _SugarGridLayoutManager {
+    GtkLayoutManager parent_instance;
+
+    SugarGrid *grid;
+    gdouble cell_size;
+    gint n_columns;
+    gint n_rows;
+};
+
+struct _SugarGridLayoutManagerClass {
+    GtkLayoutManagerClass parent_class;
+};
+
+G_DEFINE_TYPE(SugarGridLayoutChild, sugar_grid_layout_child, GTK_TYPE_LAYOUT_CHILD)
+G_DEFINE_TYPE(SugarGridLayoutManager, sugar_grid_layout_manager, GTK_TYPE_LAYOUT_MANAGER)
+
+static void
+release_cell(SugarGridLayoutManager *self, SugarGridLayoutChild *child)
+{
+    GdkRectangle bounds, clipped;
+
+    if (!child->placed)
+        return;
+
+    child->placed = FALSE;
+
+    if (self->grid == NULL || self->grid->weights == NULL)
+        return;
+
+    bounds.x = 0;
+    bounds.y = 0;
+    bounds.width = self->grid->width;
+    bounds.height = self->grid->height;
+
+    // After a shrink only the part of the cell still on the grid carries weight
+    if (gdk_rectangle_intersect(&child->cell, &bounds, &clipped))
+        sugar_grid_remove_weight(self->grid, &clipped);
+}
+
+static void
+sugar_grid_layout_child_dispose(GObject *object)
+{
+    SugarGridLayoutChild *child = SUGAR_GRID_LAYOUT_CHILD(object);
+    GtkLayoutManager *manager;
+
+    manager = gtk_layout_child_get_layout_manager(GTK_LAYOUT_CHILD(child));
+    if (manager != NULL && child->placed)
+        release_cell(SUGAR_GRID_LAYOUT_MANAGER(manager), child);
+
+    G_OBJECT_CLASS(sugar_grid_layout_child_parent_class)->dispose(object);
+}
+
+static void
+sugar_grid_layout_child_class_init(SugarGridLayoutChildClass *child_class)
+{
+    GObjectClass *gobject_class = G_OBJECT_CLASS(child_class);
+
+    gobject_class->dispose = sugar_grid_layout_child_dispose;
+}
+
+static void
+sugar_grid_layout_child_init(SugarGridLayoutChild *child)
+{
+    child->requested_column = -1;
+    child->requested_row = -1;
+    child->needs_placement = TRUE;
+}
+
+static gint
+span_for_size(SugarGridLayoutManager *self, gint size, gint limit)
+{
+    gint span = (gint) ((size + self->cell_size - 1) / self->cell_size);
+
+    return CLAMP(span, 1, limit);
+}
+
+static void
+get_child_span(SugarGridLayoutManager *self, GtkWidget *widget, GdkRectangle *span)
+{
+    GtkRequisition natural;
+
+    // Sizes come from the widget's request cache unless the child changed
+    gtk_widget_get_preferred_size(widget, NULL, &natural);
+
+    span->width = span_for_size(self, natural.width, self->n_columns);
+    span->height = span_for_size(self, natural.height, self->n_rows);
+}
+
+static void
+place_child(SugarGridLayoutManager *self, SugarGridLayoutChild *child, const GdkRectangle *span)
+{
+    GdkRectangle candidate = *span;
+    GdkRectangle best = *span;
+    guint best_weight = G_MAXUINT;
+    gint x, y;
+
+    if (child->requested_column >= 0 && child->requested_row >= 0) {
+        best.x = MIN(child->requested_column, self->n_columns - best.width);
+        best.y = MIN(child->requested_row, self->n_rows - best.height);
+    } else {
+        best.x = 0;
+        best.y = 0;
+
+        // First free spot in reading order, or the least crowded one
+        for (y = 0; y + candidate.height <= self->n_rows && best_weight > 0; y++) {
+            for (x = 0; x + candidate.width <= self->n_columns; x++) {
+                guint weight;
+
+                candidate.x = x;
+                candidate.y = y;
+                weight = sugar_grid_compute_weight(self->grid, &candidate);
+                if (weight < best_weight) {
+                    best = candidate;
+                    best_weight = weight;
+                    if (weight == 0)
+                        break;
+                }
+            }
+        }
+    }
+
+    child->cell = best;
+    child->placed = TRUE;
+    child->needs_placement = FALSE;
+    sugar_grid_add_weight(self->grid, &child->cell);
+}
+
+static gboolean
+placement_is_valid(SugarGridLayoutManager *self,
+                   SugarGridLayoutChild   *child,
+                   const GdkRectangle     *span)
+{
+    return child->placed && !child->needs_placement &&
+           child->cell.width == span->width &&
+           child->cell.height == span->height &&
+           child->cell.x + child->cell.width <= self->n_columns &&
+           child->cell.y + child->cell.height <= self->n_rows;
+}
+
+static void
+sugar_grid_layout_manager_allocate(GtkLayoutManager *manager,
+                                   GtkWidget        *widget,
+                                   int               width,
+                                   int               height,
+                                   int               baseline)
+{
+    SugarGridLayoutManager *self = SUGAR_GRID_LAYOUT_MANAGER(manager);
+    GPtrArray *unplaced;
+    GArray *spans;
+    GtkWidget *child;
+    gint n_columns, n_rows;
+    guint i;
+
+    n_columns = MAX(1, (gint) (width / self->cell_size));
+    n_rows = MAX(1, (gint) (height / self->cell_size));
+
+    if (n_columns != self->n_columns || n_rows != self->n_rows) {
+        sugar_grid_resize(self->grid, n_columns, n_rows);
+        self->n_columns = n_columns;
+        self->n_rows = n_rows;
+    }
+
+    unplaced = g_ptr_array_new();
+    spans = g_array_new(FALSE, FALSE, sizeof(GdkRectangle));
+
+    for (child = gtk_widget_get_first_child(widget);
+         child != NULL;
+         child = gtk_widget_get_next_sibling(child)) {
+        SugarGridLayoutChild *layout_child;
+        GdkRectangle span = { 0, 0, 0, 0 };
+
+        if (!gtk_widget_should_layout(child))
+            continue;
+
+        layout_child = SUGAR_GRID_LAYOUT_CHILD(gtk_layout_manager_get_layout_child(manager, child));
+        get_child_span(self, child, &span);
+
+        if (placement_is_valid(self, layout_child, &span))
+            continue;
+
+        // Free the old cells first so the search below can reuse them
+        release_cell(self, layout_child);
+        g_ptr_array_add(unplaced, layout_child);
+        g_array_append_val(spans, span);
+    }
+
+    for (i = 0; i < unplaced->len; i++) {
+        place_child(self, g_ptr_array_index(unplaced, i),
+                    &g_array_index(spans, GdkRectangle, i));
+    }
+
+    g_ptr_array_unref(unplaced);
+    g_array_unref(spans);
+
+    for (child = gtk_widget_get_first_child(widget);
+         child != NULL;
+         child = gtk_widget_get_next_sibling(child)) {
+        SugarGridLayoutChild *layout_child;
+        GtkAllocation allocation;
+
+        if (!gtk_widget_should_layout(child))
+            continue;
+
+        layout_child = SUGAR_GRID_LAYOUT_CHILD(gtk_layout_manager_get_layout_child(manager, child));
+
+        allocation.x = (gint) (layout_child->cell.x * self->cell_size);
+        allocation.y = (gint) (layout_child->cell.y * self->cell_size);
+        allocation.width = (gint) (layout_child->cell.width * self->cell_size);
+        allocation.height = (gint) (layout_child->cell.height * self->cell_size);
+
+        gtk_widget_size_allocate(child, &allocation, -1);
+    }
+}
+
+static void
+sugar_grid_layout_manager_measure(GtkLayoutManager *manager,
+                                  GtkWidget        *widget,
+                                  GtkOrientation    orientation,
+                                  int               for_size,
+                                  int              *minimum,
+                                  int              *natural,
+                                  int              *minimum_baseline,
+                                  int              *natural_baseline)
+{
+    SugarGridLayoutManager *self = SUGAR_GRID_LAYOUT_MANAGER(manager);
+    gint cells;
+
+    cells = orientation == GTK_ORIENTATION_HORIZONTAL ? self->n_columns : self->n_rows;
+
+    *minimum = (gint) self->cell_size;
+    *natural = (gint) (MAX(cells, 1) * self->cell_size);
+}
+
+static GtkSizeRequestMode
+sugar_grid_layout_manager_get_request_mode(GtkLayoutManager *manager,
+                                           GtkWidget        *widget)
+{
+    return GTK_SIZE_REQUEST_CONSTANT_SIZE;
+}
+
+static void
+sugar_grid_layout_manager_finalize(GObject *object)
+{
+    SugarGridLayoutManager *self = SUGAR_GRID_LAYOUT_MANAGER(object);
+
+    // Layout children are disposed by the parent class; they must not
+    // touch the grid once it is gone
+    g_clear_object(&self->grid);
+
+    G_OBJECT_CLASS(sugar_grid_layout_manager_parent_class)->finalize(object);
+}
+
+static void
+sugar_grid_layout_manager_class_init(SugarGridLayoutManagerClass *manager_class)
+{
+    GObjectClass *gobject_class = G_OBJECT_CLASS(manager_class);
+    GtkLayoutManagerClass *layout_class = GTK_LAYOUT_MANAGER_CLASS(manager_class);
+
+    gobject_class->finalize = sugar_grid_layout_manager_finalize;
+
+    layout_class->layout_child_type = SUGAR_TYPE_GRID_LAYOUT_CHILD;
+    layout_class->get_request_mode = sugar_grid_layout_manager_get_request_mode;
+    layout_class->measure = sugar_grid_layout_manager_measure;
+    layout_class->allocate = sugar_grid_layout_manager_allocate;
+}
+
+static void
+sugar_grid_layout_manager_init(SugarGridLayoutManager *self)
+{
+    self->grid = g_object_new(SUGAR_TYPE_GRID, NULL);
+    self->cell_size = sugar_get_grid_cell_size();
+    self->n_columns = 0;
+    self->n_rows = 0;
+}
+
+/**
+ * sugar_grid_layout_manager_new:
+ *
+ * Creates a layout manager that places children on the Sugar grid.
+ *
+ * Returns: (transfer full): A new #SugarGridLayoutManager.
+ */
+GtkLayoutManager *
+sugar_grid_layout_manager_new(void)
+{
+    return g_object_new(SUGAR_TYPE_GRID_LAYOUT_MANAGER, NULL);
+}
+
+/**
+ * sugar_grid_layout_manager_get_grid:
+ * @manager: A #SugarGridLayoutManager
+ *
+ * Gets the occupancy grid used for placement. Each cell weight is the
+ * number of children covering it.
+ *
+ * Returns: (transfer none): The #SugarGrid.
+ */
+SugarGrid *
+sugar_grid_layout_manager_get_grid(SugarGridLayoutManager *manager)
+{
+    g_return_val_if_fail(SUGAR_IS_GRID_LAYOUT_MANAGER(manager), NULL);
+
+    return manager->grid;
+}
+
+/**
+ * sugar_grid_layout_manager_get_n_columns:
+ * @manager: A #SugarGridLayoutManager
+ *
+ * Returns: The number of grid columns of the last allocation.
+ */
+gint
+sugar_grid_layout_manager_get_n_columns(SugarGridLayoutManager *manager)
+{
+    g_return_val_if_fail(SUGAR_IS_GRID_LAYOUT_MANAGER(manager), 0);
+
+    return manager->n_columns;
+}
+
+/**
+ * sugar_grid_layout_manager_get_n_rows:
+ * @manager: A #SugarGridLayoutManager
+ *
+ * Returns: The number of grid rows of the last allocation.
+ */
+gint
+sugar_grid_layout_manager_get_n_rows(SugarGridLayoutManager *manager)
+{
+    g_return_val_if_fail(SUGAR_IS_GRID_LAYOUT_MANAGER(manager), 0);
+
+    return manager->n_rows;
+}
+
+/**
+ * sugar_grid_layout_child_get_column:
+ * @child: A #SugarGridLayoutChild
+ *
+ * Returns: The column of the child's cell, or -1 if not placed yet.
+ */
+gint
+sugar_grid_layout_child_get_column(SugarGridLayoutChild *child)
+{
+    g_return_val_if_fail(SUGAR_IS_GRID_LAYOUT_CHILD(child), -1);
+
+    return child->placed ? child->cell.x : -1;
+}
+
+/**
+ * sugar_grid_layout_child_get_row:
+ * @child: A #SugarGridLayoutChild
+ *
+ * Returns: The row of the child's cell, or -1 if not placed yet.
+ */
+gint
+sugar_grid_layout_child_get_row(SugarGridLayoutChild *child)
+{
+    g_return_val_if_fail(SUGAR_IS_GRID_LAYOUT_CHILD(child), -1);
+
+    return child->placed ? child->cell.y : -1;
+}
+
+/**
+ * sugar_grid_layout_child_get_column_span:
+ * @child: A #SugarGridLayoutChild
+ *
+ * Returns: The number of columns covered by the child, or 0 if not placed.
+ */
+gint
+sugar_grid_layout_child_get_column_span(SugarGridLayoutChild *child)
+{
+    g_return_val_if_fail(SUGAR_IS_GRID_LAYOUT_CHILD(child), 0);
+
+    return child->placed ? child->cell.width : 0;
+}
+
+/**
+ * sugar_grid_layout_child_get_row_span:
+ * @child: A #SugarGridLayoutChild
+ *
+ * Returns: The number of rows covered by the child, or 0 if not placed.
+ */
+gint
+sugar_grid_layout_child_get_row_span(SugarGridLayoutChild *child)
+{
+    g_return_val_if_fail(SUGAR_IS_GRID_LAYOUT_CHILD(child), 0);
+
+    return child->placed ? child->cell.height : 0;
+}
+
+/**
+ * sugar_grid_layout_child_is_placed:
+ * @child: A #SugarGridLayoutChild
+ *
+ * Returns: %TRUE if the child currently occupies cells on the grid.
+ */
+gboolean
+sugar_grid_layout_child_is_placed(SugarGridLayoutChild *child)
+{
+    g_return_val_if_fail(SUGAR_IS_GRID_LAYOUT_CHILD(child), FALSE);
+
+    return child->placed;
+}
+
+/**
+ * sugar_grid_layout_child_set_position:
+ * @child: A #SugarGridLayoutChild
+ * @column: Requested column, or -1 for automatic placement
+ * @row: Requested row, or -1 for automatic placement
+ *
+ * Moves the child to the given cell on the next allocation. Only this
+ * child is placed again; the other children keep their cells. Passing
+ * -1 re-runs automatic placement, which also picks up a changed size.
+ */
+void
+sugar_grid_layout_child_set_position(SugarGridLayoutChild *child, gint column, gint row)
+{
+    g_return_if_fail(SUGAR_IS_GRID_LAYOUT_CHILD(child));
+
+    child->requested_column = column;
+    child->requested_row = row;
+    child->needs_placement = TRUE;
+
+    gtk_layout_manager_layout_changed(gtk_layout_child_get_layout_manager(GTK_LAYOUT_CHILD(child)));
+}
@@ -0,0 +1,59 @@
+/*
+ * Copyright (C) 2025 MostlyK
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __SUGAR_GRID_LAYOUT_MANAGER_H__
+#define __SUGAR_GRID_LAYOUT_MANAGER_H__
+
+#include <gtk/gtk.h>
+#include "sugar-grid.h"
+
+G_BEGIN_DECLS
+
+typedef struct _SugarGridLayoutManager SugarGridLayoutManager;
+typedef struct _SugarGridLayoutManagerClass SugarGridLayoutManagerClass;
+typedef struct _SugarGridLayoutChild SugarGridLayoutChild;
+typedef struct _SugarGridLayoutChildClass SugarGridLayoutChildClass;
+
+#define SUGAR_TYPE_GRID_LAYOUT_MANAGER            (sugar_grid_layout_manager_get_type())
+#define SUGAR_GRID_LAYOUT_MANAGER(object)         (G_TYPE_CHECK_INSTANCE_CAST((object), SUGAR_TYPE_GRID_LAYOUT_MANAGER, SugarGridLayoutManager))
+#define SUGAR_IS_GRID_LAYOUT_MANAGER(object)      (G_TYPE_CHECK_INSTANCE_TYPE((object), SUGAR_TYPE_GRID_LAYOUT_MANAGER))
+
+#define SUGAR_TYPE_GRID_LAYOUT_CHILD              (sugar_grid_layout_child_get_type())
+#define SUGAR_GRID_LAYOUT_CHILD(object)           (G_TYPE_CHECK_INSTANCE_CAST((object), SUGAR_TYPE_GRID_LAYOUT_CHILD, SugarGridLayoutChild))
+#define SUGAR_IS_GRID_LAYOUT_CHILD(object)        (G_TYPE_CHECK_INSTANCE_TYPE((object), SUGAR_TYPE_GRID_LAYOUT_CHILD))
+
+GType             sugar_grid_layout_manager_get_type      (void);
+GtkLayoutManager *sugar_grid_layout_manager_new           (void);
+SugarGrid        *sugar_grid_layout_manager_get_grid      (SugarGridLayoutManager *manager);
+gint              sugar_grid_layout_manager_get_n_columns (SugarGridLayoutManager *manager);
+gint              sugar_grid_layout_manager_get_n_rows    (SugarGridLayoutManager *manager);
+
+GType             sugar_grid_layout_child_get_type        (void);
+gint              sugar_grid_layout_child_get_column      (SugarGridLayoutChild   *child);
+gint              sugar_grid_layout_child_get_row         (SugarGridLayoutChild   *child);
+gint              sugar_grid_layout_child_get_column_span (SugarGridLayoutChild   *child);
+gint              sugar_grid_layout_child_get_row_span    (SugarGridLayoutChild   *child);
+gboolean          sugar_grid_layout_child_is_placed       (SugarGridLayoutChild   *child);
+void              sugar_grid_layout_child_set_position    (SugarGridLayoutChild   *child,
+                                                           gint                    column,
+                                                           gint                    row);
+
+G_END_DECLS
+
+#endif /* __SUGAR_GRID_LAYOUT_MANAGER_H__ */
@@ -18,8 +18,52 @@
  */
 
 #include "sugar-grid.h"
+#include <string.h>
 
-G_DEFINE_TYPE(SugarGrid, sugar_grid, G_TYPE_OBJECT)
+#define NO_REGION G_MAXUINT
+
+/*
+ * Free regions are labeled lazily and cached. Weight changes only grow a
+ * dirty rectangle; the next query relabels the regions touching it (plus
+ * the cells inside it) and leaves every other region untouched, falling
+ * back to a full pass when the affected area covers most of the grid.
+ */
+typedef struct {
+    guint *labels;
+    GArray *regions;
+    GArray *free_ids;
+    GdkRectangle dirty;
+    guint has_dirty : 1;
+    guint labels_valid : 1;
+} SugarGridPrivate;
+
+G_DEFINE_TYPE_WITH_PRIVATE(SugarGrid, sugar_grid, G_TYPE_OBJECT)
+
+static void
+invalidate_regions(SugarGrid *grid)
+{
+    SugarGridPrivate *priv = sugar_grid_get_instance_private(grid);
+
+    g_clear_pointer(&priv->labels, g_free);
+    priv->labels_valid = FALSE;
+    priv->has_dirty = FALSE;
+}
+
+static void
+mark_dirty(SugarGrid *grid, GdkRectangle *rect)
+{
+    SugarGridPrivate *priv = sugar_grid_get_instance_private(grid);
+
+    if (!priv->labels_valid)
+        return;
+
+    if (priv->has_dirty) {
+        gdk_rectangle_union(&priv->dirty, rect, &priv->dirty);
+    } else {
+        priv->dirty = *rect;
+        priv->has_dirty = TRUE;
+    }
+}
 
 void
 sugar_grid_setup(SugarGrid *grid, gint width, gint height)
@@ -29,6 +73,40 @@ sugar_grid_setup(SugarGrid *grid, gint width, gint height)
     grid->weights = g_new0(guchar, width * height);
     grid->width = width;
     grid->height = height;
+
+    invalidate_regions(grid);
+}
+
+/**
+ * sugar_grid_resize:
+ * @grid: A #SugarGrid
+ * @width: New width in cells
+ * @height: New height in cells
+ *
+ * Changes the grid size, keeping the weights of the cells that are
+ * inside both the old and the new bounds.
+ */
+void
+sugar_grid_resize(SugarGrid *grid, gint width, gint height)
+{
+    guchar *old_weights = grid->weights;
+    gint old_width = grid->width;
+    gint old_height = grid->height;
+    gint y;
+
+    grid->weights = NULL;
+    sugar_grid_setup(grid, width, height);
+
+    if (old_weights == NULL)
+        return;
+
+    for (y = 0; y < MIN(old_height, height); y++) {
+        memcpy(grid->weights + y * width,
+               old_weights + y * old_width,
+               MIN(old_width, width));
+    }
+
+    g_free(old_weights);
 }
 
 static gboolean
@@ -54,6 +132,8 @@ sugar_grid_add_weight(SugarGrid *grid, GdkRectangle *rect)
             grid->weights[i + k * grid->width] += 1;
         }
     }
+
+    mark_dirty(grid, rect);
 }
 
 void
@@ -71,6 +151,8 @@ sugar_grid_remove_weight(SugarGrid *grid, GdkRectangle *rect)
             grid->weights[i + k * grid->width] -= 1;
         }
     }
+
+    mark_dirty(grid, rect);
 }
 
 guint
@@ -92,12 +174,325 @@ sugar_grid_compute_weight(SugarGrid *grid, GdkRectangle *rect)
     return sum;
 }
 
+static guint
+allocate_region_id(SugarGridPrivate *priv)
+{
+    SugarGridRegion empty = { 0, 0, { 0, 0, 0, 0 } };
+    guint id;
+
+    if (priv->free_ids->len > 0) {
+        id = g_array_index(priv->free_ids, guint, priv->free_ids->len - 1);
+        g_array_set_size(priv->free_ids, priv->free_ids->len - 1);
+        return id;
+    }
+
+    id = priv->regions->len;
+    empty.id = id;
+    g_array_append_val(priv->regions, empty);
+    return id;
+}
+
+static void
+release_region_id(SugarGridPrivate *priv, guint id)
+{
+    SugarGridRegion *region = &g_array_index(priv->regions, SugarGridRegion, id);
+
+    if (region->area == 0)
+        return;
+
+    region->area = 0;
+    g_array_append_val(priv->free_ids, id);
+}
+
+static guint
+find_root(GArray *parents, guint label)
+{
+    guint *parent = (guint *) parents->data;
+
+    while (parent[label] != label) {
+        parent[label] = parent[parent[label]];
+        label = parent[label];
+    }
+
+    return label;
+}
+
+/*
+ * Two-pass scanline labeling with union-find over the cells of @area that
+ * are free and carry no label. Provisional label 0 means "not selected".
+ */
+static void
+label_area(SugarGrid *grid, SugarGridPrivate *priv, const GdkRectangle *area)
+{
+    guint *provisional = g_new0(guint, area->width * area->height);
+    GArray *parents = g_array_new(FALSE, FALSE, sizeof(guint));
+    GArray *region_ids;
+    guint zero = 0;
+    gint x, y;
+
+    g_array_append_val(parents, zero);
+
+    for (y = 0; y < area->height; y++) {
+        for (x = 0; x < area->width; x++) {
+            gint cell = (area->x + x) + (area->y + y) * grid->width;
+            guint *label = &provisional[x + y * area->width];
+            guint left, up;
+
+            if (grid->weights[cell] != 0 || priv->labels[cell] != NO_REGION)
+                continue;
+
+            left = x > 0 ? label[-1] : 0;
+            up = y > 0 ? label[-area->width] : 0;
+
+            if (left == 0 && up == 0) {
+                *label = parents->len;
+                g_array_append_val(parents, *label);
+            } else if (left == 0 || up == 0) {
+                *label = MAX(left, up);
+            } else {
+                guint left_root = find_root(parents, left);
+                guint up_root = find_root(parents, up);
+
+                *label = MIN(left_root, up_root);
+                g_array_index(parents, guint, MAX(left_root, up_root)) = *label;
+            }
+        }
+    }
+
+    region_ids = g_array_new(FALSE, FALSE, sizeof(guint));
+    g_array_set_size(region_ids, parents->len);
+    memset(region_ids->data, 0xff, parents->len * sizeof(guint));
+
+    for (y = 0; y < area->height; y++) {
+        for (x = 0; x < area->width; x++) {
+            guint label = provisional[x + y * area->width];
+            guint root, id;
+            SugarGridRegion *region;
+            GdkRectangle cell_rect = { area->x + x, area->y + y, 1, 1 };
+
+            if (label == 0)
+                continue;
+
+            root = find_root(parents, label);
+            id = g_array_index(region_ids, guint, root);
+
+            if (id == NO_REGION) {
+                id = allocate_region_id(priv);
+                g_array_index(region_ids, guint, root) = id;
+                region = &g_array_index(priv->regions, SugarGridRegion, id);
+                region->id = id;
+                region->area = 0;
+                region->bounds = cell_rect;
+            } else {
+                region = &g_array_index(priv->regions, SugarGridRegion, id);
+                gdk_rectangle_union(&region->bounds, &cell_rect, &region->bounds);
+            }
+
+            region->area++;
+            priv->labels[cell_rect.x + cell_rect.y * grid->width] = id;
+        }
+    }
+
+    g_array_unref(region_ids);
+    g_array_unref(parents);
+    g_free(provisional);
+}
+
+static void
+relabel_all(SugarGrid *grid, SugarGridPrivate *priv)
+{
+    GdkRectangle all = { 0, 0, grid->width, grid->height };
+    gsize n_cells = (gsize) grid->width * grid->height;
+
+    g_free(priv->labels);
+    priv->labels = g_new(guint, n_cells);
+    memset(priv->labels, 0xff, n_cells * sizeof(guint));
+
+    g_array_set_size(priv->regions, 0);
+    g_array_set_size(priv->free_ids, 0);
+
+    label_area(grid, priv, &all);
+
+    priv->labels_valid = TRUE;
+    priv->has_dirty = FALSE;
+}
+
+static void
+relabel_dirty(SugarGrid *grid, SugarGridPrivate *priv)
+{
+    GdkRectangle bounds = { 0, 0, grid->width, grid->height };
+    GdkRectangle touched, area;
+    guint8 *affected;
+    gint x, y;
+    guint id;
+
+    // Regions next to a changed cell may have merged or split
+    touched.x = priv->dirty.x - 1;
+    touched.y = priv->dirty.y - 1;
+    touched.width = priv->dirty.width + 2;
+    touched.height = priv->dirty.height + 2;
+    gdk_rectangle_intersect(&touched, &bounds, &touched);
+
+    affected = g_new0(guint8, priv->regions->len);
+    area = priv->dirty;
+
+    for (y = touched.y; y < touched.y + touched.height; y++) {
+        for (x = touched.x; x < touched.x + touched.width; x++) {
+            id = priv->labels[x + y * grid->width];
+            if (id != NO_REGION && !affected[id]) {
+                affected[id] = 1;
+                gdk_rectangle_union(&area, &g_array_index(priv->regions, SugarGridRegion, id).bounds, &area);
+            }
+        }
+    }
+
+    if ((gint64) area.width * area.height * 2 > (gint64) grid->width * grid->height) {
+        g_free(affected);
+        relabel_all(grid, priv);
+        return;
+    }
+
+    for (y = area.y; y < area.y + area.height; y++) {
+        for (x = area.x; x < area.x + area.width; x++) {
+            guint *label = &priv->labels[x + y * grid->width];
+
+            if ((*label != NO_REGION && affected[*label]) ||
+                (x >= priv->dirty.x && x < priv->dirty.x + priv->dirty.width &&
+                 y >= priv->dirty.y && y < priv->dirty.y + priv->dirty.height)) {
+                *label = NO_REGION;
+            }
+        }
+    }
+
+    for (id = 0; id < priv->regions->len; id++) {
+        if (affected[id])
+            release_region_id(priv, id);
+    }
+
+    g_free(affected);
+
+    label_area(grid, priv, &area);
+    priv->has_dirty = FALSE;
+}
+
+static void
+ensure_regions(SugarGrid *grid)
+{
+    SugarGridPrivate *priv = sugar_grid_get_instance_private(grid);
+
+    if (!priv->labels_valid)
+        relabel_all(grid, priv);
+    else if (priv->has_dirty)
+        relabel_dirty(grid, priv);
+}
+
+/**
+ * sugar_grid_get_free_regions:
+ * @grid: A #SugarGrid
+ *
+ * Gets the connected areas of zero-weight cells. The labeling is cached
+ * and only the regions around cells changed since the last call are
+ * recomputed.
+ *
+ * Returns: (transfer full) (element-type SugarGridRegion): The regions.
+ */
+GArray *
+sugar_grid_get_free_regions(SugarGrid *grid)
+{
+    SugarGridPrivate *priv;
+    GArray *result;
+    guint i;
+
+    g_return_val_if_fail(SUGAR_IS_GRID(grid), NULL);
+
+    result = g_array_new(FALSE, FALSE, sizeof(SugarGridRegion));
+    if (grid->weights == NULL)
+        return result;
+
+    ensure_regions(grid);
+    priv = sugar_grid_get_instance_private(grid);
+
+    for (i = 0; i < priv->regions->len; i++) {
+        SugarGridRegion *region = &g_array_index(priv->regions, SugarGridRegion, i);
+
+        if (region->area > 0)
+            g_array_append_val(result, *region);
+    }
+
+    return result;
+}
+
+/**
+ * sugar_grid_get_region_at:
+ * @grid: A #SugarGrid
+ * @x: Column of the cell
+ * @y: Row of the cell
+ *
+ * Gets the free region containing a cell.
+ *
+ * Returns: The region id, or -1 if the cell is occupied or out of bounds.
+ */
+gint
+sugar_grid_get_region_at(SugarGrid *grid, gint x, gint y)
+{
+    SugarGridPrivate *priv;
+    guint id;
+
+    g_return_val_if_fail(SUGAR_IS_GRID(grid), -1);
+
+    if (grid->weights == NULL || x < 0 || y < 0 || x >= grid->width || y >= grid->height)
+        return -1;
+
+    ensure_regions(grid);
+    priv = sugar_grid_get_instance_private(grid);
+
+    id = priv->labels[x + y * grid->width];
+    return id == NO_REGION ? -1 : (gint) id;
+}
+
+/**
+ * sugar_grid_get_region:
+ * @grid: A #SugarGrid
+ * @id: A region id
+ * @region: (out caller-allocates): Return location for the region
+ *
+ * Looks up a free region by id.
+ *
+ * Returns: %TRUE if @id names a current region.
+ */
+gboolean
+sugar_grid_get_region(SugarGrid *grid, guint id, SugarGridRegion *region)
+{
+    SugarGridPrivate *priv;
+
+    g_return_val_if_fail(SUGAR_IS_GRID(grid), FALSE);
+    g_return_val_if_fail(region != NULL, FALSE);
+
+    if (grid->weights == NULL)
+        return FALSE;
+
+    ensure_regions(grid);
+    priv = sugar_grid_get_instance_private(grid);
+
+    if (id >= priv->regions->len || g_array_index(priv->regions, SugarGridRegion, id).area == 0)
+        return FALSE;
+
+    *region = g_array_index(priv->regions, SugarGridRegion, id);
+    return TRUE;
+}
+
 static void
 sugar_grid_finalize(GObject *object)
 {
     SugarGrid *grid = SUGAR_GRID(object);
+    SugarGridPrivate *priv = sugar_grid_get_instance_private(grid);
 
     g_free(grid->weights);
+    g_free(priv->labels);
+    g_array_unref(priv->regions);
+    g_array_unref(priv->free_ids);
+
+    G_OBJECT_CLASS(sugar_grid_parent_class)->finalize(object);
 }
 
 static void
@@ -112,5 +507,10 @@ sugar_grid_class_init(SugarGridClass *grid_class)
 static void
 sugar_grid_init(SugarGrid *grid)
 {
+    SugarGridPrivate *priv = sugar_grid_get_instance_private(grid);
+
     grid->weights = NULL;
+
+    priv->regions = g_array_new(FALSE, FALSE, sizeof(SugarGridRegion));
+    priv->free_ids = g_array_new(FALSE, FALSE, sizeof(guint));
 }
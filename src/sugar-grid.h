@@ -47,6 +47,20 @@ struct _SugarGridClass {
 	GObjectClass base_class;
 };
 
+/**
+ * SugarGridRegion:
+ * @id: Identifier of the region, stable until the region changes
+ * @area: Number of free cells in the region
+ * @bounds: Bounding box of the region in grid cells
+ *
+ * A 4-connected area of cells with zero weight.
+ */
+typedef struct {
+    guint id;
+    guint area;
+    GdkRectangle bounds;
+} SugarGridRegion;
+
 GType	 sugar_grid_get_type       (void);
 void     sugar_grid_setup          (SugarGrid    *grid,
                                     gint          width,
@@ -57,6 +71,17 @@ void     sugar_grid_remove_weight  (SugarGrid    *grid,
                                     GdkRectangle *rect);
 guint    sugar_grid_compute_weight (SugarGrid    *grid,
                                     GdkRectangle *rect);
+void     sugar_grid_resize         (SugarGrid    *grid,
+                                    gint          width,
+                                    gint          height);
+
+GArray  *sugar_grid_get_free_regions (SugarGrid       *grid);
+gint     sugar_grid_get_region_at    (SugarGrid       *grid,
+                                      gint             x,
+                                      gint             y);
+gboolean sugar_grid_get_region       (SugarGrid       *grid,
+                                      guint            id,
+                                      SugarGridRegion *region);
 
 G_END_DECLS
 
@@ -0,0 +1,920 @@
+/*
+ * Copyright (C) 2025 MostlyK
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include "sugar-preview-store.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+/*
+ * Previews live in a single pack file, an append-only log with all
+ * integers little endian:
+ *
+ *   0  "SGP" magic and a version byte
+ *   4  records: key length (uint32), data length (uint32), the key and
+ *      the encoded image; a record without data removes the key
+ *
+ * The last record of a key wins. The pack is mapped, so fetching a
+ * preview is a hash lookup and a slice of the mapping instead of an
+ * open() and read() of a thumbnail file.
+ *
+ * Decoding runs on a shared pool of worker threads, newest request
+ * first, since that is the row the user just scrolled to. Requests for
+ * a key that is already being decoded wait for the same job, and a job
+ * whose requests were all cancelled is dropped without decoding.
+ *
+ * Decoded textures are kept up to a memory budget. The cache is split
+ * into power-of-two size buckets, each with its own LRU order: making
+ * room evicts the least recently used texture of the smallest bucket
+ * whose textures are each big enough to free the space needed, so one
+ * large preview does not push out a screenful of small ones.
+ */
+#define PACK_MAGIC "SGP"
+#define PACK_VERSION 1
+#define PACK_HEADER_SIZE 4
+#define RECORD_HEADER_SIZE 8
+#define DEFAULT_CACHE_SIZE (32 * 1024 * 1024)
+#define N_BUCKETS 48
+#define MAX_DECODERS 4
+
+typedef struct {
+    goffset offset;
+    guint32 length;
+} Record;
+
+typedef struct {
+    gchar *key;
+    GdkTexture *texture;
+    gsize size;
+    guint bucket;
+    GList link;
+} CachedTexture;
+
+typedef struct {
+    SugarPreviewStore *store;
+    gchar *key;
+    GBytes *data;
+    goffset offset;
+    GPtrArray *waiters;
+    guint64 serial;
+} DecodeJob;
+
+struct _SugarPreviewStore {
+    GObject parent_instance;
+
+    GMutex lock;
+    gchar *path;
+    gint fd;
+    goffset size;
+    GMappedFile *map;
+    GHashTable *records;
+
+    GHashTable *textures;
+    GQueue buckets[N_BUCKETS];
+    gsize cache_used;
+    gsize cache_max;
+
+    GHashTable *jobs;
+};
+
+struct _SugarPreviewStoreClass {
+    GObjectClass parent_class;
+};
+
+G_DEFINE_TYPE(SugarPreviewStore, sugar_preview_store, G_TYPE_OBJECT)
+
+static GMutex decoders_lock;
+static GThreadPool *decoders;
+static guint64 last_serial;
+
+static void
+cached_texture_free(gpointer data)
+{
+    CachedTexture *entry = data;
+
+    g_free(entry->key);
+    g_object_unref(entry->texture);
+    g_free(entry);
+}
+
+static guint32
+read_uint32(const guint8 *data)
+{
+    guint32 le;
+    memcpy(&le, data, sizeof(le));
+    return GUINT32_FROM_LE(le);
+}
+
+static gboolean
+set_io_error(GError **error, const gchar *message, const gchar *path)
+{
+    int saved_errno = errno;
+
+    g_set_error(error, G_IO_ERROR, g_io_error_from_errno(saved_errno),
+                "%s %s: %s", message, path, g_strerror(saved_errno));
+    return FALSE;
+}
+
+static gboolean
+write_all(gint fd, const guint8 *data, gsize length, goffset offset)
+{
+    while (length > 0) {
+        ssize_t n = pwrite(fd, data, length, offset);
+
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) return FALSE;
+        data += n;
+        length -= n;
+        offset += n;
+    }
+
+    return TRUE;
+}
+
+// Makes sure the mapping reaches @end, after appends; call with the lock held
+static GMappedFile*
+get_map(SugarPreviewStore *self, goffset end)
+{
+    if (!self->map || (goffset) g_mapped_file_get_length(self->map) < end) {
+        g_clear_pointer(&self->map, g_mapped_file_unref);
+        self->map = g_mapped_file_new_from_fd(self->fd, FALSE, NULL);
+    }
+
+    return self->map;
+}
+
+static GBytes*
+get_record_data(SugarPreviewStore *self, const Record *record)
+{
+    GMappedFile *map = get_map(self, record->offset + record->length);
+    GBytes *all;
+    GBytes *data;
+
+    if (!map) return NULL;
+
+    all = g_mapped_file_get_bytes(map);
+    data = g_bytes_new_from_bytes(all, record->offset, record->length);
+    g_bytes_unref(all);
+    return data;
+}
+
+/*
+ * Reads the record table of the pack open as self->fd. A record cut
+ * short by a crash in the middle of an append is cut off, so the next
+ * append starts on a record boundary.
+ */
+static gboolean
+load_pack(SugarPreviewStore *self, GError **error)
+{
+    static const guint8 header[PACK_HEADER_SIZE] = { 'S', 'G', 'P', PACK_VERSION };
+    const guint8 *data;
+    goffset offset = PACK_HEADER_SIZE;
+    gsize size;
+    struct stat st;
+
+    if (fstat(self->fd, &st) != 0)
+        return set_io_error(error, "Could not stat", self->path);
+
+    if (st.st_size == 0) {
+        if (!write_all(self->fd, header, sizeof(header), 0))
+            return set_io_error(error, "Could not write", self->path);
+        self->size = PACK_HEADER_SIZE;
+        return TRUE;
+    }
+
+    if (!get_map(self, st.st_size))
+        return set_io_error(error, "Could not map", self->path);
+
+    data = (const guint8 *) g_mapped_file_get_contents(self->map);
+    size = g_mapped_file_get_length(self->map);
+
+    if (size < PACK_HEADER_SIZE || memcmp(data, header, PACK_HEADER_SIZE) != 0) {
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA, "%s is not a preview pack", self->path);
+        return FALSE;
+    }
+
+    while (size - offset >= RECORD_HEADER_SIZE) {
+        guint32 key_length = read_uint32(data + offset);
+        guint32 data_length = read_uint32(data + offset + 4);
+        goffset data_offset = offset + RECORD_HEADER_SIZE + key_length;
+        gchar *key;
+
+        if (size - offset - RECORD_HEADER_SIZE < (guint64) key_length + data_length)
+            break;
+
+        key = g_strndup((const gchar *) data + offset + RECORD_HEADER_SIZE, key_length);
+        if (data_length > 0) {
+            Record *record = g_new(Record, 1);
+
+            record->offset = data_offset;
+            record->length = data_length;
+            g_hash_table_insert(self->records, key, record);
+        } else {
+            g_hash_table_remove(self->records, key);
+            g_free(key);
+        }
+
+        offset = data_offset + data_length;
+    }
+
+    if ((goffset) size > offset && ftruncate(self->fd, offset) != 0)
+        return set_io_error(error, "Could not repair", self->path);
+
+    self->size = offset;
+    return TRUE;
+}
+
+static void
+append_record(GByteArray *log, const gchar *key, const guint8 *data, gsize length)
+{
+    guint32 lengths[2] = { GUINT32_TO_LE(strlen(key)), GUINT32_TO_LE(length) };
+
+    g_byte_array_append(log, (const guint8 *) lengths, sizeof(lengths));
+    g_byte_array_append(log, (const guint8 *) key, strlen(key));
+    g_byte_array_append(log, data, length);
+}
+
+static guint
+size_bucket(gsize size)
+{
+    return MIN(g_bit_storage(size) - 1, N_BUCKETS - 1);
+}
+
+static void
+cache_remove(SugarPreviewStore *self, CachedTexture *entry)
+{
+    g_queue_unlink(&self->buckets[entry->bucket], &entry->link);
+    self->cache_used -= entry->size;
+    g_hash_table_remove(self->textures, entry->key);
+}
+
+// Evicts textures until @incoming more bytes fit in the budget
+static void
+cache_make_room(SugarPreviewStore *self, gsize incoming)
+{
+    while (self->cache_used > 0 && self->cache_used + incoming > self->cache_max) {
+        gsize needed = self->cache_used + incoming - self->cache_max;
+        GQueue *victims = NULL;
+        GQueue *largest = NULL;
+
+        // Every texture in bucket b takes at least 2^b bytes
+        for (guint b = 0; b < N_BUCKETS; b++) {
+            if (g_queue_is_empty(&self->buckets[b])) continue;
+
+            largest = &self->buckets[b];
+            if (!victims && (G_GUINT64_CONSTANT(1) << b) >= needed)
+                victims = largest;
+        }
+
+        cache_remove(self, g_queue_peek_tail_link(victims ? victims : largest)->data);
+    }
+}
+
+static void
+cache_insert(SugarPreviewStore *self, const gchar *key, GdkTexture *texture)
+{
+    gsize size = (gsize) gdk_texture_get_width(texture) * gdk_texture_get_height(texture) * 4;
+    CachedTexture *entry = g_hash_table_lookup(self->textures, key);
+
+    if (entry)
+        cache_remove(self, entry);
+
+    // A texture over the whole budget is handed out but not kept
+    if (size == 0 || size > self->cache_max)
+        return;
+
+    cache_make_room(self, size);
+
+    entry = g_new0(CachedTexture, 1);
+    entry->key = g_strdup(key);
+    entry->texture = g_object_ref(texture);
+    entry->size = size;
+    entry->bucket = size_bucket(size);
+    entry->link.data = entry;
+    g_queue_push_head_link(&self->buckets[entry->bucket], &entry->link);
+    g_hash_table_insert(self->textures, entry->key, entry);
+    self->cache_used += size;
+}
+
+static GdkTexture*
+cache_lookup(SugarPreviewStore *self, const gchar *key)
+{
+    CachedTexture *entry = g_hash_table_lookup(self->textures, key);
+
+    if (!entry) return NULL;
+
+    g_queue_unlink(&self->buckets[entry->bucket], &entry->link);
+    g_queue_push_head_link(&self->buckets[entry->bucket], &entry->link);
+    return g_object_ref(entry->texture);
+}
+
+static void
+cache_drop(SugarPreviewStore *self, const gchar *key)
+{
+    CachedTexture *entry = g_hash_table_lookup(self->textures, key);
+
+    if (entry) cache_remove(self, entry);
+}
+
+static void
+decode_job_free(DecodeJob *job)
+{
+    g_object_unref(job->store);
+    g_free(job->key);
+    g_bytes_unref(job->data);
+    g_ptr_array_unref(job->waiters);
+    g_free(job);
+}
+
+static gboolean
+job_is_wanted(DecodeJob *job)
+{
+    for (guint i = 0; i < job->waiters->len; i++) {
+        if (!g_cancellable_is_cancelled(g_task_get_cancellable(job->waiters->pdata[i])))
+            return TRUE;
+    }
+
+    return FALSE;
+}
+
+static void
+run_decode_job(gpointer item, gpointer user_data)
+{
+    DecodeJob *job = item;
+    SugarPreviewStore *self = job->store;
+    GdkTexture *texture = NULL;
+    GError *error = NULL;
+    GPtrArray *waiters;
+    Record *record;
+
+    g_mutex_lock(&self->lock);
+
+    // Every request was cancelled while the job was queued
+    if (!job_is_wanted(job)) {
+        g_hash_table_remove(self->jobs, job->key);
+        g_mutex_unlock(&self->lock);
+
+        for (guint i = 0; i < job->waiters->len; i++)
+            g_task_return_error_if_cancelled(job->waiters->pdata[i]);
+        decode_job_free(job);
+        return;
+    }
+
+    g_mutex_unlock(&self->lock);
+
+    texture = gdk_texture_new_from_bytes(job->data, &error);
+
+    g_mutex_lock(&self->lock);
+
+    g_hash_table_remove(self->jobs, job->key);
+    waiters = g_ptr_array_ref(job->waiters);
+
+    // The preview may have been replaced or removed meanwhile
+    record = g_hash_table_lookup(self->records, job->key);
+    if (texture && record && record->offset == job->offset)
+        cache_insert(self, job->key, texture);
+
+    g_mutex_unlock(&self->lock);
+
+    for (guint i = 0; i < waiters->len; i++) {
+        GTask *task = waiters->pdata[i];
+
+        if (texture)
+            g_task_return_pointer(task, g_object_ref(texture), g_object_unref);
+        else
+            g_task_return_error(task, g_error_copy(error));
+    }
+
+    g_ptr_array_unref(waiters);
+    g_clear_object(&texture);
+    g_clear_error(&error);
+    decode_job_free(job);
+}
+
+static gint
+compare_jobs(gconstpointer a, gconstpointer b, gpointer user_data)
+{
+    const DecodeJob *ja = a;
+    const DecodeJob *jb = b;
+
+    // Newest first
+    return ja->serial < jb->serial ? 1 : ja->serial > jb->serial ? -1 : 0;
+}
+
+static void
+push_decode_job(DecodeJob *job)
+{
+    g_mutex_lock(&decoders_lock);
+
+    if (!decoders) {
+        decoders = g_thread_pool_new(run_decode_job, NULL, MAX_DECODERS, FALSE, NULL);
+        g_thread_pool_set_sort_function(decoders, compare_jobs, NULL);
+    }
+
+    job->serial = ++last_serial;
+    g_thread_pool_push(decoders, job, NULL);
+
+    g_mutex_unlock(&decoders_lock);
+}
+
+static void
+sugar_preview_store_finalize(GObject *object)
+{
+    SugarPreviewStore *self = SUGAR_PREVIEW_STORE(object);
+
+    if (self->fd >= 0) close(self->fd);
+    g_clear_pointer(&self->map, g_mapped_file_unref);
+    g_hash_table_unref(self->records);
+    g_hash_table_unref(self->textures);
+    g_hash_table_unref(self->jobs);
+    g_free(self->path);
+    g_mutex_clear(&self->lock);
+
+    G_OBJECT_CLASS(sugar_preview_store_parent_class)->finalize(object);
+}
+
+static void
+sugar_preview_store_class_init(SugarPreviewStoreClass *store_class)
+{
+    GObjectClass *gobject_class = G_OBJECT_CLASS(store_class);
+
+    gobject_class->finalize = sugar_preview_store_finalize;
+}
+
+static void
+sugar_preview_store_init(SugarPreviewStore *self)
+{
+    g_mutex_init(&self->lock);
+    self->fd = -1;
+    self->records = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+    self->textures = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, cached_texture_free);
+    self->jobs = g_hash_table_new(g_str_hash, g_str_equal);
+    self->cache_max = DEFAULT_CACHE_SIZE;
+
+    for (guint b = 0; b < N_BUCKETS; b++)
+        g_queue_init(&self->buckets[b]);
+}
+
+/**
+ * sugar_preview_store_new:
+ * @path: Path of the pack file, created if it does not exist
+ * @error: Return location for error
+ *
+ * Opens a pack of Journal previews. One process should write to a pack
+ * at a time.
+ *
+ * Returns: (transfer full) (nullable): A new #SugarPreviewStore, or %NULL on error
+ */
+SugarPreviewStore*
+sugar_preview_store_new(const gchar *path, GError **error)
+{
+    SugarPreviewStore *self;
+
+    g_return_val_if_fail(path != NULL, NULL);
+
+    self = g_object_new(SUGAR_TYPE_PREVIEW_STORE, NULL);
+    self->path = g_strdup(path);
+    self->fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+
+    if (self->fd < 0) {
+        set_io_error(error, "Could not open", path);
+        g_object_unref(self);
+        return NULL;
+    }
+
+    if (!load_pack(self, error)) {
+        g_object_unref(self);
+        return NULL;
+    }
+
+    return self;
+}
+
+static gboolean
+append_to_pack(SugarPreviewStore *self, const gchar *key, const guint8 *data, gsize length, GError **error)
+{
+    GByteArray *log = g_byte_array_sized_new(RECORD_HEADER_SIZE + strlen(key) + length);
+    gboolean result;
+
+    append_record(log, key, data, length);
+
+    g_mutex_lock(&self->lock);
+
+    result = write_all(self->fd, log->data, log->len, self->size);
+    if (!result) {
+        set_io_error(error, "Could not write", self->path);
+    } else if (length > 0) {
+        Record *record = g_new(Record, 1);
+
+        record->offset = self->size + log->len - length;
+        record->length = length;
+        g_hash_table_insert(self->records, g_strdup(key), record);
+    } else {
+        g_hash_table_remove(self->records, key);
+    }
+
+    if (result) {
+        self->size += log->len;
+        cache_drop(self, key);
+    }
+
+    g_mutex_unlock(&self->lock);
+
+    g_byte_array_unref(log);
+    return result;
+}
+
+/**
+ * sugar_preview_store_add:
+ * @store: A #SugarPreviewStore
+ * @key: Key of the entry, such as its object id
+ * @data: The encoded image, in any format #GdkTexture can load
+ * @error: Return location for error
+ *
+ * Stores the preview of an entry, replacing an existing one.
+ *
+ * Returns: %TRUE on success, %FALSE on error
+ */
+gboolean
+sugar_preview_store_add(SugarPreviewStore *store, const gchar *key, GBytes *data, GError **error)
+{
+    gsize length;
+    const guint8 *contents;
+
+    g_return_val_if_fail(SUGAR_IS_PREVIEW_STORE(store), FALSE);
+    g_return_val_if_fail(key != NULL, FALSE);
+    g_return_val_if_fail(data != NULL && g_bytes_get_size(data) > 0, FALSE);
+
+    contents = g_bytes_get_data(data, &length);
+    return append_to_pack(store, key, contents, length, error);
+}
+
+/**
+ * sugar_preview_store_add_file:
+ * @store: A #SugarPreviewStore
+ * @key: Key of the entry, such as its object id
+ * @path: Path of an image file, such as a #SugarFileAttributes preview_path
+ * @error: Return location for error
+ *
+ * Copies an existing thumbnail file into the pack, see
+ * sugar_preview_store_add().
+ *
+ * Returns: %TRUE on success, %FALSE on error
+ */
+gboolean
+sugar_preview_store_add_file(SugarPreviewStore *store, const gchar *key, const gchar *path, GError **error)
+{
+    gchar *contents;
+    gsize length;
+    gboolean result;
+
+    g_return_val_if_fail(SUGAR_IS_PREVIEW_STORE(store), FALSE);
+    g_return_val_if_fail(key != NULL, FALSE);
+    g_return_val_if_fail(path != NULL, FALSE);
+
+    if (!g_file_get_contents(path, &contents, &length, error))
+        return FALSE;
+
+    if (length == 0) {
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA, "%s is empty", path);
+        g_free(contents);
+        return FALSE;
+    }
+
+    result = append_to_pack(store, key, (const guint8 *) contents, length, error);
+    g_free(contents);
+    return result;
+}
+
+/**
+ * sugar_preview_store_remove:
+ * @store: A #SugarPreviewStore
+ * @key: Key of the entry
+ * @error: Return location for error
+ *
+ * Removes the preview of an entry, if there is one. The space it took
+ * is reclaimed by sugar_preview_store_compact().
+ *
+ * Returns: %TRUE on success, %FALSE on error
+ */
+gboolean
+sugar_preview_store_remove(SugarPreviewStore *store, const gchar *key, GError **error)
+{
+    g_return_val_if_fail(SUGAR_IS_PREVIEW_STORE(store), FALSE);
+    g_return_val_if_fail(key != NULL, FALSE);
+
+    if (!sugar_preview_store_contains(store, key))
+        return TRUE;
+
+    return append_to_pack(store, key, NULL, 0, error);
+}
+
+/**
+ * sugar_preview_store_contains:
+ * @store: A #SugarPreviewStore
+ * @key: Key of the entry
+ *
+ * Checks whether the pack holds a preview for an entry.
+ *
+ * Returns: %TRUE if there is a preview for @key
+ */
+gboolean
+sugar_preview_store_contains(SugarPreviewStore *store, const gchar *key)
+{
+    gboolean result;
+
+    g_return_val_if_fail(SUGAR_IS_PREVIEW_STORE(store), FALSE);
+    g_return_val_if_fail(key != NULL, FALSE);
+
+    g_mutex_lock(&store->lock);
+    result = g_hash_table_contains(store->records, key);
+    g_mutex_unlock(&store->lock);
+
+    return result;
+}
+
+/**
+ * sugar_preview_store_lookup:
+ * @store: A #SugarPreviewStore
+ * @key: Key of the entry
+ *
+ * Gets the encoded preview of an entry without decoding it. The bytes
+ * point into the mapped pack and are not copied.
+ *
+ * Returns: (transfer full) (nullable): The encoded image, or %NULL
+ */
+GBytes*
+sugar_preview_store_lookup(SugarPreviewStore *store, const gchar *key)
+{
+    Record *record;
+    GBytes *data = NULL;
+
+    g_return_val_if_fail(SUGAR_IS_PREVIEW_STORE(store), NULL);
+    g_return_val_if_fail(key != NULL, NULL);
+
+    g_mutex_lock(&store->lock);
+
+    record = g_hash_table_lookup(store->records, key);
+    if (record)
+        data = get_record_data(store, record);
+
+    g_mutex_unlock(&store->lock);
+    return data;
+}
+
+/**
+ * sugar_preview_store_compact:
+ * @store: A #SugarPreviewStore
+ * @error: Return location for error
+ *
+ * Rewrites the pack without replaced and removed previews and swaps it
+ * in atomically. This is best done while the Journal is idle.
+ *
+ * Returns: %TRUE on success, %FALSE on error
+ */
+gboolean
+sugar_preview_store_compact(SugarPreviewStore *store, GError **error)
+{
+    static const guint8 header[PACK_HEADER_SIZE] = { 'S', 'G', 'P', PACK_VERSION };
+    GHashTable *records;
+    GHashTableIter iter;
+    gpointer key, value;
+    GByteArray *log;
+    GMappedFile *map;
+    gchar *temp_path;
+    gboolean result = FALSE;
+    gint fd;
+
+    g_return_val_if_fail(SUGAR_IS_PREVIEW_STORE(store), FALSE);
+
+    g_mutex_lock(&store->lock);
+
+    temp_path = g_strconcat(store->path, ".tmp", NULL);
+    records = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+    log = g_byte_array_new();
+    g_byte_array_append(log, header, sizeof(header));
+
+    map = get_map(store, store->size);
+    if (!map && store->size > PACK_HEADER_SIZE) {
+        set_io_error(error, "Could not map", store->path);
+        goto out;
+    }
+
+    g_hash_table_iter_init(&iter, store->records);
+    while (g_hash_table_iter_next(&iter, &key, &value)) {
+        const Record *old = value;
+        Record *record = g_new(Record, 1);
+        const guint8 *data = (const guint8 *) g_mapped_file_get_contents(map) + old->offset;
+
+        append_record(log, key, data, old->length);
+        record->offset = log->len - old->length;
+        record->length = old->length;
+        g_hash_table_insert(records, g_strdup(key), record);
+    }
+
+    fd = open(temp_path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        set_io_error(error, "Could not create", temp_path);
+        goto out;
+    }
+
+    if (!write_all(fd, log->data, log->len, 0) || fsync(fd) != 0 || rename(temp_path, store->path) != 0) {
+        set_io_error(error, "Could not write", temp_path);
+        close(fd);
+        unlink(temp_path);
+        goto out;
+    }
+
+    // Slices handed out earlier keep the old mapping alive
+    close(store->fd);
+    store->fd = fd;
+    store->size = log->len;
+    g_clear_pointer(&store->map, g_mapped_file_unref);
+    g_hash_table_unref(store->records);
+    store->records = g_steal_pointer(&records);
+    result = TRUE;
+
+out:
+    g_mutex_unlock(&store->lock);
+
+    if (records) g_hash_table_unref(records);
+    g_byte_array_unref(log);
+    g_free(temp_path);
+    return result;
+}
+
+/**
+ * sugar_preview_store_get_texture:
+ * @store: A #SugarPreviewStore
+ * @key: Key of the entry
+ *
+ * Gets the decoded preview of an entry if it is in the texture cache.
+ * This never decodes, so it is cheap enough for binding list rows;
+ * use sugar_preview_store_load_texture_async() on a miss.
+ *
+ * Returns: (transfer full) (nullable): The texture, or %NULL
+ */
+GdkTexture*
+sugar_preview_store_get_texture(SugarPreviewStore *store, const gchar *key)
+{
+    GdkTexture *texture;
+
+    g_return_val_if_fail(SUGAR_IS_PREVIEW_STORE(store), NULL);
+    g_return_val_if_fail(key != NULL, NULL);
+
+    g_mutex_lock(&store->lock);
+    texture = cache_lookup(store, key);
+    g_mutex_unlock(&store->lock);
+
+    return texture;
+}
+
+/**
+ * sugar_preview_store_load_texture_async:
+ * @store: A #SugarPreviewStore
+ * @key: Key of the entry
+ * @cancellable: (nullable): A #GCancellable
+ * @callback: Callback to call when the texture is ready
+ * @user_data: Data to pass to @callback
+ *
+ * Gets the decoded preview of an entry, decoding it on a worker thread
+ * unless it is cached. Cancel the requests of rows that scrolled out of
+ * view so their previews are not decoded for nothing.
+ */
+void
+sugar_preview_store_load_texture_async(SugarPreviewStore   *store,
+                                       const gchar         *key,
+                                       GCancellable        *cancellable,
+                                       GAsyncReadyCallback  callback,
+                                       gpointer             user_data)
+{
+    GTask *task;
+    GdkTexture *texture;
+    DecodeJob *job;
+    Record *record;
+    GBytes *data;
+
+    g_return_if_fail(SUGAR_IS_PREVIEW_STORE(store));
+    g_return_if_fail(key != NULL);
+
+    task = g_task_new(store, cancellable, callback, user_data);
+    g_task_set_source_tag(task, sugar_preview_store_load_texture_async);
+
+    g_mutex_lock(&store->lock);
+
+    texture = cache_lookup(store, key);
+    if (texture) {
+        g_mutex_unlock(&store->lock);
+        g_task_return_pointer(task, texture, g_object_unref);
+        g_object_unref(task);
+        return;
+    }
+
+    // Already being decoded, wait for that
+    job = g_hash_table_lookup(store->jobs, key);
+    if (job) {
+        g_ptr_array_add(job->waiters, task);
+        g_mutex_unlock(&store->lock);
+        return;
+    }
+
+    record = g_hash_table_lookup(store->records, key);
+    data = record ? get_record_data(store, record) : NULL;
+    if (!data) {
+        g_mutex_unlock(&store->lock);
+        g_task_return_new_error(task, G_IO_ERROR, G_IO_ERROR_NOT_FOUND, "No preview for %s", key);
+        g_object_unref(task);
+        return;
+    }
+
+    job = g_new0(DecodeJob, 1);
+    job->store = g_object_ref(store);
+    job->key = g_strdup(key);
+    job->data = data;
+    job->offset = record->offset;
+    job->waiters = g_ptr_array_new_with_free_func(g_object_unref);
+    g_ptr_array_add(job->waiters, task);
+    g_hash_table_insert(store->jobs, job->key, job);
+
+    g_mutex_unlock(&store->lock);
+
+    push_decode_job(job);
+}
+
+/**
+ * sugar_preview_store_load_texture_finish:
+ * @store: A #SugarPreviewStore
+ * @result: A #GAsyncResult
+ * @error: Return location for error
+ *
+ * Finishes sugar_preview_store_load_texture_async().
+ *
+ * Returns: (transfer full): The texture, or %NULL on error
+ */
+GdkTexture*
+sugar_preview_store_load_texture_finish(SugarPreviewStore *store, GAsyncResult *result, GError **error)
+{
+    g_return_val_if_fail(g_task_is_valid(result, store), NULL);
+
+    return g_task_propagate_pointer(G_TASK(result), error);
+}
+
+/**
+ * sugar_preview_store_set_cache_size:
+ * @store: A #SugarPreviewStore
+ * @max_bytes: Memory budget for decoded textures, 0 disables the cache
+ *
+ * Sets how much memory decoded previews may take, counted as four
+ * bytes per pixel. The default is 32 MiB, a few screenfuls of
+ * thumbnails.
+ */
+void
+sugar_preview_store_set_cache_size(SugarPreviewStore *store, gsize max_bytes)
+{
+    g_return_if_fail(SUGAR_IS_PREVIEW_STORE(store));
+
+    g_mutex_lock(&store->lock);
+    store->cache_max = max_bytes;
+    cache_make_room(store, 0);
+    g_mutex_unlock(&store->lock);
+}
+
+/**
+ * sugar_preview_store_get_cache_size:
+ * @store: A #SugarPreviewStore
+ *
+ * Gets the memory budget set with sugar_preview_store_set_cache_size().
+ *
+ * Returns: The budget in bytes
+ */
+gsize
+sugar_preview_store_get_cache_size(SugarPreviewStore *store)
+{
+    gsize result;
+
+    g_return_val_if_fail(SUGAR_IS_PREVIEW_STORE(store), 0);
+
+    g_mutex_lock(&store->lock);
+    result = store->cache_max;
+    g_mutex_unlock(&store->lock);
+
+    return result;
+}
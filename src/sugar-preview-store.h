@@ -0,0 +1,71 @@
+/*
+ * Copyright (C) 2025 MostlyK
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __SUGAR_PREVIEW_STORE_H__
+#define __SUGAR_PREVIEW_STORE_H__
+
+#include <gio/gio.h>
+#include <gdk/gdk.h>
+
+G_BEGIN_DECLS
+
+typedef struct _SugarPreviewStore SugarPreviewStore;
+typedef struct _SugarPreviewStoreClass SugarPreviewStoreClass;
+
+#define SUGAR_TYPE_PREVIEW_STORE            (sugar_preview_store_get_type())
+#define SUGAR_PREVIEW_STORE(object)         (G_TYPE_CHECK_INSTANCE_CAST((object), SUGAR_TYPE_PREVIEW_STORE, SugarPreviewStore))
+#define SUGAR_IS_PREVIEW_STORE(object)      (G_TYPE_CHECK_INSTANCE_TYPE((object), SUGAR_TYPE_PREVIEW_STORE))
+
+GType              sugar_preview_store_get_type            (void);
+SugarPreviewStore *sugar_preview_store_new                 (const gchar          *path,
+                                                            GError              **error);
+gboolean           sugar_preview_store_add                 (SugarPreviewStore    *store,
+                                                            const gchar          *key,
+                                                            GBytes               *data,
+                                                            GError              **error);
+gboolean           sugar_preview_store_add_file            (SugarPreviewStore    *store,
+                                                            const gchar          *key,
+                                                            const gchar          *path,
+                                                            GError              **error);
+gboolean           sugar_preview_store_remove              (SugarPreviewStore    *store,
+                                                            const gchar          *key,
+                                                            GError              **error);
+gboolean           sugar_preview_store_contains            (SugarPreviewStore    *store,
+                                                            const gchar          *key);
+GBytes            *sugar_preview_store_lookup              (SugarPreviewStore    *store,
+                                                            const gchar          *key);
+gboolean           sugar_preview_store_compact             (SugarPreviewStore    *store,
+                                                            GError              **error);
+GdkTexture        *sugar_preview_store_get_texture         (SugarPreviewStore    *store,
+                                                            const gchar          *key);
+void               sugar_preview_store_load_texture_async  (SugarPreviewStore    *store,
+                                                            const gchar          *key,
+                                                            GCancellable         *cancellable,
+                                                            GAsyncReadyCallback   callback,
+                                                            gpointer              user_data);
+GdkTexture        *sugar_preview_store_load_texture_finish (SugarPreviewStore    *store,
+                                                            GAsyncResult         *result,
+                                                            GError              **error);
+void               sugar_preview_store_set_cache_size      (SugarPreviewStore    *store,
+                                                            gsize                 max_bytes);
+gsize              sugar_preview_store_get_cache_size      (SugarPreviewStore    *store);
+
+G_END_DECLS
+
+#endif /* __SUGAR_PREVIEW_STORE_H__ */
@@ -0,0 +1,757 @@
+/*
+ * Copyright (C) 2025 MostlyK
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include "sugar-search-index.h"
+#include "sugar-file-attributes-private.h"
+#include <math.h>
+#include <string.h>
+
+/*
+ * Inverted index over titles and descriptions. Text is case-folded,
+ * NFKC-normalized and split into runs of letters and digits. Each term
+ * maps to a posting list of (document id, field bits and term
+ * frequency) pairs, with ids delta-encoded as varints.
+ *
+ * Posting lists only grow: a changed document is appended under a new
+ * id and its old id is left as a tombstone, so ids stay increasing.
+ * Once tombstones outnumber live documents the index is rebuilt.
+ *
+ * The write hook does no file I/O: a write of one field to an entry
+ * the index does not have yet indexes that field and records the other
+ * as missing. Missing fields are read in the querying thread before
+ * the next query.
+ */
+#define FIELD_TITLE (1 << 0)
+#define FIELD_DESCRIPTION (1 << 1)
+#define TITLE_WEIGHT 2.0
+#define DESCRIPTION_WEIGHT 1.0
+#define MIN_COMPACT_TOMBSTONES 1024
+
+typedef struct {
+    gchar *path;
+    gchar *title;
+    gchar *description;
+} Document;
+
+typedef struct {
+    GByteArray *data;
+    guint32 last_id;
+    guint32 n_documents;
+} Posting;
+
+typedef struct {
+    gchar *term;
+    gboolean prefix;
+} QueryTerm;
+
+typedef struct {
+    guint id;
+    gdouble score;
+} Hit;
+
+struct _SugarSearchIndex {
+    GObject parent_instance;
+
+    GMutex lock;
+    GPtrArray *documents;
+    GHashTable *ids;
+    GHashTable *postings;
+    GPtrArray *sorted_terms;
+    GHashTable *missing;
+    guint n_live;
+    guint hook_id;
+};
+
+struct _SugarSearchIndexClass {
+    GObjectClass parent_class;
+};
+
+G_DEFINE_TYPE(SugarSearchIndex, sugar_search_index, G_TYPE_OBJECT)
+
+static void
+document_free(Document *doc)
+{
+    g_free(doc->path);
+    g_free(doc->title);
+    g_free(doc->description);
+    g_free(doc);
+}
+
+static void
+posting_free(gpointer data)
+{
+    Posting *posting = data;
+
+    g_byte_array_unref(posting->data);
+    g_free(posting);
+}
+
+static void
+put_varint(GByteArray *data, guint32 value)
+{
+    guint8 byte;
+
+    while (value >= 0x80) {
+        byte = (value & 0x7f) | 0x80;
+        g_byte_array_append(data, &byte, 1);
+        value >>= 7;
+    }
+    byte = value;
+    g_byte_array_append(data, &byte, 1);
+}
+
+static guint32
+get_varint(const guint8 **p, const guint8 *end)
+{
+    guint32 value = 0;
+    guint shift = 0;
+
+    while (*p < end) {
+        guint8 byte = *(*p)++;
+        value |= (guint32) (byte & 0x7f) << shift;
+        if (!(byte & 0x80)) break;
+        shift += 7;
+    }
+
+    return value;
+}
+
+/*
+ * Returns @text case-folded and NFKC-normalized, the form every text
+ * index compares in, or %NULL if it is not valid UTF-8.
+ */
+gchar*
+_sugar_text_fold(const gchar *text)
+{
+    gchar *folded, *normalized;
+
+    if (!text || !g_utf8_validate(text, -1, NULL))
+        return NULL;
+
+    folded = g_utf8_casefold(text, -1);
+    normalized = g_utf8_normalize(folded, -1, G_NORMALIZE_NFKC);
+    g_free(folded);
+
+    return normalized;
+}
+
+// Returns the words of @text; the caller takes over the strings
+static GPtrArray*
+tokenize(const gchar *text)
+{
+    GPtrArray *tokens = g_ptr_array_new();
+    gchar *normalized = _sugar_text_fold(text);
+    const gchar *start = NULL;
+    const gchar *p;
+
+    if (!normalized)
+        return tokens;
+
+    for (p = normalized; ; p = g_utf8_next_char(p)) {
+        gboolean word_char = *p && g_unichar_isalnum(g_utf8_get_char(p));
+
+        if (word_char && !start) {
+            start = p;
+        } else if (!word_char && start) {
+            g_ptr_array_add(tokens, g_strndup(start, p - start));
+            start = NULL;
+        }
+        if (!*p) break;
+    }
+
+    g_free(normalized);
+    return tokens;
+}
+
+// Collects term -> (frequency << 2 | field bits) for one document
+static void
+add_terms(GHashTable *terms, const gchar *text, guint field)
+{
+    GPtrArray *tokens = tokenize(text);
+
+    for (guint i = 0; i < tokens->len; i++) {
+        gchar *token = tokens->pdata[i];
+        guint value = GPOINTER_TO_UINT(g_hash_table_lookup(terms, token));
+
+        value = ((value >> 2) + 1) << 2 | (value & 3) | field;
+        g_hash_table_insert(terms, token, GUINT_TO_POINTER(value));
+    }
+
+    g_ptr_array_unref(tokens);
+}
+
+static void
+index_document(SugarSearchIndex *self, Document *doc)
+{
+    GHashTable *terms = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    guint32 id = self->documents->len;
+    GHashTableIter iter;
+    gpointer term, value;
+
+    g_ptr_array_add(self->documents, doc);
+    g_hash_table_insert(self->ids, doc->path, GUINT_TO_POINTER(id));
+
+    add_terms(terms, doc->title, FIELD_TITLE);
+    add_terms(terms, doc->description, FIELD_DESCRIPTION);
+
+    g_hash_table_iter_init(&iter, terms);
+    while (g_hash_table_iter_next(&iter, &term, &value)) {
+        Posting *posting = g_hash_table_lookup(self->postings, term);
+
+        if (!posting) {
+            posting = g_new0(Posting, 1);
+            posting->data = g_byte_array_new();
+            g_hash_table_insert(self->postings, g_strdup(term), posting);
+            g_clear_pointer(&self->sorted_terms, g_ptr_array_unref);
+        }
+
+        put_varint(posting->data, id - posting->last_id);
+        put_varint(posting->data, GPOINTER_TO_UINT(value));
+        posting->last_id = id;
+        posting->n_documents++;
+    }
+
+    g_hash_table_unref(terms);
+}
+
+static void
+drop_document(SugarSearchIndex *self, const gchar *path)
+{
+    gpointer id;
+    Document *doc;
+
+    if (!g_hash_table_lookup_extended(self->ids, path, NULL, &id))
+        return;
+
+    doc = self->documents->pdata[GPOINTER_TO_UINT(id)];
+    g_hash_table_remove(self->ids, path);
+    self->documents->pdata[GPOINTER_TO_UINT(id)] = NULL;
+    document_free(doc);
+    self->n_live--;
+}
+
+static void
+maybe_compact(SugarSearchIndex *self)
+{
+    GPtrArray *documents = self->documents;
+    guint n_tombstones = documents->len - self->n_live;
+
+    if (n_tombstones < MAX(self->n_live, MIN_COMPACT_TOMBSTONES))
+        return;
+
+    self->documents = g_ptr_array_sized_new(self->n_live);
+    g_hash_table_remove_all(self->ids);
+    g_hash_table_remove_all(self->postings);
+    g_clear_pointer(&self->sorted_terms, g_ptr_array_unref);
+
+    for (guint i = 0; i < documents->len; i++) {
+        if (documents->pdata[i])
+            index_document(self, documents->pdata[i]);
+    }
+
+    g_ptr_array_unref(documents);
+}
+
+static void
+set_document(SugarSearchIndex *self, const gchar *path, const gchar *title, const gchar *description)
+{
+    Document *doc = g_new0(Document, 1);
+
+    // Copy first, the values may belong to the document being replaced
+    doc->path = g_strdup(path);
+    doc->title = g_strdup(title);
+    doc->description = g_strdup(description);
+
+    drop_document(self, path);
+    index_document(self, doc);
+    self->n_live++;
+    maybe_compact(self);
+}
+
+static gint
+compare_terms(gconstpointer a, gconstpointer b)
+{
+    return strcmp(*(const gchar * const *) a, *(const gchar * const *) b);
+}
+
+static GPtrArray*
+get_sorted_terms(SugarSearchIndex *self)
+{
+    GHashTableIter iter;
+    gpointer term;
+
+    if (self->sorted_terms)
+        return self->sorted_terms;
+
+    self->sorted_terms = g_ptr_array_sized_new(g_hash_table_size(self->postings));
+    g_hash_table_iter_init(&iter, self->postings);
+    while (g_hash_table_iter_next(&iter, &term, NULL))
+        g_ptr_array_add(self->sorted_terms, term);
+    g_ptr_array_sort(self->sorted_terms, compare_terms);
+
+    return self->sorted_terms;
+}
+
+static void
+collect_postings(SugarSearchIndex *self, const QueryTerm *query_term, GPtrArray *postings)
+{
+    GPtrArray *terms;
+    guint low, high;
+
+    if (!query_term->prefix) {
+        Posting *posting = g_hash_table_lookup(self->postings, query_term->term);
+        if (posting) g_ptr_array_add(postings, posting);
+        return;
+    }
+
+    // The terms starting with the prefix follow its lower bound
+    terms = get_sorted_terms(self);
+    low = 0;
+    high = terms->len;
+    while (low < high) {
+        guint middle = low + (high - low) / 2;
+        if (strcmp(terms->pdata[middle], query_term->term) < 0)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+
+    for (; low < terms->len && g_str_has_prefix(terms->pdata[low], query_term->term); low++)
+        g_ptr_array_add(postings, g_hash_table_lookup(self->postings, terms->pdata[low]));
+}
+
+static void
+score_posting(SugarSearchIndex *self,
+              Posting          *posting,
+              guint16           term_number,
+              gdouble          *scores,
+              guint16          *n_matched,
+              guint16          *last_term)
+{
+    const guint8 *p = posting->data->data;
+    const guint8 *end = p + posting->data->len;
+    gdouble idf = log(1.0 + (gdouble) self->n_live / posting->n_documents);
+    guint32 id = 0;
+
+    while (p < end) {
+        guint32 value;
+        gdouble weight = 0;
+
+        id += get_varint(&p, end);
+        value = get_varint(&p, end);
+        if (!self->documents->pdata[id])
+            continue;
+
+        if (value & FIELD_TITLE) weight += TITLE_WEIGHT;
+        if (value & FIELD_DESCRIPTION) weight += DESCRIPTION_WEIGHT;
+        scores[id] += weight * (1.0 + log(value >> 2)) * idf;
+
+        // Prefix terms expand to several postings but count once
+        if (last_term[id] != term_number) {
+            last_term[id] = term_number;
+            n_matched[id]++;
+        }
+    }
+}
+
+static GArray*
+parse_query(const gchar *query)
+{
+    GArray *terms = g_array_new(FALSE, FALSE, sizeof(QueryTerm));
+    gchar **words = g_strsplit_set(query, " \t\r\n", -1);
+
+    for (guint i = 0; words[i]; i++) {
+        gboolean prefix = g_str_has_suffix(words[i], "*");
+        GPtrArray *tokens = tokenize(words[i]);
+
+        // Only the last token of a word like "sugar-lab*" is a prefix
+        for (guint j = 0; j < tokens->len; j++) {
+            QueryTerm term = { tokens->pdata[j], prefix && j == tokens->len - 1 };
+            g_array_append_val(terms, term);
+        }
+        g_ptr_array_unref(tokens);
+    }
+
+    g_strfreev(words);
+    return terms;
+}
+
+static gint
+compare_hits(gconstpointer a, gconstpointer b)
+{
+    const Hit *ha = a;
+    const Hit *hb = b;
+
+    if (ha->score != hb->score)
+        return ha->score < hb->score ? 1 : -1;
+    // Newer documents first on ties
+    if (ha->id != hb->id)
+        return ha->id < hb->id ? 1 : -1;
+    return 0;
+}
+
+// Moves the best @k of @n hits to the front, in no particular order
+static void
+select_best_hits(Hit *hits, guint n, guint k)
+{
+    gint left = 0, right = n - 1;
+
+    while (left < right) {
+        Hit pivot = hits[left + (right - left) / 2];
+        gint i = left, j = right;
+
+        while (i <= j) {
+            while (compare_hits(&hits[i], &pivot) < 0) i++;
+            while (compare_hits(&hits[j], &pivot) > 0) j--;
+            if (i <= j) {
+                Hit tmp = hits[i];
+                hits[i++] = hits[j];
+                hits[j--] = tmp;
+            }
+        }
+
+        if ((gint) k - 1 <= j)
+            right = j;
+        else if ((gint) k - 1 >= i)
+            left = i;
+        else
+            break;
+    }
+}
+
+// Sets the fields of the entry at @path still to be read; call with the lock held
+static void
+set_missing(SugarSearchIndex *self, const gchar *path, guint fields)
+{
+    if (fields)
+        g_hash_table_insert(self->missing, g_strdup(path), GUINT_TO_POINTER(fields));
+    else
+        g_hash_table_remove(self->missing, path);
+}
+
+// Reads the fields that writes left missing, without holding the lock during I/O
+static void
+fill_missing(SugarSearchIndex *self)
+{
+    GPtrArray *paths;
+    GHashTableIter iter;
+    gpointer path;
+
+    g_mutex_lock(&self->lock);
+    if (g_hash_table_size(self->missing) == 0) {
+        g_mutex_unlock(&self->lock);
+        return;
+    }
+    paths = g_ptr_array_new_with_free_func(g_free);
+    g_hash_table_iter_init(&iter, self->missing);
+    while (g_hash_table_iter_next(&iter, &path, NULL))
+        g_ptr_array_add(paths, g_strdup(path));
+    g_mutex_unlock(&self->lock);
+
+    for (guint i = 0; i < paths->len; i++) {
+        GFile *file = g_file_new_for_path(paths->pdata[i]);
+        SugarFileAttributes *loaded = sugar_file_attributes_get_from_file(file, NULL);
+        guint fields;
+        gpointer id;
+
+        g_object_unref(file);
+
+        // Fields written meanwhile are no longer missing and keep their newer values
+        g_mutex_lock(&self->lock);
+        fields = GPOINTER_TO_UINT(g_hash_table_lookup(self->missing, paths->pdata[i]));
+        if (loaded && fields && g_hash_table_lookup_extended(self->ids, paths->pdata[i], NULL, &id)) {
+            Document *doc = self->documents->pdata[GPOINTER_TO_UINT(id)];
+            set_document(self, paths->pdata[i],
+                         (fields & FIELD_TITLE) ? loaded->title : doc->title,
+                         (fields & FIELD_DESCRIPTION) ? loaded->description : doc->description);
+        }
+        g_hash_table_remove(self->missing, paths->pdata[i]);
+        g_mutex_unlock(&self->lock);
+
+        if (loaded)
+            sugar_file_attributes_free(loaded);
+    }
+
+    g_ptr_array_unref(paths);
+}
+
+static void
+on_write(const gchar               *path,
+         const SugarFileAttributes *attrs,
+         SugarWriteFields           fields,
+         gpointer                   user_data)
+{
+    SugarSearchIndex *self = user_data;
+    guint written = 0;
+    guint unread = 0;
+    guint missing;
+    gpointer id;
+
+    if (fields & SUGAR_WRITE_TITLE)
+        written |= FIELD_TITLE;
+    // A long description may only be known by its digest here
+    if (fields & SUGAR_WRITE_DESCRIPTION) {
+        if (attrs->unloaded & SUGAR_FILE_ATTRIBUTE_DESCRIPTION)
+            unread |= FIELD_DESCRIPTION;
+        else
+            written |= FIELD_DESCRIPTION;
+    }
+    if (!written && !unread)
+        return;
+
+    g_mutex_lock(&self->lock);
+    missing = GPOINTER_TO_UINT(g_hash_table_lookup(self->missing, path));
+    if (g_hash_table_lookup_extended(self->ids, path, NULL, &id)) {
+        Document *doc = self->documents->pdata[GPOINTER_TO_UINT(id)];
+        if (written) {
+            set_document(self, path,
+                         (written & FIELD_TITLE) ? attrs->title : doc->title,
+                         (written & FIELD_DESCRIPTION) ? attrs->description : doc->description);
+        }
+    } else {
+        // A single-field write to a new entry leaves the other field to be read later
+        set_document(self, path,
+                     (written & FIELD_TITLE) ? attrs->title : NULL,
+                     (written & FIELD_DESCRIPTION) ? attrs->description : NULL);
+        missing = FIELD_TITLE | FIELD_DESCRIPTION;
+    }
+    set_missing(self, path, (missing & ~written) | unread);
+    g_mutex_unlock(&self->lock);
+}
+
+static void
+sugar_search_index_finalize(GObject *object)
+{
+    SugarSearchIndex *self = SUGAR_SEARCH_INDEX(object);
+
+    // Waits for a hook that is still running
+    _sugar_file_attributes_remove_write_hook(self->hook_id);
+
+    for (guint i = 0; i < self->documents->len; i++) {
+        if (self->documents->pdata[i])
+            document_free(self->documents->pdata[i]);
+    }
+    g_ptr_array_unref(self->documents);
+    g_hash_table_unref(self->ids);
+    g_hash_table_unref(self->postings);
+    g_hash_table_unref(self->missing);
+    g_clear_pointer(&self->sorted_terms, g_ptr_array_unref);
+    g_mutex_clear(&self->lock);
+
+    G_OBJECT_CLASS(sugar_search_index_parent_class)->finalize(object);
+}
+
+static void
+sugar_search_index_class_init(SugarSearchIndexClass *index_class)
+{
+    GObjectClass *gobject_class = G_OBJECT_CLASS(index_class);
+
+    gobject_class->finalize = sugar_search_index_finalize;
+}
+
+static void
+sugar_search_index_init(SugarSearchIndex *self)
+{
+    g_mutex_init(&self->lock);
+    self->documents = g_ptr_array_new();
+    self->ids = g_hash_table_new(g_str_hash, g_str_equal);
+    self->postings = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, posting_free);
+    self->missing = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    self->hook_id = _sugar_file_attributes_add_write_hook(on_write, self);
+}
+
+/**
+ * sugar_search_index_new:
+ *
+ * Creates an empty search index over titles and descriptions. Entries
+ * written through sugar_file_attributes_save_to_file(),
+ * sugar_file_attributes_save_at(), sugar_file_attributes_save_to_fd(),
+ * sugar_file_attributes_set_title() and
+ * sugar_file_attributes_set_description() are added or updated
+ * automatically, keyed by their local path. Saves through a descriptor
+ * whose file has no path left, such as an unlinked one, are not seen.
+ *
+ * Returns: (transfer full): A new #SugarSearchIndex
+ */
+SugarSearchIndex*
+sugar_search_index_new(void)
+{
+    return g_object_new(SUGAR_TYPE_SEARCH_INDEX, NULL);
+}
+
+/**
+ * sugar_search_index_add:
+ * @index: A #SugarSearchIndex
+ * @path: Local path of the entry
+ * @attrs: The attributes of the entry
+ *
+ * Adds an entry to the index, replacing an entry with the same path.
+ */
+void
+sugar_search_index_add(SugarSearchIndex *index, const gchar *path, const SugarFileAttributes *attrs)
+{
+    gchar *description = NULL;
+
+    g_return_if_fail(SUGAR_IS_SEARCH_INDEX(index));
+    g_return_if_fail(path != NULL);
+    g_return_if_fail(attrs != NULL);
+
+    // Scans leave long descriptions unread, but their words are wanted here
+    if (attrs->unloaded & SUGAR_FILE_ATTRIBUTE_DESCRIPTION) {
+        GFile *file = g_file_new_for_path(path);
+        description = sugar_file_attributes_get_description(file);
+        g_object_unref(file);
+    }
+
+    g_mutex_lock(&index->lock);
+    set_document(index, path, attrs->title, description ? description : attrs->description);
+    set_missing(index, path, 0);
+    g_mutex_unlock(&index->lock);
+
+    g_free(description);
+}
+
+/**
+ * sugar_search_index_remove:
+ * @index: A #SugarSearchIndex
+ * @path: Local path of the entry
+ *
+ * Removes an entry from the index, if present.
+ */
+void
+sugar_search_index_remove(SugarSearchIndex *index, const gchar *path)
+{
+    g_return_if_fail(SUGAR_IS_SEARCH_INDEX(index));
+    g_return_if_fail(path != NULL);
+
+    g_mutex_lock(&index->lock);
+    drop_document(index, path);
+    set_missing(index, path, 0);
+    maybe_compact(index);
+    g_mutex_unlock(&index->lock);
+}
+
+/**
+ * sugar_search_index_get_n_entries:
+ * @index: A #SugarSearchIndex
+ *
+ * Gets the number of entries in the index.
+ *
+ * Returns: The number of entries
+ */
+guint
+sugar_search_index_get_n_entries(SugarSearchIndex *index)
+{
+    guint result;
+
+    g_return_val_if_fail(SUGAR_IS_SEARCH_INDEX(index), 0);
+
+    g_mutex_lock(&index->lock);
+    result = index->n_live;
+    g_mutex_unlock(&index->lock);
+
+    return result;
+}
+
+/**
+ * sugar_search_index_query:
+ * @index: A #SugarSearchIndex
+ * @query: Words to look for; a word ending in `*` matches as a prefix
+ * @match: Whether entries need all or any of the words
+ * @max_results: Maximum number of results, 0 for no limit
+ *
+ * Searches titles and descriptions. Matching ignores case and
+ * compatibility differences; matches in titles rank above matches in
+ * descriptions, and rarer words weigh more.
+ *
+ * Returns: (transfer full) (array zero-terminated=1): Paths of the
+ * matching entries, best first
+ */
+gchar**
+sugar_search_index_query(SugarSearchIndex *index,
+                         const gchar      *query,
+                         SugarSearchMatch  match,
+                         guint             max_results)
+{
+    GPtrArray *results = g_ptr_array_new();
+    GPtrArray *postings = g_ptr_array_new();
+    GArray *terms, *hits;
+    gdouble *scores;
+    guint16 *n_matched, *last_term;
+    guint n_required, n_documents;
+
+    g_return_val_if_fail(SUGAR_IS_SEARCH_INDEX(index), NULL);
+    g_return_val_if_fail(query != NULL, NULL);
+
+    fill_missing(index);
+
+    terms = parse_query(query);
+    n_required = match == SUGAR_SEARCH_MATCH_ALL ? terms->len : 1;
+
+    g_mutex_lock(&index->lock);
+
+    n_documents = index->documents->len;
+    scores = g_new0(gdouble, n_documents);
+    n_matched = g_new0(guint16, n_documents);
+    last_term = g_new0(guint16, n_documents);
+
+    for (guint i = 0; i < terms->len && i < G_MAXUINT16; i++) {
+        g_ptr_array_set_size(postings, 0);
+        collect_postings(index, &g_array_index(terms, QueryTerm, i), postings);
+
+        // A missing word ends an all-words query early
+        if (postings->len == 0 && match == SUGAR_SEARCH_MATCH_ALL)
+            break;
+        for (guint j = 0; j < postings->len; j++)
+            score_posting(index, postings->pdata[j], i + 1, scores, n_matched, last_term);
+    }
+
+    hits = g_array_new(FALSE, FALSE, sizeof(Hit));
+    for (guint id = 0; id < n_documents && terms->len > 0; id++) {
+        if (n_matched[id] >= n_required) {
+            Hit hit = { id, scores[id] };
+            g_array_append_val(hits, hit);
+        }
+    }
+    // Only the returned hits need to be in order
+    if (max_results > 0 && hits->len > max_results) {
+        select_best_hits((Hit *) hits->data, hits->len, max_results);
+        g_array_set_size(hits, max_results);
+    }
+    g_array_sort(hits, compare_hits);
+
+    for (guint i = 0; i < hits->len && (max_results == 0 || i < max_results); i++) {
+        Document *doc = index->documents->pdata[g_array_index(hits, Hit, i).id];
+        g_ptr_array_add(results, g_strdup(doc->path));
+    }
+
+    g_mutex_unlock(&index->lock);
+
+    for (guint i = 0; i < terms->len; i++)
+        g_free(g_array_index(terms, QueryTerm, i).term);
+    g_array_unref(terms);
+    g_array_unref(hits);
+    g_ptr_array_unref(postings);
+    g_free(scores);
+    g_free(n_matched);
+    g_free(last_term);
+
+    g_ptr_array_add(results, NULL);
+    return (gchar **) g_ptr_array_free(results, FALSE);
+}
@@ -0,0 +1,62 @@
+/*
+ * Copyright (C) 2025 MostlyK
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __SUGAR_SEARCH_INDEX_H__
+#define __SUGAR_SEARCH_INDEX_H__
+
+#include <glib-object.h>
+#include "sugar-file-attributes.h"
+
+G_BEGIN_DECLS
+
+typedef struct _SugarSearchIndex SugarSearchIndex;
+typedef struct _SugarSearchIndexClass SugarSearchIndexClass;
+
+#define SUGAR_TYPE_SEARCH_INDEX            (sugar_search_index_get_type())
+#define SUGAR_SEARCH_INDEX(object)         (G_TYPE_CHECK_INSTANCE_CAST((object), SUGAR_TYPE_SEARCH_INDEX, SugarSearchIndex))
+#define SUGAR_IS_SEARCH_INDEX(object)      (G_TYPE_CHECK_INSTANCE_TYPE((object), SUGAR_TYPE_SEARCH_INDEX))
+
+/**
+ * SugarSearchMatch:
+ * @SUGAR_SEARCH_MATCH_ALL: Entries must contain every query word
+ * @SUGAR_SEARCH_MATCH_ANY: Entries must contain at least one query word
+ *
+ * How the words of a query are combined by sugar_search_index_query().
+ */
+typedef enum {
+    SUGAR_SEARCH_MATCH_ALL,
+    SUGAR_SEARCH_MATCH_ANY,
+} SugarSearchMatch;
+
+GType             sugar_search_index_get_type      (void);
+SugarSearchIndex *sugar_search_index_new           (void);
+void              sugar_search_index_add           (SugarSearchIndex          *index,
+                                                    const gchar               *path,
+                                                    const SugarFileAttributes *attrs);
+void              sugar_search_index_remove        (SugarSearchIndex          *index,
+                                                    const gchar               *path);
+guint             sugar_search_index_get_n_entries (SugarSearchIndex          *index);
+gchar           **sugar_search_index_query         (SugarSearchIndex          *index,
+                                                    const gchar               *query,
+                                                    SugarSearchMatch           match,
+                                                    guint                      max_results);
+
+G_END_DECLS
+
+#endif /* __SUGAR_SEARCH_INDEX_H__ */
@@ -0,0 +1,850 @@
+/*
+ * Copyright (C) 2025 MostlyK
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include "sugar-tag-index.h"
+#include "sugar-file-attributes-private.h"
+#include <string.h>
+
+/*
+ * Each canonical tag (trimmed, case-folded and normalized) maps to a
+ * bitmap of entry ids. Bitmaps follow the roaring layout: ids are split
+ * by their upper 16 bits into containers, and a container holds its
+ * lower 16 bits either as a sorted array, while it has at most
+ * ARRAY_MAX values, or as a 65536-bit bitmap. Small tags stay small and
+ * common ones are combined a word at a time.
+ *
+ * Entry ids are reused once an entry is removed, so the bitmaps stay
+ * dense.
+ */
+#define ARRAY_MAX 4096
+#define BITMAP_WORDS 1024
+
+typedef struct {
+    guint16 key;
+    guint32 cardinality;
+    guint32 capacity;
+    guint16 *array;
+    guint64 *bits;
+} Container;
+
+typedef struct {
+    GArray *containers;
+} Bitmap;
+
+typedef struct {
+    gchar *path;
+    gchar **tags;
+} Entry;
+
+struct _SugarTagIndex {
+    GObject parent_instance;
+
+    GMutex lock;
+    GPtrArray *entries;
+    GArray *free_ids;
+    GHashTable *ids;
+    GHashTable *tags;
+    Bitmap *all;
+    guint hook_id;
+};
+
+struct _SugarTagIndexClass {
+    GObjectClass parent_class;
+};
+
+G_DEFINE_TYPE(SugarTagIndex, sugar_tag_index, G_TYPE_OBJECT)
+
+static void
+container_clear(gpointer data)
+{
+    Container *c = data;
+
+    g_free(c->array);
+    g_free(c->bits);
+}
+
+static Bitmap*
+bitmap_new(void)
+{
+    Bitmap *bitmap = g_new0(Bitmap, 1);
+
+    bitmap->containers = g_array_new(FALSE, FALSE, sizeof(Container));
+    g_array_set_clear_func(bitmap->containers, container_clear);
+    return bitmap;
+}
+
+static void
+bitmap_free(gpointer data)
+{
+    Bitmap *bitmap = data;
+
+    g_array_unref(bitmap->containers);
+    g_free(bitmap);
+}
+
+static guint32
+array_lower_bound(const guint16 *array, guint32 n, guint16 value)
+{
+    guint32 low = 0, high = n;
+
+    while (low < high) {
+        guint32 middle = low + (high - low) / 2;
+        if (array[middle] < value)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+
+    return low;
+}
+
+static gboolean
+container_contains(const Container *c, guint16 value)
+{
+    guint32 pos;
+
+    if (c->bits)
+        return (c->bits[value >> 6] >> (value & 63)) & 1;
+
+    pos = array_lower_bound(c->array, c->cardinality, value);
+    return pos < c->cardinality && c->array[pos] == value;
+}
+
+static guint64*
+container_to_words(const Container *c)
+{
+    guint64 *bits = g_new0(guint64, BITMAP_WORDS);
+
+    if (c->bits) {
+        memcpy(bits, c->bits, BITMAP_WORDS * sizeof(guint64));
+    } else {
+        for (guint32 i = 0; i < c->cardinality; i++)
+            bits[c->array[i] >> 6] |= G_GUINT64_CONSTANT(1) << (c->array[i] & 63);
+    }
+
+    return bits;
+}
+
+// Takes @values, n of them sorted; large sets move to the bitmap form
+static void
+container_set_array(Container *c, guint16 *values, guint32 n)
+{
+    g_clear_pointer(&c->array, g_free);
+    g_clear_pointer(&c->bits, g_free);
+    c->array = values;
+    c->capacity = n;
+    c->cardinality = n;
+
+    if (n > ARRAY_MAX) {
+        c->bits = container_to_words(c);
+        g_clear_pointer(&c->array, g_free);
+        c->capacity = 0;
+    }
+}
+
+// Takes @bits; sparse sets move to the array form
+static void
+container_set_words(Container *c, guint64 *bits)
+{
+    guint32 n = 0;
+
+    for (guint i = 0; i < BITMAP_WORDS; i++)
+        n += __builtin_popcountll(bits[i]);
+
+    g_clear_pointer(&c->array, g_free);
+    g_clear_pointer(&c->bits, g_free);
+    c->bits = bits;
+    c->cardinality = n;
+
+    if (n <= ARRAY_MAX) {
+        guint32 pos = 0;
+
+        c->array = g_new(guint16, MAX(n, 1));
+        c->capacity = MAX(n, 1);
+        for (guint i = 0; i < BITMAP_WORDS; i++) {
+            for (guint64 word = bits[i]; word; word &= word - 1)
+                c->array[pos++] = i * 64 + __builtin_ctzll(word);
+        }
+        g_clear_pointer(&c->bits, g_free);
+    }
+}
+
+static void
+container_and(const Container *a, const Container *b, Container *out)
+{
+    if (a->bits && b->bits) {
+        guint64 *bits = g_new(guint64, BITMAP_WORDS);
+        for (guint i = 0; i < BITMAP_WORDS; i++)
+            bits[i] = a->bits[i] & b->bits[i];
+        container_set_words(out, bits);
+    } else if (!a->bits && !b->bits) {
+        guint16 *values = g_new(guint16, MAX(MIN(a->cardinality, b->cardinality), 1));
+        guint32 i = 0, j = 0, n = 0;
+
+        while (i < a->cardinality && j < b->cardinality) {
+            if (a->array[i] < b->array[j]) {
+                i++;
+            } else if (a->array[i] > b->array[j]) {
+                j++;
+            } else {
+                values[n++] = a->array[i];
+                i++;
+                j++;
+            }
+        }
+        container_set_array(out, values, n);
+    } else {
+        const Container *array = a->bits ? b : a;
+        const Container *bitmap = a->bits ? a : b;
+        guint16 *values = g_new(guint16, MAX(array->cardinality, 1));
+        guint32 n = 0;
+
+        for (guint32 i = 0; i < array->cardinality; i++) {
+            if (container_contains(bitmap, array->array[i]))
+                values[n++] = array->array[i];
+        }
+        container_set_array(out, values, n);
+    }
+}
+
+static void
+container_or(const Container *a, const Container *b, Container *out)
+{
+    if (!a->bits && !b->bits && a->cardinality + b->cardinality <= ARRAY_MAX) {
+        guint16 *values = g_new(guint16, MAX(a->cardinality + b->cardinality, 1));
+        guint32 i = 0, j = 0, n = 0;
+
+        while (i < a->cardinality || j < b->cardinality) {
+            if (j == b->cardinality || (i < a->cardinality && a->array[i] < b->array[j]))
+                values[n++] = a->array[i++];
+            else if (i == a->cardinality || b->array[j] < a->array[i])
+                values[n++] = b->array[j++];
+            else {
+                values[n++] = a->array[i++];
+                j++;
+            }
+        }
+        container_set_array(out, values, n);
+    } else {
+        guint64 *bits = container_to_words(a);
+
+        if (b->bits) {
+            for (guint i = 0; i < BITMAP_WORDS; i++)
+                bits[i] |= b->bits[i];
+        } else {
+            for (guint32 i = 0; i < b->cardinality; i++)
+                bits[b->array[i] >> 6] |= G_GUINT64_CONSTANT(1) << (b->array[i] & 63);
+        }
+        container_set_words(out, bits);
+    }
+}
+
+static void
+container_andnot(const Container *a, const Container *b, Container *out)
+{
+    if (!a->bits) {
+        guint16 *values = g_new(guint16, MAX(a->cardinality, 1));
+        guint32 n = 0;
+
+        for (guint32 i = 0; i < a->cardinality; i++) {
+            if (!container_contains(b, a->array[i]))
+                values[n++] = a->array[i];
+        }
+        container_set_array(out, values, n);
+    } else {
+        guint64 *bits = container_to_words(a);
+
+        if (b->bits) {
+            for (guint i = 0; i < BITMAP_WORDS; i++)
+                bits[i] &= ~b->bits[i];
+        } else {
+            for (guint32 i = 0; i < b->cardinality; i++)
+                bits[b->array[i] >> 6] &= ~(G_GUINT64_CONSTANT(1) << (b->array[i] & 63));
+        }
+        container_set_words(out, bits);
+    }
+}
+
+static void
+container_copy(const Container *c, Container *out)
+{
+    *out = *c;
+    out->array = c->array ? g_memdup2(c->array, c->capacity * sizeof(guint16)) : NULL;
+    out->bits = c->bits ? g_memdup2(c->bits, BITMAP_WORDS * sizeof(guint64)) : NULL;
+}
+
+static gboolean
+bitmap_find(const Bitmap *bitmap, guint16 key, guint *index)
+{
+    guint low = 0, high = bitmap->containers->len;
+
+    while (low < high) {
+        guint middle = low + (high - low) / 2;
+        if (g_array_index(bitmap->containers, Container, middle).key < key)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+
+    *index = low;
+    return low < bitmap->containers->len && g_array_index(bitmap->containers, Container, low).key == key;
+}
+
+static void
+bitmap_add(Bitmap *bitmap, guint32 id)
+{
+    guint16 value = id & 0xffff;
+    Container *c;
+    guint index;
+    guint32 pos;
+
+    if (!bitmap_find(bitmap, id >> 16, &index)) {
+        Container empty = { id >> 16, 0, 0, NULL, NULL };
+        g_array_insert_val(bitmap->containers, index, empty);
+    }
+    c = &g_array_index(bitmap->containers, Container, index);
+
+    if (c->bits) {
+        if (!container_contains(c, value)) {
+            c->bits[value >> 6] |= G_GUINT64_CONSTANT(1) << (value & 63);
+            c->cardinality++;
+        }
+        return;
+    }
+
+    pos = array_lower_bound(c->array, c->cardinality, value);
+    if (pos < c->cardinality && c->array[pos] == value)
+        return;
+
+    if (c->cardinality == ARRAY_MAX) {
+        c->bits = container_to_words(c);
+        g_clear_pointer(&c->array, g_free);
+        c->capacity = 0;
+        c->bits[value >> 6] |= G_GUINT64_CONSTANT(1) << (value & 63);
+        c->cardinality++;
+        return;
+    }
+
+    if (c->cardinality == c->capacity) {
+        c->capacity = MIN(MAX(c->capacity * 2, 4), ARRAY_MAX);
+        c->array = g_renew(guint16, c->array, c->capacity);
+    }
+    memmove(c->array + pos + 1, c->array + pos, (c->cardinality - pos) * sizeof(guint16));
+    c->array[pos] = value;
+    c->cardinality++;
+}
+
+static void
+bitmap_remove(Bitmap *bitmap, guint32 id)
+{
+    guint16 value = id & 0xffff;
+    Container *c;
+    guint index;
+
+    if (!bitmap_find(bitmap, id >> 16, &index))
+        return;
+    c = &g_array_index(bitmap->containers, Container, index);
+    if (!container_contains(c, value))
+        return;
+
+    if (c->bits) {
+        c->bits[value >> 6] &= ~(G_GUINT64_CONSTANT(1) << (value & 63));
+        c->cardinality--;
+        if (c->cardinality <= ARRAY_MAX)
+            container_set_words(c, g_steal_pointer(&c->bits));
+    } else {
+        guint32 pos = array_lower_bound(c->array, c->cardinality, value);
+        memmove(c->array + pos, c->array + pos + 1, (c->cardinality - pos - 1) * sizeof(guint16));
+        c->cardinality--;
+    }
+
+    if (c->cardinality == 0)
+        g_array_remove_index(bitmap->containers, index);
+}
+
+static guint
+bitmap_get_cardinality(const Bitmap *bitmap)
+{
+    guint n = 0;
+
+    for (guint i = 0; i < bitmap->containers->len; i++)
+        n += g_array_index(bitmap->containers, Container, i).cardinality;
+
+    return n;
+}
+
+static Bitmap*
+bitmap_copy(const Bitmap *bitmap)
+{
+    Bitmap *copy = bitmap_new();
+
+    for (guint i = 0; i < bitmap->containers->len; i++) {
+        Container c;
+        container_copy(&g_array_index(bitmap->containers, Container, i), &c);
+        g_array_append_val(copy->containers, c);
+    }
+
+    return copy;
+}
+
+typedef enum {
+    OP_AND,
+    OP_OR,
+    OP_ANDNOT,
+} BitmapOp;
+
+// Combines containers with equal keys; unmatched ones are kept as @op requires
+static Bitmap*
+bitmap_combine(const Bitmap *a, const Bitmap *b, BitmapOp op)
+{
+    Bitmap *result = bitmap_new();
+    guint i = 0, j = 0;
+
+    while (i < a->containers->len || j < b->containers->len) {
+        const Container *ca = i < a->containers->len ? &g_array_index(a->containers, Container, i) : NULL;
+        const Container *cb = j < b->containers->len ? &g_array_index(b->containers, Container, j) : NULL;
+        Container out = { 0, 0, 0, NULL, NULL };
+
+        if (ca && (!cb || ca->key < cb->key)) {
+            i++;
+            if (op == OP_AND) continue;
+            container_copy(ca, &out);
+        } else if (cb && (!ca || cb->key < ca->key)) {
+            j++;
+            if (op != OP_OR) continue;
+            container_copy(cb, &out);
+        } else {
+            i++;
+            j++;
+            out.key = ca->key;
+            if (op == OP_AND)
+                container_and(ca, cb, &out);
+            else if (op == OP_OR)
+                container_or(ca, cb, &out);
+            else
+                container_andnot(ca, cb, &out);
+        }
+
+        if (out.cardinality > 0)
+            g_array_append_val(result->containers, out);
+        else
+            container_clear(&out);
+    }
+
+    return result;
+}
+
+// Replaces *@a by @a op @b
+static void
+bitmap_apply(Bitmap **a, const Bitmap *b, BitmapOp op)
+{
+    Bitmap *result = bitmap_combine(*a, b, op);
+
+    bitmap_free(*a);
+    *a = result;
+}
+
+static gchar*
+canonical_tag(const gchar *tag)
+{
+    gchar *stripped = g_strstrip(g_strdup(tag));
+    gchar *folded = stripped[0] ? _sugar_text_fold(stripped) : NULL;
+
+    g_free(stripped);
+    return folded;
+}
+
+static void
+entry_free(Entry *entry)
+{
+    g_free(entry->path);
+    g_strfreev(entry->tags);
+    g_free(entry);
+}
+
+static void
+drop_entry(SugarTagIndex *self, const gchar *path)
+{
+    gpointer value;
+    guint32 id;
+    Entry *entry;
+
+    if (!g_hash_table_lookup_extended(self->ids, path, NULL, &value))
+        return;
+
+    id = GPOINTER_TO_UINT(value);
+    entry = self->entries->pdata[id];
+
+    for (guint i = 0; entry->tags[i]; i++) {
+        Bitmap *bitmap = g_hash_table_lookup(self->tags, entry->tags[i]);
+        bitmap_remove(bitmap, id);
+        if (bitmap->containers->len == 0)
+            g_hash_table_remove(self->tags, entry->tags[i]);
+    }
+    bitmap_remove(self->all, id);
+
+    g_hash_table_remove(self->ids, path);
+    self->entries->pdata[id] = NULL;
+    g_array_append_val(self->free_ids, id);
+    entry_free(entry);
+}
+
+static void
+set_entry(SugarTagIndex *self, const gchar *path, const gchar *tags)
+{
+    gchar **split = g_strsplit(tags ? tags : "", ",", -1);
+    GPtrArray *canonical = g_ptr_array_new();
+    Entry *entry = g_new0(Entry, 1);
+    guint32 id;
+
+    drop_entry(self, path);
+
+    for (guint i = 0; split[i]; i++) {
+        gchar *tag = canonical_tag(split[i]);
+        if (tag && !g_ptr_array_find_with_equal_func(canonical, tag, g_str_equal, NULL))
+            g_ptr_array_add(canonical, tag);
+        else
+            g_free(tag);
+    }
+    g_ptr_array_add(canonical, NULL);
+    g_strfreev(split);
+
+    entry->path = g_strdup(path);
+    entry->tags = (gchar **) g_ptr_array_free(canonical, FALSE);
+
+    if (self->free_ids->len > 0) {
+        id = g_array_index(self->free_ids, guint32, self->free_ids->len - 1);
+        g_array_set_size(self->free_ids, self->free_ids->len - 1);
+        self->entries->pdata[id] = entry;
+    } else {
+        id = self->entries->len;
+        g_ptr_array_add(self->entries, entry);
+    }
+    g_hash_table_insert(self->ids, entry->path, GUINT_TO_POINTER(id));
+
+    for (guint i = 0; entry->tags[i]; i++) {
+        Bitmap *bitmap = g_hash_table_lookup(self->tags, entry->tags[i]);
+        if (!bitmap) {
+            bitmap = bitmap_new();
+            g_hash_table_insert(self->tags, g_strdup(entry->tags[i]), bitmap);
+        }
+        bitmap_add(bitmap, id);
+    }
+    bitmap_add(self->all, id);
+}
+
+// Returns the bitmap of @tag, or NULL if no entry has it
+static const Bitmap*
+lookup_tag(SugarTagIndex *self, const gchar *tag)
+{
+    gchar *canonical = canonical_tag(tag);
+    const Bitmap *bitmap = canonical ? g_hash_table_lookup(self->tags, canonical) : NULL;
+
+    g_free(canonical);
+    return bitmap;
+}
+
+static gint
+compare_tags(gconstpointer a, gconstpointer b)
+{
+    return strcmp(*(const gchar * const *) a, *(const gchar * const *) b);
+}
+
+static void
+on_write(const gchar               *path,
+         const SugarFileAttributes *attrs,
+         SugarWriteFields           fields,
+         gpointer                   user_data)
+{
+    SugarTagIndex *self = user_data;
+
+    if (!(fields & SUGAR_WRITE_TAGS))
+        return;
+
+    g_mutex_lock(&self->lock);
+    set_entry(self, path, attrs->tags);
+    g_mutex_unlock(&self->lock);
+}
+
+static void
+sugar_tag_index_finalize(GObject *object)
+{
+    SugarTagIndex *self = SUGAR_TAG_INDEX(object);
+
+    _sugar_file_attributes_remove_write_hook(self->hook_id);
+
+    for (guint i = 0; i < self->entries->len; i++) {
+        if (self->entries->pdata[i])
+            entry_free(self->entries->pdata[i]);
+    }
+    g_ptr_array_unref(self->entries);
+    g_array_unref(self->free_ids);
+    g_hash_table_unref(self->ids);
+    g_hash_table_unref(self->tags);
+    bitmap_free(self->all);
+    g_mutex_clear(&self->lock);
+
+    G_OBJECT_CLASS(sugar_tag_index_parent_class)->finalize(object);
+}
+
+static void
+sugar_tag_index_class_init(SugarTagIndexClass *index_class)
+{
+    GObjectClass *gobject_class = G_OBJECT_CLASS(index_class);
+
+    gobject_class->finalize = sugar_tag_index_finalize;
+}
+
+static void
+sugar_tag_index_init(SugarTagIndex *self)
+{
+    g_mutex_init(&self->lock);
+    self->entries = g_ptr_array_new();
+    self->free_ids = g_array_new(FALSE, FALSE, sizeof(guint32));
+    self->ids = g_hash_table_new(g_str_hash, g_str_equal);
+    self->tags = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, bitmap_free);
+    self->all = bitmap_new();
+    self->hook_id = _sugar_file_attributes_add_write_hook(on_write, self);
+}
+
+/**
+ * sugar_tag_index_new:
+ *
+ * Creates an empty tag index. Tags written through
+ * sugar_file_attributes_save_to_file(), sugar_file_attributes_save_at(),
+ * sugar_file_attributes_save_to_fd() and
+ * sugar_file_attributes_set_tags() are added or updated automatically,
+ * keyed by their local path. Saves through a descriptor whose file has
+ * no path left, such as an unlinked one, are not seen.
+ *
+ * Returns: (transfer full): A new #SugarTagIndex
+ */
+SugarTagIndex*
+sugar_tag_index_new(void)
+{
+    return g_object_new(SUGAR_TYPE_TAG_INDEX, NULL);
+}
+
+/**
+ * sugar_tag_index_add:
+ * @index: A #SugarTagIndex
+ * @path: Local path of the entry
+ * @tags: (nullable): Comma-separated tags, as in #SugarFileAttributes
+ *
+ * Adds an entry to the index, replacing an entry with the same path.
+ * Tags are compared without regard to case and surrounding whitespace.
+ */
+void
+sugar_tag_index_add(SugarTagIndex *index, const gchar *path, const gchar *tags)
+{
+    g_return_if_fail(SUGAR_IS_TAG_INDEX(index));
+    g_return_if_fail(path != NULL);
+
+    g_mutex_lock(&index->lock);
+    set_entry(index, path, tags);
+    g_mutex_unlock(&index->lock);
+}
+
+/**
+ * sugar_tag_index_remove:
+ * @index: A #SugarTagIndex
+ * @path: Local path of the entry
+ *
+ * Removes an entry from the index, if present.
+ */
+void
+sugar_tag_index_remove(SugarTagIndex *index, const gchar *path)
+{
+    g_return_if_fail(SUGAR_IS_TAG_INDEX(index));
+    g_return_if_fail(path != NULL);
+
+    g_mutex_lock(&index->lock);
+    drop_entry(index, path);
+    g_mutex_unlock(&index->lock);
+}
+
+/**
+ * sugar_tag_index_get_n_entries:
+ * @index: A #SugarTagIndex
+ *
+ * Gets the number of entries in the index, tagged or not.
+ *
+ * Returns: The number of entries
+ */
+guint
+sugar_tag_index_get_n_entries(SugarTagIndex *index)
+{
+    guint result;
+
+    g_return_val_if_fail(SUGAR_IS_TAG_INDEX(index), 0);
+
+    g_mutex_lock(&index->lock);
+    result = g_hash_table_size(index->ids);
+    g_mutex_unlock(&index->lock);
+
+    return result;
+}
+
+/**
+ * sugar_tag_index_get_tags:
+ * @index: A #SugarTagIndex
+ *
+ * Gets every tag used by at least one entry, in canonical form.
+ *
+ * Returns: (transfer full) (array zero-terminated=1): The sorted tags
+ */
+gchar**
+sugar_tag_index_get_tags(SugarTagIndex *index)
+{
+    GPtrArray *tags = g_ptr_array_new();
+    GHashTableIter iter;
+    gpointer tag;
+
+    g_return_val_if_fail(SUGAR_IS_TAG_INDEX(index), NULL);
+
+    g_mutex_lock(&index->lock);
+    g_hash_table_iter_init(&iter, index->tags);
+    while (g_hash_table_iter_next(&iter, &tag, NULL))
+        g_ptr_array_add(tags, g_strdup(tag));
+    g_mutex_unlock(&index->lock);
+
+    g_ptr_array_sort(tags, compare_tags);
+    g_ptr_array_add(tags, NULL);
+    return (gchar **) g_ptr_array_free(tags, FALSE);
+}
+
+/**
+ * sugar_tag_index_get_count:
+ * @index: A #SugarTagIndex
+ * @tag: A tag
+ *
+ * Gets the number of entries carrying @tag.
+ *
+ * Returns: The number of entries
+ */
+guint
+sugar_tag_index_get_count(SugarTagIndex *index, const gchar *tag)
+{
+    const Bitmap *bitmap;
+    guint result;
+
+    g_return_val_if_fail(SUGAR_IS_TAG_INDEX(index), 0);
+    g_return_val_if_fail(tag != NULL, 0);
+
+    g_mutex_lock(&index->lock);
+    bitmap = lookup_tag(index, tag);
+    result = bitmap ? bitmap_get_cardinality(bitmap) : 0;
+    g_mutex_unlock(&index->lock);
+
+    return result;
+}
+
+/**
+ * sugar_tag_index_query:
+ * @index: A #SugarTagIndex
+ * @all_of: (nullable) (array zero-terminated=1): Tags an entry must all have
+ * @any_of: (nullable) (array zero-terminated=1): Tags of which an entry must have one
+ * @none_of: (nullable) (array zero-terminated=1): Tags an entry must not have
+ *
+ * Finds the entries matching every given condition; empty or %NULL
+ * lists do not restrict the result.
+ *
+ * Returns: (transfer full) (array zero-terminated=1): Paths of the matching entries
+ */
+gchar**
+sugar_tag_index_query(SugarTagIndex       *index,
+                      const gchar * const *all_of,
+                      const gchar * const *any_of,
+                      const gchar * const *none_of)
+{
+    GPtrArray *results = g_ptr_array_new();
+    Bitmap *result = NULL;
+    const Bitmap *bitmap;
+
+    g_return_val_if_fail(SUGAR_IS_TAG_INDEX(index), NULL);
+
+    g_mutex_lock(&index->lock);
+
+    for (guint i = 0; all_of && all_of[i]; i++) {
+        bitmap = lookup_tag(index, all_of[i]);
+        if (!bitmap) {
+            g_clear_pointer(&result, bitmap_free);
+            result = bitmap_new();
+            break;
+        }
+        if (result)
+            bitmap_apply(&result, bitmap, OP_AND);
+        else
+            result = bitmap_copy(bitmap);
+    }
+
+    if (any_of && any_of[0]) {
+        Bitmap *any = bitmap_new();
+        for (guint i = 0; any_of[i]; i++) {
+            bitmap = lookup_tag(index, any_of[i]);
+            if (bitmap)
+                bitmap_apply(&any, bitmap, OP_OR);
+        }
+        if (result) {
+            bitmap_apply(&result, any, OP_AND);
+            bitmap_free(any);
+        } else {
+            result = any;
+        }
+    }
+
+    if (!result)
+        result = bitmap_copy(index->all);
+
+    for (guint i = 0; none_of && none_of[i]; i++) {
+        bitmap = lookup_tag(index, none_of[i]);
+        if (bitmap)
+            bitmap_apply(&result, bitmap, OP_ANDNOT);
+    }
+
+    for (guint i = 0; i < result->containers->len; i++) {
+        const Container *c = &g_array_index(result->containers, Container, i);
+        guint32 high = (guint32) c->key << 16;
+        guint16 *values = c->array;
+        guint32 n = c->cardinality;
+        // Walk bitmap containers through their array form
+        if (c->bits) {
+            values = g_new(guint16, n);
+            n = 0;
+            for (guint w = 0; w < BITMAP_WORDS; w++) {
+                for (guint64 word = c->bits[w]; word; word &= word - 1)
+                    values[n++] = w * 64 + __builtin_ctzll(word);
+            }
+        }
+
+        for (guint32 j = 0; j < n; j++) {
+            Entry *entry = index->entries->pdata[high | values[j]];
+            g_ptr_array_add(results, g_strdup(entry->path));
+        }
+
+        if (values != c->array)
+            g_free(values);
+    }
+
+    g_mutex_unlock(&index->lock);
+
+    bitmap_free(result);
+    g_ptr_array_add(results, NULL);
+    return (gchar **) g_ptr_array_free(results, FALSE);
+}
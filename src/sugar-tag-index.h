@@ -0,0 +1,52 @@
+/*
+ * Copyright (C) 2025 MostlyK
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __SUGAR_TAG_INDEX_H__
+#define __SUGAR_TAG_INDEX_H__
+
+#include <glib-object.h>
+
+G_BEGIN_DECLS
+
+typedef struct _SugarTagIndex SugarTagIndex;
+typedef struct _SugarTagIndexClass SugarTagIndexClass;
+
+#define SUGAR_TYPE_TAG_INDEX            (sugar_tag_index_get_type())
+#define SUGAR_TAG_INDEX(object)         (G_TYPE_CHECK_INSTANCE_CAST((object), SUGAR_TYPE_TAG_INDEX, SugarTagIndex))
+#define SUGAR_IS_TAG_INDEX(object)      (G_TYPE_CHECK_INSTANCE_TYPE((object), SUGAR_TYPE_TAG_INDEX))
+
+GType          sugar_tag_index_get_type      (void);
+SugarTagIndex *sugar_tag_index_new           (void);
+void           sugar_tag_index_add           (SugarTagIndex      *index,
+                                              const gchar        *path,
+                                              const gchar        *tags);
+void           sugar_tag_index_remove        (SugarTagIndex      *index,
+                                              const gchar        *path);
+guint          sugar_tag_index_get_n_entries (SugarTagIndex      *index);
+gchar        **sugar_tag_index_get_tags      (SugarTagIndex      *index);
+guint          sugar_tag_index_get_count     (SugarTagIndex      *index,
+                                              const gchar        *tag);
+gchar        **sugar_tag_index_query         (SugarTagIndex      *index,
+                                              const gchar * const *all_of,
+                                              const gchar * const *any_of,
+                                              const gchar * const *none_of);
+
+G_END_DECLS
+
+#endif /* __SUGAR_TAG_INDEX_H__ */
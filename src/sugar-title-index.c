@@ -0,0 +1,547 @@
+/*
+ * Copyright (C) 2025 MostlyK
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include "sugar-title-index.h"
+#include "sugar-file-attributes-private.h"
+#include <string.h>
+
+/*
+ * Substring search over titles for search-as-you-type. Every folded
+ * title is split into overlapping trigrams of characters, and each
+ * trigram maps to the ascending list of entry ids containing it. A
+ * query's candidates are the intersection of its trigram lists; they
+ * are only checked against the titles as pages of results are asked
+ * for.
+ *
+ * When a query extends the previous one, every match of the new query
+ * was a candidate of the old one, so the search continues from the
+ * old candidates that were not ruled out instead of starting over.
+ *
+ * Changed entries get a new id and leave a tombstone, as in the
+ * full-text index, so the lists stay sorted by appending.
+ */
+#define MIN_COMPACT_TOMBSTONES 1024
+
+typedef struct {
+    gchar *path;
+    gchar *folded;
+} Entry;
+
+typedef struct {
+    guint64 trigram;
+    GArray *ids;
+} Posting;
+
+struct _SugarTitleIndex {
+    GObject parent_instance;
+
+    GMutex lock;
+    GPtrArray *entries;
+    GHashTable *ids;
+    GHashTable *postings;
+    guint n_live;
+    guint hook_id;
+
+    // Search state of the current query
+    gchar *query;
+    gboolean candidates_valid;
+    GArray *candidates;
+    guint n_checked;
+    GArray *matches;
+};
+
+struct _SugarTitleIndexClass {
+    GObjectClass parent_class;
+};
+
+G_DEFINE_TYPE(SugarTitleIndex, sugar_title_index, G_TYPE_OBJECT)
+
+static void
+entry_free(Entry *entry)
+{
+    g_free(entry->path);
+    g_free(entry->folded);
+    g_free(entry);
+}
+
+static void
+posting_free(gpointer data)
+{
+    Posting *posting = data;
+
+    g_array_unref(posting->ids);
+    g_free(posting);
+}
+
+/*
+ * Calls @func for each trigram of @folded, packing three 21-bit code
+ * points into one integer.
+ */
+static void
+foreach_trigram(const gchar *folded, void (*func)(guint64 trigram, gpointer data), gpointer data)
+{
+    guint64 trigram = 0;
+    guint n_chars = 0;
+
+    for (const gchar *p = folded; *p; p = g_utf8_next_char(p)) {
+        trigram = ((trigram << 21) | g_utf8_get_char(p)) & ((G_GUINT64_CONSTANT(1) << 63) - 1);
+        if (++n_chars >= 3)
+            func(trigram, data);
+    }
+}
+
+typedef struct {
+    SugarTitleIndex *self;
+    guint32 id;
+} AddTrigram;
+
+static void
+add_trigram(guint64 trigram, gpointer data)
+{
+    AddTrigram *add = data;
+    Posting *posting = g_hash_table_lookup(add->self->postings, &trigram);
+
+    if (!posting) {
+        posting = g_new0(Posting, 1);
+        posting->trigram = trigram;
+        posting->ids = g_array_new(FALSE, FALSE, sizeof(guint32));
+        g_hash_table_insert(add->self->postings, &posting->trigram, posting);
+    }
+
+    // A trigram repeated within a title is listed once
+    if (posting->ids->len == 0 || g_array_index(posting->ids, guint32, posting->ids->len - 1) != add->id)
+        g_array_append_val(posting->ids, add->id);
+}
+
+static void
+index_entry(SugarTitleIndex *self, Entry *entry)
+{
+    AddTrigram add = { self, self->entries->len };
+
+    g_ptr_array_add(self->entries, entry);
+    g_hash_table_insert(self->ids, entry->path, GUINT_TO_POINTER(add.id));
+    foreach_trigram(entry->folded, add_trigram, &add);
+}
+
+static void
+drop_entry(SugarTitleIndex *self, const gchar *path)
+{
+    gpointer id;
+    Entry *entry;
+
+    if (!g_hash_table_lookup_extended(self->ids, path, NULL, &id))
+        return;
+
+    entry = self->entries->pdata[GPOINTER_TO_UINT(id)];
+    g_hash_table_remove(self->ids, path);
+    self->entries->pdata[GPOINTER_TO_UINT(id)] = NULL;
+    entry_free(entry);
+    self->n_live--;
+}
+
+static void
+maybe_compact(SugarTitleIndex *self)
+{
+    GPtrArray *entries = self->entries;
+
+    if (entries->len - self->n_live < MAX(self->n_live, MIN_COMPACT_TOMBSTONES))
+        return;
+
+    self->entries = g_ptr_array_sized_new(self->n_live);
+    g_hash_table_remove_all(self->ids);
+    g_hash_table_remove_all(self->postings);
+
+    for (guint i = 0; i < entries->len; i++) {
+        if (entries->pdata[i])
+            index_entry(self, entries->pdata[i]);
+    }
+
+    g_ptr_array_unref(entries);
+}
+
+// Ids changed, so the current query starts over on the next request
+static void
+reset_search(SugarTitleIndex *self)
+{
+    self->candidates_valid = FALSE;
+    g_array_set_size(self->candidates, 0);
+    g_array_set_size(self->matches, 0);
+    self->n_checked = 0;
+}
+
+static void
+set_entry(SugarTitleIndex *self, const gchar *path, const gchar *title)
+{
+    Entry *entry = g_new0(Entry, 1);
+
+    entry->path = g_strdup(path);
+    entry->folded = _sugar_text_fold(title);
+    if (!entry->folded) entry->folded = g_strdup("");
+
+    drop_entry(self, path);
+    index_entry(self, entry);
+    self->n_live++;
+    maybe_compact(self);
+    reset_search(self);
+}
+
+// Keeps the ids of @candidates that are also in @ids; both are sorted
+static void
+intersect_ids(GArray *candidates, GArray *ids)
+{
+    guint i = 0, j = 0, n = 0;
+
+    while (i < candidates->len && j < ids->len) {
+        guint32 a = g_array_index(candidates, guint32, i);
+        guint32 b = g_array_index(ids, guint32, j);
+
+        if (a < b) {
+            i++;
+        } else if (a > b) {
+            j++;
+        } else {
+            g_array_index(candidates, guint32, n++) = a;
+            i++;
+            j++;
+        }
+    }
+
+    g_array_set_size(candidates, n);
+}
+
+typedef struct {
+    SugarTitleIndex *self;
+    GPtrArray *lists;
+    gboolean missing;
+} CollectTrigrams;
+
+static void
+collect_trigram(guint64 trigram, gpointer data)
+{
+    CollectTrigrams *collect = data;
+    Posting *posting = g_hash_table_lookup(collect->self->postings, &trigram);
+
+    if (posting)
+        g_ptr_array_add(collect->lists, posting->ids);
+    else
+        collect->missing = TRUE;
+}
+
+static gint
+compare_list_lengths(gconstpointer a, gconstpointer b)
+{
+    const GArray *la = *(GArray * const *) a;
+    const GArray *lb = *(GArray * const *) b;
+
+    return (gint) la->len - (gint) lb->len;
+}
+
+/*
+ * Narrows self->candidates down to the entries containing every
+ * trigram of @query. With @from_scratch the candidates are first set to
+ * all live entries.
+ */
+static void
+filter_candidates(SugarTitleIndex *self, const gchar *query, gboolean from_scratch)
+{
+    CollectTrigrams collect = { self, g_ptr_array_new(), FALSE };
+    guint first = 0;
+
+    foreach_trigram(query, collect_trigram, &collect);
+    g_ptr_array_sort(collect.lists, compare_list_lengths);
+
+    if (collect.missing) {
+        g_array_set_size(self->candidates, 0);
+    } else if (from_scratch && collect.lists->len > 0) {
+        // Start from the shortest list
+        GArray *shortest = collect.lists->pdata[0];
+        g_array_set_size(self->candidates, 0);
+        g_array_append_vals(self->candidates, shortest->data, shortest->len);
+        first = 1;
+    } else if (from_scratch) {
+        // Queries under three characters check every title
+        g_array_set_size(self->candidates, 0);
+        for (guint32 id = 0; id < self->entries->len; id++) {
+            if (self->entries->pdata[id])
+                g_array_append_val(self->candidates, id);
+        }
+    }
+
+    for (guint i = first; i < collect.lists->len && self->candidates->len > 0; i++)
+        intersect_ids(self->candidates, collect.lists->pdata[i]);
+
+    g_ptr_array_unref(collect.lists);
+}
+
+// Checks candidates until @n_wanted matches are known or none remain
+static void
+check_candidates(SugarTitleIndex *self, guint n_wanted)
+{
+    if (!self->candidates_valid) {
+        filter_candidates(self, self->query, TRUE);
+        self->candidates_valid = TRUE;
+    }
+
+    while (self->matches->len < n_wanted && self->n_checked < self->candidates->len) {
+        guint32 id = g_array_index(self->candidates, guint32, self->n_checked++);
+        Entry *entry = self->entries->pdata[id];
+
+        if (entry && strstr(entry->folded, self->query))
+            g_array_append_val(self->matches, id);
+    }
+}
+
+static void
+on_write(const gchar               *path,
+         const SugarFileAttributes *attrs,
+         SugarWriteFields           fields,
+         gpointer                   user_data)
+{
+    SugarTitleIndex *self = user_data;
+
+    if (!(fields & SUGAR_WRITE_TITLE))
+        return;
+
+    g_mutex_lock(&self->lock);
+    set_entry(self, path, attrs->title);
+    g_mutex_unlock(&self->lock);
+}
+
+static void
+sugar_title_index_finalize(GObject *object)
+{
+    SugarTitleIndex *self = SUGAR_TITLE_INDEX(object);
+
+    _sugar_file_attributes_remove_write_hook(self->hook_id);
+
+    for (guint i = 0; i < self->entries->len; i++) {
+        if (self->entries->pdata[i])
+            entry_free(self->entries->pdata[i]);
+    }
+    g_ptr_array_unref(self->entries);
+    g_hash_table_unref(self->ids);
+    g_hash_table_unref(self->postings);
+    g_array_unref(self->candidates);
+    g_array_unref(self->matches);
+    g_free(self->query);
+    g_mutex_clear(&self->lock);
+
+    G_OBJECT_CLASS(sugar_title_index_parent_class)->finalize(object);
+}
+
+static void
+sugar_title_index_class_init(SugarTitleIndexClass *index_class)
+{
+    GObjectClass *gobject_class = G_OBJECT_CLASS(index_class);
+
+    gobject_class->finalize = sugar_title_index_finalize;
+}
+
+static void
+sugar_title_index_init(SugarTitleIndex *self)
+{
+    g_mutex_init(&self->lock);
+    self->entries = g_ptr_array_new();
+    self->ids = g_hash_table_new(g_str_hash, g_str_equal);
+    self->postings = g_hash_table_new_full(g_int64_hash, g_int64_equal, NULL, posting_free);
+    self->query = g_strdup("");
+    self->candidates = g_array_new(FALSE, FALSE, sizeof(guint32));
+    self->matches = g_array_new(FALSE, FALSE, sizeof(guint32));
+    self->hook_id = _sugar_file_attributes_add_write_hook(on_write, self);
+}
+
+/**
+ * sugar_title_index_new:
+ *
+ * Creates an empty substring index over titles. Titles written through
+ * sugar_file_attributes_save_to_file(), sugar_file_attributes_save_at(),
+ * sugar_file_attributes_save_to_fd() and
+ * sugar_file_attributes_set_title() are added or updated
+ * automatically, keyed by their local path. Saves through a descriptor
+ * whose file has no path left, such as an unlinked one, are not seen.
+ *
+ * Returns: (transfer full): A new #SugarTitleIndex
+ */
+SugarTitleIndex*
+sugar_title_index_new(void)
+{
+    return g_object_new(SUGAR_TYPE_TITLE_INDEX, NULL);
+}
+
+/**
+ * sugar_title_index_add:
+ * @index: A #SugarTitleIndex
+ * @path: Local path of the entry
+ * @title: (nullable): Title of the entry
+ *
+ * Adds an entry to the index, replacing an entry with the same path.
+ */
+void
+sugar_title_index_add(SugarTitleIndex *index, const gchar *path, const gchar *title)
+{
+    g_return_if_fail(SUGAR_IS_TITLE_INDEX(index));
+    g_return_if_fail(path != NULL);
+
+    g_mutex_lock(&index->lock);
+    set_entry(index, path, title);
+    g_mutex_unlock(&index->lock);
+}
+
+/**
+ * sugar_title_index_remove:
+ * @index: A #SugarTitleIndex
+ * @path: Local path of the entry
+ *
+ * Removes an entry from the index, if present.
+ */
+void
+sugar_title_index_remove(SugarTitleIndex *index, const gchar *path)
+{
+    g_return_if_fail(SUGAR_IS_TITLE_INDEX(index));
+    g_return_if_fail(path != NULL);
+
+    g_mutex_lock(&index->lock);
+    if (g_hash_table_contains(index->ids, path)) {
+        drop_entry(index, path);
+        maybe_compact(index);
+        reset_search(index);
+    }
+    g_mutex_unlock(&index->lock);
+}
+
+/**
+ * sugar_title_index_get_n_entries:
+ * @index: A #SugarTitleIndex
+ *
+ * Gets the number of entries in the index.
+ *
+ * Returns: The number of entries
+ */
+guint
+sugar_title_index_get_n_entries(SugarTitleIndex *index)
+{
+    guint result;
+
+    g_return_val_if_fail(SUGAR_IS_TITLE_INDEX(index), 0);
+
+    g_mutex_lock(&index->lock);
+    result = index->n_live;
+    g_mutex_unlock(&index->lock);
+
+    return result;
+}
+
+/**
+ * sugar_title_index_set_query:
+ * @index: A #SugarTitleIndex
+ * @query: Text to find anywhere in the titles
+ *
+ * Starts a search for titles containing @query, ignoring case and
+ * compatibility differences. No title is checked until results are
+ * requested. When @query contains the previous query, as it does while
+ * the user types, the search narrows the previous candidates.
+ */
+void
+sugar_title_index_set_query(SugarTitleIndex *index, const gchar *query)
+{
+    gchar *folded;
+
+    g_return_if_fail(SUGAR_IS_TITLE_INDEX(index));
+    g_return_if_fail(query != NULL);
+
+    folded = _sugar_text_fold(query);
+    if (!folded) folded = g_strdup("");
+
+    g_mutex_lock(&index->lock);
+
+    if (index->candidates_valid && strstr(folded, index->query)) {
+        // Matches so far and unchecked candidates stay in id order
+        g_array_append_vals(index->matches,
+                            &g_array_index(index->candidates, guint32, index->n_checked),
+                            index->candidates->len - index->n_checked);
+        g_array_set_size(index->candidates, 0);
+        g_array_append_vals(index->candidates, index->matches->data, index->matches->len);
+        g_array_set_size(index->matches, 0);
+        index->n_checked = 0;
+        filter_candidates(index, folded, FALSE);
+    } else {
+        reset_search(index);
+    }
+
+    g_free(index->query);
+    index->query = folded;
+
+    g_mutex_unlock(&index->lock);
+}
+
+/**
+ * sugar_title_index_get_results:
+ * @index: A #SugarTitleIndex
+ * @offset: Number of matches to skip
+ * @n_results: Maximum number of matches to return
+ *
+ * Gets a page of entries matching the current query, in the order they
+ * were added. Only as many titles are checked as the page needs.
+ *
+ * Returns: (transfer full) (array zero-terminated=1): Paths of the matching entries
+ */
+gchar**
+sugar_title_index_get_results(SugarTitleIndex *index, guint offset, guint n_results)
+{
+    GPtrArray *results = g_ptr_array_new();
+
+    g_return_val_if_fail(SUGAR_IS_TITLE_INDEX(index), NULL);
+
+    g_mutex_lock(&index->lock);
+
+    check_candidates(index, offset + MIN(n_results, G_MAXUINT - offset));
+    for (guint i = offset; i < index->matches->len && i - offset < n_results; i++) {
+        Entry *entry = index->entries->pdata[g_array_index(index->matches, guint32, i)];
+        g_ptr_array_add(results, g_strdup(entry->path));
+    }
+
+    g_mutex_unlock(&index->lock);
+
+    g_ptr_array_add(results, NULL);
+    return (gchar **) g_ptr_array_free(results, FALSE);
+}
+
+/**
+ * sugar_title_index_get_n_results:
+ * @index: A #SugarTitleIndex
+ *
+ * Gets the number of entries matching the current query. This checks
+ * every remaining candidate.
+ *
+ * Returns: The number of matches
+ */
+guint
+sugar_title_index_get_n_results(SugarTitleIndex *index)
+{
+    guint result;
+
+    g_return_val_if_fail(SUGAR_IS_TITLE_INDEX(index), 0);
+
+    g_mutex_lock(&index->lock);
+    check_candidates(index, G_MAXUINT);
+    result = index->matches->len;
+    g_mutex_unlock(&index->lock);
+
+    return result;
+}
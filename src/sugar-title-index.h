@@ -0,0 +1,51 @@
+/*
+ * Copyright (C) 2025 MostlyK
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __SUGAR_TITLE_INDEX_H__
+#define __SUGAR_TITLE_INDEX_H__
+
+#include <glib-object.h>
+
+G_BEGIN_DECLS
+
+typedef struct _SugarTitleIndex SugarTitleIndex;
+typedef struct _SugarTitleIndexClass SugarTitleIndexClass;
+
+#define SUGAR_TYPE_TITLE_INDEX            (sugar_title_index_get_type())
+#define SUGAR_TITLE_INDEX(object)         (G_TYPE_CHECK_INSTANCE_CAST((object), SUGAR_TYPE_TITLE_INDEX, SugarTitleIndex))
+#define SUGAR_IS_TITLE_INDEX(object)      (G_TYPE_CHECK_INSTANCE_TYPE((object), SUGAR_TYPE_TITLE_INDEX))
+
+GType            sugar_title_index_get_type      (void);
+SugarTitleIndex *sugar_title_index_new           (void);
+void             sugar_title_index_add           (SugarTitleIndex *index,
+                                                  const gchar     *path,
+                                                  const gchar     *title);
+void             sugar_title_index_remove        (SugarTitleIndex *index,
+                                                  const gchar     *path);
+guint            sugar_title_index_get_n_entries (SugarTitleIndex *index);
+void             sugar_title_index_set_query     (SugarTitleIndex *index,
+                                                  const gchar     *query);
+gchar          **sugar_title_index_get_results   (SugarTitleIndex *index,
+                                                  guint            offset,
+                                                  guint            n_results);
+guint            sugar_title_index_get_n_results (SugarTitleIndex *index);
+
+G_END_DECLS
+
+#endif /* __SUGAR_TITLE_INDEX_H__ */
@@ -0,0 +1,309 @@
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <sugar-ext.h>
+#include <gio/gio.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <sys/xattr.h>
+#include <unistd.h>
+
+static void write_entry(const gchar *dir, const gchar *name, const gchar *title) {
+    gchar *path = g_build_filename(dir, name, NULL);
+    g_assert_true(g_file_set_contents(path, "", 0, NULL));
+
+    GFile *file = g_file_new_for_path(path);
+    SugarFileAttributes *attrs = sugar_file_attributes_new();
+    attrs->title = g_strdup(title);
+    attrs->activity = g_strdup("org.laptop.Write");
+    g_assert_true(sugar_file_attributes_save_to_file(attrs, file, NULL));
+
+    sugar_file_attributes_free(attrs);
+    g_object_unref(file);
+    g_free(path);
+}
+
+static gchar *create_temp_tree(void) {
+    gchar *dir = g_dir_make_tmp("sugar_index_XXXXXX", NULL);
+    if (!dir) return NULL;
+
+    // Probe for user xattr support on the temp directory
+    if (setxattr(dir, "user.sugar.probe", "1", 1, 0) != 0) {
+        g_rmdir(dir);
+        g_free(dir);
+        return NULL;
+    }
+
+    gchar *sub = g_build_filename(dir, "sub", NULL);
+    g_mkdir(sub, 0700);
+    g_free(sub);
+
+    write_entry(dir, "b", "Second");
+    write_entry(dir, "a", "First");
+    write_entry(dir, "sub/c", "Nested");
+    write_entry(dir, ".hidden", "Hidden");
+    return dir;
+}
+
+static void remove_temp_tree(gchar *dir) {
+    const gchar *names[] = { "a", "b", "sub/c", ".hidden", "index", "sub", NULL };
+    for (int i = 0; names[i]; i++) {
+        gchar *path = g_build_filename(dir, names[i], NULL);
+        g_remove(path);
+        g_free(path);
+    }
+    g_rmdir(dir);
+    g_free(dir);
+}
+
+static void test_index_update(void) {
+    gchar *dir = create_temp_tree();
+    if (!dir) {
+        g_test_skip("Extended attributes not supported on this filesystem");
+        return;
+    }
+
+    GFile *root = g_file_new_for_path(dir);
+    gchar *filename = g_build_filename(dir, "index", NULL);
+    GError *error = NULL;
+
+    // A missing index file is an empty index
+    SugarAttributeIndex *index = sugar_attribute_index_new(filename, &error);
+    g_assert_no_error(error);
+    g_assert_cmpuint(sugar_attribute_index_get_n_entries(index), ==, 0);
+
+    g_assert_true(sugar_attribute_index_update(index, root, &error));
+    g_assert_no_error(error);
+
+    // Hidden files and the index itself are left out, entries are sorted
+    g_assert_cmpuint(sugar_attribute_index_get_n_entries(index), ==, 3);
+    g_assert_cmpstr(sugar_attribute_index_get_path(index, 0), ==, "a");
+    g_assert_cmpstr(sugar_attribute_index_get_path(index, 1), ==, "b");
+    g_assert_cmpstr(sugar_attribute_index_get_path(index, 2), ==, "sub/c");
+
+    SugarFileAttributes *attrs = sugar_attribute_index_get_attributes(index, 2);
+    g_assert_cmpstr(attrs->title, ==, "Nested");
+    g_assert_cmpstr(attrs->activity, ==, "org.laptop.Write");
+    g_assert_null(attrs->description);
+    sugar_file_attributes_free(attrs);
+
+    gchar *path = g_build_filename(dir, "b", NULL);
+    struct stat st;
+    g_assert_cmpint(stat(path, &st), ==, 0);
+    g_assert_cmpint(sugar_attribute_index_lookup(index, st.st_dev, st.st_ino), ==, 1);
+    g_assert_cmpint(sugar_attribute_index_lookup(index, st.st_dev, st.st_ino + 1000000), ==, -1);
+    g_object_unref(index);
+
+    // Reopening serves the entries without touching the tree
+    index = sugar_attribute_index_new(filename, &error);
+    g_assert_no_error(error);
+    g_assert_cmpuint(sugar_attribute_index_get_n_entries(index), ==, 3);
+    attrs = sugar_attribute_index_get_attributes(index, 0);
+    g_assert_cmpstr(attrs->title, ==, "First");
+    sugar_file_attributes_free(attrs);
+
+    // Changed files are picked up by their ctime
+    g_usleep(20 * G_TIME_SPAN_MILLISECOND);
+    GFile *file = g_file_new_for_path(path);
+    g_assert_true(sugar_file_attributes_set_title(file, "Renamed"));
+    g_object_unref(file);
+    g_usleep(20 * G_TIME_SPAN_MILLISECOND);
+
+    g_assert_true(sugar_attribute_index_update(index, root, &error));
+    g_assert_no_error(error);
+    attrs = sugar_attribute_index_get_attributes(index, 1);
+    g_assert_cmpstr(attrs->title, ==, "Renamed");
+    sugar_file_attributes_free(attrs);
+
+    // An unchanged tree does not rewrite the index
+    struct stat before, after;
+    g_assert_cmpint(stat(filename, &before), ==, 0);
+    g_assert_true(sugar_attribute_index_update(index, root, &error));
+    g_assert_no_error(error);
+    g_assert_cmpint(stat(filename, &after), ==, 0);
+    g_assert_cmpuint(before.st_ino, ==, after.st_ino);
+
+    // Removed files drop out
+    g_remove(path);
+    g_assert_true(sugar_attribute_index_update(index, root, &error));
+    g_assert_cmpuint(sugar_attribute_index_get_n_entries(index), ==, 2);
+    g_assert_cmpstr(sugar_attribute_index_get_path(index, 1), ==, "sub/c");
+
+    g_object_unref(index);
+    g_object_unref(root);
+    g_free(path);
+    g_free(filename);
+    remove_temp_tree(dir);
+}
+
+static void test_index_damaged(void) {
+    gchar *filename = NULL;
+    gint fd = g_file_open_tmp("sugar_index_XXXXXX", &filename, NULL);
+    g_assert_cmpint(fd, >=, 0);
+    close(fd);
+
+    // A truncated or foreign file is treated as empty, not as an error
+    const gchar damaged[] = "SGAIDX01\001\000\000";
+    g_assert_true(g_file_set_contents(filename, damaged, sizeof(damaged) - 1, NULL));
+
+    GError *error = NULL;
+    SugarAttributeIndex *index = sugar_attribute_index_new(filename, &error);
+    g_assert_no_error(error);
+    g_assert_cmpuint(sugar_attribute_index_get_n_entries(index), ==, 0);
+    g_assert_cmpint(sugar_attribute_index_lookup(index, 0, 0), ==, -1);
+
+    g_object_unref(index);
+    g_remove(filename);
+    g_free(filename);
+}
+
+static void test_index_sidecar(void) {
+    gchar *dir = g_dir_make_tmp("sugar_index_XXXXXX", NULL);
+    g_assert_nonnull(dir);
+    gchar *path = g_build_filename(dir, "entry", NULL);
+    gchar *sidecar_path = g_build_filename(dir, ".sugar-metadata", NULL);
+    g_assert_true(g_file_set_contents(path, "", 0, NULL));
+
+    // Only file systems without user xattrs fall back to the sidecar
+    if (setxattr(path, "user.sugar.probe", "1", 1, 0) == 0) {
+        g_test_skip("Extended attributes supported, the sidecar store is not used");
+        g_remove(path);
+        g_rmdir(dir);
+        g_free(sidecar_path);
+        g_free(path);
+        g_free(dir);
+        return;
+    }
+
+    GFile *file = g_file_new_for_path(path);
+    g_assert_true(sugar_file_attributes_set_title(file, "Before"));
+    g_assert_true(g_file_test(sidecar_path, G_FILE_TEST_IS_REGULAR));
+
+    gchar *filename = NULL;
+    gint fd = g_file_open_tmp("sugar_index_XXXXXX", &filename, NULL);
+    g_assert_cmpint(fd, >=, 0);
+    close(fd);
+
+    // Past the timestamp tick, so the entry's record counts as current
+    g_usleep(50000);
+    GFile *root = g_file_new_for_path(dir);
+    GError *error = NULL;
+    SugarAttributeIndex *index = sugar_attribute_index_new(filename, &error);
+    g_assert_no_error(error);
+    g_assert_true(sugar_attribute_index_update(index, root, &error));
+    g_assert_no_error(error);
+    g_usleep(50000);
+
+    // The entry's ctime stays put, only the sidecar changes
+    g_assert_true(sugar_file_attributes_set_title(file, "After"));
+    g_assert_true(sugar_attribute_index_update(index, root, &error));
+    g_assert_no_error(error);
+
+    g_assert_cmpuint(sugar_attribute_index_get_n_entries(index), ==, 1);
+    SugarFileAttributes *attrs = sugar_attribute_index_get_attributes(index, 0);
+    g_assert_cmpstr(attrs->title, ==, "After");
+    sugar_file_attributes_free(attrs);
+
+    g_object_unref(index);
+    g_object_unref(root);
+    g_object_unref(file);
+    g_remove(filename);
+    g_free(filename);
+    g_remove(sidecar_path);
+    g_remove(path);
+    g_rmdir(dir);
+    g_free(sidecar_path);
+    g_free(path);
+    g_free(dir);
+}
+
+// Makes the blobs of @dir look two hours old, past the age a sweep waits for
+static guint age_blobs(const gchar *dir) {
+    gchar *blobs_path = g_build_filename(dir, ".sugar-blobs", NULL);
+    GDir *blobs = g_dir_open(blobs_path, 0, NULL);
+    struct timespec times[2] = { { time(NULL) - 7200, 0 }, { time(NULL) - 7200, 0 } };
+    const gchar *name;
+    guint n_blobs = 0;
+
+    while (blobs && (name = g_dir_read_name(blobs)) != NULL) {
+        gchar *blob_path = g_build_filename(blobs_path, name, NULL);
+        g_assert_cmpint(utimensat(AT_FDCWD, blob_path, times, 0), ==, 0);
+        g_free(blob_path);
+        n_blobs++;
+    }
+
+    if (blobs) g_dir_close(blobs);
+    g_free(blobs_path);
+    return n_blobs;
+}
+
+static void test_index_blob_sweep(void) {
+    gchar *dir = create_temp_tree();
+    if (!dir) {
+        g_test_skip("Extended attributes not supported on this filesystem");
+        return;
+    }
+
+    gchar *filename = NULL;
+    gint fd = g_file_open_tmp("sugar_index_XXXXXX", &filename, NULL);
+    g_assert_cmpint(fd, >=, 0);
+    close(fd);
+
+    gchar *path = g_build_filename(dir, "a", NULL);
+    GFile *file = g_file_new_for_path(path);
+    gchar *old_text = g_strnfill(2000, 'o');
+    gchar *new_text = g_strnfill(2000, 'n');
+    g_assert_true(sugar_file_attributes_set_description(file, old_text));
+    g_assert_true(sugar_file_attributes_set_description(file, new_text));
+    g_assert_cmpuint(age_blobs(dir), ==, 2);
+
+    GFile *root = g_file_new_for_path(dir);
+    GError *error = NULL;
+    SugarAttributeIndex *index = sugar_attribute_index_new(filename, &error);
+    g_assert_no_error(error);
+
+    // Only the blob of the current description is still referred to
+    g_assert_true(sugar_attribute_index_update(index, root, &error));
+    g_assert_no_error(error);
+    g_assert_cmpuint(age_blobs(dir), ==, 1);
+    gchar *description = sugar_file_attributes_get_description(file);
+    g_assert_cmpstr(description, ==, new_text);
+    g_free(description);
+
+    // Blobs younger than the sweep age may belong to a save in progress
+    g_assert_true(sugar_file_attributes_set_description(file, old_text));
+    g_assert_true(sugar_file_attributes_set_description(file, "Short"));
+    g_assert_true(sugar_attribute_index_update(index, root, &error));
+    g_assert_no_error(error);
+    g_assert_cmpuint(age_blobs(dir), ==, 1);
+
+    g_assert_true(sugar_file_attributes_set_description(file, "Shorter"));
+    g_assert_true(sugar_attribute_index_update(index, root, &error));
+    g_assert_no_error(error);
+    g_assert_cmpuint(age_blobs(dir), ==, 0);
+
+    gchar *blobs_path = g_build_filename(dir, ".sugar-blobs", NULL);
+    g_rmdir(blobs_path);
+    g_free(blobs_path);
+
+    g_object_unref(index);
+    g_object_unref(root);
+    g_object_unref(file);
+    g_free(new_text);
+    g_free(old_text);
+    g_free(path);
+    g_remove(filename);
+    g_free(filename);
+    remove_temp_tree(dir);
+}
+
+int main(int argc, char *argv[]) {
+    g_test_init(&argc, &argv, NULL);
+
+    g_test_add_func("/sugar/attribute-index/update", test_index_update);
+    g_test_add_func("/sugar/attribute-index/damaged", test_index_damaged);
+    g_test_add_func("/sugar/attribute-index/sidecar", test_index_sidecar);
+    g_test_add_func("/sugar/attribute-index/blob-sweep", test_index_blob_sweep);
+
+    return g_test_run();
+}
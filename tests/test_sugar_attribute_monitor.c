@@ -0,0 +1,140 @@
+#include <glib.h>
+#include <sugar-ext.h>
+#include <gio/gio.h>
+#include <glib/gstdio.h>
+
+typedef struct {
+    guint n_signals;
+    GHashTable *titles;
+} Changes;
+
+// Keeps the latest title of every reported entry, NULL for removed ones
+static void on_attributes_changed(SugarAttributeMonitor *monitor, gchar **names, GPtrArray *attributes, gpointer user_data) {
+    Changes *changes = user_data;
+
+    g_assert_cmpuint(g_strv_length(names), ==, attributes->len);
+
+    for (guint i = 0; names[i]; i++) {
+        SugarFileAttributes *attrs = attributes->pdata[i];
+        g_hash_table_replace(changes->titles, g_strdup(names[i]),
+                             attrs ? g_strdup(attrs->title ? attrs->title : "") : NULL);
+    }
+
+    changes->n_signals++;
+}
+
+static void wait_for_signals(Changes *changes, guint n_signals) {
+    gint64 deadline = g_get_monotonic_time() + 5 * G_USEC_PER_SEC;
+
+    while (changes->n_signals < n_signals && g_get_monotonic_time() < deadline)
+        g_main_context_iteration(NULL, FALSE);
+}
+
+static void settle(guint delay_ms) {
+    gint64 deadline = g_get_monotonic_time() + delay_ms * 1000;
+
+    while (g_get_monotonic_time() < deadline)
+        g_main_context_iteration(NULL, FALSE);
+}
+
+static void create_entry(const gchar *dir_path, const gchar *name) {
+    gchar *path = g_build_filename(dir_path, name, NULL);
+    GFile *file = g_file_new_for_path(path);
+
+    g_assert_true(g_file_set_contents(path, "", 0, NULL));
+    g_assert_true(sugar_file_attributes_set_title(file, name));
+
+    g_object_unref(file);
+    g_free(path);
+}
+
+static void remove_directory(const gchar *dir_path) {
+    GDir *dir = g_dir_open(dir_path, 0, NULL);
+    const gchar *name;
+
+    while ((name = g_dir_read_name(dir)) != NULL) {
+        gchar *path = g_build_filename(dir_path, name, NULL);
+        g_unlink(path);
+        g_free(path);
+    }
+
+    g_dir_close(dir);
+    g_rmdir(dir_path);
+}
+
+static void test_attribute_monitor(void) {
+    gchar *dir_path = g_dir_make_tmp("sugar_test_monitor_XXXXXX", NULL);
+    GFile *directory = g_file_new_for_path(dir_path);
+    Changes changes = { 0, g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free) };
+    SugarAttributeMonitor *monitor;
+    GError *error = NULL;
+    gchar *path;
+
+    monitor = sugar_attribute_monitor_new(directory, &error);
+    g_assert_no_error(error);
+    g_assert_true(sugar_attribute_monitor_get_directory(monitor) == directory);
+    g_assert_cmpuint(sugar_attribute_monitor_get_delay(monitor), ==, 200);
+    sugar_attribute_monitor_set_delay(monitor, 100);
+    g_signal_connect(monitor, "attributes-changed", G_CALLBACK(on_attributes_changed), &changes);
+
+    // A new entry is reported with its attributes
+    create_entry(dir_path, "entry-single");
+    wait_for_signals(&changes, 1);
+    g_assert_cmpuint(changes.n_signals, ==, 1);
+    g_assert_cmpstr(g_hash_table_lookup(changes.titles, "entry-single"), ==, "entry-single");
+
+    // A burst of changes is reloaded once and reported together
+    g_hash_table_remove_all(changes.titles);
+    for (guint i = 0; i < 20; i++) {
+        gchar *name = g_strdup_printf("entry-%02u", i);
+        create_entry(dir_path, name);
+        g_free(name);
+    }
+    path = g_build_filename(dir_path, ".hidden", NULL);
+    g_assert_true(g_file_set_contents(path, "", 0, NULL));
+    g_free(path);
+
+    wait_for_signals(&changes, 2);
+    settle(300);
+    g_assert_cmpuint(changes.n_signals, ==, 2);
+    g_assert_cmpstr(g_hash_table_lookup(changes.titles, "entry-00"), ==, "entry-00");
+    g_assert_cmpstr(g_hash_table_lookup(changes.titles, "entry-19"), ==, "entry-19");
+    g_assert_false(g_hash_table_contains(changes.titles, ".hidden"));
+
+    // Removed entries come without attributes
+    g_hash_table_remove_all(changes.titles);
+    path = g_build_filename(dir_path, "entry-single", NULL);
+    g_unlink(path);
+    g_free(path);
+
+    wait_for_signals(&changes, 3);
+    g_assert_cmpuint(changes.n_signals, ==, 3);
+    g_assert_true(g_hash_table_contains(changes.titles, "entry-single"));
+    g_assert_null(g_hash_table_lookup(changes.titles, "entry-single"));
+
+    g_object_unref(monitor);
+    remove_directory(dir_path);
+    g_hash_table_unref(changes.titles);
+    g_object_unref(directory);
+    g_free(dir_path);
+}
+
+static void test_attribute_monitor_missing(void) {
+    GFile *directory = g_file_new_for_path("/nonexistent/journal");
+    GError *error = NULL;
+
+    g_assert_null(sugar_attribute_monitor_new(directory, &error));
+    g_assert_error(error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND);
+
+    g_error_free(error);
+    g_object_unref(directory);
+}
+
+int main(int argc, char *argv[]) {
+    g_test_init(&argc, &argv, NULL);
+
+    g_test_add_func("/sugar/attribute-monitor/changes", test_attribute_monitor);
+    g_test_add_func("/sugar/attribute-monitor/missing", test_attribute_monitor_missing);
+
+    return g_test_run();
+}
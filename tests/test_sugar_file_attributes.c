@@ -1,7 +1,11 @@
 #include <glib.h>
+#include <glib/gstdio.h>
 #include <sugar-ext.h>
 #include <gio/gio.h>
+#include <fcntl.h>
 #include <sys/stat.h>
+#include <sys/xattr.h>
+#include <unistd.h>
 
 static void test_file_attributes_creation(void) {
     SugarFileAttributes *attrs = sugar_file_attributes_new();
@@ -154,6 +158,1171 @@ static void test_activity_marking(void) {
     g_free(temp_path);
 }
 
+static GFile *create_temp_file(gchar **temp_path) {
+    gint fd = g_file_open_tmp("sugar_test_XXXXXX", temp_path, NULL);
+    if (fd == -1) {
+        return NULL;
+    }
+    close(fd);
+
+    // Probe for user xattr support on the temp directory
+    if (setxattr(*temp_path, "user.sugar.probe", "1", 1, 0) != 0) {
+        unlink(*temp_path);
+        g_free(*temp_path);
+        return NULL;
+    }
+    removexattr(*temp_path, "user.sugar.probe");
+
+    return g_file_new_for_path(*temp_path);
+}
+
+static void remove_temp_file(GFile *file, gchar *temp_path) {
+    g_object_unref(file);
+    unlink(temp_path);
+    g_free(temp_path);
+}
+
+static void test_packed_record(void) {
+    gchar *temp_path = NULL;
+    GFile *file = create_temp_file(&temp_path);
+    if (!file) {
+        g_test_skip("Extended attributes not supported on this filesystem");
+        return;
+    }
+
+    SugarFileAttributes *attrs = sugar_file_attributes_new();
+    attrs->title = g_strdup("Packed");
+    attrs->tags = g_strdup("a,b");
+    attrs->activity = g_strdup("org.laptop.Write");
+
+    GError *error = NULL;
+    g_assert_true(sugar_file_attributes_save_to_file(attrs, file, &error));
+    g_assert_no_error(error);
+
+    // Both forms are written by default
+    g_assert_cmpint(getxattr(temp_path, "user.sugar.meta", NULL, 0), >, 0);
+    g_assert_cmpint(getxattr(temp_path, "user.sugar.title", NULL, 0), >, 0);
+
+    // Reads come from the packed record alone
+    removexattr(temp_path, "user.sugar.title");
+    removexattr(temp_path, "user.sugar.activity");
+
+    SugarFileAttributes *loaded = sugar_file_attributes_get_from_file(file, &error);
+    g_assert_no_error(error);
+    g_assert_cmpstr(loaded->title, ==, "Packed");
+    g_assert_cmpstr(loaded->tags, ==, "a,b");
+    g_assert_cmpstr(loaded->activity, ==, "org.laptop.Write");
+    g_assert_null(loaded->description);
+    g_assert_cmpint(loaded->creation_time, ==, attrs->creation_time);
+    g_assert_cmpint(loaded->modification_time, ==, attrs->modification_time);
+    sugar_file_attributes_free(loaded);
+
+    // Convenience setters keep the packed record in sync
+    g_assert_true(sugar_file_attributes_set_title(file, "Renamed"));
+    gchar *title = sugar_file_attributes_get_title(file);
+    g_assert_cmpstr(title, ==, "Renamed");
+    g_free(title);
+
+    // Marking the creator gives the per-key form the record's creation time
+    removexattr(temp_path, "user.sugar.creation_time");
+    g_assert_true(sugar_file_attributes_mark_as_created_by(file, "org.laptop.Paint"));
+    gchar value[32] = { 0 };
+    g_assert_cmpint(getxattr(temp_path, "user.sugar.creation_time", value, sizeof(value) - 1), >, 0);
+    g_assert_cmpint(g_ascii_strtoll(value, NULL, 10), ==, attrs->creation_time);
+
+    // Legacy-only saves drop the packed record so it cannot go stale
+    g_assert_true(sugar_file_attributes_save_to_file_full(attrs, file, SUGAR_FILE_ATTRIBUTES_SAVE_LEGACY, &error));
+    g_assert_no_error(error);
+    g_assert_cmpint(getxattr(temp_path, "user.sugar.meta", NULL, 0), <, 0);
+
+    loaded = sugar_file_attributes_get_from_file(file, NULL);
+    g_assert_cmpstr(loaded->title, ==, "Packed");
+    sugar_file_attributes_free(loaded);
+
+    sugar_file_attributes_free(attrs);
+    remove_temp_file(file, temp_path);
+}
+
+static void test_packed_record_corrupt(void) {
+    gchar *temp_path = NULL;
+    GFile *file = create_temp_file(&temp_path);
+    if (!file) {
+        g_test_skip("Extended attributes not supported on this filesystem");
+        return;
+    }
+
+    g_assert_true(sugar_file_attributes_set_title(file, "Legacy"));
+
+    // A truncated record falls back to the per-key attributes
+    const gchar truncated[] = "SGM\001\001";
+    g_assert_cmpint(setxattr(temp_path, "user.sugar.meta", truncated, sizeof(truncated) - 1, 0), ==, 0);
+
+    gchar *title = sugar_file_attributes_get_title(file);
+    g_assert_cmpstr(title, ==, "Legacy");
+    g_free(title);
+
+    remove_temp_file(file, temp_path);
+}
+
+static void test_fd_access(void) {
+    gchar *temp_path = NULL;
+    GFile *file = create_temp_file(&temp_path);
+    if (!file) {
+        g_test_skip("Extended attributes not supported on this filesystem");
+        return;
+    }
+
+    gchar *dirname = g_path_get_dirname(temp_path);
+    gchar *basename = g_path_get_basename(temp_path);
+    gint dirfd = open(dirname, O_RDONLY | O_DIRECTORY);
+    g_assert_cmpint(dirfd, >=, 0);
+
+    SugarFileAttributes *attrs = sugar_file_attributes_new();
+    attrs->title = g_strdup("Through a directory");
+    attrs->activity = g_strdup("org.laptop.Paint");
+
+    GError *error = NULL;
+    g_assert_true(sugar_file_attributes_save_at(attrs, dirfd, basename, &error));
+    g_assert_no_error(error);
+
+    gchar *title = sugar_file_attributes_get_title(file);
+    g_assert_cmpstr(title, ==, "Through a directory");
+    g_free(title);
+
+    // An open descriptor keeps working after the file is renamed
+    gint fd = open(temp_path, O_RDONLY);
+    g_assert_cmpint(fd, >=, 0);
+    gchar *moved_path = g_strconcat(temp_path, ".moved", NULL);
+    g_assert_cmpint(rename(temp_path, moved_path), ==, 0);
+
+    SugarFileAttributes *loaded = sugar_file_attributes_new();
+    g_assert_true(sugar_file_attributes_load_from_fd(loaded, fd, &error));
+    g_assert_no_error(error);
+    g_assert_cmpstr(loaded->title, ==, "Through a directory");
+    g_assert_cmpstr(loaded->activity, ==, "org.laptop.Paint");
+
+    // Read-only descriptors are enough for writing
+    g_free(loaded->title);
+    loaded->title = g_strdup("Renamed");
+    g_assert_true(sugar_file_attributes_save_to_fd(loaded, fd, &error));
+    g_assert_no_error(error);
+    close(fd);
+    sugar_file_attributes_free(loaded);
+
+    loaded = sugar_file_attributes_new();
+    gchar *moved_basename = g_path_get_basename(moved_path);
+    g_assert_true(sugar_file_attributes_load_at(loaded, dirfd, moved_basename, &error));
+    g_assert_no_error(error);
+    g_assert_cmpstr(loaded->title, ==, "Renamed");
+    sugar_file_attributes_free(loaded);
+
+    // Missing entries report the errno
+    loaded = sugar_file_attributes_new();
+    g_assert_false(sugar_file_attributes_load_at(loaded, dirfd, basename, &error));
+    g_assert_error(error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND);
+    g_clear_error(&error);
+    sugar_file_attributes_free(loaded);
+
+    rename(moved_path, temp_path);
+    close(dirfd);
+    g_free(moved_basename);
+    g_free(moved_path);
+    g_free(basename);
+    g_free(dirname);
+    sugar_file_attributes_free(attrs);
+    remove_temp_file(file, temp_path);
+}
+
+static void test_sparse_loading(void) {
+    gchar *temp_path = NULL;
+    GFile *file = create_temp_file(&temp_path);
+    if (!file) {
+        g_test_skip("Extended attributes not supported on this filesystem");
+        return;
+    }
+
+    gchar *dirname = g_path_get_dirname(temp_path);
+    gchar *basename = g_path_get_basename(temp_path);
+    gint dirfd = open(dirname, O_RDONLY | O_DIRECTORY);
+    g_assert_cmpint(dirfd, >=, 0);
+
+    // Per-key attributes only, with a value larger than the default buffer
+    gchar *long_description = g_strnfill(2048, 'x');
+
+    SugarFileAttributes *attrs = sugar_file_attributes_new();
+    attrs->title = g_strdup("Sparse");
+    attrs->description = g_strdup(long_description);
+
+    GError *error = NULL;
+    g_assert_true(sugar_file_attributes_save_to_file_full(attrs, file, SUGAR_FILE_ATTRIBUTES_SAVE_LEGACY, &error));
+    g_assert_no_error(error);
+
+    GByteArray *scratch = g_byte_array_new();
+    SugarFileAttributes *loaded = sugar_file_attributes_new();
+    loaded->activity = g_strdup("stale");
+    g_assert_true(sugar_file_attributes_load_at_full(loaded, dirfd, basename, scratch, &error));
+    g_assert_no_error(error);
+    g_assert_cmpstr(loaded->title, ==, "Sparse");
+    g_assert_cmpstr(loaded->description, ==, long_description);
+    g_assert_null(loaded->activity);
+    g_assert_null(loaded->tags);
+    g_assert_cmpint(loaded->creation_time, ==, attrs->creation_time);
+    g_assert_cmpint(loaded->modification_time, ==, attrs->modification_time);
+    g_assert_cmpuint(scratch->len, >, 2048);
+    sugar_file_attributes_free(loaded);
+
+    // The same buffer serves a file without any Sugar metadata
+    removexattr(temp_path, "user.sugar.title");
+    removexattr(temp_path, "user.sugar.description");
+    removexattr(temp_path, "user.sugar.creation_time");
+    removexattr(temp_path, "user.sugar.modification_time");
+
+    loaded = sugar_file_attributes_new();
+    g_assert_true(sugar_file_attributes_load_at_full(loaded, dirfd, basename, scratch, &error));
+    g_assert_no_error(error);
+    g_assert_null(loaded->title);
+    g_assert_null(loaded->description);
+    g_assert_cmpint(loaded->creation_time, >=, 0);
+    g_assert_cmpint(loaded->modification_time, >, 0);
+    sugar_file_attributes_free(loaded);
+
+    g_byte_array_unref(scratch);
+    close(dirfd);
+    g_free(long_description);
+    g_free(basename);
+    g_free(dirname);
+    sugar_file_attributes_free(attrs);
+    remove_temp_file(file, temp_path);
+}
+
+typedef struct {
+    GMainLoop *loop;
+    GPtrArray *events;
+    guint pending;
+} AsyncContext;
+
+static void async_context_done(AsyncContext *context, gchar *event) {
+    g_ptr_array_add(context->events, event);
+    if (--context->pending == 0) {
+        g_main_loop_quit(context->loop);
+    }
+}
+
+static void on_title_set(GObject *source, GAsyncResult *result, gpointer user_data) {
+    GError *error = NULL;
+    g_assert_true(sugar_file_attributes_set_title_finish(result, &error));
+    g_assert_no_error(error);
+    async_context_done(user_data, g_strdup("set"));
+}
+
+static void on_title_read(GObject *source, GAsyncResult *result, gpointer user_data) {
+    GError *error = NULL;
+    gchar *title = sugar_file_attributes_get_title_finish(result, &error);
+    g_assert_no_error(error);
+    async_context_done(user_data, title);
+}
+
+static void on_saved_cancelled(GObject *source, GAsyncResult *result, gpointer user_data) {
+    GError *error = NULL;
+    g_assert_false(sugar_file_attributes_save_to_file_finish(result, &error));
+    g_assert_error(error, G_IO_ERROR, G_IO_ERROR_CANCELLED);
+    async_context_done(user_data, g_strdup(error->message));
+    g_error_free(error);
+}
+
+static void test_async_ordering(void) {
+    gchar *temp_path = NULL;
+    GFile *file = create_temp_file(&temp_path);
+    if (!file) {
+        g_test_skip("Extended attributes not supported on this filesystem");
+        return;
+    }
+
+    AsyncContext context = { g_main_loop_new(NULL, FALSE), g_ptr_array_new_with_free_func(g_free), 0 };
+    const gchar *titles[] = {"one", "two", "three"};
+
+    // Every read must observe the write queued just before it
+    for (guint i = 0; i < G_N_ELEMENTS(titles); i++) {
+        sugar_file_attributes_set_title_async(file, titles[i], NULL, on_title_set, &context);
+        sugar_file_attributes_get_title_async(file, NULL, on_title_read, &context);
+        context.pending += 2;
+    }
+    g_main_loop_run(context.loop);
+
+    g_assert_cmpuint(context.events->len, ==, 6);
+    for (guint i = 0; i < G_N_ELEMENTS(titles); i++) {
+        g_assert_cmpstr(g_ptr_array_index(context.events, i * 2), ==, "set");
+        g_assert_cmpstr(g_ptr_array_index(context.events, i * 2 + 1), ==, titles[i]);
+    }
+
+    // Cancelled before it starts, nothing is written
+    SugarFileAttributes *attrs = sugar_file_attributes_new();
+    attrs->title = g_strdup("Cancelled");
+    GCancellable *cancellable = g_cancellable_new();
+    g_cancellable_cancel(cancellable);
+    sugar_file_attributes_save_to_file_async(attrs, file, cancellable, on_saved_cancelled, &context);
+    context.pending = 1;
+    g_main_loop_run(context.loop);
+
+    gchar *title = sugar_file_attributes_get_title(file);
+    g_assert_cmpstr(title, ==, "three");
+    g_free(title);
+
+    g_object_unref(cancellable);
+    sugar_file_attributes_free(attrs);
+    g_ptr_array_unref(context.events);
+    g_main_loop_unref(context.loop);
+    remove_temp_file(file, temp_path);
+}
+
+typedef struct {
+    GMainLoop *loop;
+    GHashTable *titles;
+    guint n_batches;
+    gboolean finished;
+} DirectoryContext;
+
+static void on_directory_batch(const gchar * const *names, SugarFileAttributes * const *attributes,
+                               guint n_entries, gpointer user_data) {
+    DirectoryContext *context = user_data;
+
+    // Every batch arrives before the completion callback
+    g_assert_false(context->finished);
+    context->n_batches++;
+    for (guint i = 0; i < n_entries; i++) {
+        g_assert_false(g_hash_table_contains(context->titles, names[i]));
+        g_hash_table_insert(context->titles, g_strdup(names[i]), g_strdup(attributes[i]->title));
+    }
+}
+
+static void on_directory_loaded(GObject *source, GAsyncResult *result, gpointer user_data) {
+    DirectoryContext *context = user_data;
+    GError *error = NULL;
+
+    g_assert_true(sugar_file_attributes_load_directory_finish(result, &error));
+    g_assert_no_error(error);
+    context->finished = TRUE;
+    g_main_loop_quit(context->loop);
+}
+
+static void test_load_directory(void) {
+    gchar *probe_path = NULL;
+    GFile *probe = create_temp_file(&probe_path);
+    if (!probe) {
+        g_test_skip("Extended attributes not supported on this filesystem");
+        return;
+    }
+    remove_temp_file(probe, probe_path);
+
+    const guint n_files = 300;
+    gchar *dir_path = g_dir_make_tmp("sugar_test_dir_XXXXXX", NULL);
+    g_assert_nonnull(dir_path);
+
+    for (guint i = 0; i < n_files; i++) {
+        gchar *name = g_strdup_printf("entry-%03u", i);
+        gchar *path = g_build_filename(dir_path, name, NULL);
+        gint fd = open(path, O_CREAT | O_WRONLY, 0644);
+        g_assert_cmpint(fd, >=, 0);
+        close(fd);
+        g_assert_cmpint(setxattr(path, "user.sugar.title", name, strlen(name), 0), ==, 0);
+        g_free(path);
+        g_free(name);
+    }
+
+    // Hidden entries and subdirectories are not reported
+    gchar *hidden = g_build_filename(dir_path, ".hidden", NULL);
+    gchar *subdir = g_build_filename(dir_path, "subdir", NULL);
+    close(open(hidden, O_CREAT | O_WRONLY, 0644));
+    g_assert_cmpint(mkdir(subdir, 0755), ==, 0);
+
+    DirectoryContext context = { g_main_loop_new(NULL, FALSE),
+                                 g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free), 0, FALSE };
+    GFile *directory = g_file_new_for_path(dir_path);
+
+    sugar_file_attributes_load_directory_async(directory, on_directory_batch, &context, NULL,
+                                               on_directory_loaded, &context);
+    g_main_loop_run(context.loop);
+
+    g_assert_true(context.finished);
+    g_assert_cmpuint(g_hash_table_size(context.titles), ==, n_files);
+    g_assert_cmpuint(context.n_batches, >, 1);
+    g_assert_cmpstr(g_hash_table_lookup(context.titles, "entry-042"), ==, "entry-042");
+    g_assert_false(g_hash_table_contains(context.titles, ".hidden"));
+    g_assert_false(g_hash_table_contains(context.titles, "subdir"));
+
+    for (guint i = 0; i < n_files; i++) {
+        gchar *path = g_strdup_printf("%s/entry-%03u", dir_path, i);
+        unlink(path);
+        g_free(path);
+    }
+    unlink(hidden);
+    rmdir(subdir);
+    rmdir(dir_path);
+
+    g_object_unref(directory);
+    g_hash_table_unref(context.titles);
+    g_main_loop_unref(context.loop);
+    g_free(hidden);
+    g_free(subdir);
+    g_free(dir_path);
+}
+
+static void test_metadata_cache(void) {
+    gchar *temp_path = NULL;
+    GFile *file = create_temp_file(&temp_path);
+    if (!file) {
+        g_test_skip("Extended attributes not supported on this filesystem");
+        return;
+    }
+
+    guint64 hits, misses;
+    g_assert_true(sugar_file_attributes_set_title(file, "Cached"));
+    g_assert_true(sugar_file_attributes_set_description(file, "First"));
+
+    // Entries read within the timestamp granularity are never served
+    g_usleep(20 * G_TIME_SPAN_MILLISECOND);
+    sugar_file_attributes_cache_clear();
+
+    // Full loads fill the cache, single fields are then served from it
+    SugarFileAttributes *loaded = sugar_file_attributes_get_from_file(file, NULL);
+    g_assert_cmpstr(loaded->title, ==, "Cached");
+    sugar_file_attributes_free(loaded);
+    gchar *description = sugar_file_attributes_get_description(file);
+    g_assert_cmpstr(description, ==, "First");
+    g_free(description);
+
+    sugar_file_attributes_cache_get_stats(&hits, &misses);
+    g_assert_cmpuint(hits, ==, 1);
+    g_assert_cmpuint(misses, ==, 1);
+
+    // Writes by other processes change ctime and invalidate the entry
+    g_usleep(20 * G_TIME_SPAN_MILLISECOND);
+    g_assert_cmpint(setxattr(temp_path, "user.sugar.description", "Second", 6, 0), ==, 0);
+    removexattr(temp_path, "user.sugar.meta");
+
+    description = sugar_file_attributes_get_description(file);
+    g_assert_cmpstr(description, ==, "Second");
+    g_free(description);
+
+    sugar_file_attributes_cache_get_stats(&hits, &misses);
+    g_assert_cmpuint(hits, ==, 1);
+    g_assert_cmpuint(misses, ==, 2);
+
+    // Our own writes update the entry in place
+    g_usleep(20 * G_TIME_SPAN_MILLISECOND);
+    loaded = sugar_file_attributes_get_from_file(file, NULL);
+    sugar_file_attributes_free(loaded);
+    g_assert_true(sugar_file_attributes_set_title(file, "Updated"));
+    g_usleep(20 * G_TIME_SPAN_MILLISECOND);
+
+    gchar *title = sugar_file_attributes_get_title(file);
+    g_assert_cmpstr(title, ==, "Updated");
+    g_free(title);
+
+    // A disabled cache never hits
+    sugar_file_attributes_cache_set_max_entries(0);
+    sugar_file_attributes_cache_clear();
+    loaded = sugar_file_attributes_get_from_file(file, NULL);
+    sugar_file_attributes_free(loaded);
+    loaded = sugar_file_attributes_get_from_file(file, NULL);
+    sugar_file_attributes_free(loaded);
+
+    sugar_file_attributes_cache_get_stats(&hits, &misses);
+    g_assert_cmpuint(hits, ==, 0);
+    g_assert_cmpuint(misses, ==, 2);
+    sugar_file_attributes_cache_set_max_entries(512);
+
+    remove_temp_file(file, temp_path);
+}
+
+static void test_string_interning(void) {
+    gchar *first_path = NULL, *second_path = NULL;
+    GFile *first = create_temp_file(&first_path);
+    GFile *second = first ? create_temp_file(&second_path) : NULL;
+    if (!second) {
+        if (first)
+            remove_temp_file(first, first_path);
+        g_test_skip("Extended attributes not supported on this filesystem");
+        return;
+    }
+
+    SugarFileAttributes *attrs = sugar_file_attributes_new();
+    attrs->title = g_strdup("Shared");
+    attrs->tags = g_strdup("math,homework");
+    attrs->activity = g_strdup("org.laptop.Write");
+    g_assert_true(sugar_file_attributes_save_to_file(attrs, first, NULL));
+    g_assert_true(sugar_file_attributes_save_to_file(attrs, second, NULL));
+
+    sugar_file_attributes_set_interning(TRUE);
+    g_assert_true(sugar_file_attributes_get_interning());
+    sugar_file_attributes_cache_clear();
+
+    // Equal values loaded from different files share storage
+    SugarFileAttributes *a = sugar_file_attributes_new();
+    SugarFileAttributes *b = sugar_file_attributes_new();
+    g_assert_true(sugar_file_attributes_load_at(a, AT_FDCWD, first_path, NULL));
+    g_assert_true(sugar_file_attributes_load_at(b, AT_FDCWD, second_path, NULL));
+    g_assert_cmpstr(a->activity, ==, "org.laptop.Write");
+    g_assert_true(a->activity == b->activity);
+    g_assert_true(a->tags == b->tags);
+    g_assert_true(a->title != b->title);
+
+    SugarFileAttributes *copy = g_boxed_copy(sugar_file_attributes_get_type(), a);
+    g_assert_true(copy->activity == a->activity);
+    sugar_file_attributes_free(a);
+    g_assert_cmpstr(copy->activity, ==, "org.laptop.Write");
+
+    // Strings allocated by the caller are still freed as usual
+    g_free(b->title);
+    b->title = g_strdup("Unshared");
+    g_assert_true(sugar_file_attributes_load_from_file(b, first, NULL));
+    g_assert_true(b->activity == copy->activity);
+
+    sugar_file_attributes_set_interning(FALSE);
+    g_assert_true(sugar_file_attributes_set_tags(first, (const gchar *[]) { "art", NULL }));
+    sugar_file_attributes_free(b);
+    sugar_file_attributes_free(copy);
+    sugar_file_attributes_free(attrs);
+    sugar_file_attributes_cache_clear();
+
+    remove_temp_file(first, first_path);
+    remove_temp_file(second, second_path);
+}
+
+static void test_attribute_batch(void) {
+    gchar *packed_path = NULL, *legacy_path = NULL;
+    GFile *packed = create_temp_file(&packed_path);
+    GFile *legacy = packed ? create_temp_file(&legacy_path) : NULL;
+    if (!legacy) {
+        if (packed)
+            remove_temp_file(packed, packed_path);
+        g_test_skip("Extended attributes not supported on this filesystem");
+        return;
+    }
+
+    SugarFileAttributes *attrs = sugar_file_attributes_new();
+    attrs->title = g_strdup("Packed");
+    attrs->activity = g_strdup("org.laptop.Write");
+    g_assert_true(sugar_file_attributes_save_to_file(attrs, packed, NULL));
+    g_free(attrs->title);
+    attrs->title = g_strdup("Legacy");
+    g_assert_true(sugar_file_attributes_save_to_file_full(attrs, legacy, SUGAR_FILE_ATTRIBUTES_SAVE_LEGACY, NULL));
+
+    SugarFileAttributesBatch *batch = sugar_file_attributes_batch_new();
+    GByteArray *scratch = g_byte_array_new();
+    GError *error = NULL;
+
+    g_assert_true(sugar_file_attributes_batch_load_at(batch, AT_FDCWD, packed_path, scratch, &error));
+    g_assert_no_error(error);
+    g_assert_true(sugar_file_attributes_batch_load_at(batch, AT_FDCWD, legacy_path, NULL, &error));
+    g_assert_no_error(error);
+
+    // Failed loads leave the batch unchanged
+    g_assert_false(sugar_file_attributes_batch_load_at(batch, AT_FDCWD, "/nonexistent/entry", scratch, &error));
+    g_assert_error(error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND);
+    g_clear_error(&error);
+    g_assert_cmpuint(sugar_file_attributes_batch_get_length(batch), ==, 2);
+
+    const SugarFileAttributes *first = sugar_file_attributes_batch_get(batch, 0);
+    g_assert_cmpstr(first->title, ==, "Packed");
+    g_assert_cmpstr(first->activity, ==, "org.laptop.Write");
+    g_assert_null(first->tags);
+    g_assert_cmpint(first->creation_time, ==, attrs->creation_time);
+    g_assert_cmpstr(sugar_file_attributes_batch_get(batch, 1)->title, ==, "Legacy");
+
+    // Records keep their address as the batch grows
+    for (guint i = 0; i < 1000; i++)
+        sugar_file_attributes_batch_add(batch, attrs);
+    g_assert_true(sugar_file_attributes_batch_get(batch, 0) == first);
+    g_assert_cmpuint(sugar_file_attributes_batch_get_length(batch), ==, 1002);
+    const SugarFileAttributes *last = sugar_file_attributes_batch_get(batch, 1001);
+    g_assert_cmpstr(last->title, ==, "Legacy");
+    g_assert_true(last->title != attrs->title);
+
+    sugar_file_attributes_batch_free(batch);
+    g_byte_array_unref(scratch);
+    sugar_file_attributes_free(attrs);
+    remove_temp_file(packed, packed_path);
+    remove_temp_file(legacy, legacy_path);
+}
+
+static void test_load_fields(void) {
+    gchar *temp_path = NULL;
+    GFile *file = create_temp_file(&temp_path);
+    if (!file) {
+        g_test_skip("Extended attributes not supported on this filesystem");
+        return;
+    }
+
+    SugarFileAttributes *attrs = sugar_file_attributes_new();
+    attrs->title = g_strdup("Partial");
+    attrs->description = g_strdup("Not needed");
+    attrs->preview_path = g_strdup("/previews/partial.png");
+    g_assert_true(sugar_file_attributes_save_to_file(attrs, file, NULL));
+
+    for (guint pass = 0; pass < 2; pass++) {
+        // Packed records first, then the per-key attributes alone
+        if (pass == 1)
+            removexattr(temp_path, "user.sugar.meta");
+        sugar_file_attributes_cache_clear();
+
+        SugarFileAttributes *loaded = sugar_file_attributes_new();
+        loaded->description = g_strdup("Untouched");
+        GError *error = NULL;
+        g_assert_true(sugar_file_attributes_load_fields(loaded, file,
+                                                        SUGAR_FILE_ATTRIBUTE_TITLE |
+                                                        SUGAR_FILE_ATTRIBUTE_MODIFICATION_TIME,
+                                                        &error));
+        g_assert_no_error(error);
+        g_assert_cmpstr(loaded->title, ==, "Partial");
+        g_assert_cmpstr(loaded->description, ==, "Untouched");
+        g_assert_null(loaded->preview_path);
+        g_assert_cmpint(loaded->modification_time, ==, attrs->modification_time);
+
+        g_assert_true(sugar_file_attributes_load_fields(loaded, file, SUGAR_FILE_ATTRIBUTE_PREVIEW_PATH, NULL));
+        g_assert_cmpstr(loaded->preview_path, ==, "/previews/partial.png");
+        g_assert_cmpstr(loaded->description, ==, "Untouched");
+        sugar_file_attributes_free(loaded);
+    }
+
+    // Partial loads leave the cache alone
+    guint64 hits, misses;
+    gchar *title = sugar_file_attributes_get_title(file);
+    g_assert_cmpstr(title, ==, "Partial");
+    g_free(title);
+    sugar_file_attributes_cache_get_stats(&hits, &misses);
+    g_assert_cmpuint(hits, ==, 0);
+
+    sugar_file_attributes_free(attrs);
+    sugar_file_attributes_cache_clear();
+    remove_temp_file(file, temp_path);
+}
+
+static void test_dirty_fields(void) {
+    gchar *temp_path = NULL;
+    GFile *file = create_temp_file(&temp_path);
+    if (!file) {
+        g_test_skip("Extended attributes not supported on this filesystem");
+        return;
+    }
+
+    // Records filled in with the setters still get a creation time
+    SugarFileAttributes *attrs = sugar_file_attributes_new();
+    sugar_file_attributes_set_string(attrs, SUGAR_FILE_ATTRIBUTE_TITLE, "One");
+    sugar_file_attributes_set_string(attrs, SUGAR_FILE_ATTRIBUTE_DESCRIPTION, "Mine");
+    g_assert_cmpuint(attrs->dirty, ==, SUGAR_FILE_ATTRIBUTE_TITLE | SUGAR_FILE_ATTRIBUTE_DESCRIPTION);
+    g_assert_true(sugar_file_attributes_save_to_file(attrs, file, NULL));
+    g_assert_cmpuint(attrs->dirty, ==, 0);
+    sugar_file_attributes_free(attrs);
+
+    attrs = sugar_file_attributes_get_from_file(file, NULL);
+    g_assert_cmpstr(attrs->title, ==, "One");
+    g_assert_cmpint(attrs->creation_time, >, 0);
+    g_assert_cmpuint(attrs->dirty, ==, 0);
+
+    // Only the changed field is written, others keep their stored value
+    g_assert_cmpint(setxattr(temp_path, "user.sugar.description", "Theirs", 6, 0), ==, 0);
+    removexattr(temp_path, "user.sugar.meta");
+    sugar_file_attributes_set_string(attrs, SUGAR_FILE_ATTRIBUTE_TITLE, "Two");
+    g_assert_true(sugar_file_attributes_save_to_file(attrs, file, NULL));
+    g_assert_cmpstr(attrs->description, ==, "Mine");
+
+    SugarFileAttributes *loaded = sugar_file_attributes_get_from_file(file, NULL);
+    g_assert_cmpstr(loaded->title, ==, "Two");
+    g_assert_cmpstr(loaded->description, ==, "Theirs");
+    g_assert_cmpint(getxattr(temp_path, "user.sugar.meta", NULL, 0), >, 0);
+    sugar_file_attributes_free(loaded);
+
+    // Comparing first skips saves that change nothing
+    gint64 saved_at = attrs->modification_time;
+    sugar_file_attributes_set_string(attrs, SUGAR_FILE_ATTRIBUTE_TITLE, "Two");
+    g_assert_true(sugar_file_attributes_save_to_file_full(attrs, file,
+                                                          SUGAR_FILE_ATTRIBUTES_SAVE_DEFAULT |
+                                                          SUGAR_FILE_ATTRIBUTES_SAVE_COMPARE, NULL));
+    g_assert_cmpint(attrs->modification_time, ==, saved_at);
+    g_assert_cmpuint(attrs->dirty, ==, 0);
+
+    sugar_file_attributes_set_string(attrs, SUGAR_FILE_ATTRIBUTE_TAGS, "new");
+    g_assert_true(sugar_file_attributes_save_to_file_full(attrs, file,
+                                                          SUGAR_FILE_ATTRIBUTES_SAVE_DEFAULT |
+                                                          SUGAR_FILE_ATTRIBUTES_SAVE_COMPARE, NULL));
+    g_assert_cmpint(attrs->modification_time, >, saved_at);
+    gchar **tags = sugar_file_attributes_get_tags(file);
+    g_assert_cmpstr(tags[0], ==, "new");
+    g_strfreev(tags);
+
+    // Fields assigned directly are written along with the dirty ones
+    sugar_file_attributes_set_string(attrs, SUGAR_FILE_ATTRIBUTE_TITLE, "Three");
+    g_free(attrs->activity);
+    attrs->activity = g_strdup("org.laptop.Paint");
+    g_assert_true(sugar_file_attributes_save_to_file(attrs, file, NULL));
+
+    loaded = sugar_file_attributes_get_from_file(file, NULL);
+    g_assert_cmpstr(loaded->title, ==, "Three");
+    g_assert_cmpstr(loaded->activity, ==, "org.laptop.Paint");
+    g_assert_cmpstr(loaded->description, ==, "Theirs");
+    sugar_file_attributes_free(loaded);
+
+    // Even when the old and new values hash alike
+    sugar_file_attributes_set_string(attrs, SUGAR_FILE_ATTRIBUTE_TITLE, "AA");
+    g_assert_true(sugar_file_attributes_save_to_file(attrs, file, NULL));
+    g_assert_cmpuint(g_str_hash("AA"), ==, g_str_hash("B "));
+    g_free(attrs->title);
+    attrs->title = g_strdup("B ");
+    sugar_file_attributes_set_string(attrs, SUGAR_FILE_ATTRIBUTE_TAGS, "hashed");
+    g_assert_true(sugar_file_attributes_save_to_file(attrs, file, NULL));
+
+    loaded = sugar_file_attributes_get_from_file(file, NULL);
+    g_assert_cmpstr(loaded->title, ==, "B ");
+    sugar_file_attributes_free(loaded);
+
+    sugar_file_attributes_free(attrs);
+    remove_temp_file(file, temp_path);
+}
+
+static void test_write_queue(void) {
+    gchar *temp_path = NULL;
+    GFile *file = create_temp_file(&temp_path);
+    if (!file) {
+        g_test_skip("Extended attributes not supported on this filesystem");
+        return;
+    }
+
+    // Queued values are visible to readers before they reach the file
+    sugar_file_attributes_set_write_delay(60000);
+    g_assert_cmpuint(sugar_file_attributes_get_write_delay(), ==, 60000);
+    g_assert_true(sugar_file_attributes_set_title(file, "First"));
+    g_assert_true(sugar_file_attributes_set_title(file, "Queued"));
+    g_assert_true(sugar_file_attributes_set_description(file, "Later"));
+    g_assert_cmpint(getxattr(temp_path, "user.sugar.title", NULL, 0), <, 0);
+
+    gchar *title = sugar_file_attributes_get_title(file);
+    g_assert_cmpstr(title, ==, "Queued");
+    g_free(title);
+
+    SugarFileAttributes *attrs = sugar_file_attributes_get_from_file(file, NULL);
+    g_assert_cmpstr(attrs->description, ==, "Later");
+    sugar_file_attributes_free(attrs);
+
+    // Flushing writes the merged changes once
+    g_assert_true(sugar_file_attributes_flush(NULL));
+    gchar value[64] = { 0 };
+    g_assert_cmpint(getxattr(temp_path, "user.sugar.title", value, sizeof(value) - 1), ==, 6);
+    g_assert_cmpstr(value, ==, "Queued");
+
+    // An explicit save lands after the queued values of the same file
+    const gchar *tags[] = { "queued", NULL };
+    g_assert_true(sugar_file_attributes_set_tags(file, tags));
+    attrs = sugar_file_attributes_new();
+    sugar_file_attributes_set_string(attrs, SUGAR_FILE_ATTRIBUTE_TAGS, "saved");
+    g_assert_true(sugar_file_attributes_save_to_file(attrs, file, NULL));
+    sugar_file_attributes_free(attrs);
+    g_assert_true(sugar_file_attributes_flush(NULL));
+
+    gchar **loaded = sugar_file_attributes_get_tags(file);
+    g_assert_cmpstr(loaded[0], ==, "saved");
+    g_strfreev(loaded);
+
+    // Turning the delay off writes what is still pending
+    g_assert_true(sugar_file_attributes_set_description(file, "Final"));
+    sugar_file_attributes_set_write_delay(0);
+    gchar description[64] = { 0 };
+    g_assert_cmpint(getxattr(temp_path, "user.sugar.description", description, sizeof(description) - 1), ==, 5);
+    g_assert_cmpstr(description, ==, "Final");
+
+    remove_temp_file(file, temp_path);
+}
+
+static guint count_blobs(const gchar *dir_path) {
+    gchar *blobs_path = g_build_filename(dir_path, ".sugar-blobs", NULL);
+    GDir *dir = g_dir_open(blobs_path, 0, NULL);
+    guint n_blobs = 0;
+
+    while (dir && g_dir_read_name(dir))
+        n_blobs++;
+
+    if (dir) g_dir_close(dir);
+    g_free(blobs_path);
+    return n_blobs;
+}
+
+static void remove_blobs(const gchar *dir_path) {
+    gchar *blobs_path = g_build_filename(dir_path, ".sugar-blobs", NULL);
+    GDir *dir = g_dir_open(blobs_path, 0, NULL);
+    const gchar *name;
+
+    while (dir && (name = g_dir_read_name(dir)) != NULL) {
+        gchar *blob_path = g_build_filename(blobs_path, name, NULL);
+        unlink(blob_path);
+        g_free(blob_path);
+    }
+
+    if (dir) g_dir_close(dir);
+    g_rmdir(blobs_path);
+    g_free(blobs_path);
+}
+
+static void test_sidecar_store(void) {
+    gchar *dir_path = g_dir_make_tmp("sugar_test_XXXXXX", NULL);
+    g_assert_nonnull(dir_path);
+    gchar *path = g_build_filename(dir_path, "entry", NULL);
+    gchar *sidecar_path = g_build_filename(dir_path, ".sugar-metadata", NULL);
+    g_assert_true(g_file_set_contents(path, "", 0, NULL));
+
+    // Only file systems without user xattrs fall back to the sidecar
+    if (setxattr(path, "user.sugar.probe", "1", 1, 0) == 0) {
+        g_test_skip("Extended attributes supported, the sidecar store is not used");
+        unlink(path);
+        g_rmdir(dir_path);
+        g_free(sidecar_path);
+        g_free(path);
+        g_free(dir_path);
+        return;
+    }
+
+    GFile *file = g_file_new_for_path(path);
+    SugarFileAttributes *attrs = sugar_file_attributes_new();
+    sugar_file_attributes_set_string(attrs, SUGAR_FILE_ATTRIBUTE_TITLE, "On a stick");
+    sugar_file_attributes_set_string(attrs, SUGAR_FILE_ATTRIBUTE_ACTIVITY, "org.laptop.Write");
+    g_assert_true(sugar_file_attributes_save_to_file(attrs, file, NULL));
+    sugar_file_attributes_free(attrs);
+    g_assert_true(g_file_test(sidecar_path, G_FILE_TEST_IS_REGULAR));
+
+    // The convenience setters and the dirfd API use the same record
+    g_assert_true(sugar_file_attributes_set_description(file, "Saved without xattrs"));
+    gint dirfd = open(dir_path, O_RDONLY | O_DIRECTORY);
+    g_assert_cmpint(dirfd, >=, 0);
+    attrs = sugar_file_attributes_new();
+    g_assert_true(sugar_file_attributes_load_at(attrs, dirfd, "entry", NULL));
+    g_assert_cmpstr(attrs->title, ==, "On a stick");
+    g_assert_cmpstr(attrs->description, ==, "Saved without xattrs");
+    g_assert_cmpstr(attrs->activity, ==, "org.laptop.Write");
+    g_assert_cmpint(attrs->creation_time, >, 0);
+    sugar_file_attributes_free(attrs);
+
+    // Long descriptions go to the blob store next to the sidecar
+    gchar *long_text = g_strnfill(2000, 'x');
+    g_assert_true(sugar_file_attributes_set_description(file, long_text));
+    attrs = sugar_file_attributes_new();
+    g_assert_true(sugar_file_attributes_load_at(attrs, dirfd, "entry", NULL));
+    g_assert_null(attrs->description);
+    g_assert_cmpuint(attrs->unloaded, ==, SUGAR_FILE_ATTRIBUTE_DESCRIPTION);
+    sugar_file_attributes_free(attrs);
+    gchar *description = sugar_file_attributes_get_description(file);
+    g_assert_cmpstr(description, ==, long_text);
+    g_free(description);
+    g_free(long_text);
+
+    // Rewrites compact the log, keeping only the latest record
+    for (int i = 0; i < 2000; i++) {
+        gchar *title = g_strdup_printf("Title %d", i);
+        g_assert_true(sugar_file_attributes_set_title(file, title));
+        g_free(title);
+    }
+    struct stat st;
+    g_assert_cmpint(stat(sidecar_path, &st), ==, 0);
+    g_assert_cmpint(st.st_size, <, 64 * 1024);
+
+    gchar *title = sugar_file_attributes_get_title(file);
+    g_assert_cmpstr(title, ==, "Title 1999");
+    g_free(title);
+
+    close(dirfd);
+    g_object_unref(file);
+    remove_blobs(dir_path);
+    unlink(sidecar_path);
+    unlink(path);
+    g_rmdir(dir_path);
+    g_free(sidecar_path);
+    g_free(path);
+    g_free(dir_path);
+}
+
+static void test_file_times(void) {
+    gchar *dir_path = g_dir_make_tmp("sugar_test_XXXXXX", NULL);
+    g_assert_nonnull(dir_path);
+    gchar *first = g_build_filename(dir_path, "first", NULL);
+    gchar *second = g_build_filename(dir_path, "second", NULL);
+    g_assert_true(g_file_set_contents(first, "", 0, NULL));
+    g_assert_true(g_file_set_contents(second, "", 0, NULL));
+
+    gint dirfd = open(dir_path, O_RDONLY | O_DIRECTORY);
+    g_assert_cmpint(dirfd, >=, 0);
+
+    // Missing entries are reported as zero times
+    const gchar *names[] = { "first", "missing", "second", NULL };
+    gint64 creation_times[3];
+    gint64 modification_times[3];
+    g_assert_cmpuint(sugar_file_attributes_get_times_at(dirfd, names, creation_times, modification_times), ==, 2);
+
+    struct stat st;
+    g_assert_cmpint(stat(second, &st), ==, 0);
+    g_assert_cmpint(modification_times[2], ==, (gint64) st.st_mtim.tv_sec * G_USEC_PER_SEC + st.st_mtim.tv_nsec / 1000);
+    g_assert_cmpint(modification_times[1], ==, 0);
+    g_assert_cmpint(creation_times[1], ==, 0);
+    g_assert_cmpint(creation_times[0], >=, 0);
+
+    // Files without time attributes fall back to the same values
+    GFile *file = g_file_new_for_path(second);
+    SugarFileAttributes *attrs = g_new0(SugarFileAttributes, 1);
+    g_assert_true(sugar_file_attributes_load_fields(attrs, file,
+                                                    SUGAR_FILE_ATTRIBUTE_CREATION_TIME |
+                                                    SUGAR_FILE_ATTRIBUTE_MODIFICATION_TIME, NULL));
+    g_assert_cmpint(attrs->modification_time, ==, modification_times[2]);
+    g_assert_cmpint(attrs->creation_time, ==, creation_times[2]);
+    sugar_file_attributes_free(attrs);
+    g_object_unref(file);
+
+    // So do the descriptor based loaders
+    attrs = g_new0(SugarFileAttributes, 1);
+    g_assert_true(sugar_file_attributes_load_at(attrs, dirfd, "second", NULL));
+    g_assert_cmpint(attrs->modification_time, ==, modification_times[2]);
+    g_assert_cmpint(attrs->creation_time, ==, creation_times[2]);
+    sugar_file_attributes_free(attrs);
+
+    close(dirfd);
+    unlink(first);
+    unlink(second);
+    g_rmdir(dir_path);
+    g_free(first);
+    g_free(second);
+    g_free(dir_path);
+}
+
+static GHashTable *load_directory_titles(GFile *directory) {
+    DirectoryContext context = { g_main_loop_new(NULL, FALSE),
+                                 g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free), 0, FALSE };
+
+    sugar_file_attributes_load_directory_async(directory, on_directory_batch, &context, NULL,
+                                               on_directory_loaded, &context);
+    g_main_loop_run(context.loop);
+    g_main_loop_unref(context.loop);
+    return context.titles;
+}
+
+static void test_io_uring(void) {
+    gchar *probe_path = NULL;
+    GFile *probe = create_temp_file(&probe_path);
+    if (!probe) {
+        g_test_skip("Extended attributes not supported on this filesystem");
+        return;
+    }
+    remove_temp_file(probe, probe_path);
+
+    const guint n_files = 300;
+    gchar *dir_path = g_dir_make_tmp("sugar_test_dir_XXXXXX", NULL);
+    g_assert_nonnull(dir_path);
+
+    // Packed records, per-key attributes only and no metadata at all
+    for (guint i = 0; i < n_files; i++) {
+        gchar *name = g_strdup_printf("entry-%03u", i);
+        gchar *path = g_build_filename(dir_path, name, NULL);
+        g_assert_true(g_file_set_contents(path, "", 0, NULL));
+
+        if (i % 3 == 0) {
+            GFile *file = g_file_new_for_path(path);
+            SugarFileAttributes *attrs = sugar_file_attributes_new();
+            sugar_file_attributes_set_string(attrs, SUGAR_FILE_ATTRIBUTE_TITLE, name);
+            sugar_file_attributes_set_string(attrs, SUGAR_FILE_ATTRIBUTE_ACTIVITY, "org.laptop.Write");
+            g_assert_true(sugar_file_attributes_save_to_file(attrs, file, NULL));
+            sugar_file_attributes_free(attrs);
+            g_object_unref(file);
+        } else if (i % 3 == 1) {
+            g_assert_cmpint(setxattr(path, "user.sugar.title", name, strlen(name), 0), ==, 0);
+        }
+
+        g_free(path);
+        g_free(name);
+    }
+
+    // Both paths load the same records
+    GFile *directory = g_file_new_for_path(dir_path);
+    sugar_file_attributes_set_io_uring(FALSE);
+    g_assert_false(sugar_file_attributes_get_io_uring());
+    GHashTable *expected = load_directory_titles(directory);
+    sugar_file_attributes_set_io_uring(TRUE);
+    GHashTable *titles = load_directory_titles(directory);
+
+    g_assert_cmpuint(g_hash_table_size(titles), ==, n_files);
+    g_assert_cmpuint(g_hash_table_size(expected), ==, n_files);
+    for (guint i = 0; i < n_files; i++) {
+        gchar *name = g_strdup_printf("entry-%03u", i);
+        g_assert_cmpstr(g_hash_table_lookup(titles, name), ==, g_hash_table_lookup(expected, name));
+        g_assert_cmpstr(g_hash_table_lookup(titles, name), ==, i % 3 == 2 ? NULL : name);
+        g_free(name);
+    }
+
+    // Queued updates of many files are flushed together
+    sugar_file_attributes_set_write_delay(60000);
+    for (guint i = 0; i < n_files; i++) {
+        gchar *path = g_strdup_printf("%s/entry-%03u", dir_path, i);
+        gchar *title = g_strdup_printf("Renamed %03u", i);
+        GFile *file = g_file_new_for_path(path);
+        g_assert_true(sugar_file_attributes_set_title(file, title));
+        g_object_unref(file);
+        g_free(title);
+        g_free(path);
+    }
+    g_assert_true(sugar_file_attributes_flush(NULL));
+    sugar_file_attributes_set_write_delay(0);
+    sugar_file_attributes_set_io_uring(FALSE);
+
+    for (guint i = 0; i < n_files; i++) {
+        gchar *path = g_strdup_printf("%s/entry-%03u", dir_path, i);
+        GFile *file = g_file_new_for_path(path);
+        gchar *title = g_strdup_printf("Renamed %03u", i);
+        gchar value[64] = { 0 };
+
+        SugarFileAttributes *attrs = sugar_file_attributes_get_from_file(file, NULL);
+        g_assert_cmpstr(attrs->title, ==, title);
+        g_assert_cmpstr(attrs->activity, ==, i % 3 == 0 ? "org.laptop.Write" : NULL);
+        g_assert_cmpint(getxattr(path, "user.sugar.title", value, sizeof(value) - 1), ==, strlen(title));
+        g_assert_cmpstr(value, ==, title);
+        sugar_file_attributes_free(attrs);
+
+        g_object_unref(file);
+        unlink(path);
+        g_free(title);
+        g_free(path);
+    }
+    rmdir(dir_path);
+
+    g_hash_table_unref(expected);
+    g_hash_table_unref(titles);
+    g_object_unref(directory);
+    g_free(dir_path);
+}
+
+static void test_long_description(void) {
+    gchar *dir_path = g_dir_make_tmp("sugar_test_XXXXXX", NULL);
+    gchar *path = g_build_filename(dir_path, "entry", NULL);
+    g_assert_true(g_file_set_contents(path, "", 0, NULL));
+
+    if (setxattr(path, "user.sugar.probe", "1", 1, 0) != 0) {
+        g_test_skip("Extended attributes not supported on this filesystem");
+        unlink(path);
+        g_rmdir(dir_path);
+        g_free(path);
+        g_free(dir_path);
+        return;
+    }
+    removexattr(path, "user.sugar.probe");
+
+    GFile *file = g_file_new_for_path(path);
+    GString *text = g_string_new(NULL);
+    for (int i = 0; i < 200; i++)
+        g_string_append_printf(text, "Line %d of a long description. ", i);
+    gchar *long_text = g_string_free(text, FALSE);
+    gchar *other_text = g_strconcat("Edited. ", long_text, NULL);
+
+    // Long descriptions leave only a reference in the record
+    SugarFileAttributes *attrs = sugar_file_attributes_new();
+    sugar_file_attributes_set_string(attrs, SUGAR_FILE_ATTRIBUTE_TITLE, "Essay");
+    sugar_file_attributes_set_string(attrs, SUGAR_FILE_ATTRIBUTE_DESCRIPTION, long_text);
+    g_assert_true(sugar_file_attributes_save_to_file(attrs, file, NULL));
+    sugar_file_attributes_free(attrs);
+
+    // The per-key copy stays, where the file system can hold it
+    g_assert_cmpint(getxattr(path, "user.sugar.meta", NULL, 0), <, 1024);
+    gssize size = getxattr(path, "user.sugar.description", NULL, 0);
+    g_assert_true(size < 0 || size == (gssize) strlen(long_text));
+    g_assert_cmpuint(count_blobs(dir_path), ==, 1);
+
+    attrs = sugar_file_attributes_get_from_file(file, NULL);
+    g_assert_cmpstr(attrs->title, ==, "Essay");
+    g_assert_cmpstr(attrs->description, ==, long_text);
+    g_assert_cmpuint(attrs->unloaded, ==, 0);
+    sugar_file_attributes_free(attrs);
+
+    // Scans skip the text until it is asked for
+    gint dirfd = open(dir_path, O_RDONLY | O_DIRECTORY);
+    g_assert_cmpint(dirfd, >=, 0);
+    attrs = sugar_file_attributes_new();
+    g_assert_true(sugar_file_attributes_load_at(attrs, dirfd, "entry", NULL));
+    g_assert_cmpstr(attrs->title, ==, "Essay");
+    g_assert_null(attrs->description);
+    g_assert_cmpuint(attrs->unloaded, ==, SUGAR_FILE_ATTRIBUTE_DESCRIPTION);
+
+    // Saving such a record keeps the description it did not read
+    attrs->dirty = 0;
+    g_free(attrs->title);
+    attrs->title = g_strdup("Renamed");
+    g_assert_true(sugar_file_attributes_save_at(attrs, dirfd, "entry", NULL));
+    gchar *description = sugar_file_attributes_get_description(file);
+    g_assert_cmpstr(description, ==, long_text);
+    g_free(description);
+
+    g_assert_true(sugar_file_attributes_load_fields(attrs, file, SUGAR_FILE_ATTRIBUTE_DESCRIPTION, NULL));
+    g_assert_cmpstr(attrs->description, ==, long_text);
+    g_assert_cmpuint(attrs->unloaded, ==, 0);
+
+    // A compared save finds the text read back unchanged
+    gint64 saved_at = attrs->modification_time;
+    g_assert_true(sugar_file_attributes_save_to_file_full(attrs, file,
+                                                          SUGAR_FILE_ATTRIBUTES_SAVE_DEFAULT |
+                                                          SUGAR_FILE_ATTRIBUTES_SAVE_COMPARE, NULL));
+    g_assert_cmpint(attrs->modification_time, ==, saved_at);
+    sugar_file_attributes_free(attrs);
+
+    // The convenience setter stores out of line too, equal texts share a blob
+    g_assert_true(sugar_file_attributes_set_description(file, other_text));
+    size = getxattr(path, "user.sugar.description", NULL, 0);
+    g_assert_true(size < 0 || size == (gssize) strlen(other_text));
+    g_assert_cmpuint(count_blobs(dir_path), ==, 2);
+    description = sugar_file_attributes_get_description(file);
+    g_assert_cmpstr(description, ==, other_text);
+    g_free(description);
+    gchar *title = sugar_file_attributes_get_title(file);
+    g_assert_cmpstr(title, ==, "Renamed");
+    g_free(title);
+
+    g_assert_true(sugar_file_attributes_set_description(file, long_text));
+    g_assert_cmpuint(count_blobs(dir_path), ==, 2);
+
+    // Short descriptions stay inline
+    g_assert_true(sugar_file_attributes_set_description(file, "Short"));
+    gchar value[64] = { 0 };
+    g_assert_cmpint(getxattr(path, "user.sugar.description", value, sizeof(value) - 1), ==, 5);
+    g_assert_cmpstr(value, ==, "Short");
+    attrs = sugar_file_attributes_new();
+    g_assert_true(sugar_file_attributes_load_at(attrs, dirfd, "entry", NULL));
+    g_assert_cmpstr(attrs->description, ==, "Short");
+    g_assert_cmpuint(attrs->unloaded, ==, 0);
+    sugar_file_attributes_free(attrs);
+
+    // Copies that lost the blob store fall back to the per-key attribute
+    gchar *medium_text = g_strnfill(1000, 'm');
+    g_assert_true(sugar_file_attributes_set_description(file, medium_text));
+    g_assert_cmpint(getxattr(path, "user.sugar.description", NULL, 0), ==, 1000);
+    remove_blobs(dir_path);
+    description = sugar_file_attributes_get_description(file);
+    g_assert_cmpstr(description, ==, medium_text);
+    g_free(description);
+
+    // A reference to nothing is an error, but the other fields still load
+    g_assert_cmpint(removexattr(path, "user.sugar.description"), ==, 0);
+    GError *error = NULL;
+    attrs = sugar_file_attributes_new();
+    g_assert_false(sugar_file_attributes_load_fields(attrs, file, SUGAR_FILE_ATTRIBUTE_ALL, &error));
+    g_assert_error(error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND);
+    g_clear_error(&error);
+    g_assert_cmpstr(attrs->title, ==, "Renamed");
+    g_assert_null(attrs->description);
+    g_assert_cmpuint(attrs->unloaded, ==, SUGAR_FILE_ATTRIBUTE_DESCRIPTION);
+    sugar_file_attributes_free(attrs);
+    g_free(medium_text);
+
+    close(dirfd);
+    remove_blobs(dir_path);
+    g_object_unref(file);
+    unlink(path);
+    g_rmdir(dir_path);
+    g_free(other_text);
+    g_free(long_text);
+    g_free(path);
+    g_free(dir_path);
+}
+
 int main(int argc, char *argv[]) {
     g_test_init(&argc, &argv, NULL);
 
@@ -161,6 +1330,22 @@ int main(int argc, char *argv[]) {
     g_test_add_func("/sugar/file-attributes/basic-operations", test_file_attributes_basic_operations);
     g_test_add_func("/sugar/file-attributes/full-structure", test_file_attributes_full_structure);
     g_test_add_func("/sugar/file-attributes/activity-marking", test_activity_marking);
+    g_test_add_func("/sugar/file-attributes/packed-record", test_packed_record);
+    g_test_add_func("/sugar/file-attributes/packed-record-corrupt", test_packed_record_corrupt);
+    g_test_add_func("/sugar/file-attributes/fd-access", test_fd_access);
+    g_test_add_func("/sugar/file-attributes/sparse-loading", test_sparse_loading);
+    g_test_add_func("/sugar/file-attributes/async-ordering", test_async_ordering);
+    g_test_add_func("/sugar/file-attributes/load-directory", test_load_directory);
+    g_test_add_func("/sugar/file-attributes/metadata-cache", test_metadata_cache);
+    g_test_add_func("/sugar/file-attributes/string-interning", test_string_interning);
+    g_test_add_func("/sugar/file-attributes/batch", test_attribute_batch);
+    g_test_add_func("/sugar/file-attributes/load-fields", test_load_fields);
+    g_test_add_func("/sugar/file-attributes/dirty-fields", test_dirty_fields);
+    g_test_add_func("/sugar/file-attributes/write-queue", test_write_queue);
+    g_test_add_func("/sugar/file-attributes/sidecar", test_sidecar_store);
+    g_test_add_func("/sugar/file-attributes/file-times", test_file_times);
+    g_test_add_func("/sugar/file-attributes/io-uring", test_io_uring);
+    g_test_add_func("/sugar/file-attributes/long-description", test_long_description);
 
     return g_test_run();
 }
@@ -0,0 +1,156 @@
+#include <glib.h>
+#include <sugar-ext.h>
+#include <gio/gio.h>
+#include <glib/gstdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#define N_ENTRIES 1000
+
+static gchar *create_directory(void) {
+    gchar *dir_path = g_dir_make_tmp("sugar_test_model_XXXXXX", NULL);
+    g_assert_nonnull(dir_path);
+
+    for (guint i = 0; i < N_ENTRIES; i++) {
+        gchar *name = g_strdup_printf("entry-%04u", i);
+        gchar *path = g_build_filename(dir_path, name, NULL);
+        GFile *file = g_file_new_for_path(path);
+
+        g_assert_true(g_file_set_contents(path, "", 0, NULL));
+        g_assert_true(sugar_file_attributes_set_title(file, name));
+
+        g_object_unref(file);
+        g_free(path);
+        g_free(name);
+    }
+
+    return dir_path;
+}
+
+static void remove_directory(const gchar *dir_path) {
+    GDir *dir = g_dir_open(dir_path, 0, NULL);
+    const gchar *name;
+
+    while ((name = g_dir_read_name(dir)) != NULL) {
+        gchar *path = g_build_filename(dir_path, name, NULL);
+        if (g_file_test(path, G_FILE_TEST_IS_DIR))
+            g_rmdir(path);
+        else
+            g_unlink(path);
+        g_free(path);
+    }
+
+    g_dir_close(dir);
+    g_rmdir(dir_path);
+}
+
+static gboolean xattrs_supported(void) {
+    gchar *path = NULL;
+    gint fd = g_file_open_tmp("sugar_test_XXXXXX", &path, NULL);
+    GFile *file = g_file_new_for_path(path);
+    gboolean supported;
+
+    close(fd);
+    supported = sugar_file_attributes_set_title(file, "probe");
+    g_object_unref(file);
+    g_unlink(path);
+    g_free(path);
+    return supported;
+}
+
+static void assert_title(SugarFileAttributesListModel *model, guint position) {
+    SugarFileAttributesItem *item = g_list_model_get_item(G_LIST_MODEL(model), position);
+    gchar *expected = g_strdup_printf("entry-%04u", position);
+
+    g_assert_nonnull(item);
+    g_assert_cmpstr(sugar_file_attributes_item_get_name(item), ==, expected);
+    g_assert_cmpstr(sugar_file_attributes_item_get_attributes(item)->title, ==, expected);
+
+    g_free(expected);
+    g_object_unref(item);
+}
+
+static void wait_for_loaded(SugarFileAttributesListModel *model, guint n_loaded) {
+    gint64 deadline = g_get_monotonic_time() + 5 * G_USEC_PER_SEC;
+
+    while (sugar_file_attributes_list_model_get_n_loaded(model) < n_loaded &&
+           g_get_monotonic_time() < deadline)
+        g_main_context_iteration(NULL, FALSE);
+}
+
+static void test_list_model_on_demand(void) {
+    if (!xattrs_supported()) {
+        g_test_skip("Extended attributes not supported on this filesystem");
+        return;
+    }
+
+    gchar *dir_path = create_directory();
+    gchar *hidden = g_build_filename(dir_path, ".hidden", NULL);
+    gchar *subdir = g_build_filename(dir_path, "subdir", NULL);
+    g_assert_true(g_file_set_contents(hidden, "", 0, NULL));
+    g_assert_cmpint(g_mkdir(subdir, 0755), ==, 0);
+
+    GFile *directory = g_file_new_for_path(dir_path);
+    GError *error = NULL;
+    SugarFileAttributesListModel *model = sugar_file_attributes_list_model_new(directory, &error);
+    g_assert_no_error(error);
+
+    // The count is known before anything is loaded
+    g_assert_true(g_list_model_get_item_type(G_LIST_MODEL(model)) == SUGAR_TYPE_FILE_ATTRIBUTES_ITEM);
+    g_assert_cmpuint(g_list_model_get_n_items(G_LIST_MODEL(model)), ==, N_ENTRIES);
+    g_assert_cmpstr(sugar_file_attributes_list_model_get_name(model, 0), ==, "entry-0000");
+    g_assert_cmpuint(sugar_file_attributes_list_model_get_n_loaded(model), ==, 0);
+    g_assert_null(g_list_model_get_item(G_LIST_MODEL(model), N_ENTRIES));
+
+    // Rows after the requested one are loaded in the background
+    assert_title(model, 500);
+    wait_for_loaded(model, 1 + sugar_file_attributes_list_model_get_prefetch(model));
+    g_assert_cmpuint(sugar_file_attributes_list_model_get_n_loaded(model), ==,
+                     1 + sugar_file_attributes_list_model_get_prefetch(model));
+
+    // Scrolling through everything keeps only a window loaded
+    for (guint i = 0; i < N_ENTRIES; i++) {
+        assert_title(model, i);
+        g_main_context_iteration(NULL, FALSE);
+    }
+    for (guint i = N_ENTRIES; i > 0; i--)
+        assert_title(model, i - 1);
+    g_assert_cmpuint(sugar_file_attributes_list_model_get_n_loaded(model), <=,
+                     sugar_file_attributes_list_model_get_max_loaded(model));
+
+    sugar_file_attributes_list_model_set_max_loaded(model, 16);
+    g_assert_cmpuint(sugar_file_attributes_list_model_get_n_loaded(model), <=, 16);
+    assert_title(model, 0);
+
+    // A running prefetch keeps the model alive until it is done
+    g_object_add_weak_pointer(G_OBJECT(model), (gpointer *) &model);
+    g_object_unref(model);
+    while (model)
+        g_main_context_iteration(NULL, TRUE);
+
+    g_object_unref(directory);
+    g_free(hidden);
+    g_free(subdir);
+    remove_directory(dir_path);
+    g_free(dir_path);
+}
+
+static void test_list_model_missing_directory(void) {
+    GFile *directory = g_file_new_for_path("/nonexistent/sugar/journal");
+    GError *error = NULL;
+
+    g_assert_null(sugar_file_attributes_list_model_new(directory, &error));
+    g_assert_error(error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND);
+
+    g_error_free(error);
+    g_object_unref(directory);
+}
+
+int main(int argc, char *argv[]) {
+    g_test_init(&argc, &argv, NULL);
+
+    g_test_add_func("/sugar/file-attributes-list-model/on-demand", test_list_model_on_demand);
+    g_test_add_func("/sugar/file-attributes-list-model/missing-directory", test_list_model_missing_directory);
+
+    return g_test_run();
+}
@@ -0,0 +1,201 @@
+#include <glib.h>
+#include <sugar-ext.h>
+#include <gio/gio.h>
+
+typedef struct {
+    GPtrArray *rows;
+    guint n_signals;
+    guint position;
+    guint removed;
+    guint added;
+} Mirror;
+
+// Replays every change on a copy of the rows, so wrong ranges show up as a mismatch
+static void on_items_changed(GListModel *model, guint position, guint removed, guint added, gpointer user_data) {
+    Mirror *mirror = user_data;
+
+    g_assert_cmpuint(position + removed, <=, mirror->rows->len);
+    g_ptr_array_remove_range(mirror->rows, position, removed);
+    for (guint i = 0; i < added; i++)
+        g_ptr_array_insert(mirror->rows, position + i, g_list_model_get_item(model, position + i));
+
+    mirror->n_signals++;
+    mirror->position = position;
+    mirror->removed = removed;
+    mirror->added = added;
+}
+
+static void assert_mirror(SugarFileAttributesSortModel *model, Mirror *mirror) {
+    g_assert_cmpuint(mirror->rows->len, ==, g_list_model_get_n_items(G_LIST_MODEL(model)));
+
+    for (guint i = 0; i < mirror->rows->len; i++) {
+        SugarFileAttributesItem *item = g_list_model_get_item(G_LIST_MODEL(model), i);
+        g_assert_true(item == mirror->rows->pdata[i]);
+        g_object_unref(item);
+    }
+}
+
+static const gchar *name_at(SugarFileAttributesSortModel *model, guint position) {
+    SugarFileAttributesItem *item = g_list_model_get_item(G_LIST_MODEL(model), position);
+    const gchar *name = sugar_file_attributes_item_get_name(item);
+
+    // The model keeps its own reference
+    g_object_unref(item);
+    return name;
+}
+
+static void fill_model(SugarFileAttributesSortModel *model, guint n_entries, gboolean random_times) {
+    gchar **names = g_new0(gchar *, n_entries + 1);
+    SugarFileAttributes **attributes = g_new0(SugarFileAttributes *, n_entries);
+
+    for (guint i = 0; i < n_entries; i++) {
+        gchar *title = g_strdup_printf("title-%05u", n_entries - i);
+        names[i] = g_strdup_printf("entry-%05u", i);
+        attributes[i] = sugar_file_attributes_new();
+        sugar_file_attributes_set_string(attributes[i], SUGAR_FILE_ATTRIBUTE_TITLE, title);
+        sugar_file_attributes_set_string(attributes[i], SUGAR_FILE_ATTRIBUTE_ACTIVITY,
+                                         i % 2 ? "org.laptop.Paint" : "org.laptop.Write");
+        attributes[i]->modification_time = random_times ? g_random_int_range(0, 1000) : i;
+        g_free(title);
+    }
+
+    sugar_file_attributes_sort_model_update_many(model, (const gchar * const *) names, attributes, n_entries);
+
+    for (guint i = 0; i < n_entries; i++)
+        sugar_file_attributes_free(attributes[i]);
+    g_free(attributes);
+    g_strfreev(names);
+}
+
+static void update_time(SugarFileAttributesSortModel *model, const gchar *name, gint64 modification_time) {
+    SugarFileAttributes *attrs = sugar_file_attributes_new();
+    attrs->modification_time = modification_time;
+    sugar_file_attributes_sort_model_update(model, name, attrs);
+    sugar_file_attributes_free(attrs);
+}
+
+static gboolean is_even_entry(const gchar *name, const SugarFileAttributes *attrs, gpointer user_data) {
+    return attrs->modification_time % 2 == 0;
+}
+
+static void test_sort_model_updates(void) {
+    GFile *directory = g_file_new_for_path("/tmp/journal");
+    SugarFileAttributesSortModel *model = sugar_file_attributes_sort_model_new(directory);
+    Mirror mirror = { g_ptr_array_new_with_free_func(g_object_unref), 0, 0, 0, 0 };
+    g_signal_connect(model, "items-changed", G_CALLBACK(on_items_changed), &mirror);
+
+    // A large batch is applied with one sort and reported once
+    fill_model(model, 100, FALSE);
+    g_assert_cmpuint(mirror.n_signals, ==, 1);
+    g_assert_cmpuint(g_list_model_get_n_items(G_LIST_MODEL(model)), ==, 100);
+    g_assert_cmpstr(name_at(model, 0), ==, "entry-00099");
+    g_assert_cmpstr(name_at(model, 99), ==, "entry-00000");
+
+    // A changed entry moves with a removal and an insertion
+    update_time(model, "entry-00050", 1000);
+    g_assert_cmpuint(mirror.n_signals, ==, 3);
+    g_assert_cmpuint(mirror.position, ==, 0);
+    g_assert_cmpuint(mirror.added, ==, 1);
+    g_assert_cmpstr(name_at(model, 0), ==, "entry-00050");
+    assert_mirror(model, &mirror);
+
+    // One that keeps its place is a single changed row
+    update_time(model, "entry-00050", 998);
+    g_assert_cmpuint(mirror.n_signals, ==, 4);
+    g_assert_cmpuint(mirror.position, ==, 0);
+    g_assert_cmpuint(mirror.removed, ==, 1);
+    g_assert_cmpuint(mirror.added, ==, 1);
+
+    // New entries are inserted in place
+    update_time(model, "entry-new", 10);
+    g_assert_cmpuint(mirror.n_signals, ==, 5);
+    g_assert_cmpstr(name_at(model, mirror.position), ==, "entry-new");
+    assert_mirror(model, &mirror);
+
+    sugar_file_attributes_sort_model_remove(model, "entry-new");
+    sugar_file_attributes_sort_model_remove(model, "entry-missing");
+    g_assert_cmpuint(mirror.n_signals, ==, 6);
+    g_assert_cmpuint(sugar_file_attributes_sort_model_get_n_entries(model), ==, 100);
+    assert_mirror(model, &mirror);
+
+    // Changing the order, equal values fall back to names
+    sugar_file_attributes_sort_model_set_sort(model, SUGAR_FILE_ATTRIBUTES_SORT_TITLE, FALSE);
+    g_assert_cmpuint(sugar_file_attributes_sort_model_get_sort_key(model), ==, SUGAR_FILE_ATTRIBUTES_SORT_TITLE);
+    g_assert_false(sugar_file_attributes_sort_model_get_descending(model));
+    // The updated entry lost its title, and the empty title sorts first
+    g_assert_cmpstr(name_at(model, 0), ==, "entry-00050");
+    g_assert_cmpstr(name_at(model, 1), ==, "entry-00099");
+    assert_mirror(model, &mirror);
+
+    sugar_file_attributes_sort_model_set_sort(model, SUGAR_FILE_ATTRIBUTES_SORT_ACTIVITY, FALSE);
+    g_assert_cmpstr(name_at(model, 0), ==, "entry-00050");
+    g_assert_cmpstr(name_at(model, 1), ==, "entry-00001");
+    g_assert_cmpstr(name_at(model, 51), ==, "entry-00000");
+    assert_mirror(model, &mirror);
+
+    // Filtering reports the span of rows that differ
+    sugar_file_attributes_sort_model_set_sort(model, SUGAR_FILE_ATTRIBUTES_SORT_MODIFICATION_TIME, TRUE);
+    sugar_file_attributes_sort_model_set_filter_func(model, is_even_entry, NULL, NULL);
+    g_assert_cmpuint(g_list_model_get_n_items(G_LIST_MODEL(model)), ==, 50);
+    g_assert_cmpuint(sugar_file_attributes_sort_model_get_n_entries(model), ==, 100);
+    assert_mirror(model, &mirror);
+
+    // Hidden entries stay hidden when updated
+    update_time(model, "entry-00003", 3001);
+    g_assert_cmpuint(g_list_model_get_n_items(G_LIST_MODEL(model)), ==, 50);
+    update_time(model, "entry-00003", 3000);
+    g_assert_cmpstr(name_at(model, 0), ==, "entry-00003");
+    assert_mirror(model, &mirror);
+
+    sugar_file_attributes_sort_model_set_filter_func(model, NULL, NULL, NULL);
+    g_assert_cmpuint(g_list_model_get_n_items(G_LIST_MODEL(model)), ==, 100);
+    assert_mirror(model, &mirror);
+
+    g_object_unref(model);
+    g_object_unref(directory);
+    g_ptr_array_unref(mirror.rows);
+}
+
+static void test_sort_model_large(void) {
+    GFile *directory = g_file_new_for_path("/tmp/journal");
+    SugarFileAttributesSortModel *model = sugar_file_attributes_sort_model_new(directory);
+    const guint n_entries = 50000;
+
+    // Enough entries to be sorted on several threads
+    g_random_set_seed(42);
+    fill_model(model, n_entries, TRUE);
+    g_assert_cmpuint(g_list_model_get_n_items(G_LIST_MODEL(model)), ==, n_entries);
+
+    for (guint i = 1; i < n_entries; i++) {
+        SugarFileAttributesItem *previous = g_list_model_get_item(G_LIST_MODEL(model), i - 1);
+        SugarFileAttributesItem *item = g_list_model_get_item(G_LIST_MODEL(model), i);
+        gint64 previous_time = sugar_file_attributes_item_get_attributes(previous)->modification_time;
+        gint64 time = sugar_file_attributes_item_get_attributes(item)->modification_time;
+
+        g_assert_cmpint(previous_time, >=, time);
+        if (previous_time == time)
+            g_assert_cmpstr(sugar_file_attributes_item_get_name(previous), <, sugar_file_attributes_item_get_name(item));
+
+        g_object_unref(previous);
+        g_object_unref(item);
+    }
+
+    sugar_file_attributes_sort_model_set_sort(model, SUGAR_FILE_ATTRIBUTES_SORT_TITLE, TRUE);
+    for (guint i = 0; i < n_entries; i += 997) {
+        gchar *expected = g_strdup_printf("entry-%05u", i);
+        g_assert_cmpstr(name_at(model, i), ==, expected);
+        g_free(expected);
+    }
+
+    g_object_unref(model);
+    g_object_unref(directory);
+}
+
+int main(int argc, char *argv[]) {
+    g_test_init(&argc, &argv, NULL);
+
+    g_test_add_func("/sugar/file-attributes-sort-model/updates", test_sort_model_updates);
+    g_test_add_func("/sugar/file-attributes-sort-model/large", test_sort_model_large);
+
+    return g_test_run();
+}
@@ -94,6 +94,89 @@ static void test_sugar_grid_bounds_checking(void) {
   g_object_unref(grid);
 }
 
+static void test_sugar_grid_resize(void) {
+  SugarGrid *grid = g_object_new(SUGAR_TYPE_GRID, NULL);
+  sugar_grid_setup(grid, 6, 6);
+
+  GdkRectangle kept = {1, 1, 2, 2};
+  GdkRectangle dropped = {4, 4, 2, 2};
+  sugar_grid_add_weight(grid, &kept);
+  sugar_grid_add_weight(grid, &dropped);
+
+  sugar_grid_resize(grid, 4, 4);
+  g_assert_cmpint(grid->width, ==, 4);
+  g_assert_cmpint(grid->height, ==, 4);
+  g_assert_cmpuint(sugar_grid_compute_weight(grid, &kept), ==, 4);
+
+  GdkRectangle all = {0, 0, 4, 4};
+  g_assert_cmpuint(sugar_grid_compute_weight(grid, &all), ==, 4);
+
+  g_object_unref(grid);
+}
+
+static void test_sugar_grid_free_regions(void) {
+  SugarGrid *grid = g_object_new(SUGAR_TYPE_GRID, NULL);
+  sugar_grid_setup(grid, 5, 5);
+
+  GArray *regions = sugar_grid_get_free_regions(grid);
+  g_assert_cmpuint(regions->len, ==, 1);
+  g_assert_cmpuint(g_array_index(regions, SugarGridRegion, 0).area, ==, 25);
+  g_array_unref(regions);
+
+  // A wall down the middle splits the grid in two
+  GdkRectangle wall = {2, 0, 1, 5};
+  sugar_grid_add_weight(grid, &wall);
+
+  regions = sugar_grid_get_free_regions(grid);
+  g_assert_cmpuint(regions->len, ==, 2);
+  for (guint i = 0; i < regions->len; i++) {
+    SugarGridRegion *region = &g_array_index(regions, SugarGridRegion, i);
+    g_assert_cmpuint(region->area, ==, 10);
+    g_assert_cmpint(region->bounds.width, ==, 2);
+    g_assert_cmpint(region->bounds.height, ==, 5);
+  }
+  g_array_unref(regions);
+
+  gint left = sugar_grid_get_region_at(grid, 0, 0);
+  gint right = sugar_grid_get_region_at(grid, 4, 4);
+  g_assert_cmpint(left, >=, 0);
+  g_assert_cmpint(right, >=, 0);
+  g_assert_cmpint(left, !=, right);
+  g_assert_cmpint(sugar_grid_get_region_at(grid, 2, 2), ==, -1);
+
+  // Opening a door merges them again
+  GdkRectangle door = {2, 2, 1, 1};
+  sugar_grid_remove_weight(grid, &door);
+
+  left = sugar_grid_get_region_at(grid, 0, 0);
+  g_assert_cmpint(left, ==, sugar_grid_get_region_at(grid, 4, 4));
+
+  SugarGridRegion region;
+  g_assert_true(sugar_grid_get_region(grid, left, &region));
+  g_assert_cmpuint(region.area, ==, 21);
+  g_assert_cmpint(region.bounds.x, ==, 0);
+  g_assert_cmpint(region.bounds.width, ==, 5);
+
+  // A region that did not touch the change keeps its id
+  GdkRectangle block = {0, 3, 2, 1};
+  GdkRectangle corner = {4, 0, 1, 1};
+  sugar_grid_add_weight(grid, &door);
+  sugar_grid_add_weight(grid, &block);
+  left = sugar_grid_get_region_at(grid, 0, 0);
+  g_assert_cmpint(left, !=, sugar_grid_get_region_at(grid, 0, 4));
+
+  sugar_grid_add_weight(grid, &corner);
+  g_assert_cmpint(sugar_grid_get_region_at(grid, 0, 0), ==, left);
+  g_assert_true(sugar_grid_get_region(grid, left, &region));
+  g_assert_cmpuint(region.area, ==, 6);
+
+  right = sugar_grid_get_region_at(grid, 4, 4);
+  g_assert_true(sugar_grid_get_region(grid, right, &region));
+  g_assert_cmpuint(region.area, ==, 9);
+
+  g_object_unref(grid);
+}
+
 int main(int argc, char *argv[]) {
   g_test_init(&argc, &argv, NULL);
 
@@ -103,6 +186,8 @@ int main(int argc, char *argv[]) {
   g_test_add_func("/sugar/grid/remove-weight", test_sugar_grid_remove_weight);
   g_test_add_func("/sugar/grid/bounds-checking",
                   test_sugar_grid_bounds_checking);
+  g_test_add_func("/sugar/grid/resize", test_sugar_grid_resize);
+  g_test_add_func("/sugar/grid/free-regions", test_sugar_grid_free_regions);
 
   return g_test_run();
 }
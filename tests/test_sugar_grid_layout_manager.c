@@ -0,0 +1,126 @@
+#include <glib.h>
+#include <gtk/gtk.h>
+#include <sugar-ext.h>
+
+static GtkWidget *
+create_icon(void)
+{
+    GtkWidget *icon = gtk_drawing_area_new();
+
+    gtk_drawing_area_set_content_width(GTK_DRAWING_AREA(icon), 40);
+    gtk_drawing_area_set_content_height(GTK_DRAWING_AREA(icon), 40);
+    return icon;
+}
+
+static void
+allocate_container(GtkWidget *container, gint width, gint height)
+{
+    gint minimum, natural;
+
+    gtk_widget_measure(container, GTK_ORIENTATION_HORIZONTAL, -1, &minimum, &natural, NULL, NULL);
+    gtk_widget_measure(container, GTK_ORIENTATION_VERTICAL, -1, &minimum, &natural, NULL, NULL);
+    gtk_widget_allocate(container, width, height, -1, NULL);
+}
+
+static SugarGridLayoutChild *
+get_layout_child(GtkWidget *container, GtkWidget *child)
+{
+    GtkLayoutManager *manager = gtk_widget_get_layout_manager(container);
+
+    return SUGAR_GRID_LAYOUT_CHILD(gtk_layout_manager_get_layout_child(manager, child));
+}
+
+static void
+test_grid_layout_places_children(void)
+{
+    GtkWidget *container = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 0);
+    GtkWidget *first = create_icon();
+    GtkWidget *second = create_icon();
+    gint cell = (gint) sugar_get_grid_cell_size();
+
+    g_object_ref_sink(container);
+    gtk_widget_set_layout_manager(container, sugar_grid_layout_manager_new());
+    gtk_box_append(GTK_BOX(container), first);
+    gtk_box_append(GTK_BOX(container), second);
+
+    allocate_container(container, cell * 4, cell * 3);
+
+    SugarGridLayoutManager *manager = SUGAR_GRID_LAYOUT_MANAGER(gtk_widget_get_layout_manager(container));
+    g_assert_cmpint(sugar_grid_layout_manager_get_n_columns(manager), ==, 4);
+    g_assert_cmpint(sugar_grid_layout_manager_get_n_rows(manager), ==, 3);
+
+    SugarGridLayoutChild *first_child = get_layout_child(container, first);
+    SugarGridLayoutChild *second_child = get_layout_child(container, second);
+    g_assert_true(sugar_grid_layout_child_is_placed(first_child));
+    g_assert_true(sugar_grid_layout_child_is_placed(second_child));
+    g_assert_cmpint(sugar_grid_layout_child_get_column(first_child), ==, 0);
+    g_assert_cmpint(sugar_grid_layout_child_get_column(second_child), ==, 1);
+
+    // Both cells carry weight, nothing overlaps
+    GdkRectangle all = {0, 0, 4, 3};
+    g_assert_cmpuint(sugar_grid_compute_weight(sugar_grid_layout_manager_get_grid(manager), &all), ==, 2);
+
+    g_object_unref(container);
+}
+
+static void
+test_grid_layout_keeps_placements(void)
+{
+    GtkWidget *container = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 0);
+    GtkWidget *first = create_icon();
+    GtkWidget *second = create_icon();
+    GtkWidget *third = create_icon();
+    gint cell = (gint) sugar_get_grid_cell_size();
+
+    g_object_ref_sink(container);
+    gtk_widget_set_layout_manager(container, sugar_grid_layout_manager_new());
+    gtk_box_append(GTK_BOX(container), first);
+    gtk_box_append(GTK_BOX(container), second);
+    allocate_container(container, cell * 4, cell * 3);
+
+    // Removing a child frees its cell for the next one, others stay put
+    gtk_box_remove(GTK_BOX(container), first);
+    gtk_box_append(GTK_BOX(container), third);
+    allocate_container(container, cell * 4, cell * 3);
+
+    g_assert_cmpint(sugar_grid_layout_child_get_column(get_layout_child(container, second)), ==, 1);
+    g_assert_cmpint(sugar_grid_layout_child_get_column(get_layout_child(container, third)), ==, 0);
+
+    // Growing the area does not move anything
+    allocate_container(container, cell * 8, cell * 6);
+    g_assert_cmpint(sugar_grid_layout_child_get_column(get_layout_child(container, second)), ==, 1);
+    g_assert_cmpint(sugar_grid_layout_child_get_column(get_layout_child(container, third)), ==, 0);
+
+    // Explicit positions move only the requested child
+    sugar_grid_layout_child_set_position(get_layout_child(container, third), 5, 4);
+    allocate_container(container, cell * 8, cell * 6);
+    g_assert_cmpint(sugar_grid_layout_child_get_column(get_layout_child(container, third)), ==, 5);
+    g_assert_cmpint(sugar_grid_layout_child_get_row(get_layout_child(container, third)), ==, 4);
+    g_assert_cmpint(sugar_grid_layout_child_get_column(get_layout_child(container, second)), ==, 1);
+
+    // Shrinking re-places only the children that no longer fit
+    allocate_container(container, cell * 3, cell * 2);
+    SugarGridLayoutChild *third_child = get_layout_child(container, third);
+    g_assert_cmpint(sugar_grid_layout_child_get_column(get_layout_child(container, second)), ==, 1);
+    g_assert_cmpint(sugar_grid_layout_child_get_column(third_child), <, 3);
+    g_assert_cmpint(sugar_grid_layout_child_get_row(third_child), <, 2);
+
+    g_object_unref(container);
+}
+
+int main(int argc, char *argv[])
+{
+    // The layout manager is exercised on real widgets, which need a display
+    if (g_getenv("DISPLAY") == NULL && g_getenv("WAYLAND_DISPLAY") == NULL) {
+        g_test_message("Skipping test: requires a display server (e.g., X11 or Wayland).");
+        return 0;
+    }
+
+    gtk_init();
+    g_test_init(&argc, &argv, NULL);
+
+    g_test_add_func("/sugar/grid-layout-manager/places-children", test_grid_layout_places_children);
+    g_test_add_func("/sugar/grid-layout-manager/keeps-placements", test_grid_layout_keeps_placements);
+
+    return g_test_run();
+}
@@ -0,0 +1,176 @@
+#include <glib.h>
+#include <sugar-ext.h>
+#include <gio/gio.h>
+#include <glib/gstdio.h>
+#include <string.h>
+#include <unistd.h>
+
+static GBytes *make_png(gint width, gint height, guint8 shade) {
+    gsize stride = (gsize) width * 4;
+    guint8 *pixels = g_malloc(stride * height);
+    memset(pixels, shade, stride * height);
+
+    GBytes *bytes = g_bytes_new_take(pixels, stride * height);
+    GdkTexture *texture = gdk_memory_texture_new(width, height, GDK_MEMORY_R8G8B8A8, bytes, stride);
+    GBytes *png = gdk_texture_save_to_png_bytes(texture);
+
+    g_object_unref(texture);
+    g_bytes_unref(bytes);
+    return png;
+}
+
+static gchar *make_pack_path(void) {
+    gchar *path = NULL;
+    gint fd = g_file_open_tmp("sugar-preview-XXXXXX.pack", &path, NULL);
+    g_assert_cmpint(fd, >=, 0);
+    close(fd);
+    g_unlink(path);
+    return path;
+}
+
+static void on_texture_loaded(GObject *source, GAsyncResult *result, gpointer user_data) {
+    GdkTexture **texture = user_data;
+    GError *error = NULL;
+
+    *texture = sugar_preview_store_load_texture_finish(SUGAR_PREVIEW_STORE(source), result, &error);
+    g_assert_no_error(error);
+}
+
+static GdkTexture *load_texture(SugarPreviewStore *store, const gchar *key) {
+    GdkTexture *texture = NULL;
+
+    sugar_preview_store_load_texture_async(store, key, NULL, on_texture_loaded, &texture);
+    while (!texture)
+        g_main_context_iteration(NULL, TRUE);
+    return texture;
+}
+
+static void test_preview_pack(void) {
+    gchar *path = make_pack_path();
+    GError *error = NULL;
+    GBytes *red = make_png(8, 8, 0x80);
+    GBytes *blue = make_png(4, 4, 0x20);
+
+    SugarPreviewStore *store = sugar_preview_store_new(path, &error);
+    g_assert_no_error(error);
+    g_assert_true(sugar_preview_store_add(store, "first", red, &error));
+    g_assert_true(sugar_preview_store_add(store, "second", red, &error));
+    g_assert_true(sugar_preview_store_add(store, "second", blue, &error));
+    g_assert_true(sugar_preview_store_remove(store, "first", &error));
+    g_assert_no_error(error);
+
+    GBytes *data = sugar_preview_store_lookup(store, "second");
+    g_assert_true(g_bytes_equal(data, blue));
+    g_bytes_unref(data);
+    g_assert_false(sugar_preview_store_contains(store, "first"));
+    g_assert_null(sugar_preview_store_lookup(store, "missing"));
+    g_object_unref(store);
+
+    // The log replays to the same contents, before and after compaction
+    store = sugar_preview_store_new(path, &error);
+    g_assert_no_error(error);
+    g_assert_false(sugar_preview_store_contains(store, "first"));
+    data = sugar_preview_store_lookup(store, "second");
+    g_assert_true(g_bytes_equal(data, blue));
+
+    g_assert_true(sugar_preview_store_compact(store, &error));
+    g_assert_no_error(error);
+    // Bytes handed out before compaction stay valid
+    g_assert_true(g_bytes_equal(data, blue));
+    g_bytes_unref(data);
+    data = sugar_preview_store_lookup(store, "second");
+    g_assert_true(g_bytes_equal(data, blue));
+    g_bytes_unref(data);
+    g_object_unref(store);
+
+    store = sugar_preview_store_new(path, &error);
+    g_assert_no_error(error);
+    g_assert_true(sugar_preview_store_contains(store, "second"));
+    g_object_unref(store);
+
+    g_bytes_unref(red);
+    g_bytes_unref(blue);
+    g_unlink(path);
+    g_free(path);
+}
+
+static void test_preview_textures(void) {
+    gchar *path = make_pack_path();
+    GError *error = NULL;
+    GBytes *large = make_png(32, 32, 0x40);
+    GBytes *small = make_png(8, 8, 0x60);
+
+    SugarPreviewStore *store = sugar_preview_store_new(path, &error);
+    g_assert_no_error(error);
+    g_assert_true(sugar_preview_store_add(store, "large", large, &error));
+    g_assert_true(sugar_preview_store_add(store, "small", small, &error));
+    g_assert_no_error(error);
+
+    g_assert_null(sugar_preview_store_get_texture(store, "large"));
+    GdkTexture *texture = load_texture(store, "large");
+    g_assert_cmpint(gdk_texture_get_width(texture), ==, 32);
+    g_object_unref(texture);
+
+    // Decoded textures are cached
+    texture = sugar_preview_store_get_texture(store, "large");
+    g_assert_nonnull(texture);
+    g_object_unref(texture);
+
+    // Only the small texture fits next to nothing else
+    sugar_preview_store_set_cache_size(store, 32 * 32 * 4 - 1);
+    g_assert_cmpuint(sugar_preview_store_get_cache_size(store), ==, 32 * 32 * 4 - 1);
+    g_assert_null(sugar_preview_store_get_texture(store, "large"));
+    g_object_unref(load_texture(store, "small"));
+    g_object_unref(load_texture(store, "large"));
+    g_assert_null(sugar_preview_store_get_texture(store, "large"));
+    texture = sugar_preview_store_get_texture(store, "small");
+    g_assert_nonnull(texture);
+    g_object_unref(texture);
+
+    // Replacing a preview drops its cached texture
+    g_assert_true(sugar_preview_store_add(store, "small", large, &error));
+    g_assert_null(sugar_preview_store_get_texture(store, "small"));
+
+    g_object_unref(store);
+    g_bytes_unref(large);
+    g_bytes_unref(small);
+    g_unlink(path);
+    g_free(path);
+}
+
+static void on_missing_loaded(GObject *source, GAsyncResult *result, gpointer user_data) {
+    gboolean *done = user_data;
+    GError *error = NULL;
+
+    g_assert_null(sugar_preview_store_load_texture_finish(SUGAR_PREVIEW_STORE(source), result, &error));
+    g_assert_error(error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND);
+    g_error_free(error);
+    *done = TRUE;
+}
+
+static void test_preview_missing(void) {
+    gchar *path = make_pack_path();
+    GError *error = NULL;
+    gboolean done = FALSE;
+
+    SugarPreviewStore *store = sugar_preview_store_new(path, &error);
+    g_assert_no_error(error);
+
+    sugar_preview_store_load_texture_async(store, "missing", NULL, on_missing_loaded, &done);
+    while (!done)
+        g_main_context_iteration(NULL, TRUE);
+
+    g_object_unref(store);
+    g_unlink(path);
+    g_free(path);
+}
+
+int main(int argc, char *argv[]) {
+    g_test_init(&argc, &argv, NULL);
+
+    g_test_add_func("/sugar/preview-store/pack", test_preview_pack);
+    g_test_add_func("/sugar/preview-store/textures", test_preview_textures);
+    g_test_add_func("/sugar/preview-store/missing", test_preview_missing);
+
+    return g_test_run();
+}
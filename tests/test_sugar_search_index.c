@@ -0,0 +1,165 @@
+#include <glib.h>
+#include <sugar-ext.h>
+#include <gio/gio.h>
+#include <sys/xattr.h>
+#include <unistd.h>
+
+static void add_entry(SugarSearchIndex *index, const gchar *path, const gchar *title, const gchar *description) {
+    SugarFileAttributes *attrs = sugar_file_attributes_new();
+    attrs->title = g_strdup(title);
+    attrs->description = g_strdup(description);
+    sugar_search_index_add(index, path, attrs);
+    sugar_file_attributes_free(attrs);
+}
+
+static void assert_results(SugarSearchIndex *index, const gchar *query, SugarSearchMatch match,
+                           const gchar * const *expected) {
+    gchar **results = sugar_search_index_query(index, query, match, 0);
+    g_assert_cmpstrv(results, expected);
+    g_strfreev(results);
+}
+
+static void test_search_queries(void) {
+    SugarSearchIndex *index = sugar_search_index_new();
+
+    add_entry(index, "/journal/1", "Drawing of a Cat", "Made in Paint");
+    add_entry(index, "/journal/2", "Cat facts", "Notes about CATS and dogs");
+    add_entry(index, "/journal/3", "Shopping list", "Cat food, milk");
+    add_entry(index, "/journal/4", "ÉCOLE", "Straße");
+    g_assert_cmpuint(sugar_search_index_get_n_entries(index), ==, 4);
+
+    // Title matches rank above description matches
+    const gchar *cat[] = { "/journal/2", "/journal/1", "/journal/3", NULL };
+    assert_results(index, "cat", SUGAR_SEARCH_MATCH_ALL, cat);
+
+    const gchar *cat_notes[] = { "/journal/2", NULL };
+    assert_results(index, "CAT notes", SUGAR_SEARCH_MATCH_ALL, cat_notes);
+
+    gchar **results = sugar_search_index_query(index, "paint milk", SUGAR_SEARCH_MATCH_ANY, 0);
+    g_assert_cmpuint(g_strv_length(results), ==, 2);
+    g_assert_true(g_strv_contains((const gchar * const *) results, "/journal/1"));
+    g_assert_true(g_strv_contains((const gchar * const *) results, "/journal/3"));
+    g_strfreev(results);
+
+    // Prefixes expand to every matching word but count once
+    const gchar *cat_prefix[] = { "/journal/2", "/journal/1", "/journal/3", NULL };
+    assert_results(index, "ca*", SUGAR_SEARCH_MATCH_ALL, cat_prefix);
+    const gchar *dog_prefix[] = { "/journal/2", NULL };
+    assert_results(index, "cat do*", SUGAR_SEARCH_MATCH_ALL, dog_prefix);
+
+    // Case folding and compatibility normalization
+    const gchar *folded[] = { "/journal/4", NULL };
+    assert_results(index, "école STRASSE", SUGAR_SEARCH_MATCH_ALL, folded);
+
+    const gchar *none[] = { NULL };
+    assert_results(index, "cat horse", SUGAR_SEARCH_MATCH_ALL, none);
+    assert_results(index, "", SUGAR_SEARCH_MATCH_ANY, none);
+
+    gchar **limited = sugar_search_index_query(index, "cat", SUGAR_SEARCH_MATCH_ALL, 1);
+    g_assert_cmpuint(g_strv_length(limited), ==, 1);
+    g_assert_cmpstr(limited[0], ==, "/journal/2");
+    g_strfreev(limited);
+
+    // Replacing and removing entries
+    add_entry(index, "/journal/2", "Horse facts", NULL);
+    const gchar *cat_or_horse[] = { "/journal/2", "/journal/1", "/journal/3", NULL };
+    assert_results(index, "cat horse", SUGAR_SEARCH_MATCH_ANY, cat_or_horse);
+    const gchar *horse[] = { "/journal/2", NULL };
+    sugar_search_index_remove(index, "/journal/1");
+    assert_results(index, "horse", SUGAR_SEARCH_MATCH_ALL, horse);
+    g_assert_cmpuint(sugar_search_index_get_n_entries(index), ==, 3);
+
+    g_object_unref(index);
+}
+
+static void test_search_compaction(void) {
+    SugarSearchIndex *index = sugar_search_index_new();
+
+    // Rewriting the same entries leaves tombstones until the rebuild
+    for (int round = 0; round < 20; round++) {
+        for (int i = 0; i < 200; i++) {
+            gchar *path = g_strdup_printf("/journal/%d", i);
+            gchar *title = g_strdup_printf("Entry %d round %d", i, round);
+            add_entry(index, path, title, "Common words");
+            g_free(title);
+            g_free(path);
+        }
+    }
+    g_assert_cmpuint(sugar_search_index_get_n_entries(index), ==, 200);
+
+    gchar **results = sugar_search_index_query(index, "round 19 entry 7", SUGAR_SEARCH_MATCH_ALL, 0);
+    g_assert_cmpuint(g_strv_length(results), ==, 1);
+    g_assert_cmpstr(results[0], ==, "/journal/7");
+    g_strfreev(results);
+
+    results = sugar_search_index_query(index, "common", SUGAR_SEARCH_MATCH_ALL, 0);
+    g_assert_cmpuint(g_strv_length(results), ==, 200);
+
+    // A limit returns the head of the full ranking
+    gchar **limited = sugar_search_index_query(index, "common round* 7", SUGAR_SEARCH_MATCH_ANY, 5);
+    gchar **full = sugar_search_index_query(index, "common round* 7", SUGAR_SEARCH_MATCH_ANY, 0);
+    g_assert_cmpuint(g_strv_length(limited), ==, 5);
+    for (int i = 0; i < 5; i++)
+        g_assert_cmpstr(limited[i], ==, full[i]);
+    g_strfreev(limited);
+    g_strfreev(full);
+    g_strfreev(results);
+
+    g_object_unref(index);
+}
+
+static void test_search_library_writes(void) {
+    gchar *temp_path = NULL;
+    gint fd = g_file_open_tmp("sugar_test_XXXXXX", &temp_path, NULL);
+    g_assert_cmpint(fd, >=, 0);
+    close(fd);
+
+    if (setxattr(temp_path, "user.sugar.probe", "1", 1, 0) != 0) {
+        unlink(temp_path);
+        g_free(temp_path);
+        g_test_skip("Extended attributes not supported on this filesystem");
+        return;
+    }
+
+    SugarSearchIndex *index = sugar_search_index_new();
+    GFile *file = g_file_new_for_path(temp_path);
+
+    // A single-field write picks up the rest of the entry from the file
+    g_assert_true(sugar_file_attributes_set_description(file, "Volcano notes"));
+    g_assert_true(sugar_file_attributes_set_title(file, "Science homework"));
+
+    const gchar *expected[] = { temp_path, NULL };
+    assert_results(index, "science volcano", SUGAR_SEARCH_MATCH_ALL, expected);
+
+    SugarFileAttributes *attrs = sugar_file_attributes_new();
+    attrs->title = g_strdup("Poem");
+    g_assert_true(sugar_file_attributes_save_to_file(attrs, file, NULL));
+    sugar_file_attributes_free(attrs);
+
+    const gchar *none[] = { NULL };
+    assert_results(index, "science", SUGAR_SEARCH_MATCH_ANY, none);
+    assert_results(index, "poem", SUGAR_SEARCH_MATCH_ALL, expected);
+
+    // Fields written before the index existed are read at the next query
+    g_object_unref(index);
+    g_assert_true(sugar_file_attributes_set_title(file, "Field trip"));
+    index = sugar_search_index_new();
+    g_assert_true(sugar_file_attributes_set_description(file, "Museum visit"));
+    assert_results(index, "trip museum", SUGAR_SEARCH_MATCH_ALL, expected);
+    g_assert_cmpuint(sugar_search_index_get_n_entries(index), ==, 1);
+
+    g_object_unref(file);
+    g_object_unref(index);
+    unlink(temp_path);
+    g_free(temp_path);
+}
+
+int main(int argc, char *argv[]) {
+    g_test_init(&argc, &argv, NULL);
+
+    g_test_add_func("/sugar/search-index/queries", test_search_queries);
+    g_test_add_func("/sugar/search-index/compaction", test_search_compaction);
+    g_test_add_func("/sugar/search-index/library-writes", test_search_library_writes);
+
+    return g_test_run();
+}
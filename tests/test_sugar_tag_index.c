@@ -0,0 +1,151 @@
+#include <glib.h>
+#include <sugar-ext.h>
+#include <gio/gio.h>
+#include <sys/xattr.h>
+#include <unistd.h>
+
+static void assert_query(SugarTagIndex *index,
+                         const gchar * const *all_of,
+                         const gchar * const *any_of,
+                         const gchar * const *none_of,
+                         const gchar * const *expected) {
+    gchar **results = sugar_tag_index_query(index, all_of, any_of, none_of);
+    g_assert_cmpstrv(results, expected);
+    g_strfreev(results);
+}
+
+static void test_tag_queries(void) {
+    SugarTagIndex *index = sugar_tag_index_new();
+
+    sugar_tag_index_add(index, "/journal/1", "math, Homework");
+    sugar_tag_index_add(index, "/journal/2", "art,homework,MATH");
+    sugar_tag_index_add(index, "/journal/3", "art");
+    sugar_tag_index_add(index, "/journal/4", NULL);
+    g_assert_cmpuint(sugar_tag_index_get_n_entries(index), ==, 4);
+
+    // Tags are compared in canonical form
+    g_assert_cmpuint(sugar_tag_index_get_count(index, "HOMEWORK "), ==, 2);
+    g_assert_cmpuint(sugar_tag_index_get_count(index, "music"), ==, 0);
+    gchar **tags = sugar_tag_index_get_tags(index);
+    const gchar *all_tags[] = { "art", "homework", "math", NULL };
+    g_assert_cmpstrv(tags, all_tags);
+    g_strfreev(tags);
+
+    const gchar *math_art[] = { "math", "art", NULL };
+    const gchar *both[] = { "/journal/2", NULL };
+    assert_query(index, math_art, NULL, NULL, both);
+
+    const gchar *either[] = { "/journal/1", "/journal/2", "/journal/3", NULL };
+    assert_query(index, NULL, math_art, NULL, either);
+
+    const gchar *math[] = { "Math", NULL };
+    const gchar *untagged_or_art[] = { "/journal/3", "/journal/4", NULL };
+    assert_query(index, NULL, NULL, math, untagged_or_art);
+
+    const gchar *music[] = { "music", NULL };
+    const gchar *none[] = { NULL };
+    assert_query(index, music, NULL, NULL, none);
+
+    // Replacing and removing entries updates every tag
+    sugar_tag_index_add(index, "/journal/2", "music");
+    sugar_tag_index_remove(index, "/journal/1");
+    g_assert_cmpuint(sugar_tag_index_get_count(index, "math"), ==, 0);
+    g_assert_cmpuint(sugar_tag_index_get_count(index, "homework"), ==, 0);
+    const gchar *music_only[] = { "/journal/2", NULL };
+    assert_query(index, NULL, music, NULL, music_only);
+
+    g_object_unref(index);
+}
+
+static void test_tag_large_sets(void) {
+    SugarTagIndex *index = sugar_tag_index_new();
+    const guint n_entries = 150000;
+
+    // Enough entries for several containers, both sparse and dense
+    for (guint i = 0; i < n_entries; i++) {
+        gchar *path = g_strdup_printf("/journal/%u", i);
+        const gchar *tags = i % 2 == 0 ? (i % 1000 == 0 ? "even,round" : "even") : "odd";
+        sugar_tag_index_add(index, path, tags);
+        g_free(path);
+    }
+
+    g_assert_cmpuint(sugar_tag_index_get_count(index, "even"), ==, n_entries / 2);
+    g_assert_cmpuint(sugar_tag_index_get_count(index, "round"), ==, n_entries / 1000);
+
+    const gchar *round[] = { "round", NULL };
+    const gchar *even[] = { "even", NULL };
+    const gchar *odd[] = { "odd", NULL };
+    gchar **results = sugar_tag_index_query(index, even, NULL, round);
+    g_assert_cmpuint(g_strv_length(results), ==, n_entries / 2 - n_entries / 1000);
+    g_strfreev(results);
+
+    results = sugar_tag_index_query(index, odd, round, NULL);
+    g_assert_cmpuint(g_strv_length(results), ==, 0);
+    g_strfreev(results);
+
+    const gchar *even_odd[] = { "even", "odd", NULL };
+    results = sugar_tag_index_query(index, NULL, even_odd, NULL);
+    g_assert_cmpuint(g_strv_length(results), ==, n_entries);
+    g_assert_cmpstr(results[0], ==, "/journal/0");
+    g_assert_cmpstr(results[n_entries - 1], ==, "/journal/149999");
+    g_strfreev(results);
+
+    // Shrinking a dense tag keeps counts exact
+    for (guint i = 0; i < n_entries; i += 2) {
+        if (i % 1000 == 0)
+            continue;
+        gchar *path = g_strdup_printf("/journal/%u", i);
+        sugar_tag_index_remove(index, path);
+        g_free(path);
+    }
+    g_assert_cmpuint(sugar_tag_index_get_count(index, "even"), ==, n_entries / 1000);
+    results = sugar_tag_index_query(index, even, NULL, NULL);
+    g_assert_cmpstr(results[1], ==, "/journal/1000");
+    g_strfreev(results);
+
+    g_object_unref(index);
+}
+
+static void test_tag_library_writes(void) {
+    gchar *temp_path = NULL;
+    gint fd = g_file_open_tmp("sugar_test_XXXXXX", &temp_path, NULL);
+    g_assert_cmpint(fd, >=, 0);
+    close(fd);
+
+    if (setxattr(temp_path, "user.sugar.probe", "1", 1, 0) != 0) {
+        unlink(temp_path);
+        g_free(temp_path);
+        g_test_skip("Extended attributes not supported on this filesystem");
+        return;
+    }
+
+    SugarTagIndex *index = sugar_tag_index_new();
+    GFile *file = g_file_new_for_path(temp_path);
+    const gchar *science[] = { "science", NULL };
+    const gchar *expected[] = { temp_path, NULL };
+    const gchar *none[] = { NULL };
+    const gchar *first_tags[] = { "Science", "volcano", NULL };
+    const gchar *second_tags[] = { "poetry", NULL };
+
+    g_assert_true(sugar_file_attributes_set_tags(file, first_tags));
+    assert_query(index, science, NULL, NULL, expected);
+
+    g_assert_true(sugar_file_attributes_set_tags(file, second_tags));
+    assert_query(index, science, NULL, NULL, none);
+    g_assert_cmpuint(sugar_tag_index_get_count(index, "poetry"), ==, 1);
+
+    g_object_unref(file);
+    g_object_unref(index);
+    unlink(temp_path);
+    g_free(temp_path);
+}
+
+int main(int argc, char *argv[]) {
+    g_test_init(&argc, &argv, NULL);
+
+    g_test_add_func("/sugar/tag-index/queries", test_tag_queries);
+    g_test_add_func("/sugar/tag-index/large-sets", test_tag_large_sets);
+    g_test_add_func("/sugar/tag-index/library-writes", test_tag_library_writes);
+
+    return g_test_run();
+}
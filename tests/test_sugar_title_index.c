@@ -0,0 +1,139 @@
+#include <glib.h>
+#include <sugar-ext.h>
+#include <gio/gio.h>
+#include <fcntl.h>
+#include <sys/xattr.h>
+#include <unistd.h>
+
+static void assert_page(SugarTitleIndex *index, guint offset, guint n_results, const gchar * const *expected) {
+    gchar **results = sugar_title_index_get_results(index, offset, n_results);
+    g_assert_cmpstrv(results, expected);
+    g_strfreev(results);
+}
+
+static SugarTitleIndex *create_index(void) {
+    SugarTitleIndex *index = sugar_title_index_new();
+
+    sugar_title_index_add(index, "/journal/1", "Paint drawing");
+    sugar_title_index_add(index, "/journal/2", "Painting the Café");
+    sugar_title_index_add(index, "/journal/3", "Turtle art");
+    sugar_title_index_add(index, "/journal/4", "A pain in the neck");
+    sugar_title_index_add(index, "/journal/5", NULL);
+    return index;
+}
+
+static void test_title_substrings(void) {
+    SugarTitleIndex *index = create_index();
+    g_assert_cmpuint(sugar_title_index_get_n_entries(index), ==, 5);
+
+    // Short queries check every title
+    sugar_title_index_set_query(index, "a");
+    g_assert_cmpuint(sugar_title_index_get_n_results(index), ==, 4);
+
+    // Substrings match inside words and across them
+    sugar_title_index_set_query(index, "INT D");
+    const gchar *across[] = { "/journal/1", NULL };
+    assert_page(index, 0, 10, across);
+
+    sugar_title_index_set_query(index, "café");
+    const gchar *accented[] = { "/journal/2", NULL };
+    assert_page(index, 0, 10, accented);
+
+    sugar_title_index_set_query(index, "zebra");
+    const gchar *none[] = { NULL };
+    assert_page(index, 0, 10, none);
+    g_assert_cmpuint(sugar_title_index_get_n_results(index), ==, 0);
+
+    g_object_unref(index);
+}
+
+static void test_title_typing(void) {
+    SugarTitleIndex *index = create_index();
+
+    // Each keystroke narrows the previous candidates
+    sugar_title_index_set_query(index, "p");
+    const gchar *first_page[] = { "/journal/1", "/journal/2", NULL };
+    assert_page(index, 0, 2, first_page);
+
+    sugar_title_index_set_query(index, "pa");
+    sugar_title_index_set_query(index, "pai");
+    sugar_title_index_set_query(index, "pain");
+    const gchar *pain[] = { "/journal/1", "/journal/2", "/journal/4", NULL };
+    assert_page(index, 0, 10, pain);
+
+    sugar_title_index_set_query(index, "paint");
+    const gchar *paint_second[] = { "/journal/2", NULL };
+    assert_page(index, 1, 10, paint_second);
+    g_assert_cmpuint(sugar_title_index_get_n_results(index), ==, 2);
+
+    // Deleting characters starts over
+    sugar_title_index_set_query(index, "pai");
+    g_assert_cmpuint(sugar_title_index_get_n_results(index), ==, 3);
+
+    // Changes to the entries apply to the current query
+    sugar_title_index_add(index, "/journal/3", "Painted turtle");
+    sugar_title_index_remove(index, "/journal/1");
+    const gchar *changed[] = { "/journal/2", "/journal/4", "/journal/3", NULL };
+    assert_page(index, 0, 10, changed);
+
+    g_object_unref(index);
+}
+
+static void test_title_library_writes(void) {
+    gchar *temp_path = NULL;
+    gint fd = g_file_open_tmp("sugar_test_XXXXXX", &temp_path, NULL);
+    g_assert_cmpint(fd, >=, 0);
+    close(fd);
+
+    if (setxattr(temp_path, "user.sugar.probe", "1", 1, 0) != 0) {
+        unlink(temp_path);
+        g_free(temp_path);
+        g_test_skip("Extended attributes not supported on this filesystem");
+        return;
+    }
+
+    SugarTitleIndex *index = sugar_title_index_new();
+    GFile *file = g_file_new_for_path(temp_path);
+
+    g_assert_true(sugar_file_attributes_set_title(file, "Volcano report"));
+    sugar_title_index_set_query(index, "canO");
+    const gchar *expected[] = { temp_path, NULL };
+    assert_page(index, 0, 10, expected);
+
+    g_assert_true(sugar_file_attributes_set_title(file, "Poem"));
+    g_assert_cmpuint(sugar_title_index_get_n_results(index), ==, 0);
+
+    // Saves through descriptors are seen under the same path
+    SugarFileAttributes *attrs = sugar_file_attributes_new();
+    sugar_file_attributes_set_string(attrs, SUGAR_FILE_ATTRIBUTE_TITLE, "Volcano poem");
+    fd = open(temp_path, O_RDONLY);
+    g_assert_true(sugar_file_attributes_save_to_fd(attrs, fd, NULL));
+    close(fd);
+    assert_page(index, 0, 10, expected);
+
+    gchar *dirname = g_path_get_dirname(temp_path);
+    gchar *basename = g_path_get_basename(temp_path);
+    gint dirfd = open(dirname, O_RDONLY | O_DIRECTORY);
+    sugar_file_attributes_set_string(attrs, SUGAR_FILE_ATTRIBUTE_TITLE, "Poem");
+    g_assert_true(sugar_file_attributes_save_at(attrs, dirfd, basename, NULL));
+    g_assert_cmpuint(sugar_title_index_get_n_results(index), ==, 0);
+    close(dirfd);
+    g_free(basename);
+    g_free(dirname);
+    sugar_file_attributes_free(attrs);
+
+    g_object_unref(file);
+    g_object_unref(index);
+    unlink(temp_path);
+    g_free(temp_path);
+}
+
+int main(int argc, char *argv[]) {
+    g_test_init(&argc, &argv, NULL);
+
+    g_test_add_func("/sugar/title-index/substrings", test_title_substrings);
+    g_test_add_func("/sugar/title-index/typing", test_title_typing);
+    g_test_add_func("/sugar/title-index/library-writes", test_title_library_writes);
+
+    return g_test_run();
+}